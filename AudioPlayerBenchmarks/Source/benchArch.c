@@ -0,0 +1,250 @@
+//
+//  benchArch.c
+//  AudioPlayerBenchmarks
+//
+//  Compares the four player architectures under identical load. Each player
+//  is run as a child process on every combination of the given audio files
+//  and buffer sizes, with its output going to an offline sink (BAP_OUTPUT,
+//  null by default) paced in real time (BAP_RENDER_SPEED, realtime by
+//  default) so that callback timing is meaningful. The statistics each
+//  player writes to BAP_STATS are combined with the child's resource usage
+//  from wait4() (CPU time, context switches, peak RSS) and printed to stdout
+//  as a JSON array; progress goes to stderr. With BAP_BENCH_CACHE=cold each
+//  file is dropped from the page cache before every run (Linux), so that
+//  the players start on cold storage, as they would on a slow or network
+//  disk.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "audioPlayerUtil.h"
+#include "playerConfig.h"
+#include "benchmarks.h"
+
+// The players, in the order they are run
+static const char *players[] = {
+    "BasicAudioPlayerBlocking",
+    "BasicAudioPlayerCallback",
+    "BasicAudioPlayerCallbackMainBuffer",
+    "BasicAudioPlayerCallbackThreaded"
+};
+
+#define NUM_PLAYERS (sizeof(players) / sizeof(players[0]))
+#define MAX_BUFFER_SIZES (16)
+
+// struct type for the result of one run
+struct archRun {
+    int             status;     // exit code, or -1 if it did not exit normally
+    double          wallTime;   // s
+    struct rusage   usage;
+};
+
+// Wall clock (s)
+static double getWallTime(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Write a string as a JSON string
+static void printJsonString(const char *str) {
+    
+    putchar('"');
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            printf("\\%c", *c);
+        else if (*c < 0x20)
+            printf("\\u%04x", *c);
+        else
+            putchar(*c);
+    }
+    putchar('"');
+}
+
+// Copy a file to stdout, indented, or print null if it is empty or missing
+static void printStatsFile(const char *fileName) {
+    
+    FILE *file = fopen(fileName, "r");
+    int c, empty = 1, lineStart = 0;
+    
+    while (file != NULL && (c = fgetc(file)) != EOF) {
+        if (c == '\n' && empty)
+            continue;
+        if (lineStart)
+            fputs("    ", stdout);
+        putchar(c);
+        empty = 0;
+        lineStart = c == '\n';
+    }
+    if (empty)
+        fputs("null\n", stdout);
+    if (file != NULL)
+        fclose(file);
+}
+
+// Run one player on one file; returns an error code
+static int runPlayer(
+    const char *playerPath,
+    const char *audioFile,
+    const char *statsFile,
+    struct archRun *run
+) {
+    
+    // start from an empty statistics file, so a failed run leaves nothing
+    int fd = open(statsFile, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return ERR_OPENING_FILE;
+    close(fd);
+    
+    double start = getWallTime();
+    pid_t pid = fork();
+    if (pid < 0)
+        return ERR_BAD_ALLOC;
+    
+    if (pid == 0) {
+        // child: quiet, and with nothing to read on stdin
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execl(playerPath, playerPath, audioFile, (char *) NULL);
+        _exit(127);
+    }
+    
+    int status;
+    if (wait4(pid, &status, 0, &run->usage) != pid)
+        return ERR_BAD_ALLOC;
+    run->wallTime = getWallTime() - start;
+    run->status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    
+    return NO_ERROR;
+}
+
+// Print the result of one run as a JSON object
+static void printRun(
+    const char *player,
+    const char *audioFile,
+    unsigned long framesPerBuffer,
+    const struct archRun *run,
+    const char *statsFile,
+    int cold
+) {
+    
+    // ru_maxrss is in bytes on macOS and KiB elsewhere
+#if defined(__APPLE__)
+    long maxRssKiB = run->usage.ru_maxrss / 1024;
+#else
+    long maxRssKiB = run->usage.ru_maxrss;
+#endif
+    
+    printf("  {\n    \"player\": \"%s\",\n    \"cache\": \"%s\",\n"
+        "    \"file\": ", player, cold ? "cold" : "warm");
+    printJsonString(audioFile);
+    printf(",\n"
+        "    \"framesPerBuffer\": %lu,\n"
+        "    \"exitStatus\": %d,\n"
+        "    \"wallSeconds\": %.3f,\n"
+        "    \"userSeconds\": %.3f,\n"
+        "    \"systemSeconds\": %.3f,\n"
+        "    \"maxRssKiB\": %ld,\n"
+        "    \"voluntaryContextSwitches\": %ld,\n"
+        "    \"involuntaryContextSwitches\": %ld,\n"
+        "    \"stats\": ",
+        framesPerBuffer,
+        run->status,
+        run->wallTime,
+        run->usage.ru_utime.tv_sec + run->usage.ru_utime.tv_usec * 1e-6,
+        run->usage.ru_stime.tv_sec + run->usage.ru_stime.tv_usec * 1e-6,
+        maxRssKiB,
+        run->usage.ru_nvcsw,
+        run->usage.ru_nivcsw);
+    printStatsFile(statsFile);
+    printf("  }");
+}
+
+// Compare the player architectures over files and buffer sizes
+int benchArch(int argc, char *argv[]) {
+    
+    if (argc < 3)
+        return ERR_BAD_COMMAND_LINE;
+    
+    // buffer sizes, e.g. 256,512,1024
+    unsigned long bufferSizes[MAX_BUFFER_SIZES];
+    int numBufferSizes = 0;
+    for (char *size = argv[1]; *size != '\0' && numBufferSizes < MAX_BUFFER_SIZES; ) {
+        char *end;
+        bufferSizes[numBufferSizes] = strtoul(size, &end, 10);
+        if (end == size || bufferSizes[numBufferSizes] == 0)
+            return ERR_BAD_COMMAND_LINE;
+        numBufferSizes++;
+        size = *end == ',' ? end + 1 : end;
+    }
+    
+    // check the players are there before running anything
+    char playerPaths[NUM_PLAYERS][4096];
+    for (size_t p = 0; p < NUM_PLAYERS; p++) {
+        snprintf(playerPaths[p], sizeof(playerPaths[p]), "%s/%s", argv[0],
+            players[p]);
+        if (access(playerPaths[p], X_OK) != 0) {
+            fprintf(stderr, "Cannot run %s\n", playerPaths[p]);
+            return ERR_OPENING_FILE;
+        }
+    }
+    
+    char statsFile[] = "/tmp/bapStatsXXXXXX";
+    int fd = mkstemp(statsFile);
+    if (fd < 0)
+        return ERR_OPENING_FILE;
+    close(fd);
+    
+    // same load for every player: offline, in real time, unless overridden
+    setenv("BAP_OUTPUT", "null", 0);
+    setenv("BAP_RENDER_SPEED", "realtime", 0);
+    setenv("BAP_STATS", statsFile, 1);
+    int cold = strcmp(getConfigString("BAP_BENCH_CACHE", "warm"), "cold") == 0;
+    
+    int err = NO_ERROR, first = 1;
+    printf("[\n");
+    for (int f = 2; f < argc && !err; f++) {
+        for (int b = 0; b < numBufferSizes && !err; b++) {
+            char frames[32];
+            snprintf(frames, sizeof(frames), "%lu", bufferSizes[b]);
+            setenv("BAP_FRAMES_PER_BUFFER", frames, 1);
+    
+            for (size_t p = 0; p < NUM_PLAYERS && !err; p++) {
+                fprintf(stderr, "%s %s, %lu frames per buffer\n", players[p],
+                    argv[f], bufferSizes[b]);
+    
+                if (cold && !evictFile(argv[f]))
+                    fprintf(stderr, "Cannot drop %s from the page cache\n",
+                        argv[f]);
+    
+                struct archRun run;
+                err = runPlayer(playerPaths[p], argv[f], statsFile, &run);
+                if (err)
+                    break;
+    
+                printf(first ? "" : ",\n");
+                printRun(players[p], argv[f], bufferSizes[b], &run, statsFile,
+                    cold);
+                first = 0;
+                fflush(stdout);
+            }
+        }
+    }
+    printf("\n]\n");
+    
+    unlink(statsFile);
+    
+    return err;
+}
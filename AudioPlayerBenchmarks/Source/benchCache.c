@@ -0,0 +1,28 @@
+//
+//  benchCache.c
+//  AudioPlayerBenchmarks
+//
+//  Page cache control shared by the benchmarks that read files, for runs
+//  with BAP_BENCH_CACHE=cold.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "benchmarks.h"
+
+// Drop a file from the page cache
+int evictFile(const char *fileName) {
+    
+#if defined(__linux__)
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    int evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    
+    return evicted;
+#else
+    (void) fileName;
+    return 0;
+#endif
+}
@@ -0,0 +1,127 @@
+//
+//  benchFormat.c
+//  AudioPlayerBenchmarks
+//
+//  Streams an audio file through a frame ring buffer the way the ring-buffer
+//  players do (reader fills the ring, callback-sized reads drain it), once
+//  with the samples converted to float and once in the file's native sample
+//  format, and reports the ring's memory, the bytes moved through it and the
+//  CPU time spent reading the file.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "audioPlayerUtil.h"
+#include "frameRingBuffer.h"
+#include "playerStream.h"
+#include "benchmarks.h"
+
+// Constants
+#define DEFAULT_PASSES (10)
+#define RING_SECONDS (0.5)
+
+// Stream the file through a ring in the given format; returns an error code
+static int runFormat(
+    struct audioFileInfo *audioFile,
+    PaSampleFormat format,
+    int passes
+) {
+    
+    int err = setSampleFormat(audioFile, format);
+    if (err)
+        return err;
+    
+    struct frameRingBuffer *ring = createFrameRingBuffer(
+        nextPowerOf2((unsigned) (audioFile->sRate * RING_SECONDS)),
+        audioFile->bytesPerFrame
+    );
+    void *out = malloc(audioFile->bytesPerFrame * FRAMES_PER_BUFFER);
+    if (ring == NULL || out == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    
+    double readerTime = 0.0, drainTime = 0.0;
+    size_t framesMoved = 0;
+    
+    for (int pass = 0; pass < passes; pass++) {
+        seekAudioFile(audioFile, 0);
+    
+        sf_count_t framesRead;
+        do {
+            // reader: fill the ring
+            void* ptr[2] = {0};
+            size_t sizes[2] = {0};
+            getFrameRingBufferWriteRegions(ring, ring->frames,
+                ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+            double t0 = getThreadTime();
+            framesRead = 0;
+            for (int i = 0; i < 2 && ptr[i] != NULL; ++i)
+                framesRead += readAudioFile(audioFile, ptr[i], (sf_count_t) sizes[i]);
+            advanceFrameRingBufferWriteIndex(ring, (size_t) framesRead);
+            double t1 = getThreadTime();
+    
+            // callback: drain it in buffer-sized blocks
+            size_t frames;
+            while ((frames = readFrameRingBuffer(ring, out, FRAMES_PER_BUFFER)) > 0)
+                framesMoved += frames;
+            double t2 = getThreadTime();
+    
+            readerTime += t1 - t0;
+            drainTime += t2 - t1;
+        } while (framesRead > 0);
+    }
+    
+    // each frame is written to and read from the ring once
+    double megabytes = 2.0 * framesMoved * audioFile->bytesPerFrame / 1e6;
+    double audioSeconds = (double) framesMoved / audioFile->sRate;
+    
+    printf("%-9s %10.1f %10.1f %12.1f %14.3f %12.0f\n",
+        getSampleFormatName(format),
+        ring->frames * ring->bytesPerFrame / 1024.0,
+        megabytes,
+        drainTime > 0.0 ? megabytes / 2.0 / drainTime / 1e3 : 0.0,
+        1e3 * readerTime / audioSeconds,
+        readerTime > 0.0 ? audioSeconds / readerTime : 0.0);
+    
+cleanup:
+    free(out);
+    freeFrameRingBuffer(ring);
+    
+    return err;
+}
+
+// Compare streaming float samples with the file's native format
+int benchFormat(int argc, char *argv[]) {
+    
+    if (argc < 1)
+        return ERR_BAD_COMMAND_LINE;
+    
+    int passes = argc > 1 ? atoi(argv[1]) : DEFAULT_PASSES;
+    if (passes < 1)
+        return ERR_BAD_COMMAND_LINE;
+    
+    struct audioFileInfo audioFile = {
+        .buffer = NULL,
+        .fileID = NULL
+    };
+    int err = openAudioFile(argv[0], &audioFile, OFFLINE_MAX_CHANNELS);
+    if (err)
+        goto cleanup;
+    
+    printf("%u channels, %d Hz, %lld frames, native format %s, %d passes\n",
+        audioFile.channels, audioFile.sRate, (long long) audioFile.frames,
+        getSampleFormatName(audioFile.nativeFormat), passes);
+    printf("%-9s %10s %10s %12s %14s %12s\n", "format", "ring KiB",
+        "MB moved", "drain GB/s", "reader ms/s", "x real time");
+    
+    err = runFormat(&audioFile, paFloat32, passes);
+    if (!err && audioFile.nativeFormat != paFloat32)
+        err = runFormat(&audioFile, audioFile.nativeFormat, passes);
+    
+cleanup:
+    closeAudioFile(&audioFile);
+    
+    return err;
+}
@@ -0,0 +1,361 @@
+//
+//  benchKernels.c
+//  AudioPlayerBenchmarks
+//
+//  Checks every kernel set this CPU can run against the scalar reference
+//  (audioKernels.h), bit for bit, then times each kernel of each set on
+//  buffers of a given size. The check covers every length up to a few
+//  registers and a range of channel counts, so the vector loops and the
+//  scalar code that finishes them both run, on samples that include full
+//  scale, values beyond it, ties in rounding, infinities and NaN.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audioPlayerUtil.h"
+#include "audioKernels.h"
+#include "benchmarks.h"
+
+// Constants
+#define DEFAULT_SAMPLES (4096)      // a 512-frame buffer of 8 channels
+#define DEFAULT_SECONDS (0.2)       // per kernel and set
+#define CHECK_SAMPLES (200)         // longest check, in samples
+#define MAX_CHANNELS (8)
+#define MAX_SETS (4)
+#define GUARD_BYTES (64)            // checked for writes past the output
+
+// Kernels, as used by the check and the timing
+typedef enum {
+    K_GAIN_RAMP,
+    K_MIX,
+    K_INTERLEAVE,
+    K_DEINTERLEAVE,
+    K_TO_INT16,
+    K_TO_INT24,
+    K_TO_INT32,
+    K_FROM_INT16,
+    K_FROM_INT24,
+    K_FROM_INT32,
+    K_PEAK_RMS,
+    K_DOT_PRODUCT,
+    NUM_KERNELS
+} kernelType;
+
+static const char *kernelNames[NUM_KERNELS] = {
+    "gainRamp", "mixAccumulate", "interleave", "deinterleave",
+    "floatToInt16", "floatToInt24", "floatToInt32",
+    "int16ToFloat", "int24ToFloat", "int32ToFloat", "peakRms", "dotProduct"
+};
+
+// struct type for the buffers a kernel runs on
+struct kernelBuffers {
+    float           *in;            // float samples
+    float           *coefs;         // more, for dotProduct
+    unsigned char   *ints;          // the same as int16, int24 or int32
+    float           *planes[MAX_CHANNELS];
+    unsigned char   *out;           // whatever the kernel writes
+    size_t          outSize;
+};
+
+// Monotonic time (s)
+static double getTime(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Fill with samples, mostly in [-1.25, 1.25), from a fixed seed
+static void makeSamples(float *x, size_t n, int special) {
+    
+    unsigned int seed = 12345;
+    
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (float) ((seed >> 8) & 0xffff) / 26214.4f - 1.25f;
+    }
+    
+    if (!special)
+        return;
+    
+    // edge cases, spread so that they land in every lane
+    const float edges[] = {
+        1.0f, -1.0f, 0.0f, -0.0f, 0.5f / 32768.0f, 1.5f / 32768.0f,
+        -2.5f / 32768.0f, 0.5f / 8388608.0f, 1.0f - 1.0f / 32768.0f,
+        1e30f, -1e30f, INFINITY, -INFINITY, NAN, 1e-40f
+    };
+    size_t numEdges = sizeof(edges) / sizeof(edges[0]);
+    for (size_t i = 0; i < n; i += 7)
+        x[i] = edges[(i / 7) % numEdges];
+}
+
+// Run one kernel of a set on n samples (frames * channels)
+static void runKernel(
+    const struct audioKernels *k,
+    kernelType type,
+    struct kernelBuffers *b,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    size_t n = frames * channels;
+    float *out = (float *) b->out;
+    
+    switch (type) {
+        case K_GAIN_RAMP:
+            k->gainRamp(out, b->in, frames, channels, 0.25f, 1.0f / 480.0f);
+            break;
+        case K_MIX:
+            k->mixAccumulate(out, b->in, n, 0.001f);
+            break;
+        case K_INTERLEAVE:
+            k->interleave(out, (const float *const *) b->planes, frames,
+                channels);
+            break;
+        case K_DEINTERLEAVE: {
+            float *planes[MAX_CHANNELS];
+            for (unsigned int c = 0; c < channels; c++)
+                planes[c] = out + c * frames;
+            k->deinterleave(planes, b->in, frames, channels);
+            break;
+        }
+        case K_TO_INT16:
+            k->floatToInt16((int16_t *) b->out, b->in, n);
+            break;
+        case K_TO_INT24:
+            k->floatToInt24(b->out, b->in, n);
+            break;
+        case K_TO_INT32:
+            k->floatToInt32((int32_t *) b->out, b->in, n);
+            break;
+        case K_FROM_INT16:
+            k->int16ToFloat(out, (const int16_t *) b->ints, n);
+            break;
+        case K_FROM_INT24:
+            k->int24ToFloat(out, b->ints, n);
+            break;
+        case K_FROM_INT32:
+            k->int32ToFloat(out, (const int32_t *) b->ints, n);
+            break;
+        case K_PEAK_RMS: {
+            float peak;
+            double sumSquares;
+            k->peakRms(b->in, n, &peak, &sumSquares);
+            memcpy(b->out, &peak, sizeof(peak));
+            memcpy(b->out + sizeof(peak), &sumSquares, sizeof(sumSquares));
+            break;
+        }
+        case K_DOT_PRODUCT: {
+            float sum = k->dotProduct(b->in, b->coefs, n);
+            memcpy(b->out, &sum, sizeof(sum));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Bytes a kernel writes for n samples
+static size_t getOutputSize(kernelType type, size_t n) {
+    
+    switch (type) {
+        case K_TO_INT16:
+            return n * 2;
+        case K_TO_INT24:
+            return n * 3;
+        case K_PEAK_RMS:
+            return sizeof(float) + sizeof(double);
+        case K_DOT_PRODUCT:
+            return sizeof(float);
+        default:
+            return n * sizeof(float);
+    }
+}
+
+// Random bytes, which are random samples over the whole range of each
+// integer format
+static void makeInts(unsigned char *x, size_t bytes) {
+    
+    unsigned int seed = 777;
+    
+    for (size_t i = 0; i < bytes; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (unsigned char) (seed >> 16);
+    }
+}
+
+// Fill the output before a run: guard bytes, except for the samples that
+// mixAccumulate adds to
+static void resetOutput(kernelType type, struct kernelBuffers *b, size_t n) {
+    
+    memset(b->out, 0x5a, getOutputSize(type, n) + GUARD_BYTES);
+    if (type == K_MIX) {
+        for (size_t i = 0; i < n; i++)
+            ((float *) b->out)[i] = b->in[n - 1 - i];
+    }
+}
+
+// Channel counts a kernel is checked with
+static unsigned int getMaxCheckChannels(kernelType type) {
+    
+    switch (type) {
+        case K_GAIN_RAMP:
+        case K_INTERLEAVE:
+        case K_DEINTERLEAVE:
+            return MAX_CHANNELS;
+        default:
+            return 1;
+    }
+}
+
+// Compare a set with the scalar one; returns the number of runs that differ
+static int checkSet(
+    const struct audioKernels *ref,
+    const struct audioKernels *k,
+    kernelType type,
+    struct kernelBuffers *b,
+    unsigned char *expected
+) {
+    
+    int failures = 0;
+    
+    for (unsigned int ch = 1; ch <= getMaxCheckChannels(type); ch++) {
+        for (size_t frames = 0; frames * ch <= CHECK_SAMPLES; frames++) {
+            size_t n = frames * ch;
+            size_t size = getOutputSize(type, n);
+            for (unsigned int c = 0; c < ch; c++)
+                b->planes[c] = b->in + c * frames;
+    
+            // the whole output, and nothing written past it
+            resetOutput(type, b, n);
+            runKernel(ref, type, b, frames, ch);
+            memcpy(expected, b->out, size + GUARD_BYTES);
+            resetOutput(type, b, n);
+            runKernel(k, type, b, frames, ch);
+            if (memcmp(b->out, expected, size + GUARD_BYTES) != 0) {
+                if (failures == 0)
+                    printf("  %s %s differs from scalar: %zu frames of %u "
+                        "channels\n", k->name, kernelNames[type], frames, ch);
+                failures++;
+            }
+        }
+    }
+    
+    return failures;
+}
+
+// Time one kernel of a set; returns samples per second
+static double timeKernel(
+    const struct audioKernels *k,
+    kernelType type,
+    struct kernelBuffers *b,
+    size_t samples,
+    double seconds
+) {
+    
+    size_t calls = 0, batch = 16;
+    double start = getTime(), elapsed;
+    
+    for (unsigned int c = 0; c < 2; c++)
+        b->planes[c] = b->in + c * (samples / 2);
+    memset(b->out, 0, b->outSize);
+    
+    // stereo for the kernels that care about channels
+    do {
+        for (size_t i = 0; i < batch; i++)
+            runKernel(k, type, b, samples / 2, 2);
+        calls += batch;
+        elapsed = getTime() - start;
+    } while (elapsed < seconds);
+    
+    return calls * (double) (samples / 2 * 2) / elapsed;
+}
+
+// MAIN
+int benchKernels(int argc, char *argv[]) {
+    
+    size_t samples = argc >= 1 ? (size_t) atol(argv[0]) : DEFAULT_SAMPLES;
+    double seconds = argc >= 2 ? atof(argv[1]) : DEFAULT_SECONDS;
+    if (samples < 2 || seconds <= 0.0) {
+        printf("Usage: kernels [samples per call] [seconds per kernel]\n");
+        return ERR_BAD_COMMAND_LINE;
+    }
+    
+    const struct audioKernels *sets[MAX_SETS];
+    int numSets = getAudioKernelSets(sets, MAX_SETS);
+    const struct audioKernels *chosen = getAudioKernels();
+    
+    // the output has room for the guard bytes after it
+    size_t length = samples > CHECK_SAMPLES ? samples : CHECK_SAMPLES;
+    struct kernelBuffers b = {0};
+    b.outSize = length * sizeof(float) + sizeof(double) + GUARD_BYTES;
+    b.in = malloc(length * sizeof(float));
+    b.coefs = malloc(length * sizeof(float));
+    b.ints = malloc(length * 4);
+    b.out = malloc(b.outSize);
+    unsigned char *expected = malloc(b.outSize);
+    if (b.in == NULL || b.coefs == NULL || b.ints == NULL || b.out == NULL ||
+            expected == NULL) {
+        free(b.in);
+        free(b.coefs);
+        free(b.ints);
+        free(b.out);
+        free(expected);
+        return ERR_BAD_ALLOC;
+    }
+    
+    printf("Kernel sets:");
+    for (int s = 0; s < numSets; s++)
+        printf(" %s", sets[s]->name);
+    printf(" (players use %s)\n", chosen->name);
+    
+    // bit-exactness against the scalar set
+    int failures = 0;
+    makeSamples(b.in, length, 1);
+    makeSamples(b.coefs, length, 0);
+    makeInts(b.ints, length * 4);
+    for (int type = 0; type < NUM_KERNELS; type++) {
+        for (int s = 1; s < numSets; s++)
+            failures += checkSet(sets[0], sets[s], (kernelType) type, &b,
+                expected);
+    }
+    if (failures == 0)
+        printf("All sets match scalar bit for bit\n");
+    else
+        printf("%d checks differ from scalar\n", failures);
+    
+    // speed, on ordinary samples
+    printf("\n%-14s", "Msamples/s");
+    for (int s = 0; s < numSets; s++)
+        printf(" %10s%9s", sets[s]->name, "");
+    printf("   (%zu samples per call)\n", samples);
+    makeSamples(b.in, length, 0);
+    for (int type = 0; type < NUM_KERNELS; type++) {
+        printf("%-14s", kernelNames[type]);
+        double scalar = 0.0;
+        for (int s = 0; s < numSets; s++) {
+            double rate = timeKernel(sets[s], (kernelType) type, &b, samples,
+                seconds);
+            if (s == 0)
+                scalar = rate;
+            printf(" %10.1f", rate / 1e6);
+            if (s > 0)
+                printf(" (%5.1fx)", rate / scalar);
+            else
+                printf("%9s", "");
+        }
+        printf("\n");
+    }
+    
+    free(b.in);
+    free(b.coefs);
+    free(b.ints);
+    free(b.out);
+    free(expected);
+    
+    return failures > 0 ? EXIT_FAILURE : NO_ERROR;
+}
@@ -0,0 +1,265 @@
+//
+//  benchPlanar.c
+//  AudioPlayerBenchmarks
+//
+//  Compares the interleaved and planar (paNonInterleaved) pipelines of the
+//  ring-buffer players at 2, 8 and 32 channels. The reader writes decoded
+//  float frames into a frame ring buffer, as they are or deinterleaved into
+//  one plane per channel, and the callback reads a buffer at a time and
+//  does typical per-channel work on it: a gain ramp of its own and a
+//  peak/RMS meter for each channel. Interleaved, that work strides through
+//  the frames a channel at a time; planar, it is the vector kernels on
+//  contiguous samples. Both run on one thread, so that the times are the
+//  CPU cost of each side, and the two outputs are checked to be identical.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pa_util.h>
+#include "audioPlayerUtil.h"
+#include "audioKernels.h"
+#include "frameRingBuffer.h"
+#include "benchmarks.h"
+
+// Constants
+#define RING_FRAMES (16384)
+#define READ_FRAMES (4096)          // per refill
+#define CALLBACK_FRAMES (512)       // per callback
+#define DEFAULT_SECONDS (60.0)
+#define BENCH_SAMPLE_RATE (48000)
+#define RAMP_STEP (1e-6f)           // per frame
+
+// Channel counts measured
+static const unsigned int channelCounts[] = {2, 8, 32};
+
+#define NUM_CHANNEL_COUNTS (sizeof(channelCounts) / sizeof(channelCounts[0]))
+
+// struct type for one run through a pipeline
+struct pipeline {
+    unsigned int            channels;
+    int                     planar;
+    const struct audioKernels *kernels;
+    struct frameRingBuffer  *ring;
+    const float             *source;    // READ_FRAMES of decoded frames
+    size_t                  sourceFrame;
+    float                   *output;    // one callback's worth
+    void                    **planes;   // output, planar
+    float                   *gains;     // per channel
+    float                   *peaks;
+    double                  *sumSquares;
+    unsigned long long      hash;       // of the output, interleaved
+    float                   *check;     // interleaved output, for the hash
+};
+
+// Reader: write the next frames of the source into the ring
+static size_t produce(struct pipeline *p, size_t frames) {
+    
+    void *ptr[2];
+    size_t sizes[2];
+    
+    frames = getFrameRingBufferWriteRegions(p->ring, frames,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+    // refills are a divisor of the ring, so the source never wraps within
+    // one region
+    for (int i = 0; i < 2 && sizes[i] > 0; i++) {
+        const float *src = p->source + p->sourceFrame * p->channels;
+        if (p->planar) {
+            // deinterleaved once, on the way in
+            float *planes[p->channels];
+            getFrameRingBufferPlanes(p->ring, ptr[i], p->channels,
+                (void **) planes);
+            p->kernels->deinterleave(planes, src, sizes[i], p->channels);
+        }
+        else
+            memcpy(ptr[i], src, sizes[i] * p->channels * sizeof(float));
+        p->sourceFrame = (p->sourceFrame + sizes[i]) % READ_FRAMES;
+    }
+    
+    advanceFrameRingBufferWriteIndex(p->ring, frames);
+    
+    return frames;
+}
+
+// Callback: read a buffer, then ramp and meter each channel
+static void consume(struct pipeline *p) {
+    
+    unsigned int channels = p->channels;
+    
+    if (p->planar) {
+        readFrameRingBufferPlanes(p->ring, p->planes, channels, 0,
+            CALLBACK_FRAMES);
+        for (unsigned int c = 0; c < channels; c++) {
+            float *plane = (float *) p->planes[c];
+            p->kernels->gainRamp(plane, plane, CALLBACK_FRAMES, 1,
+                p->gains[c], RAMP_STEP);
+            p->kernels->peakRms(plane, CALLBACK_FRAMES, p->peaks + c,
+                p->sumSquares + c);
+        }
+    }
+    else {
+        readFrameRingBuffer(p->ring, p->output, CALLBACK_FRAMES);
+        for (unsigned int c = 0; c < channels; c++) {
+            float gain = p->gains[c], peak = 0.0f, sq = 0.0f;
+            for (size_t f = 0; f < CALLBACK_FRAMES; f++) {
+                float x = p->output[f * channels + c] *
+                    (gain + RAMP_STEP * (float) f);
+                p->output[f * channels + c] = x;
+                sq += x * x;
+                peak = fabsf(x) > peak ? fabsf(x) : peak;
+            }
+            p->peaks[c] = peak;
+            p->sumSquares[c] = sq;
+        }
+    }
+}
+
+// Add the callback's output to the hash (FNV-1a, interleaved)
+static void hashOutput(struct pipeline *p) {
+    
+    const float *out = p->output;
+    if (p->planar) {
+        p->kernels->interleave(p->check, (const float *const *) p->planes,
+            CALLBACK_FRAMES, p->channels);
+        out = p->check;
+    }
+    
+    const unsigned char *bytes = (const unsigned char *) out;
+    for (size_t i = 0; i < CALLBACK_FRAMES * p->channels * sizeof(float); i++)
+        p->hash = (p->hash ^ bytes[i]) * 1099511628211ULL;
+}
+
+// Stream frames through a pipeline; returns the reader's and callback's
+// times (s) in readTime and callbackTime
+static void runPipeline(
+    struct pipeline *p,
+    size_t totalFrames,
+    double *readTime,
+    double *callbackTime
+) {
+    
+    *readTime = *callbackTime = 0.0;
+    p->hash = 14695981039346656037ULL;
+    p->sourceFrame = 0;
+    
+    for (size_t done = 0; done < totalFrames; done += CALLBACK_FRAMES) {
+        // top the ring up a refill at a time, as the players do
+        if (getFrameRingBufferWriteAvailable(p->ring) >= READ_FRAMES) {
+            double start = PaUtil_GetTime();
+            produce(p, READ_FRAMES);
+            *readTime += PaUtil_GetTime() - start;
+        }
+    
+        double start = PaUtil_GetTime();
+        consume(p);
+        *callbackTime += PaUtil_GetTime() - start;
+    
+        hashOutput(p);
+    }
+}
+
+// Set up a pipeline
+static int initPipeline(
+    struct pipeline *p,
+    unsigned int channels,
+    int planar,
+    const float *source
+) {
+    
+    memset(p, 0, sizeof(*p));
+    p->channels = channels;
+    p->planar = planar;
+    p->kernels = getAudioKernels();
+    p->source = source;
+    p->ring = createFrameRingBuffer(RING_FRAMES, sizeof(float) * channels);
+    p->output = malloc(sizeof(float) * CALLBACK_FRAMES * channels);
+    p->check = malloc(sizeof(float) * CALLBACK_FRAMES * channels);
+    p->planes = malloc(sizeof(void *) * channels);
+    p->gains = malloc(sizeof(float) * channels);
+    p->peaks = malloc(sizeof(float) * channels);
+    p->sumSquares = malloc(sizeof(double) * channels);
+    if (p->ring == NULL || p->output == NULL || p->check == NULL ||
+        p->planes == NULL || p->gains == NULL || p->peaks == NULL ||
+        p->sumSquares == NULL)
+        return ERR_BAD_ALLOC;
+    
+    // the planes are the output buffer, one channel after another, as
+    // PortAudio would hand them to a paNonInterleaved callback
+    for (unsigned int c = 0; c < channels; c++) {
+        p->planes[c] = p->output + c * CALLBACK_FRAMES;
+        p->gains[c] = 0.5f + 0.01f * c;
+    }
+    
+    return NO_ERROR;
+}
+
+// Free a pipeline
+static void freePipeline(struct pipeline *p) {
+    
+    freeFrameRingBuffer(p->ring);
+    free(p->output);
+    free(p->check);
+    free(p->planes);
+    free(p->gains);
+    free(p->peaks);
+    free(p->sumSquares);
+}
+
+// MAIN
+int benchPlanar(int argc, char *argv[]) {
+    
+    double seconds = argc >= 1 ? atof(argv[0]) : DEFAULT_SECONDS;
+    if (seconds <= 0.0) {
+        printf("Usage: planar [seconds of audio]\n");
+        return ERR_BAD_COMMAND_LINE;
+    }
+    size_t totalFrames = (size_t) (seconds * BENCH_SAMPLE_RATE);
+    
+    PaUtil_InitializeClock();
+    printf("Kernels: %s; %.1f s of audio per run, %d frames per callback\n\n",
+        getAudioKernels()->name, seconds, CALLBACK_FRAMES);
+    printf("%-8s %-11s %12s %14s %10s %10s %6s\n", "Channels", "Layout",
+        "Reader ns/f", "Callback ns/f", "x realtime", "Speed-up", "Output");
+    
+    int err = NO_ERROR;
+    for (size_t i = 0; i < NUM_CHANNEL_COUNTS && !err; i++) {
+        unsigned int channels = channelCounts[i];
+    
+        // a decoded block of noise for the reader to write, over and over
+        float *source = malloc(sizeof(float) * READ_FRAMES * channels);
+        if (source == NULL)
+            return ERR_BAD_ALLOC;
+        srand(1);
+        for (size_t s = 0; s < (size_t) READ_FRAMES * channels; s++)
+            source[s] = (float) rand() / RAND_MAX - 0.5f;
+    
+        double interleavedTotal = 0.0;
+        unsigned long long interleavedHash = 0;
+        for (int planar = 0; planar <= 1 && !err; planar++) {
+            struct pipeline p;
+            err = initPipeline(&p, channels, planar, source);
+            if (!err) {
+                double readTime, callbackTime;
+                runPipeline(&p, totalFrames, &readTime, &callbackTime);
+                double total = readTime + callbackTime;
+                if (!planar) {
+                    interleavedTotal = total;
+                    interleavedHash = p.hash;
+                }
+                printf("%-8u %-11s %12.2f %14.2f %10.0f %9.2fx %6s\n",
+                    channels, planar ? "planar" : "interleaved",
+                    1e9 * readTime / totalFrames,
+                    1e9 * callbackTime / totalFrames,
+                    seconds / total, interleavedTotal / total,
+                    p.hash == interleavedHash ? "same" : "DIFFER");
+            }
+            freePipeline(&p);
+        }
+    
+        free(source);
+    }
+    
+    return err;
+}
@@ -0,0 +1,257 @@
+//
+//  benchResample.c
+//  AudioPlayerBenchmarks
+//
+//  Measures each resampler preset (resampler.h) on a few common
+//  conversions: its speed, as a multiple of real time for one channel, and
+//  its quality on pure tones, which are generated in float so that the
+//  input adds no noise of its own. THD+N is everything in the output but
+//  the tone, found by fitting a sine of the tone's frequency to it by least
+//  squares. Passband ripple is the spread of the gains of tones from 20 Hz
+//  up to 20 kHz or the filter's passband, whichever is lower.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audioPlayerUtil.h"
+#include "resampler.h"
+#include "benchmarks.h"
+
+// Constants
+#define DEFAULT_SECONDS (10.0)      // of audio, for the speed
+#define TONE_SECONDS (0.25)         // of audio, for each quality tone
+#define TONE_AMPLITUDE (0.5)
+#define RIPPLE_TONES (24)           // log-spaced from 20 Hz
+#define HIGH_TONE (15000.0)         // Hz, or less if the passband is lower
+#define OUTPUT_FRAMES (1024)        // per readResampler() call
+
+// Conversions measured
+static const int conversions[][2] = {
+    {44100, 48000},
+    {48000, 44100},
+    {96000, 48000},
+    {48000, 96000},
+};
+
+#define NUM_CONVERSIONS (sizeof(conversions) / sizeof(conversions[0]))
+
+static const char *presetNames[] = {"fast", "medium", "high", "best"};
+
+#define NUM_PRESETS (sizeof(presetNames) / sizeof(presetNames[0]))
+
+// struct type for the input to the resampler: a mono tone
+struct tone {
+    float       *samples;
+    size_t      frame;
+    size_t      frames;
+};
+
+// CPU time used by the process (s)
+static double getCpuTime(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Input for the resampler: the next frames of the tone
+static size_t readTone(void *data, float *buffer, size_t frames) {
+    
+    struct tone *t = (struct tone *) data;
+    size_t n = min(frames, t->frames - t->frame);
+    
+    memcpy(buffer, t->samples + t->frame, n * sizeof(float));
+    t->frame += n;
+    
+    return n;
+}
+
+// Fill the tone with seconds of frequency at the input rate
+static void makeTone(
+    const struct resampler *r,
+    struct tone *t,
+    double frequency,
+    double seconds
+) {
+    
+    double step = 2.0 * M_PI * frequency / r->inRate;
+    
+    t->frame = 0;
+    t->frames = (size_t) (seconds * r->inRate);
+    for (size_t i = 0; i < t->frames; i++)
+        t->samples[i] = (float) (TONE_AMPLITUDE * sin(step * i));
+}
+
+// Resample the whole tone into out; returns the number of output frames
+static size_t resampleTone(struct resampler *r, struct tone *t, float *out) {
+    
+    size_t frames = (size_t) getResampledFrames(r, (long long) t->frames);
+    
+    seekResampler(r, 0);
+    for (size_t done = 0; done < frames; done += OUTPUT_FRAMES)
+        readResampler(r, out + done, min(frames - done, (size_t) OUTPUT_FRAMES),
+            readTone, t);
+    
+    return frames;
+}
+
+// Fit a sine at frequency to the output, away from its ends; returns the
+// amplitude of the fit and the power of what is left (relative to it) in
+// residual
+static double fitTone(
+    const struct resampler *r,
+    const float *out,
+    size_t frames,
+    double frequency,
+    double *residual
+) {
+    
+    size_t start = r->taps, end = frames - r->taps;
+    double step = 2.0 * M_PI * frequency / r->outRate;
+    
+    // least squares for a cos + b sin
+    double cc = 0.0, ss = 0.0, cs = 0.0, xc = 0.0, xs = 0.0;
+    for (size_t i = start; i < end; i++) {
+        double c = cos(step * i), s = sin(step * i);
+        cc += c * c;
+        ss += s * s;
+        cs += c * s;
+        xc += out[i] * c;
+        xs += out[i] * s;
+    }
+    double det = cc * ss - cs * cs;
+    double a = (xc * ss - xs * cs) / det;
+    double b = (xs * cc - xc * cs) / det;
+    
+    double error = 0.0, power = 0.0;
+    for (size_t i = start; i < end; i++) {
+        double fit = a * cos(step * i) + b * sin(step * i);
+        error += (out[i] - fit) * (out[i] - fit);
+        power += fit * fit;
+    }
+    *residual = error / power;
+    
+    return sqrt(a * a + b * b);
+}
+
+// THD+N (dB) of a tone
+static double measureThdN(
+    struct resampler *r,
+    struct tone *t,
+    double frequency,
+    float *out
+) {
+    
+    double residual;
+    makeTone(r, t, frequency, TONE_SECONDS);
+    size_t frames = resampleTone(r, t, out);
+    fitTone(r, out, frames, frequency, &residual);
+    
+    return 10.0 * log10(residual);
+}
+
+// Spread (dB) of the gains of tones across the passband
+static double measureRipple(struct resampler *r, struct tone *t, float *out) {
+    
+    double top = getResamplerPassband(r);
+    if (top > 20000.0)
+        top = 20000.0;
+    double lowest = INFINITY, highest = -INFINITY;
+    
+    for (int i = 0; i < RIPPLE_TONES; i++) {
+        double frequency = 20.0 * pow(top / 20.0, i / (RIPPLE_TONES - 1.0));
+        double residual;
+        makeTone(r, t, frequency, TONE_SECONDS);
+        size_t frames = resampleTone(r, t, out);
+        double gain = 20.0 * log10(fitTone(r, out, frames, frequency,
+            &residual) / TONE_AMPLITUDE);
+        if (gain < lowest)
+            lowest = gain;
+        if (gain > highest)
+            highest = gain;
+    }
+    
+    return highest - lowest;
+}
+
+// Multiple of real time, for one channel
+static double measureSpeed(
+    struct resampler *r,
+    struct tone *t,
+    double seconds,
+    float *out
+) {
+    
+    makeTone(r, t, 1000.0, seconds);
+    double start = getCpuTime();
+    size_t frames = resampleTone(r, t, out);
+    double elapsed = getCpuTime() - start;
+    
+    return (double) frames / r->outRate / elapsed;
+}
+
+// MAIN
+int benchResample(int argc, char *argv[]) {
+    
+    double seconds = argc >= 1 ? atof(argv[0]) : DEFAULT_SECONDS;
+    if (seconds < TONE_SECONDS) {
+        printf("Usage: resample [seconds of audio]\n");
+        return ERR_BAD_COMMAND_LINE;
+    }
+    
+    // room for the longest input and output (the speed run, at the highest
+    // rates)
+    int maxRate = 0;
+    for (size_t c = 0; c < NUM_CONVERSIONS; c++) {
+        if (conversions[c][0] > maxRate)
+            maxRate = conversions[c][0];
+        if (conversions[c][1] > maxRate)
+            maxRate = conversions[c][1];
+    }
+    size_t maxFrames = (size_t) (seconds * maxRate) + OUTPUT_FRAMES;
+    struct tone t = {.samples = malloc(sizeof(float) * maxFrames)};
+    float *out = malloc(sizeof(float) * maxFrames);
+    if (t.samples == NULL || out == NULL) {
+        free(t.samples);
+        free(out);
+        return ERR_BAD_ALLOC;
+    }
+    
+    printf("Kernels: %s; %.1f s of audio per speed run\n\n",
+        getAudioKernels()->name, seconds);
+    printf("%-7s %-14s %5s %9s %10s %9s %9s %9s\n", "Preset", "Conversion",
+        "Taps", "Passband", "x realtime", "THD+N 1k", "THD+N hi", "Ripple");
+    
+    int err = NO_ERROR;
+    for (size_t p = 0; p < NUM_PRESETS && !err; p++) {
+        for (size_t c = 0; c < NUM_CONVERSIONS && !err; c++) {
+            struct resampler r;
+            err = initResampler(&r, conversions[c][0], conversions[c][1], 1,
+                getResamplerPreset(presetNames[p]));
+            if (err)
+                break;
+    
+            double passband = getResamplerPassband(&r);
+            double high = passband < HIGH_TONE ? 0.9 * passband : HIGH_TONE;
+            double speed = measureSpeed(&r, &t, seconds, out);
+            double thdLow = measureThdN(&r, &t, 1000.0, out);
+            double thdHigh = measureThdN(&r, &t, high, out);
+            double ripple = measureRipple(&r, &t, out);
+            printf("%-7s %6d->%-6d %5u %5.1f kHz %10.0f %6.1f dB %6.1f dB "
+                "%6.3f dB\n", presetNames[p], conversions[c][0],
+                conversions[c][1], r.taps, passband / 1e3, speed, thdLow,
+                thdHigh, ripple);
+    
+            freeResampler(&r);
+        }
+    }
+    
+    free(t.samples);
+    free(out);
+    
+    return err;
+}
@@ -0,0 +1,298 @@
+//
+//  benchRingBuffer.c
+//  AudioPlayerBenchmarks
+//
+//  Streams frames from a producer thread to a consumer thread through
+//  PaUtilRingBuffer (used the way the players used to use it: one float per
+//  element, write regions trimmed to whole frames) and through the frame ring
+//  buffer, and reports throughput and the worst-case time of a single
+//  callback-sized read and reader-sized write.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <pa_ringbuffer.h>
+#include <pa_util.h>
+#include "audioPlayerUtil.h"
+#include "frameRingBuffer.h"
+#include "benchmarks.h"
+
+// Constants
+#define RING_FRAMES (16384)
+#define NUM_WRITES_PER_BUFFER (4)
+#define DEFAULT_CHANNELS (2)
+#define DEFAULT_SECONDS (600.0)
+#define BENCH_SAMPLE_RATE (48000)
+
+// struct type for the state shared by the producer and the consumer
+struct benchState {
+    unsigned int            channels;
+    size_t                  totalFrames;    // frames to stream in total
+    float                   *source;        // one ring's worth of test frames
+    float                   *sink;          // one callback's worth of frames
+
+    // implementations under test
+    PaUtilRingBuffer        paRing;
+    float                   *paRingData;
+    struct frameRingBuffer  *frameRing;
+
+    // producer statistics
+    double                  writeMax;       // worst-case write time (s)
+    double                  writeTotal;     // total time spent writing (s)
+    size_t                  writeCalls;     // number of (non-empty) writes
+};
+
+// struct type describing a ring buffer implementation
+struct ringImpl {
+    const char  *name;
+    int         (*init)(struct benchState *s);
+    void        (*cleanup)(struct benchState *s);
+    size_t      (*produce)(struct benchState *s, size_t offset, size_t frames);
+    size_t      (*consume)(struct benchState *s, size_t frames);
+};
+
+// ----- PaUtilRingBuffer, one float per element -----
+
+static int paInit(struct benchState *s) {
+    
+    ring_buffer_size_t numSamples =
+        (ring_buffer_size_t) (RING_FRAMES * s->channels);
+    
+    s->paRingData = (float *) PaUtil_AllocateMemory(
+        (long) (sizeof(float) * nextPowerOf2((unsigned) numSamples)));
+    if (s->paRingData == NULL)
+        return ERR_BAD_ALLOC;
+    
+    if (PaUtil_InitializeRingBuffer(&s->paRing, sizeof(float),
+            (ring_buffer_size_t) nextPowerOf2((unsigned) numSamples),
+            s->paRingData))
+        return ERR_PORTAUDIO;
+    
+    return NO_ERROR;
+}
+
+static void paCleanup(struct benchState *s) {
+    
+    if (s->paRingData != NULL)
+        PaUtil_FreeMemory(s->paRingData);
+    s->paRingData = NULL;
+}
+
+static size_t paProduce(struct benchState *s, size_t offset, size_t frames) {
+    
+    ring_buffer_size_t available =
+        PaUtil_GetRingBufferWriteAvailable(&s->paRing);
+    if (available < s->paRing.bufferSize / NUM_WRITES_PER_BUFFER)
+        return 0;
+    
+    available = min(available, (ring_buffer_size_t) (frames * s->channels));
+    
+    void* ptr[2] = {0};
+    ring_buffer_size_t sizes[2] = {0};
+    PaUtil_GetRingBufferWriteRegions(&s->paRing, available,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+    // copy from the source, trimming each region to whole frames as the
+    // players used to
+    ring_buffer_size_t written = 0;
+    for (int i = 0; i < 2 && ptr[i] != NULL; ++i) {
+        if (sizes[i] % s->channels)
+            sizes[i] -= sizes[i] % s->channels;
+        memcpy(ptr[i], s->source + offset * s->channels + written,
+            sizeof(float) * (size_t) sizes[i]);
+        written += sizes[i];
+    }
+    PaUtil_AdvanceRingBufferWriteIndex(&s->paRing, written);
+    
+    return (size_t) written / s->channels;
+}
+
+static size_t paConsume(struct benchState *s, size_t frames) {
+    
+    ring_buffer_size_t elementsToRead = min(
+        PaUtil_GetRingBufferReadAvailable(&s->paRing),
+        (ring_buffer_size_t) (frames * s->channels)
+    );
+    
+    return (size_t) PaUtil_ReadRingBuffer(&s->paRing, s->sink,
+        elementsToRead) / s->channels;
+}
+
+// ----- frame ring buffer -----
+
+static int frameInit(struct benchState *s) {
+    
+    s->frameRing = createFrameRingBuffer(RING_FRAMES,
+        sizeof(float) * s->channels);
+    
+    return s->frameRing == NULL ? ERR_BAD_ALLOC : NO_ERROR;
+}
+
+static void frameCleanup(struct benchState *s) {
+    
+    freeFrameRingBuffer(s->frameRing);
+    s->frameRing = NULL;
+}
+
+static size_t frameProduce(struct benchState *s, size_t offset, size_t frames) {
+    
+    if (getFrameRingBufferWriteAvailable(s->frameRing) <
+        s->frameRing->frames / NUM_WRITES_PER_BUFFER)
+        return 0;
+    
+    return writeFrameRingBuffer(s->frameRing,
+        s->source + offset * s->channels, frames);
+}
+
+static size_t frameConsume(struct benchState *s, size_t frames) {
+    
+    return readFrameRingBuffer(s->frameRing, s->sink, frames);
+}
+
+static const struct ringImpl impls[] = {
+    {"PaUtilRingBuffer", paInit, paCleanup, paProduce, paConsume},
+    {"frameRingBuffer", frameInit, frameCleanup, frameProduce, frameConsume}
+};
+
+// ----- harness -----
+
+static const struct ringImpl *currentImpl;
+
+// producer thread: stream totalFrames frames out of the (cyclic) source
+static void* producerThread(void *data) {
+    
+    struct benchState *s = (struct benchState *) data;
+    size_t produced = 0;
+    
+    while (produced < s->totalFrames) {
+        size_t offset = produced % RING_FRAMES;
+        size_t frames = min(s->totalFrames - produced,
+            (size_t) RING_FRAMES - offset);
+    
+        double t0 = PaUtil_GetTime();
+        size_t written = currentImpl->produce(s, offset, frames);
+        double dt = PaUtil_GetTime() - t0;
+    
+        if (written > 0) {
+            s->writeTotal += dt;
+            s->writeMax = dt > s->writeMax ? dt : s->writeMax;
+            s->writeCalls++;
+            produced += written;
+        }
+        else
+            sched_yield();
+    }
+    
+    return NULL;
+}
+
+// run one implementation; returns an error code
+static int runImpl(const struct ringImpl *impl, struct benchState *s) {
+    
+    int err = impl->init(s);
+    if (err)
+        return err;
+    
+    currentImpl = impl;
+    s->writeMax = s->writeTotal = 0.0;
+    s->writeCalls = 0;
+    
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, producerThread, s) != 0) {
+        impl->cleanup(s);
+        return ERR_BAD_ALLOC;
+    }
+    
+    // consumer: read callback-sized blocks as fast as they arrive
+    size_t consumed = 0, readCalls = 0, errors = 0;
+    double readMax = 0.0, readTotal = 0.0;
+    double start = PaUtil_GetTime();
+    while (consumed < s->totalFrames) {
+        double t0 = PaUtil_GetTime();
+        size_t frames = impl->consume(s, FRAMES_PER_BUFFER);
+        double dt = PaUtil_GetTime() - t0;
+    
+        if (frames == 0)
+            continue;
+    
+        // check the frames arrived intact and in order
+        for (size_t i = 0; i < frames; i++) {
+            size_t expected = (consumed + i) % RING_FRAMES;
+            if (s->sink[i * s->channels] != (float) expected)
+                errors++;
+        }
+    
+        readTotal += dt;
+        readMax = dt > readMax ? dt : readMax;
+        readCalls++;
+        consumed += frames;
+    }
+    double elapsed = PaUtil_GetTime() - start;
+    
+    pthread_join(producer, NULL);
+    impl->cleanup(s);
+    
+    printf("%-18s %10.1f %12.0f %12.0f %12.0f %12.0f %8zu\n",
+        impl->name,
+        consumed / elapsed / 1e6,
+        1e9 * readTotal / readCalls, 1e9 * readMax,
+        1e9 * s->writeTotal / s->writeCalls, 1e9 * s->writeMax,
+        errors);
+    
+    return NO_ERROR;
+}
+
+// Compare the frame ring buffer with PaUtilRingBuffer
+int benchRingBuffer(int argc, char *argv[]) {
+    
+    int err = NO_ERROR;
+    struct benchState s = {
+        .channels = argc > 0 ? (unsigned) atoi(argv[0]) : DEFAULT_CHANNELS,
+        .source = NULL,
+        .sink = NULL,
+        .paRingData = NULL,
+        .frameRing = NULL
+    };
+    double seconds = argc > 1 ? atof(argv[1]) : DEFAULT_SECONDS;
+    
+    if (s.channels == 0 || seconds <= 0.0)
+        return ERR_BAD_COMMAND_LINE;
+    
+    // frames equivalent to the requested duration of audio
+    s.totalFrames = (size_t) (seconds * BENCH_SAMPLE_RATE);
+    
+    // the first sample of each source frame holds its index, for checking
+    s.source = malloc(sizeof(float) * RING_FRAMES * s.channels);
+    s.sink = malloc(sizeof(float) * FRAMES_PER_BUFFER * s.channels);
+    if (s.source == NULL || s.sink == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < RING_FRAMES; i++) {
+        for (unsigned int n = 0; n < s.channels; n++)
+            s.source[i * s.channels + n] = (float) i;
+    }
+    
+    PaUtil_InitializeClock();
+    
+    printf("%u channels, %zu frames, %d frames per read\n",
+        s.channels, s.totalFrames, FRAMES_PER_BUFFER);
+    printf("%-18s %10s %12s %12s %12s %12s %8s\n", "implementation",
+        "Mframes/s", "read avg ns", "read max ns", "write avg ns",
+        "write max ns", "errors");
+    
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        err = runImpl(&impls[i], &s);
+        if (err)
+            break;
+    }
+    
+cleanup:
+    free(s.source);
+    free(s.sink);
+    
+    return err;
+}
@@ -0,0 +1,345 @@
+//
+//  benchUring.c
+//  AudioPlayerBenchmarks
+//
+//  Compares reading many streams through one io_uring with the blocking
+//  sf_readf_float() loop, at 1, 16 and 256 streams. Stream i reads file
+//  i % (number of files), from a starting point spread through the file so
+//  that streams on the same file read different parts of it. One thread
+//  refills the streams in turn, READ_FRAMES of float at a time, as a reader
+//  serving many voices would. Blocking, each refill waits for its own read;
+//  through io_uring (Common/uringSource.c), every stream has BAP_URING_DEPTH
+//  reads of BAP_URING_BLOCK_KB in flight, so the other streams' reads go on
+//  while one is refilled. With BAP_BENCH_CACHE=cold the files are dropped
+//  from the page cache before each pass (Linux). Reported are the file data
+//  read per second over all streams, opening included (checking excluded),
+//  and the time each refill took: mean, 99th percentile and worst. The
+//  samples read both ways are checked to be identical.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "audioPlayerUtil.h"
+#include "playerConfig.h"
+#include "playerStream.h"
+#include "uringSource.h"
+#include "benchmarks.h"
+
+// Constants
+#define READ_FRAMES (4096)          // per refill
+#define DEFAULT_SECONDS (4.0)       // of audio per stream
+
+// Stream counts measured
+static const unsigned int streamCounts[] = {1, 16, 256};
+
+#define NUM_STREAM_COUNTS (sizeof(streamCounts) / sizeof(streamCounts[0]))
+
+// struct type for what is known of a file before it is read
+struct benchFile {
+    const char      *name;
+    unsigned int    channels;
+    int             sampleRate;
+    sf_count_t      frames;
+    size_t          bytesPerFrame;  // in the file
+};
+
+// struct type for one stream of a pass
+struct benchStream {
+    const struct benchFile *file;
+    SNDFILE         *sndfile;       // blocking
+    struct uringStream *uring;      // io_uring
+    sf_count_t      start;
+    sf_count_t      remaining;      // frames still to read
+};
+
+// struct type for the results of a pass
+struct passResult {
+    double          seconds;        // wall time, opening included
+    double          megabytes;      // of file data read
+    double          *latencies;     // of each refill (s)
+    size_t          refills;
+    unsigned long long hash;        // of the samples read, in order
+    unsigned long   waits;          // io_uring refills that had to wait
+};
+
+// Wall-clock time (s)
+static double getTime(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Drop the files from the page cache, saying if they can't be
+static void evictFiles(const struct benchFile *files, unsigned int numFiles) {
+    
+    for (unsigned int f = 0; f < numFiles; f++) {
+        if (!evictFile(files[f].name))
+            fprintf(stderr, "Cannot drop %s from the page cache\n",
+                files[f].name);
+    }
+}
+
+// Fold samples into a hash (FNV-1a over their bytes)
+static unsigned long long hashSamples(
+    unsigned long long hash,
+    const float *samples,
+    size_t n
+) {
+    
+    const unsigned char *p = (const unsigned char *) samples;
+    for (size_t i = 0; i < n * sizeof(float); i++)
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    
+    return hash;
+}
+
+// For qsort()
+static int compareDoubles(const void *a, const void *b) {
+    
+    double x = *(const double *) a, y = *(const double *) b;
+    
+    return (x > y) - (x < y);
+}
+
+// Open every stream and refill them in turn until all have read their
+// share; queue is NULL for the blocking loop. Returns an error code.
+static int runPass(
+    const struct benchFile *files,
+    unsigned int numFiles,
+    unsigned int numStreams,
+    double seconds,
+    struct uringQueue *queue,
+    struct passResult *result
+) {
+    
+    int err = NO_ERROR;
+    memset(result, 0, sizeof(*result));
+    result->hash = 14695981039346656037ULL;
+    
+    struct benchStream *streams = calloc(numStreams, sizeof(struct benchStream));
+    float *buffer = malloc(READ_FRAMES * OFFLINE_MAX_CHANNELS * sizeof(float));
+    if (streams == NULL || buffer == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    
+    // each stream's share of its file, spread out among the streams on it
+    size_t maxRefills = 0;
+    for (unsigned int i = 0; i < numStreams; i++) {
+        struct benchStream *s = &streams[i];
+        s->file = &files[i % numFiles];
+        unsigned int onFile = (numStreams - i % numFiles + numFiles - 1) /
+            numFiles;
+        sf_count_t frames = (sf_count_t) (seconds * s->file->sampleRate);
+        if (frames > s->file->frames)
+            frames = s->file->frames;
+        s->start = (s->file->frames - frames) * (i / numFiles) / onFile;
+        s->remaining = frames;
+        maxRefills += (size_t) (frames + READ_FRAMES - 1) / READ_FRAMES;
+    }
+    result->latencies = malloc(maxRefills * sizeof(double));
+    if (result->latencies == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    
+    double start = getTime(), hashTime = 0.0;
+    for (unsigned int i = 0; i < numStreams; i++) {
+        struct benchStream *s = &streams[i];
+        if (queue != NULL) {
+            s->uring = openUringStream(queue, s->file->name);
+            if (s->uring == NULL || seekUringStream(s->uring, s->start) < 0) {
+                err = ERR_OPENING_FILE;
+                goto cleanup;
+            }
+        }
+        else {
+            SF_INFO sfinfo = {0};
+            s->sndfile = sf_open(s->file->name, SFM_READ, &sfinfo);
+            if (s->sndfile == NULL ||
+                sf_seek(s->sndfile, s->start, SEEK_SET) != s->start) {
+                err = ERR_OPENING_FILE;
+                goto cleanup;
+            }
+        }
+    }
+    
+    // round after round, one refill of every stream with some left
+    for (int more = 1; more; ) {
+        more = 0;
+        for (unsigned int i = 0; i < numStreams; i++) {
+            struct benchStream *s = &streams[i];
+            if (s->remaining == 0)
+                continue;
+            sf_count_t frames = s->remaining < READ_FRAMES ?
+                s->remaining : READ_FRAMES;
+    
+            double t0 = getTime();
+            sf_count_t framesRead = queue != NULL ?
+                readUringStream(s->uring, buffer, frames, paFloat32) :
+                sf_readf_float(s->sndfile, buffer, frames);
+            result->latencies[result->refills++] = getTime() - t0;
+    
+            if (framesRead != frames) {
+                err = ERR_OPENING_FILE;
+                goto cleanup;
+            }
+            double t1 = getTime();
+            result->hash = hashSamples(result->hash, buffer,
+                (size_t) framesRead * s->file->channels);
+            hashTime += getTime() - t1;
+            result->megabytes += framesRead * s->file->bytesPerFrame / 1e6;
+            s->remaining -= framesRead;
+            more |= s->remaining > 0;
+        }
+    }
+    result->seconds = getTime() - start - hashTime;
+    
+cleanup:
+    if (streams != NULL) {
+        for (unsigned int i = 0; i < numStreams; i++) {
+            if (streams[i].sndfile != NULL)
+                sf_close(streams[i].sndfile);
+            if (streams[i].uring != NULL)
+                result->waits += streams[i].uring->waits;
+        }
+    }
+    free(streams);
+    free(buffer);
+    
+    return err;
+}
+
+// Print a pass's throughput and refill times; blocking is the blocking
+// pass to check an io_uring pass against (NULL for the blocking pass)
+static void printPass(
+    unsigned int numStreams,
+    struct passResult *result,
+    const struct passResult *blocking
+) {
+    
+    qsort(result->latencies, result->refills, sizeof(double), compareDoubles);
+    double sum = 0.0;
+    for (size_t i = 0; i < result->refills; i++)
+        sum += result->latencies[i];
+    
+    printf("%7u %-8s %10.1f %10zu %10.3f %10.3f %10.3f",
+        numStreams, blocking == NULL ? "sndfile" : "uring",
+        result->seconds > 0.0 ? result->megabytes / result->seconds : 0.0,
+        result->refills,
+        result->refills > 0 ? 1e3 * sum / result->refills : 0.0,
+        result->refills > 0 ?
+            1e3 * result->latencies[result->refills * 99 / 100] : 0.0,
+        result->refills > 0 ? 1e3 * result->latencies[result->refills - 1] :
+            0.0);
+    if (blocking != NULL)
+        printf(" %10lu %8s\n", result->waits,
+            result->hash == blocking->hash ? "same" : "DIFFER");
+    else
+        printf(" %10s %8s\n", "-", "-");
+}
+
+// Compare io_uring with the blocking loop at 1, 16 and 256 streams
+int benchUring(int argc, char *argv[]) {
+    
+    if (argc < 1)
+        return ERR_BAD_COMMAND_LINE;
+    
+    // a leading number is the seconds of audio per stream
+    double seconds = DEFAULT_SECONDS;
+    char *end;
+    double value = strtod(argv[0], &end);
+    if (end != argv[0] && *end == '\0') {
+        seconds = value;
+        argc--;
+        argv++;
+    }
+    if (argc < 1 || seconds <= 0.0)
+        return ERR_BAD_COMMAND_LINE;
+    
+    unsigned int depth = (unsigned int)
+        getConfigDouble("BAP_URING_DEPTH", DEFAULT_URING_DEPTH);
+    size_t blockBytes = (size_t) (1024 *
+        getConfigDouble("BAP_URING_BLOCK_KB", DEFAULT_URING_BLOCK_KB));
+    int cold = strcmp(getConfigString("BAP_BENCH_CACHE", "warm"), "cold") == 0;
+    
+    // only uncompressed files can be read through io_uring
+    unsigned int numFiles = (unsigned int) argc;
+    struct benchFile *files = calloc(numFiles, sizeof(struct benchFile));
+    if (files == NULL)
+        return ERR_BAD_ALLOC;
+    int err = NO_ERROR;
+    for (unsigned int f = 0; f < numFiles; f++) {
+        struct mappedAudioFile layout;
+        if (openMappedAudioFile(argv[f], &layout, 0.0) != NO_ERROR ||
+            layout.channels > OFFLINE_MAX_CHANNELS) {
+            fprintf(stderr, "%s is not an uncompressed WAV or AIFF file "
+                "(of at most %d channels)\n", argv[f], OFFLINE_MAX_CHANNELS);
+            closeMappedAudioFile(&layout);
+            err = ERR_OPENING_FILE;
+            goto cleanup;
+        }
+        files[f] = (struct benchFile) {
+            .name = argv[f],
+            .channels = layout.channels,
+            .sampleRate = layout.sRate,
+            .frames = layout.frames,
+            .bytesPerFrame = layout.channels * layout.bytesPerSample
+        };
+        closeMappedAudioFile(&layout);
+    }
+    
+    printf("%u files, %.1f s per stream, %u reads of %zu KB in flight per "
+        "stream, %s cache\n", numFiles, seconds, depth, blockBytes / 1024,
+        cold ? "cold" : "warm");
+    printf("%7s %-8s %10s %10s %10s %10s %10s %10s %8s\n", "streams",
+        "reader", "MB/s", "refills", "mean ms", "p99 ms", "max ms", "waits",
+        "samples");
+    
+    int failures = 0;
+    for (size_t c = 0; c < NUM_STREAM_COUNTS && !err; c++) {
+        unsigned int numStreams = streamCounts[c];
+        struct passResult blocking, uring = {0};
+    
+        if (cold)
+            evictFiles(files, numFiles);
+        err = runPass(files, numFiles, numStreams, seconds, NULL, &blocking);
+        if (!err)
+            printPass(numStreams, &blocking, NULL);
+    
+        // the same reads, through one io_uring for all the streams
+        struct uringQueue *queue = err ? NULL :
+            createUringQueue(numStreams, depth, blockBytes);
+        if (!err && queue == NULL)
+            printf("%7u %-8s io_uring is not available (%s)\n", numStreams,
+                "uring", strerror(errno));
+        if (queue != NULL) {
+            if (!queue->registered)
+                printf("%7u %-8s (buffers not registered: plain reads)\n",
+                    numStreams, "uring");
+            if (cold)
+                evictFiles(files, numFiles);
+            err = runPass(files, numFiles, numStreams, seconds, queue, &uring);
+            if (!err) {
+                printPass(numStreams, &uring, &blocking);
+                failures += uring.hash != blocking.hash;
+            }
+        }
+    
+        freeUringQueue(queue);
+        free(blocking.latencies);
+        free(uring.latencies);
+    }
+    if (!err && failures > 0)
+        err = EXIT_FAILURE;
+    
+cleanup:
+    free(files);
+    
+    return err;
+}
@@ -0,0 +1,36 @@
+//
+//  benchmarks.h
+//  AudioPlayerBenchmarks
+//
+//  Declarations of the individual benchmarks run from main().
+//
+
+#ifndef benchmarks_h
+#define benchmarks_h
+
+// Compare the frame ring buffer with PaUtilRingBuffer
+int benchRingBuffer(int argc, char *argv[]);
+
+// Compare streaming float samples with the file's native format
+int benchFormat(int argc, char *argv[]);
+
+// Compare the player architectures over files and buffer sizes
+int benchArch(int argc, char *argv[]);
+
+// Check the vector kernel sets against the scalar one, and time them
+int benchKernels(int argc, char *argv[]);
+
+// Speed and quality of the resampler presets
+int benchResample(int argc, char *argv[]);
+
+// Compare the interleaved and planar pipelines at 2, 8 and 32 channels
+int benchPlanar(int argc, char *argv[]);
+
+// Compare io_uring with blocking reads at 1, 16 and 256 streams
+int benchUring(int argc, char *argv[]);
+
+// Drop a file from the page cache, so that the next run reads it from the
+// disk; returns 0 if that can't be done here (benchCache.c)
+int evictFile(const char *fileName);
+
+#endif /* benchmarks_h */
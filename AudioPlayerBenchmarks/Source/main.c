@@ -0,0 +1,61 @@
+//
+//  main.c
+//  AudioPlayerBenchmarks
+//
+//  Runs one of the benchmarks for the components shared by the players.
+//  The first argument selects the benchmark; any remaining arguments are
+//  passed on to it.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "audioPlayerUtil.h"
+#include "benchmarks.h"
+
+// struct type for the table of benchmarks
+struct benchmark {
+    const char  *name;                      // name used on the command line
+    int         (*fn)(int, char *[]);       // benchmark function
+    const char  *usage;                     // arguments and description
+};
+
+static const struct benchmark benchmarks[] = {
+    {"ring", benchRingBuffer,
+        "[channels] [seconds of audio]  frame ring buffer vs PaUtilRingBuffer"},
+    {"format", benchFormat,
+        "<audio file> [passes]  native sample format vs float through the ring"},
+    {"arch", benchArch,
+        "<player directory> <frames per buffer,...> <audio file>...  "
+        "player architectures, as JSON"},
+    {"kernels", benchKernels,
+        "[samples per call] [seconds per kernel]  vector kernels vs scalar, "
+        "checked bit for bit"},
+    {"resample", benchResample,
+        "[seconds of audio]  resampler presets: speed, THD+N and ripple"},
+    {"planar", benchPlanar,
+        "[seconds of audio]  interleaved vs planar pipeline at 2, 8 and 32 "
+        "channels"},
+    {"uring", benchUring,
+        "[seconds per stream] <audio file>...  io_uring vs blocking reads at "
+        "1, 16 and 256 streams"},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// MAIN
+int main(int argc, char *argv[]) {
+    
+    if (argc >= 2) {
+        for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+            if (strcmp(argv[1], benchmarks[i].name) == 0)
+                return benchmarks[i].fn(argc - 2, argv + 2);
+        }
+    }
+    
+    // unknown or missing benchmark name
+    printf("Usage: %s <benchmark> [arguments]\n", argv[0]);
+    for (size_t i = 0; i < NUM_BENCHMARKS; i++)
+        printf("  %s %s\n", benchmarks[i].name, benchmarks[i].usage);
+    
+    return ERR_BAD_COMMAND_LINE;
+}
@@ -0,0 +1,377 @@
+//
+//  main.c
+//  BasicAudioMixer
+//
+//  Plays many audio files at once through one output stream. Each voice
+//  has its own file, decoder state and ring (voice.h); a small pool of
+//  reader threads keeps all the rings topped up (readerPool.h); and a
+//  single callback sums the voices straight from their rings into the
+//  output. Playback finishes when every voice has played to the end.
+//
+//  The time the callback spends mixing is measured, and turned into the
+//  number of voices one core could mix within a fixed share of each
+//  buffer period (BAP_MIXER_BUDGET), which is printed at the end and added
+//  to the BAP_STATS output.
+//
+//  Usage: BasicAudioMixer <audio file> [audio file ...]
+//
+//  BAP_MIXER_VOICES:   voices (default: one per file; files are used in turn
+//                      if there are more voices than files)
+//  BAP_MIXER_READERS:  reader threads (default: one per online CPU)
+//  BAP_MIXER_RING_MS:  ring per voice (250 ms)
+//  BAP_MIXER_GAIN:     gain of every voice (default: 1 / voices, so that
+//                      the sum cannot clip)
+//  BAP_MIXER_BUDGET:   share of the buffer period the callback may spend
+//                      mixing, for the voices-per-core figure (0.5)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pa_util.h>
+#include "audioPlayerUtil.h"
+#include "playerStream.h"
+#include "deviceCatalogue.h"
+#include "playerConfig.h"
+#include "xrunStats.h"
+#include "callbackTiming.h"
+#include "playerStats.h"
+#include "playerScheduling.h"
+#include "voice.h"
+#include "readerPool.h"
+
+// Default ring per voice (ms)
+#define DEFAULT_RING_MS (250.0)
+
+// Default share of the buffer period for mixing
+#define DEFAULT_BUDGET (0.5)
+
+// struct type for the mixer
+struct mixer {
+    struct voice        *voices;
+    unsigned int        numVoices;
+    unsigned int        channels;
+    struct readerPool   pool;
+    struct xrunStats    xruns;
+    struct callbackTiming timing;
+    struct playerStats  stats;
+    struct playerScheduling scheduling;
+    double              budget;     // share of the buffer period (0 to 1)
+    double              deadline;   // buffer period (s)
+
+    // callback only
+    unsigned char       *wake;      // readers to wake after this buffer
+    double              mixTime;    // time spent mixing (s)
+    double              mixMax;     // longest mix of one buffer, per voice (s)
+    unsigned long long  voiceBuffers; // buffers mixed, summed over voices
+    unsigned long long  starved;    // voice buffers short of frames
+};
+
+// Callback function passed to portaudio to mix the voices
+PaStreamCallback mixCallback;
+
+// Open the voices on the files in turn; returns an error code
+static int openVoices(
+    struct mixer *m,
+    char *fileNames[],
+    int numFiles,
+    int maxChannels,
+    double ringMs
+);
+
+// Print how many voices one core could mix
+static void printMixerStats(const struct mixer *m);
+
+// Write the same figures as JSON members (a playerStatsWriter)
+static void writeMixerStatsJson(const void *data, FILE *file);
+
+// MAIN
+int main(int argc, char *argv[]) {
+    
+    int err = 0;
+    PaError err_pa = paNoError;
+    PaStream *stream = NULL;
+    
+    struct mixer m;
+    memset(&m, 0, sizeof(m));
+    initPlayerStats(&m.stats);
+    
+    // program needs at least 1 argument: audio file names
+    if (argc < 2) {
+        err = ERR_BAD_COMMAND_LINE;
+        goto cleanup;
+    }
+    
+    err_pa = Pa_Initialize();
+    if (err_pa) {
+        err = ERR_PORTAUDIO;
+        goto cleanup;
+    }
+    
+    // Set up output device, get max output channels
+    unsigned int maxChannels;
+    PaStreamParameters outputParameters;
+    getStreamParameters(&outputParameters, OUTPUT_DEVICE, &maxChannels);
+    outputParameters.sampleFormat = paFloat32; // mixing is done in float
+    
+    // open a voice per file, or more
+    struct playerConfig config;
+    getPlayerConfig(&config);
+    initPlayerScheduling(&m.scheduling);
+    double ringMs = getConfigDouble("BAP_MIXER_RING_MS", DEFAULT_RING_MS);
+    m.numVoices = (unsigned int) getConfigDouble("BAP_MIXER_VOICES", argc - 1);
+    if (m.numVoices < 1)
+        m.numVoices = 1;
+    m.voices = calloc(m.numVoices, sizeof(struct voice));
+    if (m.voices == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    err = openVoices(&m, argv + 1, argc - 1, maxChannels, ringMs);
+    if (err) {
+        goto cleanup;
+    }
+    int sRate = m.voices[0].audioFile.sRate;
+    outputParameters.channelCount = m.channels;
+    
+    // count glitches and time callbacks from the start
+    unsigned long framesPerBuffer = getFramesPerBuffer();
+    initXrunStats(&m.xruns);
+    m.deadline = (double) framesPerBuffer / sRate;
+    initCallbackTiming(&m.timing, m.deadline);
+    installCallbackTimingSignal();
+    m.budget = getConfigDouble("BAP_MIXER_BUDGET", DEFAULT_BUDGET);
+    addPlayerStats(&m.stats, writeMixerStatsJson, &m);
+    
+    // start the readers and let them fill every ring
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int numReaders =
+        (unsigned int) getConfigDouble("BAP_MIXER_READERS", cpus > 0 ? cpus : 1);
+    err = startReaderPool(&m.pool, m.voices, m.numVoices, numReaders,
+        &m.scheduling, m.voices[0].ring->frames, config.lowWatermark, config.highWatermark);
+    if (err) {
+        goto cleanup;
+    }
+    m.wake = calloc(m.pool.numReaders, 1);
+    if (m.wake == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    waitForReaderPool(&m.pool);
+    
+    // one stream for all the voices
+    err_pa = openPlayerStream(
+        &stream,
+        NULL,
+        &outputParameters,
+        sRate,
+        framesPerBuffer,
+        paClipOff,
+        mixCallback,
+        &m
+    );
+    if (err_pa) {
+        err = ERR_PORTAUDIO;
+        goto cleanup;
+    }
+    
+    err_pa = startPlayerStream(stream);
+    if (err_pa) {
+        err = ERR_PORTAUDIO;
+        goto cleanup;
+    }
+    
+    printf("Mixing %u voices with %u readers...\n", m.numVoices,
+        m.pool.numReaders);
+    while (isPlayerStreamActive(stream)) {
+        Pa_Sleep(100);
+        publishXrunStats(&m.xruns);
+        pollCallbackTiming(&m.timing, stream);
+    }
+    
+    // Finished playing
+    printf("Finished!\n");
+    stopReaderPool(&m.pool);
+    printXrunStats(&m.xruns);
+    printCallbackTiming(&m.timing);
+    printPlayerScheduling(&m.scheduling);
+    printMixerStats(&m);
+    writePlayerStats(&m.stats, "BasicAudioMixer", argv[1],
+        &m.voices[0].audioFile, framesPerBuffer, &m.xruns, &m.timing);
+    
+    goto cleanup;
+    
+cleanup:
+    // make sure all the toys are put away before exit
+    if (stream)
+        err = closePlayerStream(stream);
+    
+    stopReaderPool(&m.pool);
+    closeDeviceCatalogue();
+    Pa_Terminate();
+    
+    for (unsigned int v = 0; v < m.numVoices && m.voices != NULL; v++)
+        closeVoice(&m.voices[v]);
+    free(m.voices);
+    free(m.wake);
+    
+    printErrorMsg(err, err_pa, NULL);
+    
+    return err;
+}
+
+// Open the voices on the files in turn
+static int openVoices(
+    struct mixer *m,
+    char *fileNames[],
+    int numFiles,
+    int maxChannels,
+    double ringMs
+) {
+    
+    float gain = (float) getConfigDouble("BAP_MIXER_GAIN", 1.0 / m->numVoices);
+    
+    for (unsigned int v = 0; v < m->numVoices; v++) {
+        struct voice *voice = &m->voices[v];
+        const char *fileName = fileNames[v % numFiles];
+        // every voice plays at the first one's rate (resampled if need be),
+        // so that every ring is as long as the first, which the readers'
+        // watermarks are set from, and in as many channels as the widest
+        int sRate = v == 0 ? 0 : m->voices[0].audioFile.sRate;
+        int err = openVoice(voice, fileName, maxChannels, sRate, ringMs);
+        if (err)
+            return err;
+        voice->gain = gain;
+        if (voice->audioFile.channels > m->channels)
+            m->channels = voice->audioFile.channels;
+    }
+    
+    // mono voices are spread over every channel as they are mixed; others
+    // are mixed to the stream's channels as they are read
+    for (unsigned int v = 0; v < m->numVoices; v++) {
+        unsigned int channels = m->voices[v].audioFile.channels;
+        if (channels != 1 && channels != m->channels) {
+            int err = setVoiceChannels(&m->voices[v], m->channels);
+            if (err)
+                return err;
+        }
+    }
+    
+    return NO_ERROR;
+}
+
+// Callback function passed to portaudio to mix the voices
+int mixCallback(
+    const void *inputBuffer,
+    void *outputBuffer,
+    unsigned long framesPerBuffer,
+    const PaStreamCallbackTimeInfo* timeInfo,
+    PaStreamCallbackFlags statusFlags,
+    void *userData
+) {
+    
+    struct mixer *m = (struct mixer *) userData;
+    float *out = (float *) outputBuffer;
+    unsigned int active = 0, mixed = 0;
+    
+    (void) inputBuffer;
+    
+    scheduleCallbackThread(&m->scheduling);
+    callbackTimingEntry(&m->timing, timeInfo);
+    
+    memset(out, 0, framesPerBuffer * m->channels * sizeof(float));
+    double start = PaUtil_GetTime();
+    
+    for (unsigned int v = 0; v < m->numVoices; v++) {
+        struct voice *voice = &m->voices[v];
+        if (voice->done)
+            continue;
+    
+        // seeing the whole file read first means seeing all of its frames
+        int readComplete = atomic_load_explicit(&voice->readComplete,
+            memory_order_acquire);
+        size_t framesLeft;
+        size_t framesMixed = mixVoice(voice, out, framesPerBuffer,
+            m->channels, &framesLeft);
+        mixed++;
+    
+        if (framesMixed < framesPerBuffer) {
+            if (readComplete && framesLeft == 0) {
+                voice->done = 1;
+                continue;
+            }
+            m->starved++;
+        }
+        active++;
+    
+        // ask its reader for more
+        if (!readComplete && framesLeft < m->pool.lowWatermark)
+            m->wake[v % m->pool.numReaders] = 1;
+    }
+    
+    // wake each reader at most once, however many of its voices are low
+    for (unsigned int r = 0; r < m->pool.numReaders; r++) {
+        if (m->wake[r]) {
+            m->wake[r] = 0;
+            wakeReader(&m->pool, r);
+        }
+    }
+    
+    // the cost of mixing, per voice
+    double mixTime = PaUtil_GetTime() - start;
+    m->mixTime += mixTime;
+    m->voiceBuffers += mixed;
+    if (mixed > 0 && mixTime / mixed > m->mixMax)
+        m->mixMax = mixTime / mixed;
+    
+    // the voices are counted above; this only counts device glitches
+    countCallback(&m->xruns, outputBuffer, m->channels * sizeof(float),
+        framesPerBuffer, framesPerBuffer, statusFlags, 0);
+    markFirstSample(&m->stats, framesPerBuffer, timeInfo);
+    
+    callbackTimingExit(&m->timing);
+    
+    return active > 0 ? paContinue : paComplete;
+}
+
+// Voices one core could mix within the budget, at a cost per voice buffer
+static double getVoicesPerCore(const struct mixer *m, double costPerVoice) {
+    
+    return costPerVoice > 0.0 ? m->budget * m->deadline / costPerVoice : 0.0;
+}
+
+// Print how many voices one core could mix
+static void printMixerStats(const struct mixer *m) {
+    
+    double mean = m->voiceBuffers > 0 ? m->mixTime / m->voiceBuffers : 0.0;
+    
+    printf("Mixing: %.3f us per voice per buffer mean, %.3f us worst; "
+        "%llu voice buffers short of frames\n", 1e6 * mean, 1e6 * m->mixMax,
+        m->starved);
+    printf("Voices per core at %.0f%% of the %.2f ms buffer period: "
+        "%.0f mean, %.0f worst case\n", 1e2 * m->budget, 1e3 * m->deadline,
+        getVoicesPerCore(m, mean), getVoicesPerCore(m, m->mixMax));
+    printf("Readers: %u threads, %.3f s of CPU for %u voices\n",
+        m->pool.numReaders, getReaderPoolCpuTime(&m->pool), m->numVoices);
+}
+
+// Write the mixer statistics as JSON members
+static void writeMixerStatsJson(const void *data, FILE *file) {
+    
+    const struct mixer *m = (const struct mixer *) data;
+    double mean = m->voiceBuffers > 0 ? m->mixTime / m->voiceBuffers : 0.0;
+    
+    fprintf(file, "  \"voices\": %u,\n"
+        "  \"readers\": %u,\n"
+        "  \"starvedVoiceBuffers\": %llu,\n"
+        "  \"mixUsPerVoiceMean\": %.3f,\n"
+        "  \"mixUsPerVoiceMax\": %.3f,\n"
+        "  \"mixBudget\": %.3f,\n"
+        "  \"voicesPerCoreMean\": %.0f,\n"
+        "  \"voicesPerCoreWorst\": %.0f,\n"
+        "  \"readerCpuSecondsTotal\": %.6f", m->numVoices, m->pool.numReaders,
+        m->starved, 1e6 * mean, 1e6 * m->mixMax, m->budget,
+        getVoicesPerCore(m, mean), getVoicesPerCore(m, m->mixMax),
+        getReaderPoolCpuTime(&m->pool));
+}
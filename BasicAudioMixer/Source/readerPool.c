@@ -0,0 +1,141 @@
+//
+//  readerPool.c
+//  BasicAudioMixer
+//
+//  A small pool of reader threads for all the voices.
+//
+
+#include <stdlib.h>
+#include "readerPool.h"
+
+// Top up the voices of one reader; returns how many are still being read
+static unsigned int refillVoices(struct voiceReader *r, size_t lowWatermark) {
+    
+    struct readerPool *pool = r->pool;
+    unsigned int reading = 0;
+    
+    for (unsigned int v = r->index; v < pool->numVoices; v += pool->numReaders) {
+        struct voice *voice = &pool->voices[v];
+        if (getFrameRingBufferReadAvailable(voice->ring) < lowWatermark)
+            refillVoice(voice, pool->highWatermark);
+        reading += !atomic_load_explicit(&voice->readComplete,
+            memory_order_relaxed);
+    }
+    
+    return reading;
+}
+
+// Keep one reader's voices topped up
+static void* readerThread(void *data) {
+    
+    struct voiceReader *r = (struct voiceReader *) data;
+    struct readerPool *pool = r->pool;
+    double start = getThreadTime();
+    
+    scheduleReaderThread(pool->scheduling);
+    
+    // fill every ring before the stream starts
+    unsigned int reading = refillVoices(r, pool->highWatermark);
+    atomic_fetch_add(&pool->primed, 1);
+    
+    while (reading > 0 && !atomic_load(&pool->quit)) {
+        waitForInterrupt(&r->event);
+        reading = refillVoices(r, pool->lowWatermark);
+    }
+    
+    r->cpuTime = getThreadTime() - start;
+    
+    return NULL;
+}
+
+// Start the readers
+int startReaderPool(
+    struct readerPool *pool,
+    struct voice *voices,
+    unsigned int numVoices,
+    unsigned int numReaders,
+    struct playerScheduling *scheduling,
+    size_t ringFrames,
+    double lowWatermark,
+    double highWatermark
+) {
+    
+    if (numReaders > numVoices)
+        numReaders = numVoices;
+    if (numReaders == 0)
+        numReaders = 1;
+    
+    pool->voices = voices;
+    pool->numVoices = numVoices;
+    pool->numReaders = numReaders;
+    pool->scheduling = scheduling;
+    pool->lowWatermark = (size_t) (lowWatermark * ringFrames);
+    pool->highWatermark = (size_t) (highWatermark * ringFrames);
+    atomic_init(&pool->primed, 0);
+    atomic_init(&pool->quit, 0);
+    pool->cpuTime = 0.0;
+    
+    pool->readers = calloc(numReaders, sizeof(struct voiceReader));
+    if (pool->readers == NULL)
+        return ERR_BAD_ALLOC;
+    
+    for (unsigned int r = 0; r < numReaders; r++) {
+        struct voiceReader *reader = &pool->readers[r];
+        reader->pool = pool;
+        reader->index = r;
+        int err = initRefillEvent(&reader->event, ringFrames, lowWatermark,
+            highWatermark);
+        if (err)
+            return err;
+        reader->started = pthread_create(&reader->thread, NULL, readerThread,
+            reader) == 0;
+        if (!reader->started) {
+            // stopReaderPool() only closes the events of started readers
+            closeRefillEvent(&reader->event);
+            return ERR_BAD_ALLOC;
+        }
+    }
+    
+    return NO_ERROR;
+}
+
+// Wait until every ring has been filled
+void waitForReaderPool(struct readerPool *pool) {
+    
+    while (atomic_load(&pool->primed) < pool->numReaders)
+        Pa_Sleep(10);
+}
+
+// Wake a reader (callback side)
+void wakeReader(struct readerPool *pool, unsigned int reader) {
+    
+    interruptRefillWait(&pool->readers[reader].event);
+}
+
+// Stop the readers and free the pool
+void stopReaderPool(struct readerPool *pool) {
+    
+    if (pool->readers == NULL)
+        return;
+    
+    atomic_store(&pool->quit, 1);
+    for (unsigned int r = 0; r < pool->numReaders; r++) {
+        struct voiceReader *reader = &pool->readers[r];
+        if (reader->started) {
+            interruptRefillWait(&reader->event);
+            pthread_join(reader->thread, NULL);
+            closeRefillEvent(&reader->event);
+            reader->started = 0;
+        }
+        pool->cpuTime += reader->cpuTime;
+    }
+    
+    free(pool->readers);
+    pool->readers = NULL;
+}
+
+// Total CPU time the readers used (s)
+double getReaderPoolCpuTime(const struct readerPool *pool) {
+    
+    return pool->cpuTime;
+}
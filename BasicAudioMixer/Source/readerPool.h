@@ -0,0 +1,81 @@
+//
+//  readerPool.h
+//  BasicAudioMixer
+//
+//  A small pool of reader threads that keeps the rings of all the voices
+//  topped up. Voice v is served by reader v % readers, so each ring still
+//  has exactly one producer. A reader sleeps on its own refillEvent until
+//  the callback sees one of its voices drop below the low watermark, then
+//  tops up every one of its voices that is below it. The callback only
+//  ever wakes each reader once per buffer, however many voices are low.
+//
+
+#ifndef readerPool_h
+#define readerPool_h
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include "refillEvent.h"
+#include "playerScheduling.h"
+#include "voice.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+struct readerPool;
+
+// struct type for one reader thread
+struct voiceReader {
+    struct readerPool   *pool;
+    unsigned int        index;
+    pthread_t           thread;
+    int                 started;
+    struct refillEvent  event;      // the callback wakes it through this
+    double              cpuTime;    // CPU time it used (s), once it exits
+};
+
+// struct type for the pool
+struct readerPool {
+    struct voice        *voices;
+    unsigned int        numVoices;
+    struct voiceReader  *readers;
+    unsigned int        numReaders;
+    struct playerScheduling *scheduling; // applied by each reader
+    size_t              lowWatermark;   // frames that wake a reader
+    size_t              highWatermark;  // frames it tops up to
+    atomic_uint         primed;         // readers that have filled their voices
+    atomic_int          quit;
+    double              cpuTime;        // used by the readers (s), once stopped
+};
+
+// Start the readers, which apply the reader scheduling to themselves and
+// fill every ring before they wait. Returns NO_ERROR or ERR_BAD_ALLOC.
+int startReaderPool(
+    struct readerPool *pool,
+    struct voice *voices,
+    unsigned int numVoices,
+    unsigned int numReaders,
+    struct playerScheduling *scheduling,
+    size_t ringFrames,
+    double lowWatermark,
+    double highWatermark
+);
+
+// Wait until every ring has been filled
+void waitForReaderPool(struct readerPool *pool);
+
+// Callback side: wake a reader. Wait-free.
+void wakeReader(struct readerPool *pool, unsigned int reader);
+
+// Stop the readers and free the pool
+void stopReaderPool(struct readerPool *pool);
+
+// Total CPU time the readers used (s); call after stopReaderPool()
+double getReaderPoolCpuTime(const struct readerPool *pool);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* readerPool_h */
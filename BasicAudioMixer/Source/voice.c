@@ -0,0 +1,152 @@
+//
+//  voice.c
+//  BasicAudioMixer
+//
+//  One voice of the mixer.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "voice.h"
+
+// Open a voice
+int openVoice(
+    struct voice *v,
+    const char *fileName,
+    int maxChannels,
+    int sRate,
+    double ringMs
+) {
+    
+    memset(v, 0, sizeof(*v));
+    v->gain = 1.0f;
+    v->kernels = getAudioKernels();
+    atomic_init(&v->readComplete, 0);
+    
+    int err = openAudioFile(fileName, &v->audioFile, maxChannels);
+    if (err)
+        return err;
+    
+    // the ring holds ringMs at the rate it is read at, not the file's
+    if (sRate > 0 && v->audioFile.sRate != sRate) {
+        printf("Resampling %s from %d Hz to %d Hz\n", fileName,
+            v->audioFile.sRate, sRate);
+        err = setOutputRate(&v->audioFile, sRate);
+        if (err)
+            return err;
+    }
+    
+    size_t ringFrames = (size_t) (ringMs * v->audioFile.sRate / 1e3);
+    v->ring = createFrameRingBuffer(ringFrames > 0 ? ringFrames : 1,
+        v->audioFile.bytesPerFrame);
+    if (v->ring == NULL)
+        return ERR_BAD_ALLOC;
+    
+    return NO_ERROR;
+}
+
+// Mix the voice's file to a number of channels
+int setVoiceChannels(struct voice *v, unsigned int channels) {
+    
+    int err = setOutputChannels(&v->audioFile, channels);
+    if (err)
+        return err;
+    
+    // frames are a different size now
+    size_t ringFrames = v->ring->frames;
+    freeFrameRingBuffer(v->ring);
+    v->ring = createFrameRingBuffer(ringFrames, v->audioFile.bytesPerFrame);
+    if (v->ring == NULL)
+        return ERR_BAD_ALLOC;
+    
+    return NO_ERROR;
+}
+
+// Close the file and free the ring
+void closeVoice(struct voice *v) {
+    
+    closeAudioFile(&v->audioFile);
+    if (v->ring != NULL)
+        freeFrameRingBuffer(v->ring);
+    v->ring = NULL;
+}
+
+// Fill the ring from the file (reader side)
+size_t refillVoice(struct voice *v, size_t fill) {
+    
+    size_t buffered = getFrameRingBufferReadAvailable(v->ring);
+    if (buffered >= fill || atomic_load_explicit(&v->readComplete,
+            memory_order_relaxed))
+        return 0;
+    
+    void *ptr[2] = {0};
+    size_t sizes[2] = {0};
+    size_t space = getFrameRingBufferWriteRegions(v->ring, fill - buffered,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    if (space == 0)
+        return 0;
+    
+    sf_count_t framesRead = 0;
+    for (int i = 0; i < 2 && ptr[i] != NULL; ++i)
+        framesRead += readAudioFile(&v->audioFile, ptr[i], (sf_count_t) sizes[i]);
+    advanceFrameRingBufferWriteIndex(v->ring, (size_t) framesRead);
+    
+    // after the frames, so that the callback never finishes a voice early;
+    // only a read that came back short, not a full ring, ends the file
+    v->frameCount += framesRead;
+    if (v->frameCount >= v->audioFile.frames || (size_t) framesRead < space)
+        atomic_store_explicit(&v->readComplete, 1, memory_order_release);
+    
+    return (size_t) framesRead;
+}
+
+// dst += src * gain, spreading each mono sample over every channel
+static void mixMonoSamples(
+    float *restrict dst,
+    const float *restrict src,
+    size_t frames,
+    unsigned int channels,
+    float gain
+) {
+    
+    for (size_t f = 0; f < frames; f++) {
+        float x = src[f] * gain;
+        for (unsigned int c = 0; c < channels; c++)
+            dst[f * channels + c] += x;
+    }
+}
+
+// Add the voice to the output (callback side)
+size_t mixVoice(
+    struct voice *v,
+    float *out,
+    size_t frames,
+    unsigned int channels,
+    size_t *framesLeft
+) {
+    
+    void *ptr[2] = {0};
+    size_t sizes[2] = {0};
+    size_t mixed = 0;
+    
+    getFrameRingBufferReadRegions(v->ring, frames,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+    // straight from the ring into the output, without a copy
+    for (int i = 0; i < 2 && ptr[i] != NULL; ++i) {
+        if (v->audioFile.channels == channels) {
+            v->kernels->mixAccumulate(out + mixed * channels,
+                (const float *) ptr[i], sizes[i] * channels, v->gain);
+        }
+        else {
+            mixMonoSamples(out + mixed * channels, (const float *) ptr[i],
+                sizes[i], channels, v->gain);
+        }
+        mixed += sizes[i];
+    }
+    advanceFrameRingBufferReadIndex(v->ring, mixed);
+    
+    *framesLeft = getFrameRingBufferReadAvailable(v->ring);
+    
+    return mixed;
+}
@@ -0,0 +1,80 @@
+//
+//  voice.h
+//  BasicAudioMixer
+//
+//  One voice of the mixer: an audio file with its own decoder state, and
+//  the ring that carries its frames from a reader thread to the callback.
+//  This is struct threadData from BasicAudioPlayerCallbackThreaded without
+//  the thread: a small pool of readers serves all the voices
+//  (readerPool.h). Voices are read as float, and a mono voice is spread
+//  over every channel of the stream.
+//
+
+#ifndef voice_h
+#define voice_h
+
+#include <stdatomic.h>
+#include "audioPlayerUtil.h"
+#include "frameRingBuffer.h"
+#include "audioKernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for one voice
+struct voice {
+    struct audioFileInfo    audioFile;
+    struct frameRingBuffer  *ring;
+    float                   gain;
+    const struct audioKernels *kernels;     // mixes it into the output
+
+    // reader only
+    sf_count_t              frameCount;     // frames read from the file
+
+    // written by the reader
+    atomic_int              readComplete;   // the whole file is in the ring
+
+    // callback only
+    int                     done;           // played to the end
+};
+
+// Open a voice on a file, resampled to sRate unless that is 0, with a ring
+// holding at least ringMs of it at that rate. Returns NO_ERROR or an error
+// code.
+int openVoice(
+    struct voice *v,
+    const char *fileName,
+    int maxChannels,
+    int sRate,
+    double ringMs
+);
+
+// Mix the voice's file to a number of channels (setOutputChannels()), with
+// a new ring of the same length. Call before it is read.
+int setVoiceChannels(struct voice *v, unsigned int channels);
+
+// Close the file and free the ring
+void closeVoice(struct voice *v);
+
+// Reader side: fill the ring up to fill frames from the file. The voice is
+// marked readComplete once a read comes back short of the space there was.
+// Returns the number of frames read.
+size_t refillVoice(struct voice *v, size_t fill);
+
+// Callback side: add up to frames frames of the voice, times its gain, to
+// out (float, interleaved with the given number of channels). Returns the
+// number of frames mixed, and the frames left in the ring in framesLeft.
+size_t mixVoice(
+    struct voice *v,
+    float *out,
+    size_t frames,
+    unsigned int channels,
+    size_t *framesLeft
+);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* voice_h */
@@ -9,6 +9,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "audioPlayerUtil.h"
+#include "playerStream.h"
+#include "deviceCatalogue.h"
+#include "xrunStats.h"
+#include "callbackTiming.h"
+#include "playerStats.h"
 
 // MAIN
 int main(int argc, char *argv[]) {
@@ -22,6 +27,10 @@ int main(int argc, char *argv[]) {
         .fileID = NULL
     };
     
+    // start the clock for the statistics
+    struct playerStats stats;
+    initPlayerStats(&stats);
+    
     // program needs 1 argument: audio file name
     if (argc != 2) {
         // handle this error
@@ -50,28 +59,53 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
-    // set output channels based on file
-    outputParameters.channelCount = audioFile.channels;
+    // set output channels based on file (or BAP_CHANNELS), mixing the file
+    // to them if need be
+    err = negotiateChannels(&audioFile, &outputParameters, maxChannels);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // run the stream at the file's rate, or resample it
+    err = negotiateSampleRate(&audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // pass the file's samples through unconverted if possible
+    err = negotiateSampleFormat(&audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
     
     // Allocate buffer memory
     // Depends on number of channels in audio file,
     // so cannot be done until now
+    unsigned long framesPerBuffer = getFramesPerBuffer();
     audioFile.buffer =
-        malloc(sizeof(float)*FRAMES_PER_BUFFER*(audioFile.channels));
+        malloc(audioFile.bytesPerFrame*framesPerBuffer);
     if (audioFile.buffer==NULL) {
         // check memory was allocated
         err = ERR_BAD_ALLOC;
         goto cleanup;
     }
     
+    // count underflows and time the write loop, as the callback players do
+    // for their callbacks
+    struct xrunStats xruns;
+    initXrunStats(&xruns);
+    static struct callbackTiming timing; // too big for the stack
+    initCallbackTiming(&timing, (double) framesPerBuffer / audioFile.sRate);
+    installCallbackTimingSignal();
+    
     // open stream for outputting audio file via callback
     PaStream *stream = NULL; // Audio stream info
-    err_pa = Pa_OpenStream(
+    err_pa = openPlayerStream(
         &stream,
         NULL,
         &outputParameters,
         audioFile.sRate,
-        FRAMES_PER_BUFFER,
+        framesPerBuffer,
         paClipOff,
         NULL,
         &audioFile
@@ -82,7 +116,7 @@ int main(int argc, char *argv[]) {
     }
     
     // start playing
-    err_pa = Pa_StartStream(stream);
+    err_pa = startPlayerStream(stream);
     if (err_pa) {
         err = ERR_PORTAUDIO;
         goto cleanup;
@@ -91,18 +125,32 @@ int main(int argc, char *argv[]) {
     // this is the blocking interface
     sf_count_t numberFramesRead; // Number of frames read from audio file
     do { // read from file and write to buffer
-        numberFramesRead = sf_readf_float(audioFile.fileID,
-            audioFile.buffer, FRAMES_PER_BUFFER);
+        callbackTimingEntry(&timing, NULL);
+        numberFramesRead = readAudioFile(&audioFile,
+            audioFile.buffer, framesPerBuffer);
+        callbackTimingExit(&timing);
         // write buffer to stream
-        err_pa = Pa_WriteStream(stream, audioFile.buffer, numberFramesRead);
-        if (err_pa) {
+        err_pa = writePlayerStream(stream, audioFile.buffer, numberFramesRead);
+        if (err_pa && err_pa != paOutputUnderflowed) {
             err = ERR_PORTAUDIO;
             goto cleanup;
         }
+        // an underflow is a glitch, not a reason to stop
+        countCallback(&xruns, audioFile.buffer, audioFile.bytesPerFrame,
+            (unsigned long) numberFramesRead, (unsigned long) numberFramesRead,
+            err_pa == paOutputUnderflowed ? paOutputUnderflow : 0, 0);
+        err_pa = paNoError;
+        markFirstSample(&stats, (unsigned long) numberFramesRead, NULL);
+        pollCallbackTiming(&timing, stream);
     } while (numberFramesRead > 0);
     
     // Finished playing
     printf("Finished!\n");
+    printXrunStats(&xruns);
+    printCallbackTiming(&timing);
+    printReadaheadStats(&audioFile.readahead);
+    writePlayerStats(&stats, "BasicAudioPlayerBlocking", argv[1], &audioFile,
+        framesPerBuffer, &xruns, &timing);
     
     goto cleanup;
     
@@ -110,9 +158,10 @@ cleanup:
     // make sure all the toys are put away befor exit
     
     if (stream) // close stream
-        err = Pa_CloseStream(stream);
+        err = closePlayerStream(stream);
     
-    // terminate portaudio
+    // save what was learnt about the device, and terminate portaudio
+    closeDeviceCatalogue();
     Pa_Terminate();
     
     // close audio file
@@ -8,7 +8,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "audioPlayerUtil.h"
+#include "playerStream.h"
+#include "deviceCatalogue.h"
+#include "xrunStats.h"
+#include "callbackTiming.h"
+#include "playerStats.h"
+#include "preloadedAudio.h"
+#include "playerScheduling.h"
+
+// struct type for the data passed to the callback
+struct callbackData {
+    struct audioFileInfo    *audioFile;
+    struct xrunStats        *xruns;
+    struct callbackTiming   *timing;
+    struct playerStats      *stats;
+    struct preloadedAudio   *preload;   // NULL when streaming from the file
+    struct playerScheduling *scheduling;
+};
 
 // Callback function passed to portaudio to play audio file
 PaStreamCallback playCallback;
@@ -25,6 +43,15 @@ int main(int argc, char *argv[]) {
         .fileID = NULL
     };
     
+    // the whole file, if it is small enough to preload
+    struct preloadedAudio preload = {
+        .data = NULL
+    };
+    
+    // start the clock for the statistics
+    struct playerStats stats;
+    initPlayerStats(&stats);
+    
     // program needs 1 argument: audio file name
     if (argc != 2) {
         // handle this error
@@ -53,31 +80,76 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
-    // set output channels based on file
-    outputParameters.channelCount = audioFile.channels;
+    // set output channels based on file (or BAP_CHANNELS), mixing the file
+    // to them if need be
+    err = negotiateChannels(&audioFile, &outputParameters, maxChannels);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // run the stream at the file's rate, or resample it
+    err = negotiateSampleRate(&audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // pass the file's samples through unconverted if possible
+    err = negotiateSampleFormat(&audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // the callback's priority and CPUs, and memory locking (there is no
+    // reader thread: the callback reads the file itself)
+    struct playerScheduling scheduling;
+    initPlayerScheduling(&scheduling);
     
     // Allocate buffer memory
     // Depends on number of channels in audio file,
     // so cannot be done until now
+    unsigned long framesPerBuffer = getFramesPerBuffer();
     audioFile.buffer =
-        malloc(sizeof(float)*FRAMES_PER_BUFFER*(audioFile.channels));
+        malloc(audioFile.bytesPerFrame*framesPerBuffer);
     if (audioFile.buffer==NULL) {
         // check memory was allocated
         err = ERR_BAD_ALLOC;
         goto cleanup;
     }
     
+    // decode short files up front, so the callback does no file I/O
+    if (shouldPreloadAudioFile(&audioFile)) {
+        err = preloadAudioFile(&preload, &audioFile);
+        if (err) {
+            goto cleanup;
+        }
+    }
+    
+    // count glitches and time callbacks from the start
+    struct xrunStats xruns;
+    initXrunStats(&xruns);
+    static struct callbackTiming timing; // too big for the stack
+    initCallbackTiming(&timing, (double) framesPerBuffer / audioFile.sRate);
+    installCallbackTimingSignal();
+    struct callbackData data = {
+        .audioFile = &audioFile,
+        .xruns = &xruns,
+        .timing = &timing,
+        .stats = &stats,
+        .preload = preload.data != NULL ? &preload : NULL,
+        .scheduling = &scheduling
+    };
+    
     // open stream for outputting audio file via callback
     PaStream *stream = NULL;                // Audio stream info
-    err_pa = Pa_OpenStream(
+    err_pa = openPlayerStream(
         &stream,
         NULL,
         &outputParameters,
         audioFile.sRate,
-        FRAMES_PER_BUFFER,
+        framesPerBuffer,
         paClipOff,
         playCallback,
-        &audioFile
+        &data
     );
     if (err_pa) {
         err = ERR_PORTAUDIO;
@@ -85,7 +157,7 @@ int main(int argc, char *argv[]) {
     }
     
     // start playing
-    err_pa = Pa_StartStream(stream);
+    err_pa = startPlayerStream(stream);
     if (err_pa) {
         err = ERR_PORTAUDIO;
         goto cleanup;
@@ -93,11 +165,20 @@ int main(int argc, char *argv[]) {
     
     // wait for audio file to finish playing
     printf("Now playing...\n");
-    while (Pa_IsStreamActive(stream))
+    while (isPlayerStreamActive(stream)) {
         Pa_Sleep(100);
+        publishXrunStats(&xruns);
+        pollCallbackTiming(&timing, stream);
+    }
     
     // Finished playing
     printf("Finished!\n");
+    printXrunStats(&xruns);
+    printCallbackTiming(&timing);
+    printReadaheadStats(&audioFile.readahead);
+    printPlayerScheduling(&scheduling);
+    writePlayerStats(&stats, "BasicAudioPlayerCallback", argv[1], &audioFile,
+        framesPerBuffer, &xruns, &timing);
     
     goto cleanup;
     
@@ -105,13 +186,15 @@ cleanup:
     // make sure all the toys are put away befor exit
     
     if (stream)
-        err = Pa_CloseStream(stream); // close stream
+        err = closePlayerStream(stream); // close stream
     
-    // terminate portaudio
+    // save what was learnt about the device, and terminate portaudio
+    closeDeviceCatalogue();
     Pa_Terminate();
     
     // close audio file
     closeAudioFile(&audioFile);
+    freePreloadedAudio(&preload);
     
     // print an error msg if applicable
     printErrorMsg(err, err_pa, audioFile.fileID);
@@ -129,26 +212,55 @@ int playCallback(
     void *userData
 ) {
     // cast inputs to correct data type
-    struct audioFileInfo *data = (struct audioFileInfo *) userData;
-    float *out = (float*)outputBuffer;
+    struct callbackData *data = (struct callbackData *) userData;
+    struct audioFileInfo *audioFile = data->audioFile;
+    
+    // raise this thread's priority and pin it, the first time through
+    scheduleCallbackThread(data->scheduling);
+    
+    // time the callback
+    callbackTimingEntry(data->timing, timeInfo);
     
     // avoid unused variable warnings
     (void) inputBuffer;
-    (void) timeInfo;
-    (void) statusFlags;
     
-    // copy data into buffer prior to output
-    sf_count_t numberFramesRead =
-        sf_readf_float(data->fileID, data->buffer, framesPerBuffer);
+    sf_count_t numberFramesRead;
+    if (data->preload != NULL) {
+        // preloaded: just copy the next frames out of the arena
+        numberFramesRead = readPreloadedAudio(data->preload, outputBuffer,
+            (sf_count_t) framesPerBuffer);
+    }
+    else {
+        // copy data into buffer prior to output
+        numberFramesRead =
+            readAudioFile(audioFile, audioFile->buffer, framesPerBuffer);
+        if (numberFramesRead < 0)
+            numberFramesRead = 0;
+        
+        // frames are interleaved and in the stream's sample format, so they
+        // can be copied to the output as they are
+        memcpy(outputBuffer, audioFile->buffer,
+            (size_t) numberFramesRead * audioFile->bytesPerFrame);
+    }
+    
+    // fill the rest with silence; a short read means the file has ended
+    countCallback(
+        data->xruns,
+        outputBuffer,
+        audioFile->bytesPerFrame,
+        (unsigned long) numberFramesRead,
+        framesPerBuffer,
+        statusFlags,
+        numberFramesRead < (sf_count_t) framesPerBuffer
+    );
+    
+    // note when the first audio goes out
+    markFirstSample(data->stats, (unsigned long) numberFramesRead,
+        timeInfo);
+    
+    callbackTimingExit(data->timing);
     
     if (numberFramesRead>0) { // If data to read
-        unsigned int i, n;
-        for ( i=0; i<numberFramesRead; i++ ) { // iterature through frames
-            for ( n=0; n < data->channels; n++ ) {
-                // channels interleaved, so increment accesses specific channel
-                *out++ = *(data->buffer)++; // write the buffer to the output
-            }
-        }
         return paContinue; // continue playing
     }
     else {
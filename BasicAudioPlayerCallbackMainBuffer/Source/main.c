@@ -7,12 +7,17 @@
 //
 
 #include <stdio.h>
-#include <pa_ringbuffer.h>
-#include <pa_util.h>
 #include "audioPlayerUtil.h"
-
-// Constants
-#define NUM_WRITES_PER_BUFFER (4)
+#include "playerStream.h"
+#include "deviceCatalogue.h"
+#include "adaptiveRing.h"
+#include "playerConfig.h"
+#include "refillEvent.h"
+#include "startPolicy.h"
+#include "playerScheduling.h"
+#include "xrunStats.h"
+#include "callbackTiming.h"
+#include "playerStats.h"
 
 // struct type for storing audio file and other thread info
 struct threadData {
@@ -20,8 +25,13 @@ struct threadData {
     unsigned short          readComplete;
     int                     threadSyncFlag;
     sf_count_t              frameCount;
-    float                   *ringBufferData;
-    PaUtilRingBuffer        ringBuffer;
+    struct adaptiveRing     ringBuffer;
+    struct refillEvent      refillEvent;
+    struct startPolicy      start;
+    struct playerScheduling scheduling;
+    struct xrunStats        xruns;
+    struct callbackTiming   timing;
+    struct playerStats      stats;
     pthread_t               threadHandle;
 };
 
@@ -29,7 +39,9 @@ struct threadData {
 PaStreamCallback playCallback;
 
 // Thread functions
-void bufferAudioFile(struct threadData* pData);
+void bufferAudioFile(struct threadData* pData, PaStream *stream,
+    int untilPrimed);
+sf_count_t readPlanes(struct threadData* pData, size_t frames);
 
 // function for calculating the next power of 2
 unsigned int nextPowerOf2(unsigned int val);
@@ -47,9 +59,12 @@ int main(int argc, char *argv[]) {
         .threadSyncFlag = 0,
         .readComplete = 0,
         .frameCount = 0,
-        .ringBufferData = NULL
+        .ringBuffer.readRing = NULL
     };
     
+    // start the clock for the statistics
+    initPlayerStats(&pData.stats);
+    
     // program needs 1 argument: audio file name
     if (argc != 2) {
         // handle this error
@@ -78,42 +93,79 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
-    // set output channels based on file
-    outputParameters.channelCount = pData.audioFile.channels;
+    // set output channels based on file (or BAP_CHANNELS), mixing the file
+    // to them if need be
+    err = negotiateChannels(&pData.audioFile, &outputParameters, maxChannels);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // run the stream at the file's rate, or resample it
+    err = negotiateSampleRate(&pData.audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
     
-    // allocate ring buffer memory
-    unsigned int numSamples = nextPowerOf2((unsigned)
-        (pData.audioFile.sRate * 0.5 * pData.audioFile.channels)
-    ); // Number of samples in ring buffer
-    pData.ringBufferData =
-        (float *) PaUtil_AllocateMemory(sizeof(float)*numSamples);
+    // interleaved frames, or a buffer per channel
+    err = negotiateLayout(&pData.audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
     
-    if(pData.ringBufferData == NULL) {
-        // check memory was allocated
-        err = ERR_BAD_ALLOC;
+    // pass the file's samples through unconverted if possible
+    err = negotiateSampleFormat(&pData.audioFile, &outputParameters);
+    if (err) {
         goto cleanup;
     }
     
-    // initialise ring buffer
-    err_pa = PaUtil_InitializeRingBuffer(
+    // get run-time settings
+    struct playerConfig config;
+    getPlayerConfig(&config);
+    initPlayerScheduling(&pData.scheduling);
+    
+    // allocate ring buffer memory (half a second of audio, or sized
+    // adaptively)
+    err = createAdaptiveRing(
         &pData.ringBuffer,
-        sizeof(float),
-        numSamples,
-        pData.ringBufferData
+        pData.audioFile.sRate,
+        pData.audioFile.bytesPerFrame
     );
-    if (err_pa) {
-        err = ERR_PORTAUDIO;
+    if (err) {
+        goto cleanup;
+    }
+    if (outputParameters.sampleFormat & paNonInterleaved)
+        setAdaptiveRingPlanar(&pData.ringBuffer, pData.audioFile.channels);
+    
+    // set up the notification the callback uses to wake the reader
+    err = initRefillEvent(
+        &pData.refillEvent,
+        getAdaptiveRingCapacity(&pData.ringBuffer),
+        config.lowWatermark,
+        config.highWatermark
+    );
+    if (err) {
         goto cleanup;
     }
     
+    // count glitches and time callbacks from the start
+    initXrunStats(&pData.xruns);
+    unsigned long framesPerBuffer = getFramesPerBuffer();
+    initCallbackTiming(&pData.timing,
+        (double) framesPerBuffer / pData.audioFile.sRate);
+    installCallbackTimingSignal();
+    
+    // prime just enough to start on (or fill the ring first)
+    initStartPolicy(&pData.start, pData.audioFile.sRate, framesPerBuffer,
+        pData.refillEvent.highWatermark);
+    
     // open stream for outputting audio file via callback
     PaStream *stream = NULL; // Audio stream info
-    err_pa = Pa_OpenStream(
+    err_pa = openPlayerStream(
         &stream,
         NULL,
         &outputParameters,
         pData.audioFile.sRate,
-        FRAMES_PER_BUFFER,
+        framesPerBuffer,
         paClipOff,
         playCallback,
         &pData
@@ -123,23 +175,42 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
+    // this thread is the reader
+    scheduleReaderThread(&pData.scheduling);
+    
+    // put the start of the file on to the ring buffer
+    bufferAudioFile(&pData, stream, 1);
+    
     // start playing
-    err_pa = Pa_StartStream(stream);
+    err_pa = startPlayerStream(stream);
     if (err_pa) {
         err = ERR_PORTAUDIO;
         goto cleanup;
     }
     
-    // start putting audio data on to the ring buffer
+    // carry on putting audio data on to the ring buffer
     printf("Now playing...\n");
-    bufferAudioFile(&pData);
+    bufferAudioFile(&pData, stream, 0);
     
     // wait for audio file to finish playing
-    while (Pa_IsStreamActive(stream))
+    while (isPlayerStreamActive(stream)) {
         Pa_Sleep(100);
+        publishXrunStats(&pData.xruns);
+        pollCallbackTiming(&pData.timing, stream);
+    }
     
     // Finished playing
     printf("Finished!\n");
+    printXrunStats(&pData.xruns);
+    printCallbackTiming(&pData.timing);
+    printReadaheadStats(&pData.audioFile.readahead);
+    printStartPolicy(&pData.start);
+    printPlayerScheduling(&pData.scheduling);
+    printRefillStats(&pData.refillEvent);
+    printAdaptiveRingStats(&pData.ringBuffer);
+    writePlayerStats(&pData.stats, "BasicAudioPlayerCallbackMainBuffer",
+        argv[1], &pData.audioFile, framesPerBuffer, &pData.xruns,
+        &pData.timing);
     
     goto cleanup;
     
@@ -147,17 +218,20 @@ cleanup:
     // make sure all the toys are put away befor exit
     
     if (stream) // close stream
-        err = Pa_CloseStream(stream);
+        err = closePlayerStream(stream);
     
-    // terminate portaudio
+    // save what was learnt about the device, and terminate portaudio
+    closeDeviceCatalogue();
     Pa_Terminate();
     
     // close audio file
     closeAudioFile(&pData.audioFile);
     
     // free allocated memory
-    if (pData.ringBufferData != NULL)
-        PaUtil_FreeMemory(pData.ringBufferData);
+    if (pData.ringBuffer.readRing != NULL) {
+        closeRefillEvent(&pData.refillEvent);
+        freeAdaptiveRing(&pData.ringBuffer);
+    }
     
     // print an error msg if applicable
     printErrorMsg(err, err_pa, pData.audioFile.fileID);
@@ -177,26 +251,63 @@ int playCallback(
     
     // cast inputs to appropriate types
     struct threadData *data = (struct threadData *) userData;
-    float *out = (float*) outputBuffer;
-
-    // determine how many elements to pass to output buffer
-    ring_buffer_size_t elementsToPlay =
-        PaUtil_GetRingBufferReadAvailable(&data->ringBuffer);
-    ring_buffer_size_t elementsToRead = min(
-        elementsToPlay,
-        (ring_buffer_size_t)(framesPerBuffer * data->audioFile.channels)
-    );
+    
+    // raise this thread's priority and pin it, the first time through
+    scheduleCallbackThread(&data->scheduling);
+    
+    // time the callback
+    callbackTimingEntry(&data->timing, timeInfo);
+    
+    // determine how many frames to pass to output buffer
+    size_t framesToPlay = getAdaptiveRingReadAvailable(&data->ringBuffer);
+    size_t framesToRead = min(framesToPlay, (size_t) framesPerBuffer);
     
     // prevent unused variable warnings
     (void) inputBuffer;
-    (void) timeInfo;
-    (void) statusFlags;
     (void) userData;
     
-    // read data from buffer and put in output buffer
-    PaUtil_ReadRingBuffer(&data->ringBuffer, out, elementsToRead);
+    // read data from buffer and put in output buffer (a buffer per channel
+    // if the stream is planar), filling any shortfall with silence and
+    // counting it (unless the file has simply run out)
+    if (data->ringBuffer.planes > 0) {
+        readAdaptiveRingPlanes(
+            &data->ringBuffer,
+            (void *const *) outputBuffer,
+            framesToRead
+        );
+        countPlanarCallback(
+            &data->xruns,
+            (void *const *) outputBuffer,
+            data->ringBuffer.planes,
+            sizeof(float),
+            framesToRead,
+            framesPerBuffer,
+            statusFlags,
+            data->readComplete
+        );
+    }
+    else {
+        readAdaptiveRing(&data->ringBuffer, outputBuffer, framesToRead);
+        countCallback(
+            &data->xruns,
+            outputBuffer,
+            data->audioFile.bytesPerFrame,
+            framesToRead,
+            framesPerBuffer,
+            statusFlags,
+            data->readComplete
+        );
+    }
+    
+    // note when the first audio goes out
+    markFirstSample(&data->stats, framesToRead, timeInfo);
+    
+    // wake the reader if the ring is running low
+    notifyRefill(&data->refillEvent, framesToPlay - framesToRead);
+    
+    callbackTimingExit(&data->timing);
     
-    if (data->readComplete && elementsToPlay == 0)
+    if (data->readComplete && framesToPlay == 0)
         return paComplete; // finished reading file
     else
         return paContinue; // still reading file
@@ -205,54 +316,89 @@ int playCallback(
 
 // This routine is run in a separate thread to read data from file into the ring
 // buffer. When the file has reached the end, a flag is set so that the PA
-// callback can return paComplete.
-void bufferAudioFile(struct threadData* pData) {
+// callback can return paComplete. Before the stream starts, it returns once
+// the ring is primed (untilPrimed).
+void bufferAudioFile(struct threadData* pData, PaStream *stream,
+    int untilPrimed) {
     while (1) {
-        // how many elements can be written
-        ring_buffer_size_t numAvailableElements =
-            PaUtil_GetRingBufferWriteAvailable(&pData->ringBuffer);
+        // how many frames are left in the ring, and whether the fill is
+        // still growing from the start
+        size_t framesBuffered = getAdaptiveRingFramesBuffered(&pData->ringBuffer);
+        int growing = isStartGrowing(
+            &pData->start,
+            framesBuffered,
+            pData->refillEvent.highWatermark
+        );
         
-        if (numAvailableElements >=
-            pData->ringBuffer.bufferSize / NUM_WRITES_PER_BUFFER) {
-            // there is space for writing
+        if (framesBuffered < pData->refillEvent.lowWatermark || growing) {
+            // ring is running low: top it up to the high watermark (in
+            // steps, while starting)
             
-            void* ptr[2] = {0};
-            ring_buffer_size_t sizes[2] = {0};
-            
-            // Get region of ring buffer for writing
-            PaUtil_GetRingBufferWriteRegions(
-                &pData->ringBuffer,
-                numAvailableElements,
-                ptr + 0,
-                sizes + 0,
-                ptr + 1,
-                sizes + 1
+            size_t framesWanted = beginStartRefill(
+                &pData->start,
+                pData->refillEvent.highWatermark - framesBuffered,
+                framesBuffered
             );
+            sf_count_t framesReadFromFile = 0;
             
-            // now get data from file and write to buffer
-            ring_buffer_size_t itemsReadFromFile = 0;
-            for (int i = 0; i < 2 && ptr[i] != NULL; ++i) {
-                if (sizes[i] % pData->audioFile.channels) {
-                    // ensure items is integer number of channels
-                    sizes[i] -= sizes[i] % pData->audioFile.channels;
+            if (pData->ringBuffer.planes > 0) {
+                // deinterleave the file straight into the planes
+                framesReadFromFile = readPlanes(pData, framesWanted);
+            }
+            else {
+                void* ptr[2] = {0};
+                size_t sizes[2] = {0};
+                
+                // Get region of ring buffer for writing
+                getAdaptiveRingWriteRegions(
+                    &pData->ringBuffer,
+                    framesWanted,
+                    ptr + 0,
+                    sizes + 0,
+                    ptr + 1,
+                    sizes + 1
+                );
+                
+                // now get data from file and write to buffer
+                for (int i = 0; i < 2 && ptr[i] != NULL; ++i) {
+                    framesReadFromFile += readAudioFile(
+                        &pData->audioFile,
+                        ptr[i],
+                        (sf_count_t) sizes[i]
+                    );
                 }
-                itemsReadFromFile += (ring_buffer_size_t)
-                    sf_read_float(pData->audioFile.fileID, ptr[i], sizes[i]);
             }
             
             // advance write index
-            PaUtil_AdvanceRingBufferWriteIndex(
+            advanceAdaptiveRingWriteIndex(
                 &pData->ringBuffer,
-                itemsReadFromFile
+                (size_t) framesReadFromFile
+            );
+            double latency = refillDone(&pData->refillEvent);
+            endStartRefill(
+                &pData->start,
+                framesBuffered + (size_t) framesReadFromFile
             );
             
-            if (itemsReadFromFile > 0) {
+            // resize the ring if refills are too slow (or needlessly fast)
+            if (updateAdaptiveRing(
+                    &pData->ringBuffer,
+                    framesBuffered,
+                    latency,
+                    pData->refillEvent.lowWatermark)) {
+                setRefillWatermarks(
+                    &pData->refillEvent,
+                    getAdaptiveRingCapacity(&pData->ringBuffer)
+                );
+            }
+            
+            if (framesReadFromFile > 0) {
                 // Check current position against file length; use that to
                 // determine whether the read is complete
-                pData->frameCount +=
-                    itemsReadFromFile/(pData->audioFile.channels);
+                pData->frameCount += framesReadFromFile;
                 if (pData->frameCount == pData->audioFile.frames) {
                     pData->readComplete = 1;
+                    break;
                 }
             }
             else {
@@ -262,8 +408,48 @@ void bufferAudioFile(struct threadData* pData) {
             }
         }
         
-        // Sleep a little while...
-        Pa_Sleep(20);
-        // Then check if we need to fill the buffer
+        // the stream can start once the ring is primed
+        if (untilPrimed && isStartReady(&pData->start))
+            return;
+        
+        // Wait for the callback to drain the ring below the low watermark
+        // (straight on while the fill is growing from the start)
+        if (!growing)
+            waitForRefill(&pData->refillEvent, &pData->ringBuffer);
+        
+        // we are on the main thread, so report glitches, sample the load
+        // and answer SIGUSR1 from here
+        publishXrunStats(&pData->xruns);
+        if (!untilPrimed)
+            pollCallbackTiming(&pData->timing, stream);
+    }
+}
+
+// Read up to frames from the file into the regions of a planar ring
+sf_count_t readPlanes(struct threadData* pData, size_t frames) {
+    
+    void* planes[2][pData->ringBuffer.planes];
+    size_t sizes[2] = {0};
+    
+    // Get region of ring buffer for writing, in every plane
+    getAdaptiveRingWritePlanes(
+        &pData->ringBuffer,
+        frames,
+        planes[0],
+        sizes + 0,
+        planes[1],
+        sizes + 1
+    );
+    
+    // now get data from file and write to buffer
+    sf_count_t framesReadFromFile = 0;
+    for (int i = 0; i < 2 && sizes[i] > 0; ++i) {
+        framesReadFromFile += readAudioFilePlanar(
+            &pData->audioFile,
+            planes[i],
+            (sf_count_t) sizes[i]
+        );
     }
+    
+    return framesReadFromFile;
 }
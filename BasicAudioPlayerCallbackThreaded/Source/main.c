@@ -7,28 +7,53 @@
 //
 
 #include <stdio.h>
-#include <pa_ringbuffer.h>
-#include <pa_util.h>
+#include <string.h>
+#include <stdatomic.h>
 #include <pthread.h> // these functions are for posix threading
 #include "audioPlayerUtil.h"
-
-// Constants
-#define NUM_WRITES_PER_BUFFER (4)
+#include "playerStream.h"
+#include "deviceCatalogue.h"
+#include "adaptiveRing.h"
+#include "playerConfig.h"
+#include "refillEvent.h"
+#include "startPolicy.h"
+#include "playerScheduling.h"
+#include "xrunStats.h"
+#include "callbackTiming.h"
+#include "playerStats.h"
+#include "playerSeek.h"
+#include "playerControl.h"
+#include "playerTransport.h"
+#include "playlist.h"
 
 // struct type for storing audio file and other thread info
 struct threadData {
     struct audioFileInfo    audioFile;
-    unsigned short          readComplete;
-    int                     threadSyncFlag;
+    atomic_int              readComplete;
     sf_count_t              frameCount;
-    float                   *ringBufferData;
-    PaUtilRingBuffer        ringBuffer;
+    struct adaptiveRing     ringBuffer;
+    struct refillEvent      refillEvent;
+    struct startPolicy      start;
+    struct playerScheduling scheduling;
+    struct xrunStats        xruns;
+    struct callbackTiming   timing;
+    struct playerStats      stats;
+    struct playerSeek       seek;
+    struct playerTransport  transport;
+    struct playlist         playlist;
     pthread_t               threadHandle;
+    atomic_int              quit;   // the reader is to stop
 };
 
 // Callback function passed to portaudio to play audio file
 PaStreamCallback playCallback;
 
+// Handles commands typed while the file plays
+playerCommandHandler handleCommand;
+
+// Writes the seek, command and playlist statistics
+playerStatsWriter writeControlStatsJson;
+
 // Thread functions
 typedef void* ThreadFunctionType(void*); // thread callback type
 PaError startThread(struct threadData* threadData, ThreadFunctionType fn);
@@ -48,14 +73,19 @@ int main(int argc, char *argv[]) {
     struct threadData pData = {
         .audioFile.buffer = NULL,
         .audioFile.fileID = NULL,
-        .threadSyncFlag = 1,
         .readComplete = 0,
         .frameCount = 0,
-        .ringBufferData = NULL
+        .ringBuffer.readRing = NULL,
+        .transport.scratch = NULL
     };
+    struct playerControl control = {.started = 0};
     
-    // program needs 1 argument: audio file name
-    if (argc != 2) {
+    // start the clock for the statistics
+    initPlayerStats(&pData.stats);
+    
+    // program needs at least 1 argument: audio file names, played one after
+    // the other
+    if (argc < 2) {
         // handle this error
         err = ERR_BAD_COMMAND_LINE;
         goto cleanup;
@@ -82,42 +112,93 @@ int main(int argc, char *argv[]) {
         goto cleanup;
     }
     
-    // set output channels based on file
-    outputParameters.channelCount = pData.audioFile.channels;
+    // set output channels based on file (or BAP_CHANNELS), mixing the file
+    // to them if need be
+    err = negotiateChannels(&pData.audioFile, &outputParameters, maxChannels);
+    if (err) {
+        goto cleanup;
+    }
     
-    // allocate ring buffer memory
-    unsigned int numSamples = nextPowerOf2((unsigned)
-        (pData.audioFile.sRate * 0.5 * pData.audioFile.channels)
-    ); // Number of samples in ring buffer
-    pData.ringBufferData =
-        (float *) PaUtil_AllocateMemory(sizeof(float)*numSamples);
+    // run the stream at the file's rate, or resample it
+    err = negotiateSampleRate(&pData.audioFile, &outputParameters);
+    if (err) {
+        goto cleanup;
+    }
     
-    if(pData.ringBufferData == NULL) {
-        // check memory was allocated
-        err = ERR_BAD_ALLOC;
+    // pass the file's samples through unconverted if possible
+    err = negotiateSampleFormat(&pData.audioFile, &outputParameters);
+    if (err) {
         goto cleanup;
     }
     
-    // initialise ring buffer
-    err_pa = PaUtil_InitializeRingBuffer(
+    // get run-time settings
+    struct playerConfig config;
+    getPlayerConfig(&config);
+    initPlayerScheduling(&pData.scheduling);
+    
+    // allocate ring buffer memory (half a second of audio, or sized
+    // adaptively)
+    err = createAdaptiveRing(
         &pData.ringBuffer,
-        sizeof(float),
-        numSamples,
-        pData.ringBufferData
+        pData.audioFile.sRate,
+        pData.audioFile.bytesPerFrame
     );
-    if (err_pa) {
-        err = ERR_PORTAUDIO;
+    if (err) {
+        goto cleanup;
+    }
+    
+    // set up the notification the callback uses to wake the reader
+    err = initRefillEvent(
+        &pData.refillEvent,
+        getAdaptiveRingCapacity(&pData.ringBuffer),
+        config.lowWatermark,
+        config.highWatermark
+    );
+    if (err) {
+        goto cleanup;
+    }
+    
+    // count glitches and time callbacks from the start
+    initXrunStats(&pData.xruns);
+    unsigned long framesPerBuffer = getFramesPerBuffer();
+    initCallbackTiming(&pData.timing,
+        (double) framesPerBuffer / pData.audioFile.sRate);
+    installCallbackTimingSignal();
+    
+    // prime just enough to start on (or fill the ring first)
+    initStartPolicy(&pData.start, pData.audioFile.sRate, framesPerBuffer,
+        pData.refillEvent.highWatermark);
+    
+    // set up seeking, which the reader does when asked
+    err = initPlayerSeek(&pData.seek, &pData.audioFile, framesPerBuffer,
+        &pData.refillEvent);
+    if (err) {
         goto cleanup;
     }
     
+    // set up the transport commands, which the callback applies
+    err = initPlayerTransport(&pData.transport, &pData.audioFile,
+        framesPerBuffer, &pData.seek);
+    if (err) {
+        goto cleanup;
+    }
+    
+    // open the tracks after the first in the background as it plays
+    err = initPlaylist(&pData.playlist, argv + 1, argc - 1, &pData.audioFile,
+        maxChannels);
+    if (err) {
+        goto cleanup;
+    }
+    addPlayerStats(&pData.stats, writeControlStatsJson, &pData);
+    
     // open stream for outputting audio file via callback
     PaStream *stream = NULL; // Audio stream info
-    err_pa = Pa_OpenStream(
+    err_pa = openPlayerStream(
         &stream,
         NULL,
         &outputParameters,
         pData.audioFile.sRate,
-        FRAMES_PER_BUFFER,
+        framesPerBuffer,
         paClipOff,
         playCallback,
         &pData
@@ -134,41 +215,77 @@ int main(int argc, char *argv[]) {
     }
     
     // start playing
-    err_pa = Pa_StartStream(stream);
+    err_pa = startPlayerStream(stream);
     if (err_pa) {
         err = ERR_PORTAUDIO;
         goto cleanup;
     }
     
+    // take commands while playing
+    err = startPlayerControl(&control, handleCommand, &pData);
+    if (err) {
+        goto cleanup;
+    }
+    
     // wait for audio file to finish playing
-    printf("Now playing...\n");
-    while (Pa_IsStreamActive(stream))
+    printf("Now playing... (commands: play, pause, stop, gain <linear>, "
+        "seek <seconds>, each optionally @<seconds> or +<seconds>)\n");
+    while (isPlayerStreamActive(stream)) {
         Pa_Sleep(100);
+        publishXrunStats(&pData.xruns);
+        pollCallbackTiming(&pData.timing, stream);
+        reportSeeks(&pData.seek);
+        reportTransport(&pData.transport);
+        reportPlaylist(&pData.playlist);
+    }
     
     // Finished playing
     printf("Finished!\n");
+    printXrunStats(&pData.xruns);
+    printCallbackTiming(&pData.timing);
+    printReadaheadStats(&pData.audioFile.readahead);
+    printStartPolicy(&pData.start);
+    printPlayerScheduling(&pData.scheduling);
+    printRefillStats(&pData.refillEvent);
+    printAdaptiveRingStats(&pData.ringBuffer);
+    printSeekStats(&pData.seek);
+    printTransportStats(&pData.transport);
+    printPlaylistStats(&pData.playlist);
+    writePlayerStats(&pData.stats, "BasicAudioPlayerCallbackThreaded",
+        argv[1], &pData.audioFile, framesPerBuffer, &pData.xruns,
+        &pData.timing);
     
     goto cleanup;
     
 cleanup:
     // make sure all the toys are put away befor exit
     
+    // stop taking commands
+    stopPlayerControl(&control);
+    
     if (stream) // close stream
-        err = Pa_CloseStream(stream);
+        err = closePlayerStream(stream);
     
     // stop audio file reading thread
     if (pData.threadHandle != 0)
         err = stopThread(&pData);
     
-    // terminate portaudio
+    // save what was learnt about the device, and terminate portaudio
+    closeDeviceCatalogue();
     Pa_Terminate();
     
-    // close audio file
+    // close audio file, and any open for the next track
     closeAudioFile(&pData.audioFile);
+    if (pData.playlist.paths != NULL)
+        freePlaylist(&pData.playlist);
     
     // free allocated memory
-    if (pData.ringBufferData != NULL)
-        PaUtil_FreeMemory(pData.ringBufferData);
+    if (pData.ringBuffer.readRing != NULL) {
+        closeRefillEvent(&pData.refillEvent);
+        freeAdaptiveRing(&pData.ringBuffer);
+    }
+    freePlayerSeek(&pData.seek);
+    freePlayerTransport(&pData.transport);
     
     // print an error msg if applicable
     printErrorMsg(err, err_pa, pData.audioFile.fileID);
@@ -188,26 +305,62 @@ int playCallback(
     
     // cast inputs to appropriate types
     struct threadData *data = (struct threadData *) userData;
-    float *out = (float*) outputBuffer;
-
-    // determine how many elements to pass to output buffer
-    ring_buffer_size_t elementsToPlay =
-        PaUtil_GetRingBufferReadAvailable(&data->ringBuffer);
-    ring_buffer_size_t elementsToRead = min(
-        elementsToPlay,
-        (ring_buffer_size_t)(framesPerBuffer * data->audioFile.channels)
-    );
+    
+    // raise this thread's priority and pin it, the first time through
+    scheduleCallbackThread(&data->scheduling);
+    
+    // time the callback
+    callbackTimingEntry(&data->timing, timeInfo);
+    
+    // apply the commands due in this buffer, which decide how much audio
+    // it takes (none while paused) and where it is read to
+    size_t framesWanted = beginTransport(&data->transport, framesPerBuffer,
+        &data->timing);
+    void *audio = getTransportAudio(&data->transport, outputBuffer);
+    
+    // move to a new position if the reader has pre-rolled one, then
+    // determine how many frames to pass to output buffer
+    size_t framesToPlay = getSeekReadAvailable(&data->seek, &data->ringBuffer,
+        &data->timing);
+    size_t framesToRead = min(framesToPlay, framesWanted);
     
     // prevent unused variable warnings
     (void) inputBuffer;
-    (void) timeInfo;
-    (void) statusFlags;
     (void) userData;
     
-    // read data from buffer and put in output buffer
-    PaUtil_ReadRingBuffer(&data->ringBuffer, out, elementsToRead);
+    // read data from buffer, noting where each track starts
+    size_t ringFrame = data->ringBuffer.framesRead;
+    readSeek(&data->seek, &data->ringBuffer, audio, framesToRead);
+    notePlaylistPosition(&data->playlist, ringFrame,
+        data->ringBuffer.framesRead, framesWanted - framesToRead);
+    
+    // fill any shortfall with silence and count it (unless the file has
+    // simply run out)
+    countCallback(
+        &data->xruns,
+        audio,
+        data->audioFile.bytesPerFrame,
+        framesToRead,
+        framesWanted,
+        statusFlags,
+        atomic_load(&data->readComplete)
+    );
+    
+    // note when the first audio goes out
+    markFirstSample(&data->stats, framesToRead, timeInfo);
+    
+    // put it in the output buffer, with any pauses and gain changes
+    endTransport(&data->transport, outputBuffer, audio, framesPerBuffer);
+    
+    // wake the reader if the ring is running low
+    notifyRefill(&data->refillEvent, framesToPlay - framesToRead);
+    
+    callbackTimingExit(&data->timing);
     
-    if (data->readComplete && elementsToPlay == 0)
+    if (isTransportStopped(&data->transport))
+        return paComplete; // stopped
+    else if (atomic_load(&data->readComplete) && framesToPlay == 0 &&
+        !isSeekPending(&data->seek))
         return paComplete; // finished reading file
     else
         return paContinue; // still reading file
@@ -226,14 +379,9 @@ PaError startThread(struct threadData* pData, ThreadFunctionType fn) {
         return paUnanticipatedHostError;
     }
     
-    // set priority
-    const struct sched_param param =
-        {.sched_priority =  sched_get_priority_max(SCHED_FIFO)};
-    pthread_setschedparam(pData->threadHandle, SCHED_FIFO, &param);
-    
-    // Wait for thread to fill buffer before allowing execution to continue
-    while (pData->threadSyncFlag)
-        Pa_Sleep(10);
+    // Wait for the thread to prime the ring before allowing execution to
+    // continue
+    waitForStart(&pData->start);
     
     return 0;
 }
@@ -241,12 +389,12 @@ PaError startThread(struct threadData* pData, ThreadFunctionType fn) {
 // stop the thread
 PaError stopThread(struct threadData* pData) {
     
-    // this is not the most elegant way to stop a thread
-    // (which should be done asynchronously so that the
-    // thread can put its toys away). But the thread only
-    // manipulates pre-existing data, so it's probably OK.
-    
-    pthread_cancel(pData->threadHandle);
+    // ask the reader to stop, wake it if it is waiting, and wait for it to
+    // finish whatever it is in the middle of, so that nothing it uses is
+    // freed under it
+    atomic_store(&pData->quit, 1);
+    interruptRefillWait(&pData->refillEvent);
+    pthread_join(pData->threadHandle, NULL);
     pData->threadHandle = 0;
     
     return 0;
@@ -260,22 +408,68 @@ void* threadFunctionReadAudioFile(void* data) {
     // cast input to correct data type
     struct threadData* pData = (struct threadData*) data;
     
-    while (1) {
-        // how many elements can be written
-        ring_buffer_size_t numAvailableElements =
-            PaUtil_GetRingBufferWriteAvailable(&pData->ringBuffer);
+    // the reader can wait, so it runs at normal (or batch) priority
+    scheduleReaderThread(&pData->scheduling);
+    
+    while (!atomic_load(&pData->quit)) {
+        // move to a new position if asked to; the file is pre-rolled there
+        // before the callback is told. The target is in the track being
+        // played, which the reader may already have read past
+        if (isSeekDue(&pData->seek) &&
+            rewindPlaylist(&pData->playlist, &pData->audioFile))
+            pData->frameCount = 0;
+        sf_count_t position = prerollSeek(
+            &pData->seek,
+            &pData->audioFile,
+            pData->frameCount
+        );
+        if (position >= 0) {
+            pData->frameCount = position;
+            dropPlaylistHead(&pData->playlist);
+            atomic_store(&pData->readComplete, 0);
+            publishSeek(&pData->seek, &pData->ringBuffer);
+        }
         
-        if (numAvailableElements >=
-            pData->ringBuffer.bufferSize / NUM_WRITES_PER_BUFFER) {
-            // there is space for writing
+        // at the end of a track carry straight on into the next one, if
+        // there is one, so that it follows on in the ring without a gap
+        if (pData->frameCount == pData->audioFile.frames &&
+            !atomic_load(&pData->readComplete)) {
+            if (advancePlaylist(
+                    &pData->playlist,
+                    &pData->audioFile,
+                    pData->ringBuffer.framesWritten)) {
+                pData->frameCount = 0;
+            }
+            else
+                atomic_store(&pData->readComplete, 1);
+        }
+        
+        // how many frames are left in the ring, and whether the fill is
+        // still growing from the start
+        size_t framesBuffered = getAdaptiveRingFramesBuffered(&pData->ringBuffer);
+        int growing = isStartGrowing(
+            &pData->start,
+            framesBuffered,
+            pData->refillEvent.highWatermark
+        );
+        
+        if (!atomic_load(&pData->readComplete) &&
+            (framesBuffered < pData->refillEvent.lowWatermark || growing)) {
+            // ring is running low: top it up to the high watermark (in
+            // steps, while starting)
             
             void* ptr[2] = {0};
-            ring_buffer_size_t sizes[2] = {0};
+            size_t sizes[2] = {0};
+            size_t framesWanted = beginStartRefill(
+                &pData->start,
+                pData->refillEvent.highWatermark - framesBuffered,
+                framesBuffered
+            );
             
             // Get region of ring buffer for writing
-            PaUtil_GetRingBufferWriteRegions(
+            getAdaptiveRingWriteRegions(
                 &pData->ringBuffer,
-                numAvailableElements,
+                framesWanted,
                 ptr + 0,
                 sizes + 0,
                 ptr + 1,
@@ -283,45 +477,112 @@ void* threadFunctionReadAudioFile(void* data) {
             );
             
             // now get data from file and write to buffer
-            ring_buffer_size_t itemsReadFromFile = 0;
+            sf_count_t framesReadFromFile = 0;
             for (int i = 0; i < 2 && ptr[i] != NULL; ++i) {
-                if (sizes[i] % pData->audioFile.channels) {
-                    // ensure items is integer number of channels
-                    sizes[i] -= sizes[i] % pData->audioFile.channels;
-                }
-                itemsReadFromFile += (ring_buffer_size_t)
-                    sf_read_float(pData->audioFile.fileID, ptr[i], sizes[i]);
+                framesReadFromFile += readPlaylist(
+                    &pData->playlist,
+                    &pData->audioFile,
+                    ptr[i],
+                    (sf_count_t) sizes[i]
+                );
             }
             
             // advance write index
-            PaUtil_AdvanceRingBufferWriteIndex(
+            advanceAdaptiveRingWriteIndex(
                 &pData->ringBuffer,
-                itemsReadFromFile
+                (size_t) framesReadFromFile
+            );
+            double latency = refillDone(&pData->refillEvent);
+            endStartRefill(
+                &pData->start,
+                framesBuffered + (size_t) framesReadFromFile
             );
             
-            if (itemsReadFromFile > 0) {
-                // Mark thread started here, that way we "prime" the ring buffer
-                // before playback
-                pData->threadSyncFlag = 0;
-                // Check current position against file length; use that to
-                // determine whether the read is complete
-                pData->frameCount +=
-                    itemsReadFromFile/(pData->audioFile.channels);
-                if (pData->frameCount == pData->audioFile.frames) {
-                    pData->readComplete = 1;
-                }
+            // resize the ring if refills are too slow (or needlessly fast)
+            if (updateAdaptiveRing(
+                    &pData->ringBuffer,
+                    framesBuffered,
+                    latency,
+                    pData->refillEvent.lowWatermark)) {
+                setRefillWatermarks(
+                    &pData->refillEvent,
+                    getAdaptiveRingCapacity(&pData->ringBuffer)
+                );
+            }
+            
+            if (framesReadFromFile > 0) {
+                // Keep track of the position in the file; the next track
+                // is opened at its end
+                pData->frameCount += framesReadFromFile;
             }
             else {
                 // No data to read
-                pData->threadSyncFlag = 1;
+                releaseStart(&pData->start);
                 break;
             }
         }
         
-        // Sleep a little while...
-        Pa_Sleep(20);
-        // Then check if we need to fill the buffer
+        // a file shorter than the prime plays as soon as it has been read
+        if (atomic_load(&pData->readComplete))
+            releaseStart(&pData->start);
+        
+        // Wait for the callback to drain the ring below the low watermark,
+        // or, once the last file has been read, for a seek; at the end of
+        // any other track, go straight on to the next, and while the fill
+        // is growing from the start, straight on with that
+        if (atomic_load(&pData->readComplete))
+            waitForInterrupt(&pData->refillEvent);
+        else if (pData->frameCount < pData->audioFile.frames && !growing)
+            waitForRefill(&pData->refillEvent, &pData->ringBuffer);
     }
     
     return NULL; // nothing to return
 }
+
+// Handle a command typed while the file plays
+int handleCommand(void *userData, const struct playerCommandLine *line) {
+    
+    struct threadData *pData = (struct threadData *) userData;
+    playerCommandType type;
+    
+    if (strcmp(line->command, "play") == 0)
+        type = CMD_PLAY;
+    else if (strcmp(line->command, "pause") == 0)
+        type = CMD_PAUSE;
+    else if (strcmp(line->command, "stop") == 0)
+        type = CMD_STOP;
+    else if (strcmp(line->command, "gain") == 0 && line->hasValue)
+        type = CMD_GAIN;
+    else if (strcmp(line->command, "seek") == 0 && line->hasValue)
+        type = CMD_SEEK;
+    else
+        return 0;
+    
+    // the stream frame to apply it at: a time since the stream started, or
+    // from now; without one it applies at the start of the next buffer
+    unsigned long long frame = 0;
+    if (line->hasTime) {
+        double frames = line->time * pData->audioFile.sRate + 0.5;
+        if (line->relative)
+            frames += getTransportFrame(&pData->transport);
+        frame = frames > 0.0 ? (unsigned long long) frames : 0;
+    }
+    
+    // the callback takes it from here
+    if (!postTransportCommand(&pData->transport, type, line->value, frame))
+        printf("Command queue full: %s ignored\n", line->command);
+    
+    return 1;
+}
+
+// Write the seek, command and playlist statistics as JSON members
+void writeControlStatsJson(const void *data, FILE *file) {
+    
+    const struct threadData *pData = (const struct threadData *) data;
+    
+    writeSeekStatsJson(&pData->seek, file);
+    fputs(",\n", file);
+    writeTransportStatsJson(&pData->transport, file);
+    fputs(",\n", file);
+    writePlaylistStatsJson(&pData->playlist, file);
+}
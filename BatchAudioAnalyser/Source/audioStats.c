@@ -0,0 +1,70 @@
+//
+//  audioStats.c
+//  BatchAudioAnalyser
+//
+//  Level statistics for a stream of float samples.
+//
+
+#include <math.h>
+#include "audioStats.h"
+#include "audioKernels.h"
+
+// Reset the statistics
+void initAudioStats(struct audioStats *stats) {
+    
+    stats->samples = 0;
+    stats->sum = 0.0;
+    stats->sumSquares = 0.0;
+    stats->peak = 0.0f;
+    stats->clipped = 0;
+}
+
+// Add a block of samples to the statistics
+void accumulateAudioStats(
+    struct audioStats *stats,
+    const float *samples,
+    size_t count,
+    float clipLevel
+) {
+    
+    float peak;
+    double sumSquares;
+    float sum[AUDIO_KERNEL_LANES] = {0};
+    size_t i = 0;
+    
+    // peak and sum of squares with the vector kernels
+    getAudioKernels()->peakRms(samples, count, &peak, &sumSquares);
+    stats->sumSquares += sumSquares;
+    if (peak > stats->peak)
+        stats->peak = peak;
+    
+    // the sum in the kernels' lanes, which the compiler can vectorise
+    // without reordering the additions
+    for (; i + AUDIO_KERNEL_LANES <= count; i += AUDIO_KERNEL_LANES) {
+        for (int l = 0; l < AUDIO_KERNEL_LANES; l++)
+            sum[l] += samples[i + l];
+    }
+    for (; i < count; i++)
+        sum[0] += samples[i];
+    for (int l = 0; l < AUDIO_KERNEL_LANES; l++)
+        stats->sum += sum[l];
+    
+    // nothing can have clipped unless the peak reached the clip level
+    if (peak >= clipLevel) {
+        for (i = 0; i < count; i++)
+            stats->clipped += fabsf(samples[i]) >= clipLevel;
+    }
+    stats->samples += (sf_count_t) count;
+}
+
+// Root mean square of the samples
+double getAudioStatsRms(const struct audioStats *stats) {
+    
+    return stats->samples > 0 ? sqrt(stats->sumSquares / stats->samples) : 0.0;
+}
+
+// Mean of the samples
+double getAudioStatsDcOffset(const struct audioStats *stats) {
+    
+    return stats->samples > 0 ? stats->sum / stats->samples : 0.0;
+}
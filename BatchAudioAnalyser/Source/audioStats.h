@@ -0,0 +1,43 @@
+//
+//  audioStats.h
+//  BatchAudioAnalyser
+//
+//  Level statistics for a stream of float samples: peak, RMS, DC offset and
+//  the number of clipped samples. The peak and sum of squares of each block
+//  come from the peakRms kernel (audioKernels.h), the sum is kept in the
+//  same lanes, and clipped samples are only counted in a block whose peak
+//  reaches the clip level; each block's result is then added to
+//  double-precision totals.
+//
+
+#ifndef audioStats_h
+#define audioStats_h
+
+#include <stddef.h>
+#include <sndfile.h>
+
+// struct type for the statistics of one file
+struct audioStats {
+    sf_count_t  samples;        // samples seen (all channels)
+    double      sum;            // for the DC offset
+    double      sumSquares;     // for the RMS
+    float       peak;           // largest absolute sample
+    sf_count_t  clipped;        // samples at or beyond the clip level
+};
+
+// Reset the statistics
+void initAudioStats(struct audioStats *stats);
+
+// Add a block of samples to the statistics
+void accumulateAudioStats(
+    struct audioStats *stats,
+    const float *samples,
+    size_t count,
+    float clipLevel
+);
+
+// Derived figures (0 if there were no samples)
+double getAudioStatsRms(const struct audioStats *stats);
+double getAudioStatsDcOffset(const struct audioStats *stats);
+
+#endif /* audioStats_h */
@@ -0,0 +1,429 @@
+//
+//  main.c
+//  BatchAudioAnalyser
+//
+//  Measures the peak, RMS, DC offset and number of clipped samples of each
+//  of a list of audio files, in parallel, and writes the results as CSV or
+//  JSON (chosen by the output file's extension). Files are read with the
+//  players' openAudioFile()/readAudioFile() in FRAMES_PER_BUFFER-sized
+//  blocks, and shared between worker threads by a work-stealing queue.
+//
+//  Usage: BatchAudioAnalyser <results.csv|results.json> [audio file ...]
+//  With no audio files on the command line, their names are read from stdin,
+//  one per line.
+//
+//  BAP_THREADS:        worker threads (default: one per online CPU)
+//  BAP_MAX_OPEN_FILES: most files open at once (default: one per thread)
+//  BAP_CLIP_LEVEL:     absolute sample value counted as clipped (default
+//                      32767/32768, full scale for 16-bit files)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pa_util.h>
+#include "audioPlayerUtil.h"
+#include "playerConfig.h"
+#include "audioKernels.h"
+#include "audioStats.h"
+#include "workQueue.h"
+
+// Most channels a file may have
+#define MAX_CHANNELS (1024)
+
+// struct type for the result for one file
+struct fileResult {
+    int                 err;        // NO_ERROR, or why the file was skipped
+    unsigned int        channels;
+    int                 sRate;
+    sf_count_t          frames;
+    off_t               bytes;      // size on disk
+    struct audioStats   stats;
+};
+
+// struct type for the state shared by the workers
+struct analyser {
+    char                **fileNames;
+    struct fileResult   *results;
+    struct workQueue    queue;
+    float               clipLevel;
+
+    // bounds the number of open files
+    pthread_mutex_t     openLock;
+    pthread_cond_t      openCond;
+    unsigned int        openFiles;
+    unsigned int        maxOpenFiles;
+};
+
+// struct type for a worker thread
+struct worker {
+    struct analyser     *analyser;
+    unsigned int        index;
+    pthread_t           thread;
+};
+
+// Read the list of files from stdin
+static int readFileList(char ***fileNames, uint32_t *numFiles);
+
+// Analyse one file
+static void analyseFile(struct analyser *a, uint32_t item);
+
+// Worker thread
+static void* workerThread(void *data);
+
+// Write the results
+static int writeResults(
+    const char *outputName,
+    char **fileNames,
+    const struct fileResult *results,
+    uint32_t numFiles
+);
+
+// MAIN
+int main(int argc, char *argv[]) {
+    
+    int err = NO_ERROR;
+    struct analyser a = {
+        .fileNames = NULL,
+        .results = NULL,
+        .queue.shares = NULL
+    };
+    struct worker *workers = NULL;
+    unsigned int numWorkers = 0, startedWorkers = 0;
+    uint32_t numFiles = 0;
+    int fileNamesRead = 0;
+    
+    // program needs an output file, and optionally the audio files
+    if (argc < 2) {
+        err = ERR_BAD_COMMAND_LINE;
+        goto cleanup;
+    }
+    
+    // get the list of files
+    if (argc > 2) {
+        a.fileNames = argv + 2;
+        numFiles = (uint32_t) (argc - 2);
+    }
+    else {
+        err = readFileList(&a.fileNames, &numFiles);
+        if (err)
+            goto cleanup;
+        fileNamesRead = 1;
+    }
+    
+    // get run-time settings
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    numWorkers = (unsigned int) getConfigDouble("BAP_THREADS", cpus > 0 ? cpus : 1);
+    if (numWorkers < 1)
+        numWorkers = 1;
+    a.maxOpenFiles = (unsigned int) getConfigDouble("BAP_MAX_OPEN_FILES", numWorkers);
+    if (a.maxOpenFiles < 1)
+        a.maxOpenFiles = 1;
+    a.clipLevel = (float) getConfigDouble("BAP_CLIP_LEVEL", 32767.0 / 32768.0);
+    
+    // allocate the results and share out the work
+    a.results = calloc(numFiles ? numFiles : 1, sizeof(*a.results));
+    workers = calloc(numWorkers, sizeof(*workers));
+    if (a.results == NULL || workers == NULL) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    err = createWorkQueue(&a.queue, numWorkers, numFiles);
+    if (err)
+        goto cleanup;
+    pthread_mutex_init(&a.openLock, NULL);
+    pthread_cond_init(&a.openCond, NULL);
+    a.openFiles = 0;
+    
+    printf("Analysing %u files with %u threads (at most %u files open)\n",
+        numFiles, numWorkers, a.maxOpenFiles);
+    PaUtil_InitializeClock();
+    double start = PaUtil_GetTime();
+    
+    // choose the kernels before the workers share them
+    getAudioKernels();
+    
+    // start the workers, and wait for them to run out of work
+    for (unsigned int w = 0; w < numWorkers; w++) {
+        workers[w].analyser = &a;
+        workers[w].index = w;
+        if (pthread_create(&workers[w].thread, NULL, workerThread, &workers[w]) != 0)
+            break;
+        startedWorkers++;
+    }
+    for (unsigned int w = 0; w < startedWorkers; w++)
+        pthread_join(workers[w].thread, NULL);
+    if (startedWorkers == 0) {
+        err = ERR_BAD_ALLOC;
+        goto cleanup;
+    }
+    
+    double elapsed = PaUtil_GetTime() - start;
+    
+    // report throughput
+    unsigned long failed = 0;
+    double megabytes = 0.0;
+    for (uint32_t i = 0; i < numFiles; i++) {
+        if (a.results[i].err)
+            failed++;
+        else
+            megabytes += a.results[i].bytes / 1e6;
+    }
+    printf("Analysed %u files (%.1f MB, %lu failed) in %.3f s: %.1f files/s, "
+        "%.1f MB/s\n", numFiles, megabytes, failed, elapsed,
+        elapsed > 0.0 ? numFiles / elapsed : 0.0,
+        elapsed > 0.0 ? megabytes / elapsed : 0.0);
+    
+    err = writeResults(argv[1], a.fileNames, a.results, numFiles);
+    
+    pthread_cond_destroy(&a.openCond);
+    pthread_mutex_destroy(&a.openLock);
+    
+    goto cleanup;
+    
+cleanup:
+    // make sure all the toys are put away before exit
+    
+    if (fileNamesRead) {
+        for (uint32_t i = 0; i < numFiles; i++)
+            free(a.fileNames[i]);
+        free(a.fileNames);
+    }
+    free(a.results);
+    free(workers);
+    freeWorkQueue(&a.queue);
+    
+    if (err == ERR_BAD_COMMAND_LINE)
+        puts("Usage: BatchAudioAnalyser <results.csv|results.json> [audio file ...]");
+    else if (err == ERR_BAD_ALLOC)
+        puts("Unable to allocate memory.");
+    
+    return err;
+}
+
+// Read the list of files from stdin
+static int readFileList(char ***fileNames, uint32_t *numFiles) {
+    
+    char *line = NULL;
+    size_t len = 0, capacity = 0;
+    ssize_t read;
+    
+    *fileNames = NULL;
+    *numFiles = 0;
+    
+    while ((read = getline(&line, &len, stdin)) > 0) {
+        // strip the line ending, and skip blank lines
+        while (read > 0 && (line[read - 1] == '\n' || line[read - 1] == '\r'))
+            line[--read] = '\0';
+        if (read == 0)
+            continue;
+    
+        if (*numFiles == capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            char **grown = realloc(*fileNames, capacity * sizeof(char *));
+            if (grown == NULL)
+                break;
+            *fileNames = grown;
+        }
+        if (((*fileNames)[*numFiles] = strdup(line)) == NULL)
+            break;
+        (*numFiles)++;
+    }
+    
+    free(line);
+    
+    return feof(stdin) ? NO_ERROR : ERR_BAD_ALLOC;
+}
+
+// Analyse one file
+static void analyseFile(struct analyser *a, uint32_t item) {
+    
+    struct fileResult *result = &a->results[item];
+    struct audioFileInfo audioFile = {
+        .buffer = NULL,
+        .fileID = NULL
+    };
+    struct stat st;
+    
+    initAudioStats(&result->stats);
+    if (stat(a->fileNames[item], &st) == 0)
+        result->bytes = st.st_size;
+    
+    // wait for a free file handle
+    pthread_mutex_lock(&a->openLock);
+    while (a->openFiles >= a->maxOpenFiles)
+        pthread_cond_wait(&a->openCond, &a->openLock);
+    a->openFiles++;
+    pthread_mutex_unlock(&a->openLock);
+    
+    result->err = openAudioFile(a->fileNames[item], &audioFile, MAX_CHANNELS);
+    if (!result->err) {
+        result->channels = audioFile.channels;
+        result->sRate = audioFile.sRate;
+        result->frames = audioFile.frames;
+    
+        // stream the file through in blocks, as the players do
+        audioFile.buffer =
+            malloc(sizeof(float) * audioFile.channels * FRAMES_PER_BUFFER);
+        if (audioFile.buffer == NULL)
+            result->err = ERR_BAD_ALLOC;
+        else {
+            sf_count_t framesRead;
+            while ((framesRead = readAudioFile(&audioFile, audioFile.buffer,
+                    FRAMES_PER_BUFFER)) > 0) {
+                accumulateAudioStats(&result->stats, audioFile.buffer,
+                    (size_t) framesRead * audioFile.channels, a->clipLevel);
+            }
+        }
+    }
+    
+    closeAudioFile(&audioFile);
+    
+    pthread_mutex_lock(&a->openLock);
+    a->openFiles--;
+    pthread_cond_signal(&a->openCond);
+    pthread_mutex_unlock(&a->openLock);
+}
+
+// Worker thread: analyse files until there are none left to take or steal
+static void* workerThread(void *data) {
+    
+    struct worker *w = (struct worker *) data;
+    uint32_t item;
+    
+    while (takeWork(&w->analyser->queue, w->index, &item))
+        analyseFile(w->analyser, item);
+    
+    return NULL;
+}
+
+// Level in dBFS
+static double toDb(double level) {
+    
+    return 20.0 * log10(level);
+}
+
+// Write a file name as a CSV field
+static void writeCsvString(FILE *file, const char *str) {
+    
+    if (strpbrk(str, ",\"\n\r") == NULL) {
+        fputs(str, file);
+        return;
+    }
+    
+    fputc('"', file);
+    for (const char *c = str; *c; c++) {
+        if (*c == '"')
+            fputc('"', file);
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// Write a file name as a JSON string
+static void writeJsonString(FILE *file, const char *str) {
+    
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// Write a level in dBFS as a CSV field (empty for silence)
+static void writeCsvDb(FILE *file, double level) {
+    
+    if (level > 0.0)
+        fprintf(file, "%.3f", toDb(level));
+}
+
+// Write a level in dBFS as JSON (null for silence)
+static void writeJsonDb(FILE *file, double level) {
+    
+    if (level > 0.0)
+        fprintf(file, "%.3f", toDb(level));
+    else
+        fputs("null", file);
+}
+
+// Write the results
+static int writeResults(
+    const char *outputName,
+    char **fileNames,
+    const struct fileResult *results,
+    uint32_t numFiles
+) {
+    
+    size_t len = strlen(outputName);
+    int json = len >= 5 && strcmp(outputName + len - 5, ".json") == 0;
+    
+    FILE *file = fopen(outputName, "w");
+    if (file == NULL) {
+        printf("Unable to open %s for writing\n", outputName);
+        return ERR_OPENING_FILE;
+    }
+    
+    if (json)
+        fputs("[\n", file);
+    else
+        fputs("file,channels,sampleRate,frames,seconds,peak,peakDbfs,rms,"
+            "rmsDbfs,dcOffset,clippedSamples,error\n", file);
+    
+    for (uint32_t i = 0; i < numFiles; i++) {
+        const struct fileResult *r = &results[i];
+        double seconds = r->sRate > 0 ? (double) r->frames / r->sRate : 0.0;
+        double rms = getAudioStatsRms(&r->stats);
+    
+        if (json) {
+            fputs("  {\"file\": ", file);
+            writeJsonString(file, fileNames[i]);
+            if (r->err) {
+                fprintf(file, ", \"error\": %d}", r->err);
+            }
+            else {
+                fprintf(file, ", \"channels\": %u, \"sampleRate\": %d, "
+                    "\"frames\": %lld, \"seconds\": %.6f, \"peak\": %.9g, "
+                    "\"peakDbfs\": ", r->channels, r->sRate,
+                    (long long) r->frames, seconds, r->stats.peak);
+                writeJsonDb(file, r->stats.peak);
+                fprintf(file, ", \"rms\": %.9g, \"rmsDbfs\": ", rms);
+                writeJsonDb(file, rms);
+                fprintf(file, ", \"dcOffset\": %.9g, \"clippedSamples\": %lld}",
+                    getAudioStatsDcOffset(&r->stats),
+                    (long long) r->stats.clipped);
+            }
+            fputs(i + 1 < numFiles ? ",\n" : "\n", file);
+        }
+        else {
+            writeCsvString(file, fileNames[i]);
+            if (r->err) {
+                fprintf(file, ",,,,,,,,,,,%d\n", r->err);
+            }
+            else {
+                fprintf(file, ",%u,%d,%lld,%.6f,%.9g,", r->channels,
+                    r->sRate, (long long) r->frames, seconds, r->stats.peak);
+                writeCsvDb(file, r->stats.peak);
+                fprintf(file, ",%.9g,", rms);
+                writeCsvDb(file, rms);
+                fprintf(file, ",%.9g,%lld,\n", getAudioStatsDcOffset(&r->stats),
+                    (long long) r->stats.clipped);
+            }
+        }
+    }
+    
+    if (json)
+        fputs("]\n", file);
+    
+    fclose(file);
+    
+    return NO_ERROR;
+}
@@ -0,0 +1,93 @@
+//
+//  workQueue.c
+//  BatchAudioAnalyser
+//
+//  A work-stealing queue over the items 0..n-1.
+//
+
+#include <stdlib.h>
+#include "audioPlayerUtil.h"
+#include "workQueue.h"
+
+// Pack and unpack a share
+#define SHARE(begin, end) (((uint64_t) (begin) << 32) | (uint32_t) (end))
+#define SHARE_BEGIN(share) ((uint32_t) ((share) >> 32))
+#define SHARE_END(share) ((uint32_t) (share))
+
+// Share the items out between the workers
+int createWorkQueue(
+    struct workQueue *q,
+    unsigned int workers,
+    uint32_t items
+) {
+    
+    q->workers = workers;
+    q->shares = malloc(sizeof(*q->shares) * workers);
+    if (q->shares == NULL)
+        return ERR_BAD_ALLOC;
+    
+    // contiguous shares keep each worker on neighbouring files (often in the
+    // same directory) for as long as it has its own work
+    for (unsigned int w = 0; w < workers; w++) {
+        uint32_t begin = (uint32_t) ((uint64_t) items * w / workers);
+        uint32_t end = (uint32_t) ((uint64_t) items * (w + 1) / workers);
+        atomic_init(&q->shares[w], SHARE(begin, end));
+    }
+    
+    return NO_ERROR;
+}
+
+// Free the queue
+void freeWorkQueue(struct workQueue *q) {
+    
+    free(q->shares);
+    q->shares = NULL;
+}
+
+// Take from the front of a worker's own share
+static int takeOwn(struct workQueue *q, unsigned int worker, uint32_t *item) {
+    
+    uint64_t share = atomic_load(&q->shares[worker]);
+    
+    while (SHARE_BEGIN(share) < SHARE_END(share)) {
+        uint64_t taken = SHARE(SHARE_BEGIN(share) + 1, SHARE_END(share));
+        if (atomic_compare_exchange_weak(&q->shares[worker], &share, taken)) {
+            *item = SHARE_BEGIN(share);
+            return 1;
+        }
+    }
+    
+    return 0;
+}
+
+// Steal the back half of another worker's share
+static int steal(struct workQueue *q, unsigned int worker, uint32_t *item) {
+    
+    for (unsigned int i = 1; i < q->workers; i++) {
+        unsigned int victim = (worker + i) % q->workers;
+        uint64_t share = atomic_load(&q->shares[victim]);
+    
+        while (SHARE_BEGIN(share) < SHARE_END(share)) {
+            uint32_t begin = SHARE_BEGIN(share), end = SHARE_END(share);
+            uint32_t middle = begin + (end - begin) / 2;
+            if (atomic_compare_exchange_weak(&q->shares[victim], &share,
+                    SHARE(begin, middle))) {
+                // our own share is empty, so nobody else will touch it; nor
+                // can a stale compare-and-swap match it, because an item
+                // only leaves the front of a share to be processed, so a
+                // share never takes the same value twice
+                *item = middle;
+                atomic_store(&q->shares[worker], SHARE(middle + 1, end));
+                return 1;
+            }
+        }
+    }
+    
+    return 0;
+}
+
+// Get the next item for a worker
+int takeWork(struct workQueue *q, unsigned int worker, uint32_t *item) {
+    
+    return takeOwn(q, worker, item) || steal(q, worker, item);
+}
@@ -0,0 +1,40 @@
+//
+//  workQueue.h
+//  BatchAudioAnalyser
+//
+//  A work-stealing queue over the items 0..n-1 (indices into a list of
+//  files). Each worker starts with an equal, contiguous share of the items
+//  and takes them from the front of its share; a worker that runs out steals
+//  the back half of another worker's share. Each share is a single atomic
+//  word (begin and end packed together), so taking and stealing are both a
+//  compare-and-swap and no locks are needed.
+//
+
+#ifndef workQueue_h
+#define workQueue_h
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// struct type for the queue
+struct workQueue {
+    _Atomic uint64_t    *shares;    // per worker: begin << 32 | end
+    unsigned int        workers;
+};
+
+// Share the items out between the workers. Returns NO_ERROR or
+// ERR_BAD_ALLOC.
+int createWorkQueue(
+    struct workQueue *q,
+    unsigned int workers,
+    uint32_t items
+);
+
+// Free the queue
+void freeWorkQueue(struct workQueue *q);
+
+// Get the next item for a worker, stealing if its own share is used up.
+// Returns 0 when there is nothing left to take.
+int takeWork(struct workQueue *q, unsigned int worker, uint32_t *item);
+
+#endif /* workQueue_h */
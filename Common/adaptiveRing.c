@@ -0,0 +1,384 @@
+//
+//  adaptiveRing.c
+//
+//  A frame ring buffer that can be resized while it is playing.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <pa_util.h>
+#include "audioPlayerUtil.h"
+#include "adaptiveRing.h"
+#include "playerConfig.h"
+
+// Size of the fixed ring (seconds)
+#define FIXED_RING_SECONDS (0.5)
+
+// Default limits for the adaptive ring
+#define DEFAULT_MIN_SECONDS (0.05)
+#define DEFAULT_MAX_SECONDS (4.0)
+#define DEFAULT_MAX_MB (64.0)
+#define DEFAULT_WINDOW (2.0)
+
+// Grow when a refill takes more than this fraction of the time the audio
+// left in the ring lasts when the reader is woken (the reserve)
+#define GROW_LATENCY_FRACTION (0.5)
+
+// Shrink when the worst refill in a window would take less than this
+// fraction of the reserve of the smaller ring...
+#define SHRINK_LATENCY_FRACTION (0.25)
+
+// ...for this many windows in a row
+#define SHRINK_AFTER_WINDOWS (3)
+
+// largest power of 2 no bigger than val
+static size_t prevPowerOf2(size_t val) {
+    
+    size_t p = 1;
+    while (p <= val / 2)
+        p <<= 1;
+    
+    return p;
+}
+
+// Create the ring
+int createAdaptiveRing(
+    struct adaptiveRing *ar,
+    double sRate,
+    size_t bytesPerFrame
+) {
+    
+    PaUtil_InitializeClock();
+    
+    memset(ar, 0, sizeof(*ar));
+    atomic_init(&ar->nextRing, NULL);
+    ar->adaptive =
+        strcmp(getConfigString("BAP_RING_SIZING", "fixed"), "adaptive") == 0;
+    ar->bytesPerFrame = bytesPerFrame;
+    ar->sRate = sRate;
+    ar->startTime = PaUtil_GetTime();
+    
+    size_t initialFrames = nextPowerOf2((unsigned) (sRate * FIXED_RING_SECONDS));
+    if (ar->adaptive) {
+        // the ring must hold a few callbacks' worth for the watermarks to work
+        ar->minFrames = nextPowerOf2((unsigned) (sRate *
+            getConfigDouble("BAP_RING_MIN_SECONDS", DEFAULT_MIN_SECONDS)));
+        if (ar->minFrames < 4 * getFramesPerBuffer())
+            ar->minFrames = nextPowerOf2((unsigned) (4 * getFramesPerBuffer()));
+        
+        // capacities are powers of 2, so round the limits down
+        double maxFrames = sRate *
+            getConfigDouble("BAP_RING_MAX_SECONDS", DEFAULT_MAX_SECONDS);
+        double maxBytesFrames = 1e6 *
+            getConfigDouble("BAP_RING_MAX_MB", DEFAULT_MAX_MB) / bytesPerFrame;
+        if (maxBytesFrames < maxFrames)
+            maxFrames = maxBytesFrames;
+        ar->maxFrames = maxFrames >= 1.0 ? prevPowerOf2((size_t) maxFrames) : 1;
+        if (ar->maxFrames < ar->minFrames)
+            ar->maxFrames = ar->minFrames;
+        
+        // less than one callback's worth left is nearly dry
+        ar->dryFrames = getFramesPerBuffer();
+        ar->window = getConfigDouble("BAP_RING_WINDOW", DEFAULT_WINDOW);
+        ar->windowStart = PaUtil_GetTime();
+        ar->windowMinFill = (size_t) -1;
+        
+        // start small to get audio out quickly
+        initialFrames = ar->minFrames;
+        printf("Adaptive ring: %zu frames to start, %zu to %zu frames\n",
+            initialFrames, ar->minFrames, ar->maxFrames);
+    }
+    
+    ar->readRing = ar->writeRing =
+        createFrameRingBuffer(initialFrames, bytesPerFrame);
+    
+    return ar->readRing == NULL ? ERR_BAD_ALLOC : NO_ERROR;
+}
+
+// Hold planar frames
+void setAdaptiveRingPlanar(struct adaptiveRing *ar, unsigned int channels) {
+    
+    ar->planes = channels;
+}
+
+// Free the ring(s)
+void freeAdaptiveRing(struct adaptiveRing *ar) {
+    
+    if (ar->readRing != ar->writeRing && ar->readRing != ar->oldRing)
+        freeFrameRingBuffer(ar->readRing);
+    if (ar->oldRing != ar->writeRing)
+        freeFrameRingBuffer(ar->oldRing);
+    freeFrameRingBuffer(ar->writeRing);
+    
+    ar->readRing = ar->writeRing = ar->oldRing = NULL;
+    atomic_store(&ar->nextRing, NULL);
+}
+
+// Number of frames that can be read (consumer side)
+size_t getAdaptiveRingReadAvailable(struct adaptiveRing *ar) {
+    
+    struct frameRingBuffer *next =
+        atomic_load_explicit(&ar->nextRing, memory_order_acquire);
+    size_t available = getFrameRingBufferReadAvailable(ar->readRing);
+    
+    if (next != NULL)
+        available += getFrameRingBufferReadAvailable(next);
+    
+    return available;
+}
+
+// Copy frames out of one ring, offset frames into data (one buffer, or one
+// per plane), or drop them if data is NULL
+static size_t takeFrames(
+    struct adaptiveRing *ar,
+    struct frameRingBuffer *rb,
+    void *const *data,
+    size_t offset,
+    size_t frames
+) {
+    
+    if (data != NULL && ar->planes > 0)
+        return readFrameRingBufferPlanes(rb, data, ar->planes, offset, frames);
+    else if (data != NULL)
+        return readFrameRingBuffer(rb,
+            (unsigned char *) data[0] + offset * rb->bytesPerFrame, frames);
+    
+    size_t available = getFrameRingBufferReadAvailable(rb);
+    if (frames > available)
+        frames = available;
+    advanceFrameRingBufferReadIndex(rb, frames);
+    
+    return frames;
+}
+
+// Copy frames out, or drop them (consumer side)
+static size_t takeAdaptiveRing(
+    struct adaptiveRing *ar,
+    void *const *data,
+    size_t frames
+) {
+    
+    size_t framesRead = takeFrames(ar, ar->readRing, data, 0, frames);
+    
+    if (framesRead < frames) {
+        struct frameRingBuffer *next =
+            atomic_load_explicit(&ar->nextRing, memory_order_acquire);
+        if (next != NULL) {
+            // the reader stops writing to the old ring before it publishes
+            // the new one, so if the old ring is still short it is finished
+            framesRead += takeFrames(ar, ar->readRing, data, framesRead,
+                frames - framesRead);
+            if (framesRead < frames) {
+                // move on; from here the reader may free the old ring
+                ar->readRing = next;
+                atomic_store_explicit(&ar->nextRing, NULL, memory_order_release);
+                framesRead += takeFrames(ar, next, data, framesRead,
+                    frames - framesRead);
+            }
+        }
+    }
+    
+    ar->framesRead += framesRead;
+    
+    return framesRead;
+}
+
+// Copy frames out (consumer side)
+size_t readAdaptiveRing(struct adaptiveRing *ar, void *data, size_t frames) {
+    
+    return takeAdaptiveRing(ar, &data, frames);
+}
+
+// Copy frames out into one buffer per channel (consumer side)
+size_t readAdaptiveRingPlanes(
+    struct adaptiveRing *ar,
+    void *const *data,
+    size_t frames
+) {
+    
+    return takeAdaptiveRing(ar, data, frames);
+}
+
+// Drop frames (consumer side)
+size_t discardAdaptiveRing(struct adaptiveRing *ar, size_t frames) {
+    
+    return takeAdaptiveRing(ar, NULL, frames);
+}
+
+// Number of frames buffered (producer side)
+size_t getAdaptiveRingFramesBuffered(struct adaptiveRing *ar) {
+    
+    size_t framesBuffered = ar->writeRing->frames -
+        getFrameRingBufferWriteAvailable(ar->writeRing);
+    
+    // frames the callback has yet to drain from the previous ring
+    if (ar->oldRing != NULL) {
+        framesBuffered += ar->oldRing->frames -
+            getFrameRingBufferWriteAvailable(ar->oldRing);
+    }
+    
+    return framesBuffered;
+}
+
+// Capacity of the ring being written (producer side)
+size_t getAdaptiveRingCapacity(struct adaptiveRing *ar) {
+    
+    return ar->writeRing->frames;
+}
+
+// Get regions for writing (producer side)
+size_t getAdaptiveRingWriteRegions(
+    struct adaptiveRing *ar,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+) {
+    
+    return getFrameRingBufferWriteRegions(ar->writeRing, frames,
+        dataPtr1, sizePtr1, dataPtr2, sizePtr2);
+}
+
+// Get regions for writing, in each plane (producer side)
+size_t getAdaptiveRingWritePlanes(
+    struct adaptiveRing *ar,
+    size_t frames,
+    void **planes1, size_t *sizePtr1,
+    void **planes2, size_t *sizePtr2
+) {
+    
+    void *ptr[2];
+    
+    frames = getFrameRingBufferWriteRegions(ar->writeRing, frames,
+        ptr + 0, sizePtr1, ptr + 1, sizePtr2);
+    getFrameRingBufferPlanes(ar->writeRing, ptr[0], ar->planes, planes1);
+    if (*sizePtr2 > 0)
+        getFrameRingBufferPlanes(ar->writeRing, ptr[1], ar->planes, planes2);
+    
+    return frames;
+}
+
+// Publish written frames (producer side)
+void advanceAdaptiveRingWriteIndex(struct adaptiveRing *ar, size_t frames) {
+    
+    advanceFrameRingBufferWriteIndex(ar->writeRing, frames);
+    ar->framesWritten += frames;
+}
+
+// start a new observation window
+static void resetWindow(struct adaptiveRing *ar, double now) {
+    
+    ar->windowStart = now;
+    ar->windowLatency = 0.0;
+    ar->windowMinFill = (size_t) -1;
+}
+
+// switch the producer to a new ring of the given capacity
+static int resize(
+    struct adaptiveRing *ar,
+    size_t frames,
+    double now,
+    const char *reason
+) {
+    
+    struct frameRingBuffer *rb =
+        createFrameRingBuffer(frames, ar->bytesPerFrame);
+    if (rb == NULL) {
+        printf("Ring resize to %zu frames failed: out of memory\n", frames);
+        return 0;
+    }
+    
+    size_t oldFrames = ar->writeRing->frames;
+    printf("Ring %s from %zu to %zu frames (%.1f to %.1f ms) at %.3f s: %s\n",
+        frames > oldFrames ? "grown" : "shrunk", oldFrames, frames,
+        1e3 * oldFrames / ar->sRate, 1e3 * frames / ar->sRate,
+        now - ar->startTime, reason);
+    
+    // the callback finishes the old ring, then moves on to the new one
+    ar->oldRing = ar->writeRing;
+    ar->writeRing = rb;
+    atomic_store_explicit(&ar->nextRing, rb, memory_order_release);
+    
+    ar->resizes++;
+    ar->quietWindows = 0;
+    resetWindow(ar, now);
+    
+    return 1;
+}
+
+// Apply the sizing policy (producer side)
+int updateAdaptiveRing(
+    struct adaptiveRing *ar,
+    size_t framesBuffered,
+    double latency,
+    size_t lowWatermark
+) {
+    
+    if (!ar->adaptive)
+        return 0;
+    
+    double now = PaUtil_GetTime();
+    char reason[128];
+    
+    // free the previous ring once the callback has moved on from it
+    if (ar->oldRing != NULL &&
+        atomic_load_explicit(&ar->nextRing, memory_order_acquire) == NULL) {
+        freeFrameRingBuffer(ar->oldRing);
+        ar->oldRing = NULL;
+    }
+    
+    if (latency > ar->windowLatency)
+        ar->windowLatency = latency;
+    if (framesBuffered < ar->windowMinFill)
+        ar->windowMinFill = framesBuffered;
+    
+    // one resize at a time
+    if (ar->oldRing != NULL)
+        return 0;
+    
+    size_t capacity = ar->writeRing->frames;
+    double reserve = lowWatermark / ar->sRate;
+    
+    // grow straight away if the ring nearly ran dry or a refill was slow
+    // (only judging refills the callback asked for: the first fill, and any
+    // after a timeout, start from wherever the ring happens to be)
+    if (capacity < ar->maxFrames && latency > 0.0) {
+        if (framesBuffered < ar->dryFrames) {
+            snprintf(reason, sizeof(reason), "fill fell to %zu frames",
+                framesBuffered);
+            return resize(ar, capacity * 2, now, reason);
+        }
+        if (latency > GROW_LATENCY_FRACTION * reserve) {
+            snprintf(reason, sizeof(reason),
+                "refill took %.1f ms of a %.1f ms reserve",
+                1e3 * latency, 1e3 * reserve);
+            return resize(ar, capacity * 2, now, reason);
+        }
+    }
+    
+    // otherwise shrink after a run of quiet windows
+    if (now - ar->windowStart >= ar->window) {
+        int quiet = ar->windowMinFill >= 2 * ar->dryFrames &&
+            ar->windowLatency < SHRINK_LATENCY_FRACTION * reserve / 2;
+        ar->quietWindows = quiet ? ar->quietWindows + 1 : 0;
+        
+        if (ar->quietWindows >= SHRINK_AFTER_WINDOWS && capacity > ar->minFrames) {
+            snprintf(reason, sizeof(reason),
+                "%d quiet windows, worst refill %.1f ms, lowest fill %zu frames",
+                ar->quietWindows, 1e3 * ar->windowLatency, ar->windowMinFill);
+            return resize(ar, capacity / 2, now, reason);
+        }
+        resetWindow(ar, now);
+    }
+    
+    return 0;
+}
+
+// Print a summary of the resizing
+void printAdaptiveRingStats(const struct adaptiveRing *ar) {
+    
+    if (ar->adaptive) {
+        printf("Ring resized %lu times, final size %zu frames (%.1f ms)\n",
+            ar->resizes, ar->writeRing->frames,
+            1e3 * ar->writeRing->frames / ar->sRate);
+    }
+}
@@ -0,0 +1,153 @@
+//
+//  adaptiveRing.h
+//
+//  A frame ring buffer that can be resized while it is playing. The reader
+//  (producer) decides when to resize: it allocates a new ring, switches its
+//  writes to it and publishes it to the callback (consumer), which finishes
+//  draining the old ring before moving on to the new one, so no frames are
+//  lost or repeated. The reader frees the old ring once the callback has
+//  moved on.
+//
+//  With BAP_RING_SIZING=adaptive the ring starts small, so that audio starts
+//  quickly, and the reader grows it when a refill takes too long compared
+//  with the audio left in the ring, or when the ring nearly runs dry, and
+//  shrinks it again after a run of uneventful windows. Each decision is
+//  logged. With BAP_RING_SIZING=fixed (the default) the ring holds half a
+//  second of audio and is never resized.
+//
+//  The ring can also hold planar audio, one plane per channel (see
+//  frameRingBuffer.h); resized rings keep the layout.
+//
+//  BAP_RING_SIZING:        fixed (default) or adaptive
+//  BAP_RING_MIN_SECONDS:   smallest (and initial) adaptive ring (0.05 s)
+//  BAP_RING_MAX_SECONDS:   largest adaptive ring (4 s)
+//  BAP_RING_MAX_MB:        largest adaptive ring in memory (64 MB)
+//  BAP_RING_WINDOW:        how often growing/shrinking is reconsidered (2 s)
+//
+
+#ifndef adaptiveRing_h
+#define adaptiveRing_h
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "frameRingBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+    
+// struct type for a resizable ring buffer
+struct adaptiveRing {
+    // consumer (callback) only
+    struct frameRingBuffer  *readRing;      // ring being read
+    size_t                  framesRead;     // frames read or discarded so far
+        
+    // producer (reader) only
+    struct frameRingBuffer  *writeRing;     // ring being written
+    struct frameRingBuffer  *oldRing;       // previous ring, until freed
+    size_t                  framesWritten;  // frames published so far
+        
+    // handed from producer to consumer: the ring to read once readRing is
+    // empty (NULL when no resize is in progress)
+    _Atomic(struct frameRingBuffer *) nextRing;
+        
+    // sizing policy (reader only)
+    int             adaptive;       // resize at all?
+    size_t          bytesPerFrame;
+    unsigned int    planes;         // channels if planar, or 0
+    double          sRate;
+    size_t          minFrames;      // smallest capacity
+    size_t          maxFrames;      // largest capacity
+    size_t          dryFrames;      // fill that counts as nearly dry
+    double          startTime;      // when the ring was created
+    double          window;         // seconds between shrink decisions
+    double          windowStart;    // when the current window started
+    double          windowLatency;  // worst refill latency in the window (s)
+    size_t          windowMinFill;  // lowest fill seen in the window
+    int             quietWindows;   // consecutive windows without trouble
+    unsigned long   resizes;        // number of resizes
+};
+    
+// Create the ring for audio at the given sample rate. Returns NO_ERROR or
+// ERR_BAD_ALLOC.
+int createAdaptiveRing(
+    struct adaptiveRing *ar,
+    double sRate,
+    size_t bytesPerFrame
+);
+    
+// Hold the frames planar, one plane per channel, rather than interleaved.
+// Call before the first write.
+void setAdaptiveRingPlanar(struct adaptiveRing *ar, unsigned int channels);
+
+// Free the ring(s); neither side may be using it
+void freeAdaptiveRing(struct adaptiveRing *ar);
+    
+// Consumer side: number of frames that can be read, across both rings while
+// a resize is in progress
+size_t getAdaptiveRingReadAvailable(struct adaptiveRing *ar);
+    
+// Consumer side: copy frames out, moving on to the new ring after a resize.
+// Returns the number of frames read.
+size_t readAdaptiveRing(struct adaptiveRing *ar, void *data, size_t frames);
+
+// Consumer side: as readAdaptiveRing(), for a planar ring, into one buffer
+// per channel
+size_t readAdaptiveRingPlanes(
+    struct adaptiveRing *ar,
+    void *const *data,
+    size_t frames
+);
+
+// Consumer side: drop frames without copying them, as readAdaptiveRing()
+// would have read them. Returns the number of frames dropped.
+size_t discardAdaptiveRing(struct adaptiveRing *ar, size_t frames);
+    
+// Producer side: number of frames buffered, across both rings while a
+// resize is in progress
+size_t getAdaptiveRingFramesBuffered(struct adaptiveRing *ar);
+    
+// Producer side: capacity of the ring being written
+size_t getAdaptiveRingCapacity(struct adaptiveRing *ar);
+    
+// Producer side: get up to two regions for writing (in the ring being
+// written). Returns the number of frames covered.
+size_t getAdaptiveRingWriteRegions(
+    struct adaptiveRing *ar,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+);
+
+// Producer side: as getAdaptiveRingWriteRegions(), for a planar ring: each
+// region as the start of it in every plane (arrays of one pointer per
+// channel). Returns the number of frames covered.
+size_t getAdaptiveRingWritePlanes(
+    struct adaptiveRing *ar,
+    size_t frames,
+    void **planes1, size_t *sizePtr1,
+    void **planes2, size_t *sizePtr2
+);
+    
+// Producer side: publish frames written into the write regions
+void advanceAdaptiveRingWriteIndex(struct adaptiveRing *ar, size_t frames);
+    
+// Producer side: called after each refill with the fill level the ring had
+// fallen to and the refill latency (0 if the refill was not requested by the
+// callback). Applies the sizing policy. Returns 1 if the ring was resized,
+// in which case the watermarks need to be updated for the new capacity.
+int updateAdaptiveRing(
+    struct adaptiveRing *ar,
+    size_t framesBuffered,
+    double latency,
+    size_t lowWatermark
+);
+    
+// Print a summary of the resizing
+void printAdaptiveRingStats(const struct adaptiveRing *ar);
+    
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* adaptiveRing_h */
@@ -0,0 +1,287 @@
+//
+//  audioKernels.c
+//
+//  The scalar reference kernels, and the choice of kernel set.
+//
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "audioKernels.h"
+#include "playerConfig.h"
+
+// The vector sets depend on rounding each multiply and add on its own, like
+// this code does
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+extern const struct audioKernels sse2AudioKernels;      // audioKernelsX86.c
+extern const struct audioKernels avx2AudioKernels;
+extern const struct audioKernels avx512AudioKernels;
+#endif
+
+// Largest number of kernel sets
+#define MAX_KERNEL_SETS (4)
+
+// Frames interleaved or deinterleaved at a time, so that the interleaved
+// side stays in the L1 cache while each channel passes over it
+#define TRANSPOSE_BLOCK_FRAMES (64)
+
+// Clip to [lo, hi]; written the way the vector max and min instructions
+// work, so that NaN gives lo in every set
+static inline float clipSample(float v, float lo, float hi) {
+    
+    v = v > lo ? v : lo;
+    return v < hi ? v : hi;
+}
+
+static void gainRampScalar(
+    float *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels,
+    float gain,
+    float step
+) {
+    
+    for (size_t f = 0; f < frames; f++) {
+        float g = gain + step * (float) f;
+        for (unsigned int c = 0; c < channels; c++)
+            dst[f * channels + c] = src[f * channels + c] * g;
+    }
+}
+
+static void mixAccumulateScalar(
+    float *dst,
+    const float *src,
+    size_t samples,
+    float gain
+) {
+    
+    for (size_t i = 0; i < samples; i++)
+        dst[i] += src[i] * gain;
+}
+
+static void interleaveScalar(
+    float *dst,
+    const float *const *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    for (size_t start = 0; start < frames; start += TRANSPOSE_BLOCK_FRAMES) {
+        size_t end = start + TRANSPOSE_BLOCK_FRAMES < frames ?
+            start + TRANSPOSE_BLOCK_FRAMES : frames;
+        for (unsigned int c = 0; c < channels; c++) {
+            for (size_t f = start; f < end; f++)
+                dst[f * channels + c] = src[c][f];
+        }
+    }
+}
+
+static void deinterleaveScalar(
+    float *const *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    for (size_t start = 0; start < frames; start += TRANSPOSE_BLOCK_FRAMES) {
+        size_t end = start + TRANSPOSE_BLOCK_FRAMES < frames ?
+            start + TRANSPOSE_BLOCK_FRAMES : frames;
+        for (unsigned int c = 0; c < channels; c++) {
+            for (size_t f = start; f < end; f++)
+                dst[c][f] = src[f * channels + c];
+        }
+    }
+}
+
+static void floatToInt16Scalar(int16_t *dst, const float *src, size_t samples) {
+    
+    for (size_t i = 0; i < samples; i++)
+        dst[i] = (int16_t) lrintf(clipSample(src[i] * 32768.0f, -32768.0f,
+            32767.0f));
+}
+
+static void floatToInt24Scalar(void *dst, const float *src, size_t samples) {
+    
+    unsigned char *p = (unsigned char *) dst;
+    
+    for (size_t i = 0; i < samples; i++, p += 3) {
+        uint32_t v = (uint32_t) lrintf(clipSample(src[i] * 8388608.0f,
+            -8388608.0f, 8388607.0f));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        p[0] = (unsigned char) (v >> 16);
+        p[1] = (unsigned char) (v >> 8);
+        p[2] = (unsigned char) v;
+#else
+        p[0] = (unsigned char) v;
+        p[1] = (unsigned char) (v >> 8);
+        p[2] = (unsigned char) (v >> 16);
+#endif
+    }
+}
+
+static void floatToInt32Scalar(int32_t *dst, const float *src, size_t samples) {
+    
+    // 2147483520 is the largest float below 2^31
+    for (size_t i = 0; i < samples; i++)
+        dst[i] = (int32_t) lrintf(clipSample(src[i] * 2147483648.0f,
+            -2147483648.0f, 2147483520.0f));
+}
+
+static void int16ToFloatScalar(float *dst, const int16_t *src, size_t samples) {
+    
+    for (size_t i = 0; i < samples; i++)
+        dst[i] = (float) src[i] * (1.0f / 32768.0f);
+}
+
+static void int24ToFloatScalar(float *dst, const void *src, size_t samples) {
+    
+    const unsigned char *p = (const unsigned char *) src;
+    
+    for (size_t i = 0; i < samples; i++, p += 3) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        uint32_t u = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+            (uint32_t) p[2] << 8;
+#else
+        uint32_t u = (uint32_t) p[2] << 24 | (uint32_t) p[1] << 16 |
+            (uint32_t) p[0] << 8;
+#endif
+        dst[i] = (float) ((int32_t) u >> 8) * (1.0f / 8388608.0f);
+    }
+}
+
+static void int32ToFloatScalar(float *dst, const int32_t *src, size_t samples) {
+    
+    for (size_t i = 0; i < samples; i++)
+        dst[i] = (float) src[i] * (1.0f / 2147483648.0f);
+}
+
+static void peakRmsScalar(
+    const float *src,
+    size_t samples,
+    float *peak,
+    double *sumSquares
+) {
+    
+    float sq[AUDIO_KERNEL_LANES] = {0}, pk[AUDIO_KERNEL_LANES] = {0};
+    
+    // sample i goes to lane i % AUDIO_KERNEL_LANES, as in the vector sets
+    for (size_t i = 0; i < samples; i++) {
+        float x = src[i], a = fabsf(x);
+        size_t l = i % AUDIO_KERNEL_LANES;
+        sq[l] += x * x;
+        pk[l] = a > pk[l] ? a : pk[l];
+    }
+    
+    double sum = 0.0;
+    float largest = 0.0f;
+    for (int l = 0; l < AUDIO_KERNEL_LANES; l++) {
+        sum += sq[l];
+        largest = pk[l] > largest ? pk[l] : largest;
+    }
+    
+    *peak = largest;
+    *sumSquares = sum;
+}
+
+// Add up the lanes of a dot product, in the same order in every set
+float sumAudioKernelLanes(float *lanes) {
+    
+    for (int width = AUDIO_KERNEL_LANES / 2; width > 0; width /= 2) {
+        for (int l = 0; l < width; l++)
+            lanes[l] += lanes[l + width];
+    }
+    
+    return lanes[0];
+}
+
+static float dotProductScalar(const float *a, const float *b, size_t n) {
+    
+    float sums[AUDIO_KERNEL_LANES] = {0};
+    
+    for (size_t i = 0; i < n; i++)
+        sums[i % AUDIO_KERNEL_LANES] += a[i] * b[i];
+    
+    return sumAudioKernelLanes(sums);
+}
+
+const struct audioKernels scalarAudioKernels = {
+    .name = "scalar",
+    .gainRamp = gainRampScalar,
+    .mixAccumulate = mixAccumulateScalar,
+    .interleave = interleaveScalar,
+    .deinterleave = deinterleaveScalar,
+    .floatToInt16 = floatToInt16Scalar,
+    .floatToInt24 = floatToInt24Scalar,
+    .floatToInt32 = floatToInt32Scalar,
+    .int16ToFloat = int16ToFloatScalar,
+    .int24ToFloat = int24ToFloatScalar,
+    .int32ToFloat = int32ToFloatScalar,
+    .peakRms = peakRmsScalar,
+    .dotProduct = dotProductScalar
+};
+
+// All the sets this CPU can run
+int getAudioKernelSets(const struct audioKernels **list, int max) {
+    
+    const struct audioKernels *sets[MAX_KERNEL_SETS];
+    int n = 0;
+    
+    sets[n++] = &scalarAudioKernels;
+#ifdef HAVE_X86_KERNELS
+    // checks that the OS saves the registers, too
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        sets[n++] = &sse2AudioKernels;
+    if (__builtin_cpu_supports("avx2"))
+        sets[n++] = &avx2AudioKernels;
+    if (__builtin_cpu_supports("avx512f"))
+        sets[n++] = &avx512AudioKernels;
+#endif
+    
+    if (n > max)
+        n = max;
+    memcpy(list, sets, (size_t) n * sizeof(sets[0]));
+    
+    return n;
+}
+
+// The kernels for this CPU
+const struct audioKernels* getAudioKernels(void) {
+    
+    static _Atomic(const struct audioKernels *) chosen = NULL;
+    
+    const struct audioKernels *k =
+        atomic_load_explicit(&chosen, memory_order_acquire);
+    if (k != NULL)
+        return k;
+    
+    // the best set, unless another is asked for
+    const struct audioKernels *sets[MAX_KERNEL_SETS];
+    int n = getAudioKernelSets(sets, MAX_KERNEL_SETS);
+    k = sets[n - 1];
+    
+    const char *name = getConfigString("BAP_KERNELS", NULL);
+    if (name != NULL) {
+        int i = 0;
+        while (i < n && strcmp(sets[i]->name, name) != 0)
+            i++;
+        if (i < n)
+            k = sets[i];
+        else
+            printf("Kernels %s are not available, using %s\n", name, k->name);
+    }
+    
+    // any thread that gets here at the same time makes the same choice
+    atomic_store_explicit(&chosen, k, memory_order_release);
+    
+    return k;
+}
@@ -0,0 +1,83 @@
+//
+//  audioKernels.h
+//
+//  Vectorised inner loops for the sample processing the players and the
+//  mixer do: gain with a ramp, mix-accumulate, interleaving, conversion
+//  between float and the integer sample formats, peak/RMS, and dot
+//  products for filters. There is a scalar version of each kernel, which
+//  is the reference, and SSE2, AVX2 and AVX-512 versions on x86. The best
+//  set the CPU supports is chosen once, on the first call to
+//  getAudioKernels(); BAP_KERNELS can name a set instead (scalar, sse2,
+//  avx2 or avx512).
+//
+//  Every set gives bit-for-bit the same result as the scalar one (the
+//  kernels benchmark checks this): the vector versions do the same float
+//  operations in the same order, never fuse a multiply and an add, and
+//  peak/RMS and dot products always keep AUDIO_KERNEL_LANES partial
+//  results, whatever the width of the registers.
+//
+
+#ifndef audioKernels_h
+#define audioKernels_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Partial sums kept by peakRms and dotProduct (one AVX-512 register of
+// floats)
+#define AUDIO_KERNEL_LANES (16)
+
+// struct type for one set of kernels. Samples are float in [-1, 1) unless
+// stated; int24 is packed, in native byte order, as paInt24. Conversions to
+// integers clip, and round to nearest with ties to even.
+struct audioKernels {
+    const char  *name;
+
+    // dst = src * (gain + step * f), for frame f of frames; dst may be src
+    void (*gainRamp)(float *dst, const float *src, size_t frames,
+        unsigned int channels, float gain, float step);
+
+    // dst += src * gain, over samples
+    void (*mixAccumulate)(float *dst, const float *src, size_t samples,
+        float gain);
+
+    // Between one buffer per channel (planar) and interleaved frames
+    void (*interleave)(float *dst, const float *const *src, size_t frames,
+        unsigned int channels);
+    void (*deinterleave)(float *const *dst, const float *src, size_t frames,
+        unsigned int channels);
+
+    // Between float and the integer formats
+    void (*floatToInt16)(int16_t *dst, const float *src, size_t samples);
+    void (*floatToInt24)(void *dst, const float *src, size_t samples);
+    void (*floatToInt32)(int32_t *dst, const float *src, size_t samples);
+    void (*int16ToFloat)(float *dst, const int16_t *src, size_t samples);
+    void (*int24ToFloat)(float *dst, const void *src, size_t samples);
+    void (*int32ToFloat)(float *dst, const int32_t *src, size_t samples);
+
+    // Largest absolute value and sum of squares of samples
+    void (*peakRms)(const float *src, size_t samples, float *peak,
+        double *sumSquares);
+
+    // Sum of a[i] * b[i] (a filter tap loop)
+    float (*dotProduct)(const float *a, const float *b, size_t n);
+};
+
+// The kernels for this CPU (or the set named by BAP_KERNELS). Chosen on the
+// first call, so call it once before the stream starts; after that it is
+// wait-free.
+const struct audioKernels* getAudioKernels(void);
+
+// All the sets this CPU can run, scalar first, in list; returns how many
+// (at most max)
+int getAudioKernelSets(const struct audioKernels **list, int max);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* audioKernels_h */
@@ -0,0 +1,1128 @@
+//
+//  audioKernelsX86.c
+//
+//  SSE2, AVX2 and AVX-512 versions of the kernels in audioKernels.h. Each
+//  function is compiled for its own instruction set with a target
+//  attribute, so the file needs no special compiler flags, and
+//  getAudioKernels() only calls those the CPU has. Loops do whole registers
+//  and leave the remaining samples to the scalar code. Interleaving is done
+//  by each set for stereo, and by SSE2 4 channels at a time for multiples
+//  of 4. Kernels that a layout doesn't suit (gain ramps and interleaving
+//  with other channel counts) fall back to the scalar code altogether.
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+#include "audioKernels.h"
+
+// as in audioKernels.c: no fused multiply-adds, which AVX-512 would allow
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+extern const struct audioKernels scalarAudioKernels;   // audioKernels.c
+float sumAudioKernelLanes(float *lanes);
+
+// Scalar gain ramp from frame first on; the vector loops hand over here
+static inline void gainRampFrom(
+    float *dst,
+    const float *src,
+    size_t first,
+    size_t frames,
+    unsigned int channels,
+    float gain,
+    float step
+) {
+    
+    for (size_t f = first; f < frames; f++) {
+        float g = gain + step * (float) f;
+        for (unsigned int c = 0; c < channels; c++)
+            dst[f * channels + c] = src[f * channels + c] * g;
+    }
+}
+
+// Scalar peak/RMS from sample i on, then the sum over the lanes, exactly as
+// peakRmsScalar() does it
+static inline void peakRmsFrom(
+    const float *src,
+    size_t i,
+    size_t samples,
+    float *sq,
+    float *pk,
+    float *peak,
+    double *sumSquares
+) {
+    
+    for (; i < samples; i++) {
+        float x = src[i], a = fabsf(x);
+        size_t l = i % AUDIO_KERNEL_LANES;
+        sq[l] += x * x;
+        pk[l] = a > pk[l] ? a : pk[l];
+    }
+    
+    double sum = 0.0;
+    float largest = 0.0f;
+    for (int l = 0; l < AUDIO_KERNEL_LANES; l++) {
+        sum += sq[l];
+        largest = pk[l] > largest ? pk[l] : largest;
+    }
+    
+    *peak = largest;
+    *sumSquares = sum;
+}
+
+// Scalar dot product from element i on, then the sum over the lanes
+static inline float dotProductFrom(
+    const float *a,
+    const float *b,
+    size_t i,
+    size_t n,
+    float *sums
+) {
+    
+    for (; i < n; i++)
+        sums[i % AUDIO_KERNEL_LANES] += a[i] * b[i];
+    
+    return sumAudioKernelLanes(sums);
+}
+
+// Frame of each lane of a register of width samples, from the first
+static inline void getLaneFrames(
+    int32_t *offsets,
+    int width,
+    unsigned int channels
+) {
+    
+    for (int j = 0; j < width; j++)
+        offsets[j] = (int32_t) ((unsigned int) j / channels);
+}
+
+// One packed 24-bit sample, sign-extended (x86 is little-endian)
+static inline int32_t loadInt24(const unsigned char *p) {
+    
+    return (int32_t) ((uint32_t) p[2] << 24 | (uint32_t) p[1] << 16 |
+        (uint32_t) p[0] << 8) >> 8;
+}
+
+// Pack the low 24 bits of 8 samples into 24 bytes from p. Writes 4 bytes
+// more, which whatever comes next overwrites.
+static inline TARGET_AVX2 void storeInt24x8(unsigned char *p, __m256i v) {
+    
+    const __m256i pack = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    
+    v = _mm256_shuffle_epi8(v, pack);
+    _mm_storeu_si128((__m128i *) p, _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i *) (p + 12), _mm256_extracti128_si256(v, 1));
+}
+
+// Sign-extend 8 packed 24-bit samples from p. Reads 28 bytes.
+static inline TARGET_AVX2 __m256i loadInt24x8(const unsigned char *p) {
+    
+    const __m256i unpack = _mm256_setr_epi8(
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) p)),
+        _mm_loadu_si128((const __m128i *) (p + 12)), 1);
+    
+    return _mm256_srai_epi32(_mm256_shuffle_epi8(v, unpack), 8);
+}
+
+// SSE2
+
+static TARGET_SSE2 void gainRampSse2(
+    float *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels,
+    float gain,
+    float step
+) {
+    
+    size_t f = 0;
+    
+    if (channels > 0 && 4 % channels == 0) {
+        // a register holds 4 / channels whole frames
+        int32_t offsets[4];
+        getLaneFrames(offsets, 4, channels);
+        __m128i lanes = _mm_loadu_si128((const __m128i *) offsets);
+        __m128 g0 = _mm_set1_ps(gain), s = _mm_set1_ps(step);
+        size_t samples = frames * channels, i = 0;
+        for (; i + 4 <= samples; i += 4) {
+            __m128i fi = _mm_add_epi32(_mm_set1_epi32((int32_t) (i / channels)),
+                lanes);
+            __m128 g = _mm_add_ps(g0, _mm_mul_ps(s, _mm_cvtepi32_ps(fi)));
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        }
+        f = i / channels;
+    }
+    else if (channels % 4 == 0) {
+        // whole registers per frame
+        for (; f < frames; f++) {
+            __m128 g = _mm_set1_ps(gain + step * (float) f);
+            for (size_t i = f * channels; i < (f + 1) * channels; i += 4)
+                _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        }
+    }
+    
+    gainRampFrom(dst, src, f, frames, channels, gain, step);
+}
+
+static TARGET_SSE2 void mixAccumulateSse2(
+    float *dst,
+    const float *src,
+    size_t samples,
+    float gain
+) {
+    
+    __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    
+    for (; i + 8 <= samples; i += 8) {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(dst + i),
+            _mm_mul_ps(_mm_loadu_ps(src + i), g));
+        __m128 b = _mm_add_ps(_mm_loadu_ps(dst + i + 4),
+            _mm_mul_ps(_mm_loadu_ps(src + i + 4), g));
+        _mm_storeu_ps(dst + i, a);
+        _mm_storeu_ps(dst + i + 4, b);
+    }
+    
+    scalarAudioKernels.mixAccumulate(dst + i, src + i, samples - i, gain);
+}
+
+// Interleave a multiple of 4 channels, 4 frames by 4 channels at a time
+static TARGET_SSE2 void interleaveQuadsSse2(
+    float *dst,
+    const float *const *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    size_t f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        float *out = dst + f * channels;
+        for (unsigned int c = 0; c < channels; c += 4) {
+            __m128 r0 = _mm_loadu_ps(src[c] + f);
+            __m128 r1 = _mm_loadu_ps(src[c + 1] + f);
+            __m128 r2 = _mm_loadu_ps(src[c + 2] + f);
+            __m128 r3 = _mm_loadu_ps(src[c + 3] + f);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(out + c, r0);
+            _mm_storeu_ps(out + channels + c, r1);
+            _mm_storeu_ps(out + 2 * channels + c, r2);
+            _mm_storeu_ps(out + 3 * channels + c, r3);
+        }
+    }
+    
+    const float *rest[channels];
+    for (unsigned int c = 0; c < channels; c++)
+        rest[c] = src[c] + f;
+    scalarAudioKernels.interleave(dst + f * channels, rest, frames - f,
+        channels);
+}
+
+// Deinterleave a multiple of 4 channels, 4 frames by 4 channels at a time
+static TARGET_SSE2 void deinterleaveQuadsSse2(
+    float *const *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    size_t f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        const float *in = src + f * channels;
+        for (unsigned int c = 0; c < channels; c += 4) {
+            __m128 r0 = _mm_loadu_ps(in + c);
+            __m128 r1 = _mm_loadu_ps(in + channels + c);
+            __m128 r2 = _mm_loadu_ps(in + 2 * channels + c);
+            __m128 r3 = _mm_loadu_ps(in + 3 * channels + c);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dst[c] + f, r0);
+            _mm_storeu_ps(dst[c + 1] + f, r1);
+            _mm_storeu_ps(dst[c + 2] + f, r2);
+            _mm_storeu_ps(dst[c + 3] + f, r3);
+        }
+    }
+    
+    float *rest[channels];
+    for (unsigned int c = 0; c < channels; c++)
+        rest[c] = dst[c] + f;
+    scalarAudioKernels.deinterleave(rest, src + f * channels, frames - f,
+        channels);
+}
+
+static TARGET_SSE2 void interleaveSse2(
+    float *dst,
+    const float *const *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    if (channels % 4 == 0) {
+        interleaveQuadsSse2(dst, src, frames, channels);
+        return;
+    }
+    if (channels != 2) {
+        scalarAudioKernels.interleave(dst, src, frames, channels);
+        return;
+    }
+    
+    size_t f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        __m128 l = _mm_loadu_ps(src[0] + f), r = _mm_loadu_ps(src[1] + f);
+        _mm_storeu_ps(dst + 2 * f, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dst + 2 * f + 4, _mm_unpackhi_ps(l, r));
+    }
+    
+    const float *rest[2] = {src[0] + f, src[1] + f};
+    scalarAudioKernels.interleave(dst + 2 * f, rest, frames - f, 2);
+}
+
+static TARGET_SSE2 void deinterleaveSse2(
+    float *const *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    if (channels % 4 == 0) {
+        deinterleaveQuadsSse2(dst, src, frames, channels);
+        return;
+    }
+    if (channels != 2) {
+        scalarAudioKernels.deinterleave(dst, src, frames, channels);
+        return;
+    }
+    
+    size_t f = 0;
+    for (; f + 4 <= frames; f += 4) {
+        __m128 a = _mm_loadu_ps(src + 2 * f), b = _mm_loadu_ps(src + 2 * f + 4);
+        _mm_storeu_ps(dst[0] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(dst[1] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    
+    float *rest[2] = {dst[0] + f, dst[1] + f};
+    scalarAudioKernels.deinterleave(rest, src + 2 * f, frames - f, 2);
+}
+
+// Scale, clip and round 4 samples to int32
+static inline TARGET_SSE2 __m128i convertSse2(
+    const float *src,
+    __m128 scale,
+    __m128 lo,
+    __m128 hi
+) {
+    
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(src), scale);
+    
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+}
+
+static TARGET_SSE2 void floatToInt16Sse2(
+    int16_t *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m128 scale = _mm_set1_ps(32768.0f);
+    __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    
+    for (; i + 8 <= samples; i += 8) {
+        __m128i a = convertSse2(src + i, scale, lo, hi);
+        __m128i b = convertSse2(src + i + 4, scale, lo, hi);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+    }
+    
+    scalarAudioKernels.floatToInt16(dst + i, src + i, samples - i);
+}
+
+static TARGET_SSE2 void floatToInt24Sse2(
+    void *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m128 scale = _mm_set1_ps(8388608.0f);
+    __m128 lo = _mm_set1_ps(-8388608.0f), hi = _mm_set1_ps(8388607.0f);
+    unsigned char *p = (unsigned char *) dst;
+    size_t i = 0;
+    
+    // SSE2 has no byte shuffle: convert in registers, pack one by one
+    for (; i + 4 <= samples; i += 4, p += 12) {
+        int32_t v[4];
+        _mm_storeu_si128((__m128i *) v, convertSse2(src + i, scale, lo, hi));
+        for (int j = 0; j < 4; j++) {
+            p[3 * j] = (unsigned char) v[j];
+            p[3 * j + 1] = (unsigned char) (v[j] >> 8);
+            p[3 * j + 2] = (unsigned char) (v[j] >> 16);
+        }
+    }
+    
+    scalarAudioKernels.floatToInt24(p, src + i, samples - i);
+}
+
+static TARGET_SSE2 void floatToInt32Sse2(
+    int32_t *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m128 scale = _mm_set1_ps(2147483648.0f);
+    __m128 lo = _mm_set1_ps(-2147483648.0f), hi = _mm_set1_ps(2147483520.0f);
+    size_t i = 0;
+    
+    for (; i + 4 <= samples; i += 4)
+        _mm_storeu_si128((__m128i *) (dst + i),
+            convertSse2(src + i, scale, lo, hi));
+    
+    scalarAudioKernels.floatToInt32(dst + i, src + i, samples - i);
+}
+
+static TARGET_SSE2 void int16ToFloatSse2(
+    float *dst,
+    const int16_t *src,
+    size_t samples
+) {
+    
+    __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        // sign-extend by putting each sample in the top half of a 32-bit lane
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+    }
+    
+    scalarAudioKernels.int16ToFloat(dst + i, src + i, samples - i);
+}
+
+static TARGET_SSE2 void int24ToFloatSse2(
+    float *dst,
+    const void *src,
+    size_t samples
+) {
+    
+    __m128 scale = _mm_set1_ps(1.0f / 8388608.0f);
+    const unsigned char *p = (const unsigned char *) src;
+    size_t i = 0;
+    
+    // SSE2 has no byte shuffle: unpack one by one, convert in registers
+    for (; i + 4 <= samples; i += 4, p += 12) {
+        __m128i s = _mm_setr_epi32(loadInt24(p), loadInt24(p + 3),
+            loadInt24(p + 6), loadInt24(p + 9));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(s), scale));
+    }
+    
+    scalarAudioKernels.int24ToFloat(dst + i, p, samples - i);
+}
+
+static TARGET_SSE2 void int32ToFloatSse2(
+    float *dst,
+    const int32_t *src,
+    size_t samples
+) {
+    
+    __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    
+    for (; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    
+    scalarAudioKernels.int32ToFloat(dst + i, src + i, samples - i);
+}
+
+static TARGET_SSE2 void peakRmsSse2(
+    const float *src,
+    size_t samples,
+    float *peak,
+    double *sumSquares
+) {
+    
+    // four registers make the 16 lanes
+    __m128 sq[4], pk[4];
+    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    size_t i = 0;
+    
+    for (int r = 0; r < 4; r++)
+        sq[r] = pk[r] = _mm_setzero_ps();
+    for (; i + AUDIO_KERNEL_LANES <= samples; i += AUDIO_KERNEL_LANES) {
+        for (int r = 0; r < 4; r++) {
+            __m128 x = _mm_loadu_ps(src + i + 4 * r);
+            sq[r] = _mm_add_ps(sq[r], _mm_mul_ps(x, x));
+            pk[r] = _mm_max_ps(_mm_and_ps(x, mask), pk[r]);
+        }
+    }
+    
+    float sqLanes[AUDIO_KERNEL_LANES], pkLanes[AUDIO_KERNEL_LANES];
+    for (int r = 0; r < 4; r++) {
+        _mm_storeu_ps(sqLanes + 4 * r, sq[r]);
+        _mm_storeu_ps(pkLanes + 4 * r, pk[r]);
+    }
+    peakRmsFrom(src, i, samples, sqLanes, pkLanes, peak, sumSquares);
+}
+
+static TARGET_SSE2 float dotProductSse2(
+    const float *a,
+    const float *b,
+    size_t n
+) {
+    
+    __m128 sum[4];
+    size_t i = 0;
+    
+    for (int r = 0; r < 4; r++)
+        sum[r] = _mm_setzero_ps();
+    for (; i + AUDIO_KERNEL_LANES <= n; i += AUDIO_KERNEL_LANES) {
+        for (int r = 0; r < 4; r++)
+            sum[r] = _mm_add_ps(sum[r], _mm_mul_ps(_mm_loadu_ps(a + i + 4 * r),
+                _mm_loadu_ps(b + i + 4 * r)));
+    }
+    
+    float sums[AUDIO_KERNEL_LANES];
+    for (int r = 0; r < 4; r++)
+        _mm_storeu_ps(sums + 4 * r, sum[r]);
+    
+    return dotProductFrom(a, b, i, n, sums);
+}
+
+// AVX2
+
+static TARGET_AVX2 void gainRampAvx2(
+    float *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels,
+    float gain,
+    float step
+) {
+    
+    size_t f = 0;
+    
+    if (channels > 0 && 8 % channels == 0) {
+        int32_t offsets[8];
+        getLaneFrames(offsets, 8, channels);
+        __m256i lanes = _mm256_loadu_si256((const __m256i *) offsets);
+        __m256 g0 = _mm256_set1_ps(gain), s = _mm256_set1_ps(step);
+        size_t samples = frames * channels, i = 0;
+        for (; i + 8 <= samples; i += 8) {
+            __m256i fi = _mm256_add_epi32(
+                _mm256_set1_epi32((int32_t) (i / channels)), lanes);
+            __m256 g = _mm256_add_ps(g0, _mm256_mul_ps(s, _mm256_cvtepi32_ps(fi)));
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        }
+        f = i / channels;
+    }
+    else if (channels % 8 == 0) {
+        for (; f < frames; f++) {
+            __m256 g = _mm256_set1_ps(gain + step * (float) f);
+            for (size_t i = f * channels; i < (f + 1) * channels; i += 8)
+                _mm256_storeu_ps(dst + i,
+                    _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        }
+    }
+    
+    gainRampFrom(dst, src, f, frames, channels, gain, step);
+}
+
+static TARGET_AVX2 void mixAccumulateAvx2(
+    float *dst,
+    const float *src,
+    size_t samples,
+    float gain
+) {
+    
+    __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    
+    for (; i + 16 <= samples; i += 16) {
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(dst + i),
+            _mm256_mul_ps(_mm256_loadu_ps(src + i), g));
+        __m256 b = _mm256_add_ps(_mm256_loadu_ps(dst + i + 8),
+            _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), g));
+        _mm256_storeu_ps(dst + i, a);
+        _mm256_storeu_ps(dst + i + 8, b);
+    }
+    
+    scalarAudioKernels.mixAccumulate(dst + i, src + i, samples - i, gain);
+}
+
+static TARGET_AVX2 void interleaveAvx2(
+    float *dst,
+    const float *const *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    if (channels != 2) {
+        interleaveSse2(dst, src, frames, channels);
+        return;
+    }
+    
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        __m256 l = _mm256_loadu_ps(src[0] + f), r = _mm256_loadu_ps(src[1] + f);
+        // unpack works within each 128-bit half; put the halves in order
+        __m256 lo = _mm256_unpacklo_ps(l, r), hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(dst + 2 * f, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(dst + 2 * f + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    
+    const float *rest[2] = {src[0] + f, src[1] + f};
+    scalarAudioKernels.interleave(dst + 2 * f, rest, frames - f, 2);
+}
+
+static TARGET_AVX2 void deinterleaveAvx2(
+    float *const *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    if (channels != 2) {
+        deinterleaveSse2(dst, src, frames, channels);
+        return;
+    }
+    
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        __m256 a = _mm256_loadu_ps(src + 2 * f);
+        __m256 b = _mm256_loadu_ps(src + 2 * f + 8);
+        // shuffle gives pairs of frames 0 1 4 5 2 3 6 7; swap the middle pairs
+        __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm256_storeu_ps(dst[0] + f, _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0))));
+        _mm256_storeu_ps(dst[1] + f, _mm256_castpd_ps(_mm256_permute4x64_pd(
+            _mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+    
+    float *rest[2] = {dst[0] + f, dst[1] + f};
+    scalarAudioKernels.deinterleave(rest, src + 2 * f, frames - f, 2);
+}
+
+// Scale, clip and round 8 samples to int32
+static inline TARGET_AVX2 __m256i convertAvx2(
+    const float *src,
+    __m256 scale,
+    __m256 lo,
+    __m256 hi
+) {
+    
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src), scale);
+    
+    return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, lo), hi));
+}
+
+static TARGET_AVX2 void floatToInt16Avx2(
+    int16_t *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m256 scale = _mm256_set1_ps(32768.0f);
+    __m256 lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    
+    for (; i + 16 <= samples; i += 16) {
+        __m256i a = convertAvx2(src + i, scale, lo, hi);
+        __m256i b = convertAvx2(src + i + 8, scale, lo, hi);
+        // packs works within each 128-bit half; put the halves in order
+        __m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b),
+            _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+    }
+    
+    scalarAudioKernels.floatToInt16(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX2 void floatToInt24Avx2(
+    void *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m256 scale = _mm256_set1_ps(8388608.0f);
+    __m256 lo = _mm256_set1_ps(-8388608.0f), hi = _mm256_set1_ps(8388607.0f);
+    unsigned char *p = (unsigned char *) dst;
+    size_t i = 0;
+    
+    // stop while the bytes written past each block are still in dst
+    for (; i + 11 <= samples; i += 8, p += 24)
+        storeInt24x8(p, convertAvx2(src + i, scale, lo, hi));
+    
+    scalarAudioKernels.floatToInt24(p, src + i, samples - i);
+}
+
+static TARGET_AVX2 void floatToInt32Avx2(
+    int32_t *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m256 scale = _mm256_set1_ps(2147483648.0f);
+    __m256 lo = _mm256_set1_ps(-2147483648.0f);
+    __m256 hi = _mm256_set1_ps(2147483520.0f);
+    size_t i = 0;
+    
+    for (; i + 8 <= samples; i += 8)
+        _mm256_storeu_si256((__m256i *) (dst + i),
+            convertAvx2(src + i, scale, lo, hi));
+    
+    scalarAudioKernels.floatToInt32(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX2 void int16ToFloatAvx2(
+    float *dst,
+    const int16_t *src,
+    size_t samples
+) {
+    
+    __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    
+    for (; i + 8 <= samples; i += 8) {
+        __m256i v = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i *) (src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    
+    scalarAudioKernels.int16ToFloat(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX2 void int24ToFloatAvx2(
+    float *dst,
+    const void *src,
+    size_t samples
+) {
+    
+    __m256 scale = _mm256_set1_ps(1.0f / 8388608.0f);
+    const unsigned char *p = (const unsigned char *) src;
+    size_t i = 0;
+    
+    // stop while the bytes read past each block are still in src
+    for (; i + 11 <= samples; i += 8, p += 24)
+        _mm256_storeu_ps(dst + i,
+            _mm256_mul_ps(_mm256_cvtepi32_ps(loadInt24x8(p)), scale));
+    
+    scalarAudioKernels.int24ToFloat(dst + i, p, samples - i);
+}
+
+static TARGET_AVX2 void int32ToFloatAvx2(
+    float *dst,
+    const int32_t *src,
+    size_t samples
+) {
+    
+    __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    
+    for (; i + 8 <= samples; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    
+    scalarAudioKernels.int32ToFloat(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX2 void peakRmsAvx2(
+    const float *src,
+    size_t samples,
+    float *peak,
+    double *sumSquares
+) {
+    
+    // two registers make the 16 lanes
+    __m256 sq[2], pk[2];
+    __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    size_t i = 0;
+    
+    for (int r = 0; r < 2; r++)
+        sq[r] = pk[r] = _mm256_setzero_ps();
+    for (; i + AUDIO_KERNEL_LANES <= samples; i += AUDIO_KERNEL_LANES) {
+        for (int r = 0; r < 2; r++) {
+            __m256 x = _mm256_loadu_ps(src + i + 8 * r);
+            sq[r] = _mm256_add_ps(sq[r], _mm256_mul_ps(x, x));
+            pk[r] = _mm256_max_ps(_mm256_and_ps(x, mask), pk[r]);
+        }
+    }
+    
+    float sqLanes[AUDIO_KERNEL_LANES], pkLanes[AUDIO_KERNEL_LANES];
+    for (int r = 0; r < 2; r++) {
+        _mm256_storeu_ps(sqLanes + 8 * r, sq[r]);
+        _mm256_storeu_ps(pkLanes + 8 * r, pk[r]);
+    }
+    peakRmsFrom(src, i, samples, sqLanes, pkLanes, peak, sumSquares);
+}
+
+static TARGET_AVX2 float dotProductAvx2(
+    const float *a,
+    const float *b,
+    size_t n
+) {
+    
+    __m256 sum[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    size_t i = 0;
+    
+    for (; i + AUDIO_KERNEL_LANES <= n; i += AUDIO_KERNEL_LANES) {
+        for (int r = 0; r < 2; r++)
+            sum[r] = _mm256_add_ps(sum[r], _mm256_mul_ps(
+                _mm256_loadu_ps(a + i + 8 * r), _mm256_loadu_ps(b + i + 8 * r)));
+    }
+    
+    float sums[AUDIO_KERNEL_LANES];
+    for (int r = 0; r < 2; r++)
+        _mm256_storeu_ps(sums + 8 * r, sum[r]);
+    
+    return dotProductFrom(a, b, i, n, sums);
+}
+
+// AVX-512
+
+static TARGET_AVX512 void gainRampAvx512(
+    float *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels,
+    float gain,
+    float step
+) {
+    
+    size_t f = 0;
+    
+    if (channels > 0 && 16 % channels == 0) {
+        int32_t offsets[16];
+        getLaneFrames(offsets, 16, channels);
+        __m512i lanes = _mm512_loadu_si512(offsets);
+        __m512 g0 = _mm512_set1_ps(gain), s = _mm512_set1_ps(step);
+        size_t samples = frames * channels, i = 0;
+        for (; i + 16 <= samples; i += 16) {
+            __m512i fi = _mm512_add_epi32(
+                _mm512_set1_epi32((int32_t) (i / channels)), lanes);
+            __m512 g = _mm512_add_ps(g0, _mm512_mul_ps(s, _mm512_cvtepi32_ps(fi)));
+            _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_loadu_ps(src + i), g));
+        }
+        f = i / channels;
+    }
+    else if (channels % 16 == 0) {
+        for (; f < frames; f++) {
+            __m512 g = _mm512_set1_ps(gain + step * (float) f);
+            for (size_t i = f * channels; i < (f + 1) * channels; i += 16)
+                _mm512_storeu_ps(dst + i,
+                    _mm512_mul_ps(_mm512_loadu_ps(src + i), g));
+        }
+    }
+    
+    gainRampFrom(dst, src, f, frames, channels, gain, step);
+}
+
+static TARGET_AVX512 void mixAccumulateAvx512(
+    float *dst,
+    const float *src,
+    size_t samples,
+    float gain
+) {
+    
+    __m512 g = _mm512_set1_ps(gain);
+    size_t i = 0;
+    
+    for (; i + 32 <= samples; i += 32) {
+        __m512 a = _mm512_add_ps(_mm512_loadu_ps(dst + i),
+            _mm512_mul_ps(_mm512_loadu_ps(src + i), g));
+        __m512 b = _mm512_add_ps(_mm512_loadu_ps(dst + i + 16),
+            _mm512_mul_ps(_mm512_loadu_ps(src + i + 16), g));
+        _mm512_storeu_ps(dst + i, a);
+        _mm512_storeu_ps(dst + i + 16, b);
+    }
+    
+    scalarAudioKernels.mixAccumulate(dst + i, src + i, samples - i, gain);
+}
+
+static TARGET_AVX512 void interleaveAvx512(
+    float *dst,
+    const float *const *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    if (channels != 2) {
+        interleaveSse2(dst, src, frames, channels);
+        return;
+    }
+    
+    // indices into the 32 floats of left then right
+    const __m512i first = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19,
+        4, 20, 5, 21, 6, 22, 7, 23);
+    const __m512i second = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27,
+        12, 28, 13, 29, 14, 30, 15, 31);
+    size_t f = 0;
+    
+    for (; f + 16 <= frames; f += 16) {
+        __m512 l = _mm512_loadu_ps(src[0] + f), r = _mm512_loadu_ps(src[1] + f);
+        _mm512_storeu_ps(dst + 2 * f, _mm512_permutex2var_ps(l, first, r));
+        _mm512_storeu_ps(dst + 2 * f + 16, _mm512_permutex2var_ps(l, second, r));
+    }
+    
+    const float *rest[2] = {src[0] + f, src[1] + f};
+    scalarAudioKernels.interleave(dst + 2 * f, rest, frames - f, 2);
+}
+
+static TARGET_AVX512 void deinterleaveAvx512(
+    float *const *dst,
+    const float *src,
+    size_t frames,
+    unsigned int channels
+) {
+    
+    if (channels != 2) {
+        deinterleaveSse2(dst, src, frames, channels);
+        return;
+    }
+    
+    const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14,
+        16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15,
+        17, 19, 21, 23, 25, 27, 29, 31);
+    size_t f = 0;
+    
+    for (; f + 16 <= frames; f += 16) {
+        __m512 a = _mm512_loadu_ps(src + 2 * f);
+        __m512 b = _mm512_loadu_ps(src + 2 * f + 16);
+        _mm512_storeu_ps(dst[0] + f, _mm512_permutex2var_ps(a, even, b));
+        _mm512_storeu_ps(dst[1] + f, _mm512_permutex2var_ps(a, odd, b));
+    }
+    
+    float *rest[2] = {dst[0] + f, dst[1] + f};
+    scalarAudioKernels.deinterleave(rest, src + 2 * f, frames - f, 2);
+}
+
+// Scale, clip and round 16 samples to int32
+static inline TARGET_AVX512 __m512i convertAvx512(
+    const float *src,
+    __m512 scale,
+    __m512 lo,
+    __m512 hi
+) {
+    
+    __m512 v = _mm512_mul_ps(_mm512_loadu_ps(src), scale);
+    
+    return _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(v, lo), hi));
+}
+
+static TARGET_AVX512 void floatToInt16Avx512(
+    int16_t *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m512 scale = _mm512_set1_ps(32768.0f);
+    __m512 lo = _mm512_set1_ps(-32768.0f), hi = _mm512_set1_ps(32767.0f);
+    size_t i = 0;
+    
+    for (; i + 16 <= samples; i += 16)
+        _mm256_storeu_si256((__m256i *) (dst + i),
+            _mm512_cvtsepi32_epi16(convertAvx512(src + i, scale, lo, hi)));
+    
+    scalarAudioKernels.floatToInt16(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX512 void floatToInt24Avx512(
+    void *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m512 scale = _mm512_set1_ps(8388608.0f);
+    __m512 lo = _mm512_set1_ps(-8388608.0f), hi = _mm512_set1_ps(8388607.0f);
+    unsigned char *p = (unsigned char *) dst;
+    size_t i = 0;
+    
+    // the byte shuffle needs AVX512BW, so pack with AVX2, half at a time
+    for (; i + 19 <= samples; i += 16, p += 48) {
+        __m512i v = convertAvx512(src + i, scale, lo, hi);
+        storeInt24x8(p, _mm512_castsi512_si256(v));
+        storeInt24x8(p + 24, _mm512_extracti64x4_epi64(v, 1));
+    }
+    
+    scalarAudioKernels.floatToInt24(p, src + i, samples - i);
+}
+
+static TARGET_AVX512 void floatToInt32Avx512(
+    int32_t *dst,
+    const float *src,
+    size_t samples
+) {
+    
+    __m512 scale = _mm512_set1_ps(2147483648.0f);
+    __m512 lo = _mm512_set1_ps(-2147483648.0f);
+    __m512 hi = _mm512_set1_ps(2147483520.0f);
+    size_t i = 0;
+    
+    for (; i + 16 <= samples; i += 16)
+        _mm512_storeu_si512(dst + i, convertAvx512(src + i, scale, lo, hi));
+    
+    scalarAudioKernels.floatToInt32(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX512 void int16ToFloatAvx512(
+    float *dst,
+    const int16_t *src,
+    size_t samples
+) {
+    
+    __m512 scale = _mm512_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    
+    for (; i + 16 <= samples; i += 16) {
+        __m512i v = _mm512_cvtepi16_epi32(
+            _mm256_loadu_si256((const __m256i *) (src + i)));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+    }
+    
+    scalarAudioKernels.int16ToFloat(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX512 void int24ToFloatAvx512(
+    float *dst,
+    const void *src,
+    size_t samples
+) {
+    
+    __m512 scale = _mm512_set1_ps(1.0f / 8388608.0f);
+    const unsigned char *p = (const unsigned char *) src;
+    size_t i = 0;
+    
+    for (; i + 19 <= samples; i += 16, p += 48) {
+        __m512i v = _mm512_inserti64x4(_mm512_castsi256_si512(loadInt24x8(p)),
+            loadInt24x8(p + 24), 1);
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+    }
+    
+    scalarAudioKernels.int24ToFloat(dst + i, p, samples - i);
+}
+
+static TARGET_AVX512 void int32ToFloatAvx512(
+    float *dst,
+    const int32_t *src,
+    size_t samples
+) {
+    
+    __m512 scale = _mm512_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    
+    for (; i + 16 <= samples; i += 16) {
+        __m512i v = _mm512_loadu_si512(src + i);
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+    }
+    
+    scalarAudioKernels.int32ToFloat(dst + i, src + i, samples - i);
+}
+
+static TARGET_AVX512 void peakRmsAvx512(
+    const float *src,
+    size_t samples,
+    float *peak,
+    double *sumSquares
+) {
+    
+    __m512 sq = _mm512_setzero_ps(), pk = _mm512_setzero_ps();
+    size_t i = 0;
+    
+    for (; i + AUDIO_KERNEL_LANES <= samples; i += AUDIO_KERNEL_LANES) {
+        __m512 x = _mm512_loadu_ps(src + i);
+        sq = _mm512_add_ps(sq, _mm512_mul_ps(x, x));
+        pk = _mm512_max_ps(_mm512_abs_ps(x), pk);
+    }
+    
+    float sqLanes[AUDIO_KERNEL_LANES], pkLanes[AUDIO_KERNEL_LANES];
+    _mm512_storeu_ps(sqLanes, sq);
+    _mm512_storeu_ps(pkLanes, pk);
+    peakRmsFrom(src, i, samples, sqLanes, pkLanes, peak, sumSquares);
+}
+
+static TARGET_AVX512 float dotProductAvx512(
+    const float *a,
+    const float *b,
+    size_t n
+) {
+    
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    
+    for (; i + AUDIO_KERNEL_LANES <= n; i += AUDIO_KERNEL_LANES)
+        sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_loadu_ps(a + i),
+            _mm512_loadu_ps(b + i)));
+    
+    float sums[AUDIO_KERNEL_LANES];
+    _mm512_storeu_ps(sums, sum);
+    
+    return dotProductFrom(a, b, i, n, sums);
+}
+
+const struct audioKernels sse2AudioKernels = {
+    .name = "sse2",
+    .gainRamp = gainRampSse2,
+    .mixAccumulate = mixAccumulateSse2,
+    .interleave = interleaveSse2,
+    .deinterleave = deinterleaveSse2,
+    .floatToInt16 = floatToInt16Sse2,
+    .floatToInt24 = floatToInt24Sse2,
+    .floatToInt32 = floatToInt32Sse2,
+    .int16ToFloat = int16ToFloatSse2,
+    .int24ToFloat = int24ToFloatSse2,
+    .int32ToFloat = int32ToFloatSse2,
+    .peakRms = peakRmsSse2,
+    .dotProduct = dotProductSse2
+};
+
+const struct audioKernels avx2AudioKernels = {
+    .name = "avx2",
+    .gainRamp = gainRampAvx2,
+    .mixAccumulate = mixAccumulateAvx2,
+    .interleave = interleaveAvx2,
+    .deinterleave = deinterleaveAvx2,
+    .floatToInt16 = floatToInt16Avx2,
+    .floatToInt24 = floatToInt24Avx2,
+    .floatToInt32 = floatToInt32Avx2,
+    .int16ToFloat = int16ToFloatAvx2,
+    .int24ToFloat = int24ToFloatAvx2,
+    .int32ToFloat = int32ToFloatAvx2,
+    .peakRms = peakRmsAvx2,
+    .dotProduct = dotProductAvx2
+};
+
+const struct audioKernels avx512AudioKernels = {
+    .name = "avx512",
+    .gainRamp = gainRampAvx512,
+    .mixAccumulate = mixAccumulateAvx512,
+    .interleave = interleaveAvx512,
+    .deinterleave = deinterleaveAvx512,
+    .floatToInt16 = floatToInt16Avx512,
+    .floatToInt24 = floatToInt24Avx512,
+    .floatToInt32 = floatToInt32Avx512,
+    .int16ToFloat = int16ToFloatAvx512,
+    .int24ToFloat = int24ToFloatAvx512,
+    .int32ToFloat = int32ToFloatAvx512,
+    .peakRms = peakRmsAvx512,
+    .dotProduct = dotProductAvx512
+};
+
+#endif /* x86 */
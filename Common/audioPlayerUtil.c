@@ -6,7 +6,22 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
 #include "audioPlayerUtil.h"
+#include "playerConfig.h"
+#include "playerStream.h"
+#include "deviceCatalogue.h"
+
+// How far ahead of the read position to prefetch (seconds)
+#define DEFAULT_PREFETCH_SECONDS (2.0)
+
+// Resampler preset used if BAP_RESAMPLE_QUALITY is not set
+#define DEFAULT_RESAMPLE_QUALITY "high"
+
+// Channel matrix used if BAP_CHANNEL_MATRIX is not set
+#define DEFAULT_CHANNEL_MATRIX "itu"
 
 // Return a name for an input or output device
 const char* getDeviceIOname(PaIOdevice ioDevice) {
@@ -29,14 +44,27 @@ int openAudioFile(
 ) {
     
     SF_INFO sfinfo; // audio file info returned by sndfile
+    const char *reader = getConfigString("BAP_READER", "sndfile");
+    double prefetchSeconds =
+        getConfigDouble("BAP_PREFETCH_SECONDS", DEFAULT_PREFETCH_SECONDS);
     
-    // Open audio file
-    audioFile->fileID = sf_open(fileName, SFM_READ, &sfinfo);
+    // Open audio file, through a descriptor of our own to read ahead of
+    // libsndfile if requested
+    if (strcmp(reader, "readahead") == 0)
+        audioFile->fileID = openReadaheadFile(fileName, &audioFile->readahead,
+            &sfinfo, prefetchSeconds);
+    else
+        audioFile->fileID = sf_open(fileName, SFM_READ, &sfinfo);
     
     // Pass parameters to audio file info
     audioFile->channels = sfinfo.channels;
+    audioFile->fileChannels = sfinfo.channels;
     audioFile->frames = sfinfo.frames;
     audioFile->sRate = sfinfo.samplerate;
+    audioFile->nativeFormat = getNativeSampleFormat(sfinfo.format);
+    audioFile->sampleFormat = paFloat32;
+    audioFile->bytesPerFrame = sizeof(float) * audioFile->channels;
+    audioFile->timeReads = getConfigString("BAP_STATS", NULL) != NULL;
     
     // Error checking
     if (audioFile->fileID == NULL) {
@@ -45,15 +73,505 @@ int openAudioFile(
         return ERR_OPENING_FILE;
     }
     else if (audioFile->channels > maxChannels) {
-        // number of channels exceeds channels supported by device
-        printf("The specified audio file has %d audio channels. The chosen device only supports up to %d channels.\n",
+        // number of channels exceeds channels supported by device: mix down
+        printf("The specified audio file has %d audio channels. The chosen device only supports up to %d channels; mixing down.\n",
             audioFile->channels,maxChannels);
-        return ERR_INVALID_CHANNELS;
+        int err = setOutputChannels(audioFile, maxChannels);
+        if (err)
+            return err;
+    }
+    
+    // Read compressed files from the PCM cache if they have been decoded
+    // before; otherwise decode them into it in the background
+    if (isPcmCacheable(sfinfo.format)) {
+        if (openCachedAudioFile(fileName, &audioFile->mapped,
+                prefetchSeconds) == NO_ERROR &&
+            audioFile->mapped.channels == audioFile->fileChannels &&
+            audioFile->mapped.frames == audioFile->frames) {
+            printf("Reading decoded audio from the PCM cache\n");
+        }
+        else {
+            closeMappedAudioFile(&audioFile->mapped);
+            audioFile->cacheFill =
+                startPcmCacheFill(fileName, audioFile->nativeFormat);
+        }
+    }
+    
+    // Map uncompressed files directly if requested
+    else if (strcmp(reader, "mmap") == 0) {
+        if (openMappedAudioFile(fileName, &audioFile->mapped,
+                prefetchSeconds) == NO_ERROR &&
+            audioFile->mapped.channels == audioFile->fileChannels &&
+            audioFile->mapped.frames == audioFile->frames) {
+            printf("Reading audio file via memory map\n");
+        }
+        else {
+            // compressed or unusual file: let libsndfile decode it
+            closeMappedAudioFile(&audioFile->mapped);
+            printf("Audio file cannot be memory mapped; using libsndfile\n");
+        }
+    }
+    
+    // Read uncompressed files through io_uring if requested and available
+    else if (strcmp(reader, "uring") == 0) {
+        unsigned int depth = (unsigned int)
+            getConfigDouble("BAP_URING_DEPTH", DEFAULT_URING_DEPTH);
+        size_t blockBytes = (size_t) (1024 *
+            getConfigDouble("BAP_URING_BLOCK_KB", DEFAULT_URING_BLOCK_KB));
+        audioFile->uring = createUringQueue(1, depth, blockBytes);
+        if (audioFile->uring == NULL)
+            printf("io_uring is not available (%s); using libsndfile\n",
+                strerror(errno));
+        else if ((audioFile->uringStream =
+                openUringStream(audioFile->uring, fileName)) != NULL &&
+            audioFile->uringStream->layout.channels == audioFile->fileChannels &&
+            audioFile->uringStream->frames == audioFile->frames) {
+            printf("Reading audio file through io_uring (%u reads of %zu KB "
+                "in flight)\n", depth, audioFile->uring->blockBytes / 1024);
+        }
+        else {
+            // compressed or unusual file: let libsndfile decode it
+            freeUringQueue(audioFile->uring);
+            audioFile->uring = NULL;
+            audioFile->uringStream = NULL;
+            printf("Audio file cannot be read through io_uring; "
+                "using libsndfile\n");
+        }
+    }
+    
+    // everything was OK
+    return NO_ERROR;
+}
+
+// Choose the sample format for the stream
+int negotiateSampleFormat(
+    struct audioFileInfo *audioFile,
+    PaStreamParameters *p
+) {
+    
+    PaSampleFormat format = audioFile->nativeFormat;
+    
+    // keep all of the resampler's and the matrix's precision
+    if (strcmp(getConfigString("BAP_SAMPLE_FORMAT", "native"), "float") == 0 ||
+        audioFile->resampler != NULL || audioFile->matrix != NULL ||
+        audioFile->planarInput != NULL)
+        format = paFloat32;
+    
+    // check the output can take the file's samples as they are
+    if (format != paFloat32) {
+        p->sampleFormat = format;
+        int supported = getPlayerSink() != SINK_DEVICE ?
+            getSampleSize(format) != 0 :
+            checkOutputFormat(p, audioFile->sRate) == paFormatIsSupported;
+        if (!supported) {
+            printf("The output does not support %s samples; using float\n",
+                getSampleFormatName(format));
+            format = paFloat32;
+        }
+    }
+    
+    p->sampleFormat = format;
+    printf("Sample format: %s (file is %s)\n", getSampleFormatName(format),
+        getSampleFormatName(audioFile->nativeFormat));
+    if (audioFile->planarInput != NULL)
+        p->sampleFormat |= paNonInterleaved;
+    
+    return setSampleFormat(audioFile, format);
+}
+
+// Choose the layout of the stream's buffers
+int negotiateLayout(struct audioFileInfo *audioFile, PaStreamParameters *p) {
+    
+    if (strcmp(getConfigString("BAP_LAYOUT", "interleaved"), "planar") != 0)
+        return NO_ERROR;
+    
+    // a block of frames is read interleaved, then split into the planes
+    audioFile->planarInput =
+        malloc(sizeof(float) * FRAMES_PER_BUFFER * p->channelCount);
+    if (audioFile->planarInput == NULL)
+        return ERR_BAD_ALLOC;
+    printf("Layout: planar, %d buffers of float\n", p->channelCount);
+    
+    return NO_ERROR;
+}
+
+// Set the format readAudioFile() returns samples in
+int setSampleFormat(struct audioFileInfo *audioFile, PaSampleFormat format) {
+    
+    if (getSampleSize(format) == 0)
+        return ERR_OPENING_FILE;
+    
+    // reading packed 24-bit samples through libsndfile needs 32-bit scratch,
+    // and converting resampled or mixed samples from float needs float
+    // scratch (the file is read as float for those)
+    int processed = audioFile->resampler != NULL || audioFile->matrix != NULL;
+    int needScratch = processed ? format != paFloat32 :
+        format == paInt24 && audioFile->mapped.map == NULL;
+    if (needScratch && audioFile->scratch == NULL) {
+        audioFile->scratch =
+            malloc(sizeof(int) * FRAMES_PER_BUFFER * audioFile->channels);
+        if (audioFile->scratch == NULL)
+            return ERR_BAD_ALLOC;
+    }
+    
+    audioFile->sampleFormat = format;
+    audioFile->bytesPerFrame = getSampleSize(format) * audioFile->channels;
+    
+    return NO_ERROR;
+}
+
+// Choose the sample rate for the stream
+int negotiateSampleRate(
+    struct audioFileInfo *audioFile,
+    PaStreamParameters *p
+) {
+    
+    int sRate = (int) getConfigDouble("BAP_SAMPLE_RATE", 0.0);
+    
+    // the file's rate, if the device can run at it
+    if (sRate <= 0) {
+        sRate = audioFile->sRate;
+        if (getPlayerSink() == SINK_DEVICE) {
+            p->sampleFormat = paFloat32;
+            if (checkOutputFormat(p, sRate) != paFormatIsSupported)
+                sRate = (int) Pa_GetDeviceInfo(p->device)->defaultSampleRate;
+        }
     }
-    else {
-        // everything was OK
+    
+    if (sRate == audioFile->sRate)
         return NO_ERROR;
+    
+    int fileRate = audioFile->sRate;
+    int err = setOutputRate(audioFile, sRate);
+    if (!err)
+        printf("Resampling from %d Hz to %d Hz (%s quality)\n", fileRate,
+            sRate, audioFile->resampler->preset->name);
+    
+    return err;
+}
+
+// Choose the channel count for the stream
+int negotiateChannels(
+    struct audioFileInfo *audioFile,
+    PaStreamParameters *p,
+    unsigned int maxChannels
+) {
+    
+    unsigned int channels = audioFile->channels;
+    
+    int requested = (int) getConfigDouble("BAP_CHANNELS", 0.0);
+    if (requested > 0)
+        channels = min((unsigned int) requested, maxChannels);
+    
+    p->channelCount = channels;
+    
+    // even at the file's channel count, its layout may not be the stream's
+    return setOutputChannels(audioFile, channels);
+}
+
+// Layout of the file's channels: its channel map, or the usual one
+static void getFileChannelLayout(
+    struct audioFileInfo *audioFile,
+    int *layout
+) {
+    
+    unsigned int channels = audioFile->fileChannels;
+    
+    if (sf_command(audioFile->fileID, SFC_GET_CHANNEL_MAP_INFO, layout,
+            (int) (sizeof(int) * channels)) != SF_TRUE)
+        getDefaultChannelLayout(layout, channels);
+}
+
+// Mix the file's channels to channels
+int setOutputChannels(struct audioFileInfo *audioFile, unsigned int channels) {
+    
+    // start again from the file's own channels
+    if (audioFile->matrix != NULL) {
+        freeChannelMatrix(audioFile->matrix);
+        free(audioFile->matrix);
+        audioFile->matrix = NULL;
+    }
+    free(audioFile->matrixInput);
+    audioFile->matrixInput = NULL;
+    audioFile->channels = audioFile->fileChannels;
+    // the scratch is sized by the channel count
+    free(audioFile->scratch);
+    audioFile->scratch = NULL;
+    
+    struct channelMatrix *m = malloc(sizeof(struct channelMatrix));
+    if (m == NULL)
+        return ERR_BAD_ALLOC;
+    int err = initChannelMatrix(m, audioFile->fileChannels, channels,
+        FRAMES_PER_BUFFER);
+    if (err) {
+        free(m);
+        return err;
+    }
+    
+    // a preset, or the rows of the matrix
+    const char *spec =
+        getConfigString("BAP_CHANNEL_MATRIX", DEFAULT_CHANNEL_MATRIX);
+    int normalise = strcmp(spec, "itu-normalised") == 0;
+    if (strcmp(spec, "itu") != 0 && !normalise &&
+        parseChannelMatrix(m, spec) != NO_ERROR) {
+        printf("Cannot mix %u channels to %u with the matrix \"%s\"; using %s\n",
+            audioFile->fileChannels, channels, spec, DEFAULT_CHANNEL_MATRIX);
+        spec = DEFAULT_CHANNEL_MATRIX;
+    }
+    if (strcmp(spec, "itu") == 0 || normalise) {
+        int inLayout[audioFile->fileChannels];
+        int outLayout[channels];
+        getFileChannelLayout(audioFile, inLayout);
+        getDefaultChannelLayout(outLayout, channels);
+        setLayoutChannelMatrix(m, inLayout, outLayout, normalise);
+    }
+    
+    if (isIdentityChannelMatrix(m)) {
+        // nothing to mix, but the frame size goes back to the file's
+        freeChannelMatrix(m);
+        free(m);
+        return setSampleFormat(audioFile, audioFile->sampleFormat);
+    }
+    
+    audioFile->matrixInput =
+        malloc(sizeof(float) * FRAMES_PER_BUFFER * audioFile->fileChannels);
+    if (audioFile->matrixInput == NULL) {
+        freeChannelMatrix(m);
+        free(m);
+        return ERR_BAD_ALLOC;
+    }
+    audioFile->matrix = m;
+    audioFile->channels = channels;
+    printChannelMatrix(m);
+    
+    return setSampleFormat(audioFile, audioFile->sampleFormat);
+}
+
+// Resample the file to sRate
+int setOutputRate(struct audioFileInfo *audioFile, int sRate) {
+    
+    if (sRate == audioFile->sRate)
+        return NO_ERROR;
+    
+    const char *quality =
+        getConfigString("BAP_RESAMPLE_QUALITY", DEFAULT_RESAMPLE_QUALITY);
+    const struct resamplerPreset *preset = getResamplerPreset(quality);
+    if (preset == NULL) {
+        printf("Unknown resampling quality %s; using %s\n", quality,
+            DEFAULT_RESAMPLE_QUALITY);
+        preset = getResamplerPreset(DEFAULT_RESAMPLE_QUALITY);
     }
+    
+    struct resampler *r = malloc(sizeof(struct resampler));
+    if (r == NULL)
+        return ERR_BAD_ALLOC;
+    int err = initResampler(r, audioFile->sRate, sRate,
+        audioFile->fileChannels, preset);
+    if (err) {
+        free(r);
+        return err;
+    }
+    
+    audioFile->resampler = r;
+    audioFile->frames = getResampledFrames(r, audioFile->frames);
+    audioFile->sRate = sRate;
+    
+    // the file is read as float; anything else is converted from that
+    return setSampleFormat(audioFile, audioFile->sampleFormat);
+}
+
+// CPU time used by the calling thread (s)
+double getThreadTime(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read frames from the file in a format
+static sf_count_t readFrames(
+    struct audioFileInfo *audioFile,
+    void *buffer,
+    sf_count_t frames,
+    PaSampleFormat format
+) {
+    
+    if (audioFile->mapped.map != NULL)
+        return readMappedAudioFile(&audioFile->mapped, buffer, frames, format);
+    if (audioFile->uringStream != NULL)
+        return readUringStream(audioFile->uringStream, buffer, frames, format);
+    
+    switch (format) {
+        case paInt16:
+            return sf_readf_short(audioFile->fileID, buffer, frames);
+        case paInt32:
+            return sf_readf_int(audioFile->fileID, buffer, frames);
+        case paInt24: {
+            // libsndfile has no packed 24-bit read, so go via 32-bit samples
+            unsigned char *out = (unsigned char *) buffer;
+            sf_count_t framesRead = 0;
+            while (framesRead < frames) {
+                sf_count_t n = sf_readf_int(audioFile->fileID, audioFile->scratch,
+                    min(frames - framesRead, (sf_count_t) FRAMES_PER_BUFFER));
+                if (n <= 0)
+                    break;
+                packInt24(out, audioFile->scratch,
+                    (size_t) n * audioFile->channels);
+                out += (size_t) n * 3 * audioFile->channels;
+                framesRead += n;
+            }
+            return framesRead;
+        }
+        default:
+            return sf_readf_float(audioFile->fileID, buffer, frames);
+    }
+}
+
+// Input for the resampler: float frames from the file
+static size_t readResamplerSource(void *data, float *buffer, size_t frames) {
+    
+    sf_count_t framesRead = readFrames((struct audioFileInfo *) data, buffer,
+        (sf_count_t) frames, paFloat32);
+    
+    return framesRead > 0 ? (size_t) framesRead : 0;
+}
+
+// Read frames through the resampler and the channel matrix, whichever
+// there are, into the file's sampleFormat; returns how many
+static sf_count_t readProcessedFrames(
+    struct audioFileInfo *audioFile,
+    void *buffer,
+    sf_count_t frames
+) {
+    
+    struct resampler *r = audioFile->resampler;
+    struct channelMatrix *m = audioFile->matrix;
+    PaSampleFormat format = audioFile->sampleFormat;
+    const struct audioKernels *k = getAudioKernels();
+    unsigned char *out = (unsigned char *) buffer;
+    sf_count_t framesRead = 0;
+    
+    // a buffer at a time: float at the file's channels, then through the
+    // matrix, then to an integer format through the scratch
+    while (framesRead < frames) {
+        sf_count_t n = min(frames - framesRead, (sf_count_t) FRAMES_PER_BUFFER);
+        float *mixed = format == paFloat32 ?
+            (float *) out : (float *) audioFile->scratch;
+        float *in = m != NULL ? audioFile->matrixInput : mixed;
+        if (r != NULL)
+            readResampler(r, in, (size_t) n, readResamplerSource, audioFile);
+        else {
+            n = readFrames(audioFile, in, n, paFloat32);
+            if (n <= 0)
+                break;
+        }
+        if (m != NULL)
+            applyChannelMatrix(m, mixed, in, (size_t) n);
+    
+        size_t samples = (size_t) n * audioFile->channels;
+        switch (format) {
+            case paInt16:
+                k->floatToInt16((int16_t *) out, mixed, samples);
+                break;
+            case paInt24:
+                k->floatToInt24(out, mixed, samples);
+                break;
+            case paInt32:
+                k->floatToInt32((int32_t *) out, mixed, samples);
+                break;
+            default:
+                break;
+        }
+        out += (size_t) n * audioFile->bytesPerFrame;
+        framesRead += n;
+    }
+    
+    return framesRead;
+}
+
+// This function reads interleaved frames from an audio file
+sf_count_t readAudioFile(
+    struct audioFileInfo *audioFile,
+    void *buffer,
+    sf_count_t frames
+) {
+    
+    // the clock is only read for the statistics, since this may be running
+    // in the callback
+    double start = audioFile->timeReads ? getThreadTime() : 0.0;
+    sf_count_t framesRead;
+    struct resampler *r = audioFile->resampler;
+    if (r != NULL || audioFile->matrix != NULL) {
+        // the resampler goes on past the end of the file, so stop it there
+        if (r != NULL)
+            frames = min(frames, (sf_count_t) (audioFile->frames - r->outFrame));
+        framesRead = frames > 0 ?
+            readProcessedFrames(audioFile, buffer, frames) : 0;
+    }
+    else
+        framesRead = readFrames(audioFile, buffer, frames,
+            audioFile->sampleFormat);
+    advanceReadahead(&audioFile->readahead);
+    if (audioFile->timeReads)
+        audioFile->readTime += getThreadTime() - start;
+    
+    return framesRead;
+}
+
+// This function reads frames into one buffer per channel
+sf_count_t readAudioFilePlanar(
+    struct audioFileInfo *audioFile,
+    void *const *planes,
+    sf_count_t frames
+) {
+    
+    const struct audioKernels *k = getAudioKernels();
+    float *dst[audioFile->channels];
+    sf_count_t framesRead = 0;
+    
+    while (framesRead < frames) {
+        sf_count_t n = readAudioFile(audioFile, audioFile->planarInput,
+            min(frames - framesRead, (sf_count_t) FRAMES_PER_BUFFER));
+        if (n <= 0)
+            break;
+    
+        for (unsigned int c = 0; c < audioFile->channels; c++)
+            dst[c] = (float *) planes[c] + framesRead;
+        k->deinterleave(dst, audioFile->planarInput, (size_t) n,
+            audioFile->channels);
+        framesRead += n;
+    }
+    
+    return framesRead;
+}
+
+// This function moves the read position of an audio file
+sf_count_t seekAudioFile(struct audioFileInfo *audioFile, sf_count_t frame) {
+    
+    // the file is read from a little before the frame, for the filter
+    if (audioFile->resampler != NULL) {
+        if (frame < 0 || frame > audioFile->frames)
+            return -1;
+        struct resampler *r = audioFile->resampler;
+        sf_count_t inFrame = (sf_count_t) seekResampler(r, frame);
+        sf_count_t result = audioFile->mapped.map != NULL ?
+            seekMappedAudioFile(&audioFile->mapped, inFrame) :
+            audioFile->uringStream != NULL ?
+            seekUringStream(audioFile->uringStream, inFrame) :
+            sf_seek(audioFile->fileID, inFrame, SEEK_SET);
+        restartReadahead(&audioFile->readahead);
+        return result < 0 ? result : frame;
+    }
+    
+    if (audioFile->mapped.map != NULL)
+        return seekMappedAudioFile(&audioFile->mapped, frame);
+    else if (audioFile->uringStream != NULL)
+        return seekUringStream(audioFile->uringStream, frame);
+    
+    sf_count_t result = sf_seek(audioFile->fileID, frame, SEEK_SET);
+    restartReadahead(&audioFile->readahead);
+    return result;
 }
 
 // This function closes an audio file
@@ -62,18 +580,32 @@ void closeAudioFile(struct audioFileInfo *audioFile) {
     // close audio file
     if (audioFile->fileID != NULL)
         sf_close(audioFile->fileID);
+    closeReadaheadFile(&audioFile->readahead);
+    freeUringQueue(audioFile->uring);
+    audioFile->uring = NULL;
+    audioFile->uringStream = NULL;
+    closeMappedAudioFile(&audioFile->mapped);
+    finishPcmCacheFill(audioFile->cacheFill);
+    audioFile->cacheFill = NULL;
     
     // free malloc'd memory
     if (audioFile->buffer != NULL)
         free(audioFile->buffer);
+    free(audioFile->scratch);
+    if (audioFile->resampler != NULL) {
+        freeResampler(audioFile->resampler);
+        free(audioFile->resampler);
+    }
+    if (audioFile->matrix != NULL) {
+        freeChannelMatrix(audioFile->matrix);
+        free(audioFile->matrix);
+    }
+    free(audioFile->matrixInput);
+    free(audioFile->planarInput);
 }
 
-// Set up output device
-void getStreamParameters(
-    PaStreamParameters *p,
-    const PaIOdevice ioDevice,
-    unsigned int *maxChannels
-) {
+// List the devices and ask the user to choose one
+static PaDeviceIndex askForDevice(const PaIOdevice ioDevice) {
     
     // Print out a list of the devices supporting input/output
     const PaDeviceInfo *info;       // audio device info
@@ -117,17 +649,55 @@ void getStreamParameters(
         }
         else // convert str to id
             id = atoi(selection);
-        
+    
         // check id is valid
         if ((id >= 0 && id < Pa_GetDeviceCount()) && read > 0)
             break;
         else
             printf("Invalid selection!\n");
     }
+    
+    return id;
+}
 
+// Set up output device
+void getStreamParameters(
+    PaStreamParameters *p,
+    const PaIOdevice ioDevice,
+    unsigned int *maxChannels
+) {
+    
+    // Offline output: there is no device to choose
+    if (getPlayerSink() != SINK_DEVICE) {
+        printf("Rendering audio %s offline\n", getDeviceIOname(ioDevice));
+        p->device = paNoDevice;
+        p->suggestedLatency = 0.0;
+        p->hostApiSpecificStreamInfo = NULL;
+        *maxChannels = OFFLINE_MAX_CHANNELS;
+        return;
+    }
+    
+    // Choose the device as BAP_DEVICE and BAP_HOST_API say, or by asking
+    PaDeviceIndex id = paNoDevice; // audio device id
+    int input = ioDevice == INPUT_DEVICE;
+    if (strcmp(getConfigString("BAP_DEVICE", "default"), "ask") != 0) {
+        id = findDevice(input);
+        if (id == paNoDevice) {
+            printf("No audio %s device matches BAP_DEVICE and BAP_HOST_API; "
+                "using the default\n", getDeviceIOname(ioDevice));
+            id = input ? Pa_GetDefaultInputDevice() :
+                Pa_GetDefaultOutputDevice();
+        }
+    }
+    if (id == paNoDevice)
+        id = askForDevice(ioDevice);
+    
+    // remember what it can do, for next time
+    openDeviceCatalogue(id);
+    
     // get device info
-    info = Pa_GetDeviceInfo(id);
-    hostapi = Pa_GetHostApiInfo(info->hostApi);
+    const PaDeviceInfo *info = Pa_GetDeviceInfo(id);
+    const PaHostApiInfo *hostapi = Pa_GetHostApiInfo(info->hostApi);
     printf("Opening audio %s device [%s] %s\n", getDeviceIOname(ioDevice),
         hostapi->name, info->name);
     
@@ -142,7 +712,7 @@ void getStreamParameters(
 
 // print an error message
 void printErrorMsg(int err, PaError err_pa, SNDFILE *sndfile) {
-
+    
     if (err) {
         switch (err) {
             case ERR_BAD_COMMAND_LINE:
@@ -170,6 +740,14 @@ void printErrorMsg(int err, PaError err_pa, SNDFILE *sndfile) {
     
 }
 
+// Frames per stream buffer
+unsigned long getFramesPerBuffer(void) {
+    
+    double frames = getConfigDouble("BAP_FRAMES_PER_BUFFER", FRAMES_PER_BUFFER);
+    
+    return frames >= 1.0 ? (unsigned long) frames : FRAMES_PER_BUFFER;
+}
+
 // next power of 2 (e.g. 127 -> 128)
 unsigned int nextPowerOf2(unsigned int val) {
     val--;
@@ -10,6 +10,13 @@
 
 #include <portaudio.h>
 #include <sndfile.h>
+#include "mappedAudioFile.h"
+#include "readaheadFile.h"
+#include "uringSource.h"
+#include "sampleFormat.h"
+#include "pcmCache.h"
+#include "resampler.h"
+#include "channelMatrix.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,27 +51,125 @@ enum ERR_MSGS {
 
 // struct type for storing audio file info
 struct audioFileInfo {
-    unsigned int    channels;   // number of audio channels
+    unsigned int    channels;   // number of audio channels (as read)
+    unsigned int    fileChannels; // number in the file
     sf_count_t      frames;     // number of frames
     int             sRate;      // sample rate
     SNDFILE*        fileID;     // id of audio file
-    float*          buffer;     // pointer to a buffer for storing audio data
+    void*           buffer;     // pointer to a buffer for storing audio data
+    struct mappedAudioFile mapped; // memory-mapped samples (if map != NULL)
+    struct readaheadFile readahead; // read ahead of libsndfile (if active)
+    struct uringQueue* uring;   // io_uring reads, if uringStream != NULL
+    struct uringStream* uringStream;
+    PaSampleFormat  nativeFormat;  // format that holds the file's samples
+    PaSampleFormat  sampleFormat;  // format the samples are read in
+    size_t          bytesPerFrame; // size of a frame in sampleFormat
+    int*            scratch;    // for paInt24 through libsndfile, or resampling
+    double          readTime;   // CPU time spent in readAudioFile() (s)
+    int             timeReads;  // keep readTime (only if BAP_STATS is set)
+    struct pcmCacheFill* cacheFill; // decode into the PCM cache, if running
+    struct resampler* resampler; // to the stream's rate, if it differs
+    struct channelMatrix* matrix; // to the stream's channels, if they differ
+    float*          matrixInput; // the file's channels, before the matrix
+    float*          planarInput; // interleaved frames, for readAudioFilePlanar()
 };
 
 // Return a name for an input or output device
 const char* getDeviceIOname(PaIOdevice ioDevice);
 
-// This function opens an audio file
+// This function opens an audio file. A file with more channels than
+// maxChannels is mixed down to maxChannels (setOutputChannels()).
 int openAudioFile(
     const char fileName[],
     struct audioFileInfo *audioFile,
     int maxChannels
 );
 
+// Choose the sample format for the stream (and hence the ring buffer and
+// the reader): the file's native format if the output supports it and
+// BAP_SAMPLE_FORMAT is "native" (the default), otherwise paFloat32. Sets
+// the sample format in the stream parameters (with paNonInterleaved for a
+// planar layout), whose channel count must already be set.
+int negotiateSampleFormat(
+    struct audioFileInfo *audioFile,
+    PaStreamParameters *p
+);
+
+// Set the format readAudioFile() returns samples in (paFloat32, paInt16,
+// paInt24 or paInt32)
+int setSampleFormat(struct audioFileInfo *audioFile, PaSampleFormat format);
+
+// Choose the layout of the stream's buffers: interleaved frames, or with
+// BAP_LAYOUT=planar one buffer per channel (paNonInterleaved), to be
+// filled with readAudioFilePlanar(). Planar streams are float. Call before
+// negotiateSampleFormat().
+int negotiateLayout(struct audioFileInfo *audioFile, PaStreamParameters *p);
+
+// Choose the channel count for the stream, and set it in the stream
+// parameters: BAP_CHANNELS (at most maxChannels) if that is set, otherwise
+// the file's. The file is mixed to that many channels in the stream's
+// layout (setOutputChannels()), which reorders its channels if its own
+// channel map differs.
+int negotiateChannels(
+    struct audioFileInfo *audioFile,
+    PaStreamParameters *p,
+    unsigned int maxChannels
+);
+
+// Mix the file's channels to channels, with the matrix BAP_CHANNEL_MATRIX
+// names: "itu" (the default) or "itu-normalised" for the BS.775 mix from
+// the file's channel map (SFC_GET_CHANNEL_MAP_INFO, or the usual layout
+// for its channel count) to the usual layout for channels, or a routing
+// string (see parseChannelMatrix()). From then on channels and
+// readAudioFile() are at the new count; the matrix works in float, so
+// paFloat32 loses nothing. May be called again to change the count.
+int setOutputChannels(struct audioFileInfo *audioFile, unsigned int channels);
+
+// Choose the sample rate for the stream: BAP_SAMPLE_RATE if that is set,
+// otherwise the file's rate if the output supports it, otherwise the
+// device's default rate. If that is not the file's rate, the file is
+// resampled (setOutputRate()). Call before negotiateSampleFormat(), with
+// the channel count set in the stream parameters.
+int negotiateSampleRate(
+    struct audioFileInfo *audioFile,
+    PaStreamParameters *p
+);
+
+// Resample the file to sRate, at the BAP_RESAMPLE_QUALITY preset, if that
+// is not its rate. From then on sRate, frames, readAudioFile() and
+// seekAudioFile() are all at the new rate; the resampler works in float,
+// so paFloat32 loses nothing. Call once, before the first read.
+int setOutputRate(struct audioFileInfo *audioFile, int sRate);
+
+// This function reads interleaved frames from an audio file, in the
+// file's sampleFormat, adding the CPU time it takes to readTime (if
+// timeReads)
+sf_count_t readAudioFile(
+    struct audioFileInfo *audioFile,
+    void *buffer,
+    sf_count_t frames
+);
+
+// This function reads frames from an audio file into one float buffer
+// per channel (after negotiateLayout() has chosen a planar layout),
+// deinterleaving them with the vector kernels
+sf_count_t readAudioFilePlanar(
+    struct audioFileInfo *audioFile,
+    void *const *planes,
+    sf_count_t frames
+);
+
+// CPU time used by the calling thread so far (s)
+double getThreadTime(void);
+
+// This function moves the read position of an audio file
+sf_count_t seekAudioFile(struct audioFileInfo *audioFile, sf_count_t frame);
+
 // This function closes an audio file
 void closeAudioFile(struct audioFileInfo *audioFile);
 
-// Set up audio device
+// Set up audio device: the one BAP_DEVICE and BAP_HOST_API choose (see
+// deviceCatalogue.h), or the default
 void getStreamParameters(
     PaStreamParameters *p,
     PaIOdevice ioDevice,
@@ -74,6 +179,10 @@ void getStreamParameters(
 // print an error message
 void printErrorMsg(int err, PaError err_pa, SNDFILE *sndfile);
 
+// Frames per stream buffer: BAP_FRAMES_PER_BUFFER, or FRAMES_PER_BUFFER if
+// that is not set
+unsigned long getFramesPerBuffer(void);
+
 // next power of 2 (e.g. 127 -> 128)
 unsigned int nextPowerOf2(unsigned int val);
 
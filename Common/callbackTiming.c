@@ -0,0 +1,226 @@
+//
+//  callbackTiming.c
+//
+//  Timing telemetry for the stream callbacks.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <pa_util.h>
+#include "callbackTiming.h"
+#include "playerStream.h"
+
+// Set by the SIGUSR1 handler
+static volatile sig_atomic_t dumpRequested = 0;
+
+// Bucket holding a value (ns)
+static unsigned int getBucket(uint64_t value) {
+    
+    if (value < SUB_BUCKETS)
+        return (unsigned int) value;
+    
+    // keep the top SUB_BUCKET_BITS + 1 bits of the value
+    unsigned int msb = 63 - (unsigned int) __builtin_clzll(value);
+    if (msb >= MAX_VALUE_BITS)
+        return HISTOGRAM_BUCKETS - 1;
+    unsigned int shift = msb - SUB_BUCKET_BITS;
+    
+    return SUB_BUCKETS * (shift + 1) + (unsigned int) (value >> shift) - SUB_BUCKETS;
+}
+
+// Largest value held by a bucket (ns)
+static uint64_t getBucketLimit(unsigned int bucket) {
+    
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    
+    unsigned int shift = bucket / SUB_BUCKETS - 1;
+    uint64_t mantissa = SUB_BUCKETS + bucket % SUB_BUCKETS;
+    
+    return ((mantissa + 1) << shift) - 1;
+}
+
+// Add a time (s) to a histogram (callback side)
+static void record(struct timingHistogram *h, double seconds) {
+    
+    uint64_t value = seconds > 0.0 ? (uint64_t) (seconds * 1e9) : 0;
+    
+    // the callback is the only writer, so relaxed operations are enough
+    atomic_fetch_add_explicit(&h->counts[getBucket(value)], 1,
+        memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed))
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+}
+
+// Value (ns) at or below which the given fraction of the samples lie
+static uint64_t getPercentile(const struct timingHistogram *h, double fraction) {
+    
+    unsigned long total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    unsigned long target = (unsigned long) (fraction * total + 0.5);
+    unsigned long count = 0;
+    
+    if (target == 0)
+        target = 1;
+    
+    // report the top of the bucket, but no more than the largest value seen
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        count += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (count >= target)
+            return getBucketLimit(i) < max ? getBucketLimit(i) : max;
+    }
+    
+    return max;
+}
+
+static void initHistogram(struct timingHistogram *h) {
+    
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        atomic_init(&h->counts[i], 0);
+    atomic_init(&h->total, 0);
+    atomic_init(&h->max, 0);
+}
+
+// Reset the histograms
+void initCallbackTiming(struct callbackTiming *t, double deadline) {
+    
+    PaUtil_InitializeClock();
+    
+    initHistogram(&t->duration);
+    initHistogram(&t->interval);
+    initHistogram(&t->headroom);
+    atomic_init(&t->late, 0);
+    t->entryTime = 0.0;
+    t->lastEntry = 0.0;
+    t->dacLead = 0.0;
+    t->deadline = deadline;
+    t->loadSamples = 0;
+    t->loadTotal = 0.0;
+    t->loadMax = 0.0;
+}
+
+static void requestDump(int sig) {
+    
+    (void) sig;
+    dumpRequested = 1;
+}
+
+// Install a SIGUSR1 handler
+void installCallbackTimingSignal(void) {
+    
+#if defined(SIGUSR1)
+    struct sigaction action = {.sa_handler = requestDump};
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+#endif
+}
+
+// Record entry (callback side)
+void callbackTimingEntry(
+    struct callbackTiming *t,
+    const PaStreamCallbackTimeInfo *timeInfo
+) {
+    
+    t->entryTime = PaUtil_GetTime();
+    if (t->lastEntry > 0.0)
+        record(&t->interval, t->entryTime - t->lastEntry);
+    t->lastEntry = t->entryTime;
+    
+    // some host APIs don't report the DAC time
+    t->dacLead = timeInfo != NULL && timeInfo->outputBufferDacTime > 0.0 ?
+        timeInfo->outputBufferDacTime - timeInfo->currentTime : -1.0;
+}
+
+// Record exit (callback side)
+void callbackTimingExit(struct callbackTiming *t) {
+    
+    double duration = PaUtil_GetTime() - t->entryTime;
+    
+    record(&t->duration, duration);
+    if (t->dacLead >= 0.0) {
+        double headroom = t->dacLead - duration;
+        record(&t->headroom, headroom);
+        if (headroom < 0.0)
+            atomic_fetch_add_explicit(&t->late, 1, memory_order_relaxed);
+    }
+}
+
+// Sample the CPU load and dump on request (non-real-time side)
+void pollCallbackTiming(struct callbackTiming *t, PaStream *stream) {
+    
+    double load = getPlayerStreamCpuLoad(stream);
+    
+    t->loadSamples++;
+    t->loadTotal += load;
+    if (load > t->loadMax)
+        t->loadMax = load;
+    
+    if (dumpRequested) {
+        dumpRequested = 0;
+        printCallbackTiming(t);
+    }
+}
+
+static void printHistogram(const char *name, const struct timingHistogram *h) {
+    
+    printf("%-10s %10lu %10.1f %10.1f %10.1f %10.1f\n", name,
+        atomic_load_explicit(&h->total, memory_order_relaxed),
+        getPercentile(h, 0.5) / 1e3,
+        getPercentile(h, 0.99) / 1e3,
+        getPercentile(h, 0.999) / 1e3,
+        atomic_load_explicit(&h->max, memory_order_relaxed) / 1e3);
+}
+
+// Print percentiles and CPU load
+void printCallbackTiming(const struct callbackTiming *t) {
+    
+    printf("Callback timing (us), deadline %.1f us:\n", 1e6 * t->deadline);
+    printf("%-10s %10s %10s %10s %10s %10s\n",
+        "", "count", "p50", "p99", "p99.9", "max");
+    printHistogram("duration", &t->duration);
+    printHistogram("interval", &t->interval);
+    if (atomic_load_explicit(&t->headroom.total, memory_order_relaxed) > 0) {
+        printHistogram("headroom", &t->headroom);
+        printf("Callbacks returning after their DAC time: %lu\n",
+            atomic_load_explicit(&t->late, memory_order_relaxed));
+    }
+    if (t->loadSamples > 0) {
+        printf("CPU load: %.1f%% mean, %.1f%% max (%lu samples)\n",
+            100.0 * t->loadTotal / t->loadSamples, 100.0 * t->loadMax,
+            t->loadSamples);
+    }
+}
+
+static void writeHistogramJson(
+    const char *name,
+    const struct timingHistogram *h,
+    FILE *file
+) {
+    
+    fprintf(file, "  \"%s\": {\"count\": %lu, \"p50Us\": %.1f, "
+        "\"p99Us\": %.1f, \"p999Us\": %.1f, \"maxUs\": %.1f},\n", name,
+        atomic_load_explicit(&h->total, memory_order_relaxed),
+        getPercentile(h, 0.5) / 1e3,
+        getPercentile(h, 0.99) / 1e3,
+        getPercentile(h, 0.999) / 1e3,
+        atomic_load_explicit(&h->max, memory_order_relaxed) / 1e3);
+}
+
+// Write percentiles and CPU load as JSON members
+void writeCallbackTimingJson(const struct callbackTiming *t, FILE *file) {
+    
+    fprintf(file, "  \"deadlineUs\": %.1f,\n", 1e6 * t->deadline);
+    writeHistogramJson("duration", &t->duration, file);
+    writeHistogramJson("interval", &t->interval, file);
+    writeHistogramJson("headroom", &t->headroom, file);
+    fprintf(file, "  \"jitterUs\": %.1f,\n",
+        ((double) getPercentile(&t->interval, 0.999) -
+         (double) getPercentile(&t->interval, 0.5)) / 1e3);
+    fprintf(file, "  \"lateCallbacks\": %lu,\n",
+        atomic_load_explicit(&t->late, memory_order_relaxed));
+    fprintf(file, "  \"cpuLoadMean\": %.4f,\n  \"cpuLoadMax\": %.4f",
+        t->loadSamples > 0 ? t->loadTotal / t->loadSamples : 0.0, t->loadMax);
+}
@@ -0,0 +1,88 @@
+//
+//  callbackTiming.h
+//
+//  Timing telemetry for the stream callbacks. Each callback timestamps its
+//  entry and exit with PaUtil_GetTime() and records, in preallocated
+//  log-linear (HDR-style) histograms, how long it ran, the time since the
+//  previous callback, and how much time was left before its output was due
+//  at the DAC (outputBufferDacTime) when it returned. Recording is wait-free
+//  and allocation-free. A non-real-time thread samples the stream's CPU load
+//  alongside, and prints percentiles on exit or when the process receives
+//  SIGUSR1.
+//
+
+#ifndef callbackTiming_h
+#define callbackTiming_h
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <portaudio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Histogram resolution: 2^SUB_BUCKET_BITS buckets per power of 2 (about 6%
+// precision), for values from 1 ns up to 2^MAX_VALUE_BITS ns (18 minutes)
+#define SUB_BUCKET_BITS (4)
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_VALUE_BITS (40)
+#define HISTOGRAM_BUCKETS (SUB_BUCKETS * (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1))
+
+// struct type for a histogram of times in nanoseconds
+struct timingHistogram {
+    atomic_ulong        counts[HISTOGRAM_BUCKETS];
+    atomic_ulong        total;
+    atomic_ullong       max;    // largest value recorded (ns)
+};
+
+// struct type for the timing of one stream's callbacks
+struct callbackTiming {
+    struct timingHistogram  duration;   // entry to exit
+    struct timingHistogram  interval;   // entry to next entry
+    struct timingHistogram  headroom;   // exit to outputBufferDacTime
+    atomic_ulong            late;       // callbacks that returned after it
+
+    // callback only
+    double                  entryTime;  // PaUtil_GetTime() at entry
+    double                  lastEntry;  // entry time of the previous callback
+    double                  dacLead;    // outputBufferDacTime - currentTime
+
+    // sampling thread only
+    double                  deadline;   // duration of one buffer (s)
+    unsigned long           loadSamples;
+    double                  loadTotal;
+    double                  loadMax;
+};
+
+// Reset the histograms; deadline is the duration of one buffer (s)
+void initCallbackTiming(struct callbackTiming *t, double deadline);
+
+// Install a SIGUSR1 handler that requests a dump of the timing
+void installCallbackTimingSignal(void);
+
+// Called first thing in the callback
+void callbackTimingEntry(
+    struct callbackTiming *t,
+    const PaStreamCallbackTimeInfo *timeInfo
+);
+
+// Called just before the callback returns
+void callbackTimingExit(struct callbackTiming *t);
+
+// Called periodically from a non-real-time thread: samples the stream's CPU
+// load and prints the timing if SIGUSR1 has been received
+void pollCallbackTiming(struct callbackTiming *t, PaStream *stream);
+
+// Print p50/p99/p99.9/max of each histogram and the CPU load
+void printCallbackTiming(const struct callbackTiming *t);
+
+// Write the same figures as members of a JSON object (see playerStats.h).
+// Jitter is the spread of the callback interval, p99.9 - p50.
+void writeCallbackTimingJson(const struct callbackTiming *t, FILE *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* callbackTiming_h */
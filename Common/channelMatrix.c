@@ -0,0 +1,365 @@
+//
+//  channelMatrix.c
+//
+//  Mixing between channel counts and speaker layouts.
+//
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sndfile.h>
+#include "channelMatrix.h"
+#include "audioPlayerUtil.h"
+
+// -3 dB and -6 dB
+#define GAIN_3DB (0.70710678f)
+#define GAIN_6DB (0.5f)
+
+// struct type for one way of folding a position into the output: into
+// one or two positions, at a gain
+struct fold {
+    int     from;
+    int     to[2];      // the second may be SF_CHANNEL_MAP_INVALID
+    float   gain;
+};
+
+// Where positions go when the output does not have them, best first: the
+// first fold whose positions the output has is used. Front, centre and
+// surround follow BS.775; the rest go to their nearest neighbours.
+static const struct fold folds[] = {
+    {SF_CHANNEL_MAP_MONO, {SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_MONO, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_FRONT_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_LEFT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_RIGHT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_LEFT_OF_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_CENTER}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_LEFT_OF_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_FRONT_LEFT_OF_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_RIGHT_OF_CENTER, {SF_CHANNEL_MAP_FRONT_RIGHT, SF_CHANNEL_MAP_FRONT_CENTER}, GAIN_3DB},
+    {SF_CHANNEL_MAP_FRONT_RIGHT_OF_CENTER, {SF_CHANNEL_MAP_FRONT_RIGHT, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_FRONT_RIGHT_OF_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_SIDE_LEFT, {SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_SIDE_LEFT, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_SIDE_LEFT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_SIDE_RIGHT, {SF_CHANNEL_MAP_REAR_RIGHT, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_SIDE_RIGHT, {SF_CHANNEL_MAP_FRONT_RIGHT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_SIDE_RIGHT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_REAR_LEFT, {SF_CHANNEL_MAP_SIDE_LEFT, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_REAR_LEFT, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_REAR_LEFT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_REAR_RIGHT, {SF_CHANNEL_MAP_SIDE_RIGHT, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_REAR_RIGHT, {SF_CHANNEL_MAP_FRONT_RIGHT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_REAR_RIGHT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_REAR_CENTER, {SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_REAR_RIGHT}, GAIN_3DB},
+    {SF_CHANNEL_MAP_REAR_CENTER, {SF_CHANNEL_MAP_SIDE_LEFT, SF_CHANNEL_MAP_SIDE_RIGHT}, GAIN_3DB},
+    {SF_CHANNEL_MAP_REAR_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_6DB},
+    {SF_CHANNEL_MAP_REAR_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_LEFT, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_LEFT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_RIGHT, {SF_CHANNEL_MAP_FRONT_RIGHT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_RIGHT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_CENTER, {SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_FRONT_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_LEFT, {SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_REAR_LEFT, {SF_CHANNEL_MAP_SIDE_LEFT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_REAR_LEFT, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_LEFT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_RIGHT, {SF_CHANNEL_MAP_REAR_RIGHT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_REAR_RIGHT, {SF_CHANNEL_MAP_SIDE_RIGHT, SF_CHANNEL_MAP_INVALID}, GAIN_3DB},
+    {SF_CHANNEL_MAP_TOP_REAR_RIGHT, {SF_CHANNEL_MAP_FRONT_RIGHT, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_RIGHT, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_CENTER, {SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_REAR_RIGHT}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_CENTER, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_6DB},
+    {SF_CHANNEL_MAP_TOP_REAR_CENTER, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, GAIN_6DB},
+    // only the omnidirectional part of B-format can be played as it is
+    {SF_CHANNEL_MAP_AMBISONIC_B_W, {SF_CHANNEL_MAP_MONO, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_AMBISONIC_B_W, {SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_INVALID}, 1.0f},
+    {SF_CHANNEL_MAP_AMBISONIC_B_W, {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT}, GAIN_3DB},
+};
+
+#define NUM_FOLDS (sizeof(folds) / sizeof(folds[0]))
+
+// The usual layout for a number of channels
+void getDefaultChannelLayout(int *layout, unsigned int channels) {
+    
+    static const int layouts[8][8] = {
+        {SF_CHANNEL_MAP_MONO},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT,
+            SF_CHANNEL_MAP_FRONT_CENTER},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT,
+            SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_REAR_RIGHT},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT,
+            SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_REAR_LEFT,
+            SF_CHANNEL_MAP_REAR_RIGHT},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT,
+            SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_LFE,
+            SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_REAR_RIGHT},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT,
+            SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_LFE,
+            SF_CHANNEL_MAP_REAR_CENTER, SF_CHANNEL_MAP_SIDE_LEFT,
+            SF_CHANNEL_MAP_SIDE_RIGHT},
+        {SF_CHANNEL_MAP_FRONT_LEFT, SF_CHANNEL_MAP_FRONT_RIGHT,
+            SF_CHANNEL_MAP_FRONT_CENTER, SF_CHANNEL_MAP_LFE,
+            SF_CHANNEL_MAP_REAR_LEFT, SF_CHANNEL_MAP_REAR_RIGHT,
+            SF_CHANNEL_MAP_SIDE_LEFT, SF_CHANNEL_MAP_SIDE_RIGHT},
+    };
+    
+    for (unsigned int c = 0; c < channels; c++)
+        layout[c] = channels <= 8 ? layouts[channels - 1][c] :
+            c < 8 ? layouts[7][c] : SF_CHANNEL_MAP_INVALID;
+}
+
+// Set up a matrix
+int initChannelMatrix(
+    struct channelMatrix *m,
+    unsigned int inChannels,
+    unsigned int outChannels,
+    size_t maxFrames
+) {
+    
+    memset(m, 0, sizeof(*m));
+    m->inChannels = inChannels;
+    m->outChannels = outChannels;
+    m->maxFrames = maxFrames;
+    m->kernels = getAudioKernels();
+    
+    m->gains = calloc((size_t) inChannels * outChannels, sizeof(float));
+    m->inPlanes = calloc(inChannels + outChannels, sizeof(float *));
+    float *planeData =
+        malloc(sizeof(float) * maxFrames * (inChannels + outChannels));
+    if (m->gains == NULL || m->inPlanes == NULL || planeData == NULL) {
+        free(planeData);
+        freeChannelMatrix(m);
+        return ERR_BAD_ALLOC;
+    }
+    m->outPlanes = m->inPlanes + inChannels;
+    for (unsigned int c = 0; c < inChannels + outChannels; c++)
+        m->inPlanes[c] = planeData + c * maxFrames;
+    
+    return NO_ERROR;
+}
+
+// Free the gains and planes
+void freeChannelMatrix(struct channelMatrix *m) {
+    
+    free(m->gains);
+    if (m->inPlanes != NULL)
+        free(m->inPlanes[0]);
+    free(m->inPlanes);
+    m->gains = NULL;
+    m->inPlanes = NULL;
+    m->outPlanes = NULL;
+}
+
+// The same position, under the name used in the folds
+static int normalisePosition(int position) {
+    
+    switch (position) {
+        case SF_CHANNEL_MAP_LEFT:
+            return SF_CHANNEL_MAP_FRONT_LEFT;
+        case SF_CHANNEL_MAP_RIGHT:
+            return SF_CHANNEL_MAP_FRONT_RIGHT;
+        case SF_CHANNEL_MAP_CENTER:
+            return SF_CHANNEL_MAP_FRONT_CENTER;
+        default:
+            return position;
+    }
+}
+
+// Output channel at a position, or -1
+static int findPosition(const int *layout, unsigned int channels, int position) {
+    
+    for (unsigned int c = 0; c < channels; c++) {
+        if (normalisePosition(layout[c]) == position)
+            return (int) c;
+    }
+    
+    return -1;
+}
+
+// Set the gains from the layouts of the input and output
+void setLayoutChannelMatrix(
+    struct channelMatrix *m,
+    const int *inLayout,
+    const int *outLayout,
+    int normalise
+) {
+    
+    unsigned int in = m->inChannels, out = m->outChannels;
+    memset(m->gains, 0, sizeof(float) * in * out);
+    
+    for (unsigned int i = 0; i < in; i++) {
+        int position = normalisePosition(inLayout[i]);
+    
+        // no position: straight through by number
+        if (position == SF_CHANNEL_MAP_INVALID) {
+            if (i < out)
+                m->gains[i * in + i] += 1.0f;
+            continue;
+        }
+    
+        // the same position
+        int o = findPosition(outLayout, out, position);
+        if (o >= 0) {
+            m->gains[o * in + i] += 1.0f;
+            continue;
+        }
+    
+        // the first fold the output can take, if any
+        for (size_t f = 0; f < NUM_FOLDS; f++) {
+            if (folds[f].from != position)
+                continue;
+            int o0 = findPosition(outLayout, out, folds[f].to[0]);
+            int o1 = folds[f].to[1] == SF_CHANNEL_MAP_INVALID ? -2 :
+                findPosition(outLayout, out, folds[f].to[1]);
+            if (o0 < 0 || o1 == -1)
+                continue;
+            m->gains[o0 * in + i] += folds[f].gain;
+            if (o1 >= 0)
+                m->gains[o1 * in + i] += folds[f].gain;
+            break;
+        }
+    }
+    
+    if (!normalise)
+        return;
+    
+    // scale so that the loudest output cannot pass full scale
+    float largest = 0.0f;
+    for (unsigned int o = 0; o < out; o++) {
+        float sum = 0.0f;
+        for (unsigned int i = 0; i < in; i++)
+            sum += fabsf(m->gains[o * in + i]);
+        if (sum > largest)
+            largest = sum;
+    }
+    if (largest > 1.0f) {
+        for (size_t g = 0; g < (size_t) in * out; g++)
+            m->gains[g] /= largest;
+    }
+}
+
+// Skip spaces
+static const char* skipSpaces(const char *p) {
+    
+    while (isspace((unsigned char) *p))
+        p++;
+    
+    return p;
+}
+
+// Set the gains from a routing string
+int parseChannelMatrix(struct channelMatrix *m, const char *text) {
+    
+    unsigned int in = m->inChannels;
+    unsigned int row = 0;
+    const char *p = text;
+    memset(m->gains, 0, sizeof(float) * in * m->outChannels);
+    
+    while (1) {
+        if (row >= m->outChannels)
+            return ERR_BAD_COMMAND_LINE;
+    
+        // a sum of terms, or nothing for a silent output
+        p = skipSpaces(p);
+        while (*p != ';' && *p != '\0') {
+            char *end;
+            long input = strtol(p, &end, 10);
+            if (end == p || input < 0 || input >= (long) in)
+                return ERR_BAD_COMMAND_LINE;
+            p = skipSpaces(end);
+            double gain = 1.0;
+            if (*p == '*') {
+                gain = strtod(p + 1, &end);
+                if (end == p + 1)
+                    return ERR_BAD_COMMAND_LINE;
+                p = skipSpaces(end);
+            }
+            m->gains[row * in + input] += (float) gain;
+            if (*p == '+')
+                p++;
+            else if (*p != ';' && *p != '\0')
+                return ERR_BAD_COMMAND_LINE;
+        }
+        row++;
+    
+        if (*p == '\0')
+            break;
+        p++;
+    }
+    
+    return row == m->outChannels ? NO_ERROR : ERR_BAD_COMMAND_LINE;
+}
+
+// Whether the matrix passes every channel through unchanged
+int isIdentityChannelMatrix(const struct channelMatrix *m) {
+    
+    if (m->inChannels != m->outChannels)
+        return 0;
+    
+    for (unsigned int o = 0; o < m->outChannels; o++) {
+        for (unsigned int i = 0; i < m->inChannels; i++) {
+            if (m->gains[o * m->inChannels + i] != (o == i ? 1.0f : 0.0f))
+                return 0;
+        }
+    }
+    
+    return 1;
+}
+
+// Print the rows of the matrix, as a routing string
+void printChannelMatrix(const struct channelMatrix *m) {
+    
+    printf("Channel matrix (%u to %u channels):", m->inChannels,
+        m->outChannels);
+    for (unsigned int o = 0; o < m->outChannels; o++) {
+        int terms = 0;
+        for (unsigned int i = 0; i < m->inChannels; i++) {
+            float gain = m->gains[o * m->inChannels + i];
+            if (gain == 0.0f)
+                continue;
+            printf("%s%u", terms++ > 0 ? " + " : " ", i);
+            if (gain != 1.0f)
+                printf("*%.4g", gain);
+        }
+        printf("%s", o + 1 < m->outChannels ? ";" : "\n");
+    }
+}
+
+// Mix frames from src into dst
+void applyChannelMatrix(
+    struct channelMatrix *m,
+    float *dst,
+    const float *src,
+    size_t frames
+) {
+    
+    unsigned int in = m->inChannels, out = m->outChannels;
+    const struct audioKernels *k = m->kernels;
+    
+    for (size_t done = 0; done < frames; ) {
+        size_t n = min(frames - done, m->maxFrames);
+    
+        // each output plane is a sum of input planes
+        k->deinterleave(m->inPlanes, src + done * in, n, in);
+        for (unsigned int o = 0; o < out; o++) {
+            memset(m->outPlanes[o], 0, n * sizeof(float));
+            for (unsigned int i = 0; i < in; i++) {
+                float gain = m->gains[o * in + i];
+                if (gain != 0.0f)
+                    k->mixAccumulate(m->outPlanes[o], m->inPlanes[i], n, gain);
+            }
+        }
+        k->interleave(dst + done * out, (const float *const *) m->outPlanes, n,
+            out);
+    
+        done += n;
+    }
+}
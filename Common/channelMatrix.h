@@ -0,0 +1,94 @@
+//
+//  channelMatrix.h
+//
+//  Mixes frames of one channel count into another through a matrix of
+//  gains: each output channel is a weighted sum of the input channels. The
+//  matrix can be built from the speaker layouts of the input and output
+//  (the ITU-R BS.775 downmix, with channels that have nowhere better to go
+//  folded into their neighbours, and upmixing by placing each channel on
+//  its speaker), or given as a routing string.
+//
+//  Layouts are arrays of libsndfile SF_CHANNEL_MAP_* positions, one per
+//  channel, as SFC_GET_CHANNEL_MAP_INFO returns them.
+//
+//  The matrix runs on one buffer per channel, through the deinterleave,
+//  mixAccumulate and interleave kernels (audioKernels.h).
+//
+
+#ifndef channelMatrix_h
+#define channelMatrix_h
+
+#include <stddef.h>
+#include "audioKernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for a channel matrix
+struct channelMatrix {
+    unsigned int    inChannels;
+    unsigned int    outChannels;
+    float           *gains;     // outChannels rows of inChannels
+    size_t          maxFrames;  // per pass through the planes
+    float           **inPlanes;
+    float           **outPlanes;
+    const struct audioKernels *kernels;
+};
+
+// The usual layout (WAVE channel order) for a number of channels. Channels
+// beyond the eighth have no position (SF_CHANNEL_MAP_INVALID).
+void getDefaultChannelLayout(int *layout, unsigned int channels);
+
+// Set up a matrix, all gains 0, that works frames at a time (maxFrames).
+// Returns NO_ERROR, or ERR_BAD_ALLOC.
+int initChannelMatrix(
+    struct channelMatrix *m,
+    unsigned int inChannels,
+    unsigned int outChannels,
+    size_t maxFrames
+);
+
+// Free the gains and planes
+void freeChannelMatrix(struct channelMatrix *m);
+
+// Set the gains from the layouts of the input and output. Input channels
+// at a position the output has go straight to it; others are folded into
+// the nearest positions the output has, at the BS.775 gains (the LFE is
+// dropped if the output has none). Channels with no position go to the
+// output channel with the same number, if there is one. If normalise is
+// set, the gains are scaled so that no output can clip.
+void setLayoutChannelMatrix(
+    struct channelMatrix *m,
+    const int *inLayout,
+    const int *outLayout,
+    int normalise
+);
+
+// Set the gains from a routing string: one row per output channel,
+// separated by ';', each a sum of input channels (numbered from 0) with
+// optional gains, e.g. "0 + 2*0.707; 1 + 2*0.707". Returns NO_ERROR, or
+// ERR_BAD_COMMAND_LINE if the string cannot be parsed, has the wrong
+// number of rows or names an input that does not exist.
+int parseChannelMatrix(struct channelMatrix *m, const char *text);
+
+// Whether the matrix passes every channel through unchanged
+int isIdentityChannelMatrix(const struct channelMatrix *m);
+
+// Print the rows of the matrix
+void printChannelMatrix(const struct channelMatrix *m);
+
+// Mix frames of interleaved inChannels from src into interleaved
+// outChannels in dst
+void applyChannelMatrix(
+    struct channelMatrix *m,
+    float *dst,
+    const float *src,
+    size_t frames
+);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* channelMatrix_h */
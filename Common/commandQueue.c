@@ -0,0 +1,66 @@
+//
+//  commandQueue.c
+//
+//  Wait-free queue of transport commands to the stream callback.
+//
+
+#include <pa_util.h>
+#include "commandQueue.h"
+
+// Empty the queue
+void initCommandQueue(struct commandQueue *q) {
+    
+    PaUtil_InitializeClock();
+    
+    atomic_init(&q->writeIndex, 0);
+    atomic_init(&q->readIndex, 0);
+    q->cachedReadIndex = 0;
+    q->cachedWriteIndex = 0;
+}
+
+// Add a command (producer side)
+int postCommand(struct commandQueue *q, const struct playerCommand *command) {
+    
+    size_t w = atomic_load_explicit(&q->writeIndex, memory_order_relaxed);
+    
+    // only look at the consumer's index when the cached one says we're full
+    if (w - q->cachedReadIndex == COMMAND_QUEUE_SIZE) {
+        q->cachedReadIndex =
+            atomic_load_explicit(&q->readIndex, memory_order_acquire);
+        if (w - q->cachedReadIndex == COMMAND_QUEUE_SIZE)
+            return 0;
+    }
+    
+    struct playerCommand *slot = &q->commands[w & (COMMAND_QUEUE_SIZE - 1)];
+    *slot = *command;
+    slot->postTime = PaUtil_GetTime();
+    
+    // publish the command
+    atomic_store_explicit(&q->writeIndex, w + 1, memory_order_release);
+    
+    return 1;
+}
+
+// The oldest command (consumer side)
+const struct playerCommand* peekCommand(struct commandQueue *q) {
+    
+    size_t r = atomic_load_explicit(&q->readIndex, memory_order_relaxed);
+    
+    if (r == q->cachedWriteIndex) {
+        q->cachedWriteIndex =
+            atomic_load_explicit(&q->writeIndex, memory_order_acquire);
+        if (r == q->cachedWriteIndex)
+            return NULL;
+    }
+    
+    return &q->commands[r & (COMMAND_QUEUE_SIZE - 1)];
+}
+
+// Remove the oldest command (consumer side)
+void popCommand(struct commandQueue *q) {
+    
+    size_t r = atomic_load_explicit(&q->readIndex, memory_order_relaxed);
+    
+    // hand the slot back to the producer
+    atomic_store_explicit(&q->readIndex, r + 1, memory_order_release);
+}
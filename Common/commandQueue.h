@@ -0,0 +1,74 @@
+//
+//  commandQueue.h
+//
+//  Fixed-capacity single-producer/single-consumer queue of transport
+//  commands (play, pause, stop, gain, seek), from the thread that takes
+//  commands to the stream callback. Posting and taking are wait-free: each
+//  side only ever stores its own index and reads the other's, with C11
+//  acquire/release ordering, as in frameRingBuffer.h. A full queue rejects
+//  the command rather than blocking.
+//
+
+#ifndef commandQueue_h
+#define commandQueue_h
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "frameRingBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Commands the queue can hold (power of 2)
+#define COMMAND_QUEUE_SIZE (64)
+
+// Transport commands
+typedef enum {
+    CMD_PLAY,       // resume after a pause
+    CMD_PAUSE,      // fade out and stop consuming audio, keeping the stream
+    CMD_STOP,       // fade out and finish the stream
+    CMD_GAIN,       // change the gain (linear) to value
+    CMD_SEEK        // move to value seconds into the file
+} playerCommandType;
+
+// struct type for one command
+struct playerCommand {
+    playerCommandType   type;
+    double              value;      // gain or position, if the command has one
+    unsigned long long  frame;      // stream frame to apply at (0 = at once)
+    double              postTime;   // PaUtil_GetTime() when it was posted
+    int                 held;       // callback: a seek requested ahead of its frame
+};
+
+// struct type for the queue
+struct commandQueue {
+    // written by the producer only
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t writeIndex;
+    size_t          cachedReadIndex;    // producer's last view of readIndex
+
+    // written by the consumer only
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t readIndex;
+    size_t          cachedWriteIndex;   // consumer's last view of writeIndex
+
+    _Alignas(CACHE_LINE_SIZE) struct playerCommand commands[COMMAND_QUEUE_SIZE];
+};
+
+// Empty the queue; neither side may be using it
+void initCommandQueue(struct commandQueue *q);
+
+// Producer side: add a command, stamping its post time. Returns 1, or 0 if
+// the queue is full.
+int postCommand(struct commandQueue *q, const struct playerCommand *command);
+
+// Consumer side: the oldest command, or NULL if the queue is empty
+const struct playerCommand* peekCommand(struct commandQueue *q);
+
+// Consumer side: remove the command returned by peekCommand()
+void popCommand(struct commandQueue *q);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* commandQueue_h */
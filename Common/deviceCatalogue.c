@@ -0,0 +1,482 @@
+//
+//  deviceCatalogue.c
+//
+//  Choosing the audio device, and the catalogue of what devices can do.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "deviceCatalogue.h"
+#include "playerConfig.h"
+
+// Longest host API or device name kept
+#define MAX_NAME_LENGTH (256)
+
+// Most format checks kept for a device
+#define MAX_PROBES (32)
+
+// First line of the file
+#define CATALOGUE_HEADER "# BasicAudioPlayer device catalogue"
+
+// struct type for the answer to one Pa_IsFormatSupported() check
+struct formatProbe {
+    int             channels;
+    double          sampleRate;
+    PaSampleFormat  format;
+    PaError         result;
+};
+
+// struct type for a device in the catalogue
+struct catalogueEntry {
+    char            hostApi[MAX_NAME_LENGTH];
+    char            name[MAX_NAME_LENGTH];
+    PaDeviceIndex   index;      // when last seen
+    int             maxInputChannels;
+    int             maxOutputChannels;
+    double          defaultSampleRate;
+    int             numProbes;
+    struct formatProbe probes[MAX_PROBES];
+};
+
+// The catalogue. The background check replaces the entries, so they are
+// only touched under the lock.
+static struct {
+    pthread_mutex_t lock;
+    struct catalogueEntry *entries;
+    int             numEntries;
+    int             current;    // entry for the stream's device (or -1)
+    int             loaded;
+    int             changed;    // since it was written
+    unsigned int    checks;     // format checks made
+    unsigned int    answered;   // of them, answered from the catalogue
+    pthread_t       thread;
+    int             threadStarted;
+} catalogue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .current = -1
+};
+
+// The catalogue file, or NULL if there is no catalogue
+static const char* getCataloguePath(void) {
+    
+    return getConfigString("BAP_DEVICE_CATALOGUE", NULL);
+}
+
+// Whether text contains part, ignoring case (NULL or "" part always does)
+static int containsText(const char *text, const char *part) {
+    
+    if (part == NULL)
+        return 1;
+    
+    for (size_t n = strlen(part); *text; text++) {
+        size_t i = 0;
+        while (i < n && tolower((unsigned char) text[i]) ==
+               tolower((unsigned char) part[i]))
+            i++;
+        if (i == n)
+            return 1;
+    }
+    
+    return *part == '\0';
+}
+
+// Copy a name, shortened if need be, without tabs or newlines (which
+// separate the fields of the file)
+static void copyName(char *name, const char *source) {
+    
+    snprintf(name, MAX_NAME_LENGTH, "%s", source);
+    for (char *c = name; *c; c++) {
+        if (*c == '\t' || *c == '\n')
+            *c = ' ';
+    }
+}
+
+// Fill in an entry from PortAudio's information about a device, without
+// any answers
+static void describeDevice(struct catalogueEntry *e, PaDeviceIndex index) {
+    
+    const PaDeviceInfo *info = Pa_GetDeviceInfo(index);
+    
+    memset(e, 0, sizeof(*e));
+    copyName(e->hostApi, Pa_GetHostApiInfo(info->hostApi)->name);
+    copyName(e->name, info->name);
+    e->index = index;
+    e->maxInputChannels = info->maxInputChannels;
+    e->maxOutputChannels = info->maxOutputChannels;
+    e->defaultSampleRate = info->defaultSampleRate;
+}
+
+// Whether an entry is the same device as one described by describeDevice()
+static int isSameDevice(
+    const struct catalogueEntry *e,
+    const struct catalogueEntry *live
+) {
+    
+    return strcmp(e->hostApi, live->hostApi) == 0 &&
+        strcmp(e->name, live->name) == 0;
+}
+
+// Whether it is also unchanged, so its answers still hold
+static int isUnchanged(
+    const struct catalogueEntry *e,
+    const struct catalogueEntry *live
+) {
+    
+    return isSameDevice(e, live) &&
+        e->maxInputChannels == live->maxInputChannels &&
+        e->maxOutputChannels == live->maxOutputChannels &&
+        e->defaultSampleRate == live->defaultSampleRate;
+}
+
+// Read the catalogue file, once
+static void loadCatalogue(void) {
+    
+    if (catalogue.loaded)
+        return;
+    catalogue.loaded = 1;
+    
+    const char *path = getCataloguePath();
+    FILE *file = path != NULL ? fopen(path, "r") : NULL;
+    if (file == NULL)
+        return;
+    
+    char line[3 * MAX_NAME_LENGTH];
+    struct catalogueEntry e;
+    struct formatProbe probe;
+    unsigned long format;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "device\t%255[^\t]\t%255[^\t]\t%d\t%d\t%d\t%lf",
+                e.hostApi, e.name, &e.index, &e.maxInputChannels,
+                &e.maxOutputChannels, &e.defaultSampleRate) == 6) {
+            struct catalogueEntry *entries = realloc(catalogue.entries,
+                sizeof(*entries) * (catalogue.numEntries + 1));
+            if (entries == NULL)
+                break;
+            e.numProbes = 0;
+            catalogue.entries = entries;
+            catalogue.entries[catalogue.numEntries++] = e;
+        }
+        else if (sscanf(line, "probe\t%d\t%lf\t%lx\t%d", &probe.channels,
+                &probe.sampleRate, &format, &probe.result) == 4 &&
+                 catalogue.numEntries > 0) {
+            struct catalogueEntry *last =
+                catalogue.entries + catalogue.numEntries - 1;
+            probe.format = (PaSampleFormat) format;
+            if (last->numProbes < MAX_PROBES)
+                last->probes[last->numProbes++] = probe;
+        }
+    }
+    
+    fclose(file);
+}
+
+// Write entries to the catalogue file, to a temporary file that is renamed
+// into place so that a player never reads half of one. Returns 1 if it was
+// written.
+static int saveCatalogue(
+    const struct catalogueEntry *entries,
+    int numEntries
+) {
+    
+    const char *path = getCataloguePath();
+    char temp[PATH_MAX];
+    if (path == NULL ||
+        snprintf(temp, sizeof(temp), "%s.tmp-%d", path, (int) getpid()) >=
+        (int) sizeof(temp))
+        return 0;
+    
+    FILE *file = fopen(temp, "w");
+    if (file == NULL)
+        return 0;
+    
+    fprintf(file, CATALOGUE_HEADER "\n");
+    for (int i = 0; i < numEntries; i++) {
+        const struct catalogueEntry *e = entries + i;
+        fprintf(file, "device\t%s\t%s\t%d\t%d\t%d\t%.17g\n", e->hostApi,
+            e->name, e->index, e->maxInputChannels, e->maxOutputChannels,
+            e->defaultSampleRate);
+        for (int j = 0; j < e->numProbes; j++) {
+            const struct formatProbe *p = e->probes + j;
+            fprintf(file, "probe\t%d\t%.17g\t%lx\t%d\n", p->channels,
+                p->sampleRate, (unsigned long) p->format, p->result);
+        }
+    }
+    
+    if (fclose(file) == 0 && rename(temp, path) == 0)
+        return 1;
+    remove(temp);
+    return 0;
+}
+
+// Whether a device matches BAP_DEVICE (as a name) and BAP_HOST_API
+static int isWanted(
+    const struct catalogueEntry *e,
+    const char *name,
+    const char *hostApi,
+    int input
+) {
+    
+    return containsText(e->name, name) && containsText(e->hostApi, hostApi) &&
+        (input ? e->maxInputChannels : e->maxOutputChannels) > 0;
+}
+
+// The device BAP_DEVICE and BAP_HOST_API choose
+PaDeviceIndex findDevice(int input) {
+    
+    const char *name = getConfigString("BAP_DEVICE", "default");
+    // set but empty is the same as not set, rather than device 0
+    if (*name == '\0')
+        name = "default";
+    const char *hostApi = getConfigString("BAP_HOST_API", NULL);
+    char *end;
+    
+    // by index
+    long index = strtol(name, &end, 10);
+    if (*end == '\0') {
+        const PaDeviceInfo *info =
+            index < Pa_GetDeviceCount() ? Pa_GetDeviceInfo(index) : NULL;
+        return info != NULL && (input ? info->maxInputChannels :
+            info->maxOutputChannels) > 0 ? (PaDeviceIndex) index : paNoDevice;
+    }
+    
+    // the default, or the default of the host API
+    if (strcmp(name, "default") == 0) {
+        if (hostApi == NULL)
+            return input ? Pa_GetDefaultInputDevice() :
+                Pa_GetDefaultOutputDevice();
+        for (PaHostApiIndex i = 0; i < Pa_GetHostApiCount(); i++) {
+            const PaHostApiInfo *api = Pa_GetHostApiInfo(i);
+            if (containsText(api->name, hostApi))
+                return input ? api->defaultInputDevice :
+                    api->defaultOutputDevice;
+        }
+        return paNoDevice;
+    }
+    
+    // by name: first where the catalogue last saw it...
+    struct catalogueEntry live;
+    pthread_mutex_lock(&catalogue.lock);
+    loadCatalogue();
+    PaDeviceIndex found = paNoDevice;
+    for (int i = 0; i < catalogue.numEntries && found == paNoDevice; i++) {
+        const struct catalogueEntry *e = catalogue.entries + i;
+        if (isWanted(e, name, hostApi, input) && e->index >= 0 &&
+            e->index < Pa_GetDeviceCount()) {
+            describeDevice(&live, e->index);
+            if (isSameDevice(e, &live) && isWanted(&live, name, hostApi, input))
+                found = e->index;
+        }
+    }
+    pthread_mutex_unlock(&catalogue.lock);
+    
+    // ...then among all of them
+    for (PaDeviceIndex i = 0; i < Pa_GetDeviceCount() && found == paNoDevice;
+         i++) {
+        describeDevice(&live, i);
+        if (isWanted(&live, name, hostApi, input))
+            found = i;
+    }
+    
+    return found;
+}
+
+// Compare the catalogue with the devices PortAudio found, keeping the
+// answers for devices that are unchanged, and write it back
+static void* checkCatalogue(void *arg) {
+    
+    (void) arg;
+    
+    // ask PortAudio about every device without the lock, so that the
+    // stream's format checks don't wait for it
+    int numDevices = Pa_GetDeviceCount();
+    struct catalogueEntry *entries =
+        numDevices > 0 ? malloc(sizeof(*entries) * numDevices) : NULL;
+    if (entries == NULL)
+        return NULL;
+    for (int i = 0; i < numDevices; i++)
+        describeDevice(entries + i, i);
+    
+    // then swap them in, with the answers kept from the old entries
+    struct catalogueEntry *saved = NULL;
+    pthread_mutex_lock(&catalogue.lock);
+    char *kept = calloc(catalogue.numEntries + 1, 1);
+    if (kept != NULL) {
+        int current = -1;
+        for (int i = 0; i < numDevices; i++) {
+            // the same device, where the catalogue has it more than once
+            // (e.g. two of the same interface) the first not yet matched
+            int match = -1;
+            for (int j = 0; j < catalogue.numEntries && match < 0; j++) {
+                if (!kept[j] && isSameDevice(catalogue.entries + j, entries + i))
+                    match = j;
+            }
+            const struct catalogueEntry *old =
+                match >= 0 ? catalogue.entries + match : NULL;
+            if (old != NULL && isUnchanged(old, entries + i)) {
+                entries[i].numProbes = old->numProbes;
+                memcpy(entries[i].probes, old->probes,
+                    sizeof(old->probes[0]) * old->numProbes);
+            }
+            if (old == NULL || !isUnchanged(old, entries + i) || old->index != i)
+                catalogue.changed = 1;
+            if (match >= 0) {
+                kept[match] = 1;
+                if (match == catalogue.current)
+                    current = i;
+            }
+        }
+        if (numDevices != catalogue.numEntries)
+            catalogue.changed = 1;
+    
+        free(catalogue.entries);
+        catalogue.entries = entries;
+        catalogue.numEntries = numDevices;
+        catalogue.current = current;
+        entries = NULL;
+    
+        // written from a copy, so that the file isn't written under the lock;
+        // answers added meanwhile mark it changed again
+        if (catalogue.changed) {
+            saved = malloc(sizeof(*saved) * numDevices);
+            if (saved != NULL) {
+                memcpy(saved, catalogue.entries, sizeof(*saved) * numDevices);
+                catalogue.changed = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&catalogue.lock);
+    free(entries);
+    free(kept);
+    
+    if (saved != NULL && !saveCatalogue(saved, numDevices)) {
+        pthread_mutex_lock(&catalogue.lock);
+        catalogue.changed = 1;
+        pthread_mutex_unlock(&catalogue.lock);
+    }
+    free(saved);
+    
+    return NULL;
+}
+
+// Use the catalogue for the stream's device, and check the rest of it
+void openDeviceCatalogue(PaDeviceIndex device) {
+    
+    if (getCataloguePath() == NULL || device == paNoDevice)
+        return;
+    
+    pthread_mutex_lock(&catalogue.lock);
+    loadCatalogue();
+    
+    // the device's entry, made new if it is not there or has changed
+    struct catalogueEntry live;
+    describeDevice(&live, device);
+    int current = -1;
+    for (int i = 0; i < catalogue.numEntries && current < 0; i++) {
+        if (catalogue.entries[i].index == device &&
+            isSameDevice(catalogue.entries + i, &live))
+            current = i;
+    }
+    for (int i = 0; i < catalogue.numEntries && current < 0; i++) {
+        if (isSameDevice(catalogue.entries + i, &live))
+            current = i;
+    }
+    if (current < 0) {
+        struct catalogueEntry *entries = realloc(catalogue.entries,
+            sizeof(*entries) * (catalogue.numEntries + 1));
+        if (entries != NULL) {
+            catalogue.entries = entries;
+            current = catalogue.numEntries++;
+            catalogue.entries[current] = live;
+        }
+    }
+    else if (!isUnchanged(catalogue.entries + current, &live))
+        catalogue.entries[current] = live;
+    else
+        catalogue.entries[current].index = device;
+    catalogue.current = current;
+    
+    pthread_mutex_unlock(&catalogue.lock);
+    
+    // the other devices can wait
+    catalogue.threadStarted =
+        pthread_create(&catalogue.thread, NULL, checkCatalogue, NULL) == 0;
+}
+
+// Whether the answer to a check says something about the device, rather
+// than about the moment it was asked
+static int isLasting(PaError result) {
+    
+    return result == paFormatIsSupported ||
+        result == paInvalidChannelCount ||
+        result == paInvalidSampleRate ||
+        result == paSampleFormatNotSupported;
+}
+
+// Pa_IsFormatSupported() for an output, from the catalogue where it can be
+PaError checkOutputFormat(const PaStreamParameters *p, double sampleRate) {
+    
+    struct formatProbe probe = {
+        .channels = p->channelCount,
+        .sampleRate = sampleRate,
+        .format = p->sampleFormat
+    };
+    
+    pthread_mutex_lock(&catalogue.lock);
+    catalogue.checks++;
+    struct catalogueEntry *e = catalogue.current >= 0 &&
+        catalogue.entries[catalogue.current].index == p->device ?
+        catalogue.entries + catalogue.current : NULL;
+    for (int i = 0; e != NULL && i < e->numProbes; i++) {
+        const struct formatProbe *q = e->probes + i;
+        if (q->channels == probe.channels && q->sampleRate == sampleRate &&
+            q->format == probe.format) {
+            catalogue.answered++;
+            pthread_mutex_unlock(&catalogue.lock);
+            return q->result;
+        }
+    }
+    pthread_mutex_unlock(&catalogue.lock);
+    
+    // ask the device (without the lock: this can take a while)
+    probe.result = Pa_IsFormatSupported(NULL, p, sampleRate);
+    
+    pthread_mutex_lock(&catalogue.lock);
+    e = catalogue.current >= 0 &&
+        catalogue.entries[catalogue.current].index == p->device ?
+        catalogue.entries + catalogue.current : NULL;
+    if (e != NULL && e->numProbes < MAX_PROBES && isLasting(probe.result)) {
+        e->probes[e->numProbes++] = probe;
+        catalogue.changed = 1;
+    }
+    pthread_mutex_unlock(&catalogue.lock);
+    
+    return probe.result;
+}
+
+// Write any new answers, and free the catalogue
+void closeDeviceCatalogue(void) {
+    
+    if (catalogue.threadStarted) {
+        pthread_join(catalogue.thread, NULL);
+        catalogue.threadStarted = 0;
+    }
+    
+    pthread_mutex_lock(&catalogue.lock);
+    if (catalogue.changed &&
+        saveCatalogue(catalogue.entries, catalogue.numEntries))
+        catalogue.changed = 0;
+    if (catalogue.checks > 0 && getCataloguePath() != NULL)
+        printf("Device catalogue: %u of %u format checks answered from it\n",
+            catalogue.answered, catalogue.checks);
+    free(catalogue.entries);
+    catalogue.entries = NULL;
+    catalogue.numEntries = 0;
+    catalogue.current = -1;
+    catalogue.loaded = 0;
+    pthread_mutex_unlock(&catalogue.lock);
+}
@@ -0,0 +1,59 @@
+//
+//  deviceCatalogue.h
+//
+//  Choosing the audio device without asking, and remembering what the
+//  devices can do between runs. BAP_DEVICE picks a device by index or by
+//  part of its name (any case), and BAP_HOST_API narrows the choice to host
+//  APIs whose names contain it; with neither set, the default device is
+//  used. Setting BAP_DEVICE to "ask" lists the devices and asks for one, as
+//  the players used to.
+//
+//  When BAP_DEVICE_CATALOGUE names a file, the devices are kept in it (a
+//  line each: host API, name, index, channels and default rate), each with
+//  the answers to the Pa_IsFormatSupported() checks the players have made
+//  of it. On some host APIs those checks open the device, and they are most
+//  of the time it takes to start playing; with the catalogue, each is made
+//  once per device rather than on every launch. A device chosen by name is
+//  looked for at the index it had last time, so only when it has moved are
+//  the devices searched. The chosen device is checked against PortAudio
+//  before its answers are used, and once it has been, a background thread
+//  checks the rest of the catalogue, drops devices that have gone and the
+//  answers for devices that have changed, adds new ones and writes it back.
+//  Answers about a device that was busy are never kept.
+//
+//  BAP_DEVICE:             device index, part of its name, "ask" or
+//                          "default" (default)
+//  BAP_HOST_API:           part of the host API's name (any)
+//  BAP_DEVICE_CATALOGUE:   catalogue file (no catalogue if unset)
+//
+
+#ifndef deviceCatalogue_h
+#define deviceCatalogue_h
+
+#include <portaudio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// The device BAP_DEVICE and BAP_HOST_API choose, with input or output
+// channels as asked, or paNoDevice if none does
+PaDeviceIndex findDevice(int input);
+
+// Use the catalogue for the device the stream will be opened on, and start
+// checking the rest of it in the background
+void openDeviceCatalogue(PaDeviceIndex device);
+
+// Pa_IsFormatSupported() for an output, answered from the catalogue where
+// it can be
+PaError checkOutputFormat(const PaStreamParameters *p, double sampleRate);
+
+// Wait for the background check, write any new answers to the catalogue,
+// and free it. Call before Pa_Terminate().
+void closeDeviceCatalogue(void);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* deviceCatalogue_h */
@@ -0,0 +1,273 @@
+//
+//  frameRingBuffer.c
+//
+//  Single-producer/single-consumer ring buffer that counts whole audio frames.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "frameRingBuffer.h"
+
+// Allocate a ring buffer
+struct frameRingBuffer* createFrameRingBuffer(
+    size_t frames,
+    size_t bytesPerFrame
+) {
+    
+    struct frameRingBuffer *rb = NULL;
+    
+    if (frames == 0 || bytesPerFrame == 0)
+        return NULL;
+    
+    // round capacity up to a power of 2 so that indices wrap with a mask
+    size_t capacity = 1;
+    while (capacity < frames)
+        capacity <<= 1;
+    
+    // the struct itself must be aligned for the indices to sit on their own
+    // cache lines
+    if (posix_memalign((void **) &rb, CACHE_LINE_SIZE, sizeof(*rb)))
+        return NULL;
+    // with room for a cache line between planes, should the ring be used
+    // for planar audio (there are at most bytesPerFrame / 2 channels)
+    if (posix_memalign((void **) &rb->data, CACHE_LINE_SIZE,
+            capacity * bytesPerFrame + bytesPerFrame / 2 * CACHE_LINE_SIZE)) {
+        free(rb);
+        return NULL;
+    }
+    
+    atomic_init(&rb->writeIndex, 0);
+    atomic_init(&rb->readIndex, 0);
+    rb->cachedReadIndex = 0;
+    rb->cachedWriteIndex = 0;
+    rb->frames = capacity;
+    rb->mask = capacity - 1;
+    rb->bytesPerFrame = bytesPerFrame;
+    
+    return rb;
+}
+
+// Free a ring buffer
+void freeFrameRingBuffer(struct frameRingBuffer *rb) {
+    
+    if (rb != NULL) {
+        free(rb->data);
+        free(rb);
+    }
+}
+
+// Number of frames that can be written (producer side)
+size_t getFrameRingBufferWriteAvailable(struct frameRingBuffer *rb) {
+    
+    size_t w = atomic_load_explicit(&rb->writeIndex, memory_order_relaxed);
+    
+    rb->cachedReadIndex =
+        atomic_load_explicit(&rb->readIndex, memory_order_acquire);
+    
+    return rb->frames - (w - rb->cachedReadIndex);
+}
+
+// Number of frames that can be read (consumer side)
+size_t getFrameRingBufferReadAvailable(struct frameRingBuffer *rb) {
+    
+    size_t r = atomic_load_explicit(&rb->readIndex, memory_order_relaxed);
+    
+    rb->cachedWriteIndex =
+        atomic_load_explicit(&rb->writeIndex, memory_order_acquire);
+    
+    return rb->cachedWriteIndex - r;
+}
+
+// split a span of frames starting at index into (up to) two regions
+static size_t getRegions(
+    struct frameRingBuffer *rb,
+    size_t index,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+) {
+    
+    size_t start = index & rb->mask;
+    
+    *dataPtr1 = rb->data + start * rb->bytesPerFrame;
+    if (start + frames > rb->frames) {
+        // region wraps around the end of the buffer
+        *sizePtr1 = rb->frames - start;
+        *dataPtr2 = rb->data;
+        *sizePtr2 = frames - *sizePtr1;
+    }
+    else {
+        *sizePtr1 = frames;
+        *dataPtr2 = NULL;
+        *sizePtr2 = 0;
+    }
+    
+    return frames;
+}
+
+// Get regions for writing
+size_t getFrameRingBufferWriteRegions(
+    struct frameRingBuffer *rb,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+) {
+    
+    size_t w = atomic_load_explicit(&rb->writeIndex, memory_order_relaxed);
+    
+    // only reload the consumer's index (and touch its cache line) when our
+    // cached view of it is not enough to satisfy the request
+    size_t available = rb->frames - (w - rb->cachedReadIndex);
+    if (available < frames)
+        available = getFrameRingBufferWriteAvailable(rb);
+    
+    return getRegions(
+        rb,
+        w,
+        frames < available ? frames : available,
+        dataPtr1, sizePtr1,
+        dataPtr2, sizePtr2
+    );
+}
+
+// Publish written frames
+void advanceFrameRingBufferWriteIndex(struct frameRingBuffer *rb, size_t frames) {
+    
+    size_t w = atomic_load_explicit(&rb->writeIndex, memory_order_relaxed);
+    
+    // release: frame data must be visible before the new index
+    atomic_store_explicit(&rb->writeIndex, w + frames, memory_order_release);
+}
+
+// Get regions for reading
+size_t getFrameRingBufferReadRegions(
+    struct frameRingBuffer *rb,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+) {
+    
+    size_t r = atomic_load_explicit(&rb->readIndex, memory_order_relaxed);
+    
+    // likewise, only reload the producer's index when necessary
+    size_t available = rb->cachedWriteIndex - r;
+    if (available < frames)
+        available = getFrameRingBufferReadAvailable(rb);
+    
+    return getRegions(
+        rb,
+        r,
+        frames < available ? frames : available,
+        dataPtr1, sizePtr1,
+        dataPtr2, sizePtr2
+    );
+}
+
+// Release consumed frames
+void advanceFrameRingBufferReadIndex(struct frameRingBuffer *rb, size_t frames) {
+    
+    size_t r = atomic_load_explicit(&rb->readIndex, memory_order_relaxed);
+    
+    // release: we must have finished reading the frames before the producer
+    // is allowed to overwrite them
+    atomic_store_explicit(&rb->readIndex, r + frames, memory_order_release);
+}
+
+// Copy frames into the ring buffer
+size_t writeFrameRingBuffer(
+    struct frameRingBuffer *rb,
+    const void *data,
+    size_t frames
+) {
+    
+    void *ptr[2];
+    size_t sizes[2];
+    
+    frames = getFrameRingBufferWriteRegions(rb, frames,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+    memcpy(ptr[0], data, sizes[0] * rb->bytesPerFrame);
+    if (sizes[1] > 0) {
+        memcpy(ptr[1], (const unsigned char *) data +
+            sizes[0] * rb->bytesPerFrame, sizes[1] * rb->bytesPerFrame);
+    }
+    
+    advanceFrameRingBufferWriteIndex(rb, frames);
+    
+    return frames;
+}
+
+// Copy frames out of the ring buffer
+size_t readFrameRingBuffer(
+    struct frameRingBuffer *rb,
+    void *data,
+    size_t frames
+) {
+    
+    void *ptr[2];
+    size_t sizes[2];
+    
+    frames = getFrameRingBufferReadRegions(rb, frames,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+    memcpy(data, ptr[0], sizes[0] * rb->bytesPerFrame);
+    if (sizes[1] > 0) {
+        memcpy((unsigned char *) data + sizes[0] * rb->bytesPerFrame,
+            ptr[1], sizes[1] * rb->bytesPerFrame);
+    }
+    
+    advanceFrameRingBufferReadIndex(rb, frames);
+    
+    return frames;
+}
+
+// Start of a region in each plane
+void getFrameRingBufferPlanes(
+    const struct frameRingBuffer *rb,
+    const void *region,
+    unsigned int channels,
+    void **planes
+) {
+    
+    size_t sampleSize = rb->bytesPerFrame / channels;
+    size_t start = (size_t) ((const unsigned char *) region - rb->data) /
+        rb->bytesPerFrame;
+    
+    // planes a power of 2 apart would all fall in the same cache sets, so
+    // each is a cache line further on
+    size_t planeBytes = rb->frames * sampleSize + CACHE_LINE_SIZE;
+    
+    for (unsigned int c = 0; c < channels; c++)
+        planes[c] = rb->data + c * planeBytes + start * sampleSize;
+}
+
+// Copy frames out of a planar ring buffer
+size_t readFrameRingBufferPlanes(
+    struct frameRingBuffer *rb,
+    void *const *data,
+    unsigned int channels,
+    size_t offset,
+    size_t frames
+) {
+    
+    void *ptr[2];
+    size_t sizes[2];
+    void *planes[channels];
+    size_t sampleSize = rb->bytesPerFrame / channels;
+    
+    frames = getFrameRingBufferReadRegions(rb, frames,
+        ptr + 0, sizes + 0, ptr + 1, sizes + 1);
+    
+    // one contiguous copy per channel and region
+    for (int i = 0; i < 2 && sizes[i] > 0; i++) {
+        getFrameRingBufferPlanes(rb, ptr[i], channels, planes);
+        for (unsigned int c = 0; c < channels; c++)
+            memcpy((unsigned char *) data[c] + offset * sampleSize,
+                planes[c], sizes[i] * sampleSize);
+        offset += sizes[i];
+    }
+    
+    advanceFrameRingBufferReadIndex(rb, frames);
+    
+    return frames;
+}
@@ -0,0 +1,126 @@
+//
+//  frameRingBuffer.h
+//
+//  Single-producer/single-consumer ring buffer that counts whole audio frames.
+//  One thread (the file reader) writes and one thread (the PortAudio callback)
+//  reads. Indices are free-running frame counters published with C11
+//  acquire/release atomics, and each side's index sits on its own cache line
+//  so the reader thread and the callback don't false-share.
+//
+//  The same ring can hold planar audio instead: one ring of samples per
+//  channel, each a cache line further apart than its size (so that the
+//  planes don't all map to the same cache sets), all sharing the one pair
+//  of indices. A region then covers the same frames in every plane, and
+//  getFrameRingBufferPlanes() finds them.
+//
+
+#ifndef frameRingBuffer_h
+#define frameRingBuffer_h
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Large enough to separate the indices on both x86 (64 bytes, plus the
+// adjacent-line prefetcher) and Apple silicon (128 bytes)
+#define CACHE_LINE_SIZE (128)
+
+// struct type for the ring buffer
+struct frameRingBuffer {
+    // written by the producer only
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t writeIndex;
+    size_t          cachedReadIndex;    // producer's last view of readIndex
+
+    // written by the consumer only
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t readIndex;
+    size_t          cachedWriteIndex;   // consumer's last view of writeIndex
+
+    // constant after creation
+    _Alignas(CACHE_LINE_SIZE) size_t frames; // capacity in frames (power of 2)
+    size_t          mask;               // used to wrap indices into the buffer
+    size_t          bytesPerFrame;      // size of one (interleaved) frame
+    unsigned char   *data;              // frame storage
+};
+
+// Allocate a ring buffer holding (at least) the given number of frames;
+// the capacity is rounded up to a power of 2. Returns NULL on failure.
+struct frameRingBuffer* createFrameRingBuffer(
+    size_t frames,
+    size_t bytesPerFrame
+);
+
+// Free a ring buffer allocated with createFrameRingBuffer()
+void freeFrameRingBuffer(struct frameRingBuffer *rb);
+
+// Number of frames that can be written (producer side)
+size_t getFrameRingBufferWriteAvailable(struct frameRingBuffer *rb);
+
+// Number of frames that can be read (consumer side)
+size_t getFrameRingBufferReadAvailable(struct frameRingBuffer *rb);
+
+// Get up to two contiguous regions for writing up to the requested number of
+// frames. Returns the number of frames covered by the two regions.
+size_t getFrameRingBufferWriteRegions(
+    struct frameRingBuffer *rb,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+);
+
+// Publish frames written into the write regions
+void advanceFrameRingBufferWriteIndex(struct frameRingBuffer *rb, size_t frames);
+
+// Get up to two contiguous regions for reading up to the requested number of
+// frames. Returns the number of frames covered by the two regions.
+size_t getFrameRingBufferReadRegions(
+    struct frameRingBuffer *rb,
+    size_t frames,
+    void **dataPtr1, size_t *sizePtr1,
+    void **dataPtr2, size_t *sizePtr2
+);
+
+// Release frames consumed from the read regions
+void advanceFrameRingBufferReadIndex(struct frameRingBuffer *rb, size_t frames);
+
+// Copy frames into the ring buffer. Returns the number of frames written.
+size_t writeFrameRingBuffer(
+    struct frameRingBuffer *rb,
+    const void *data,
+    size_t frames
+);
+
+// Copy frames out of the ring buffer. Returns the number of frames read.
+size_t readFrameRingBuffer(
+    struct frameRingBuffer *rb,
+    void *data,
+    size_t frames
+);
+
+// Planar rings: the start of a region from getFrameRingBuffer*Regions() in
+// each of the channels planes. Every plane starts on a cache line once the
+// ring holds CACHE_LINE_SIZE bytes of samples per channel.
+void getFrameRingBufferPlanes(
+    const struct frameRingBuffer *rb,
+    const void *region,
+    unsigned int channels,
+    void **planes
+);
+
+// Planar rings: copy frames out into one buffer per channel, starting offset
+// frames into each. Returns the number of frames read.
+size_t readFrameRingBufferPlanes(
+    struct frameRingBuffer *rb,
+    void *const *data,
+    unsigned int channels,
+    size_t offset,
+    size_t frames
+);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* frameRingBuffer_h */
@@ -0,0 +1,391 @@
+//
+//  mappedAudioFile.c
+//
+//  Zero-copy reader for uncompressed WAV and AIFF files.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "audioPlayerUtil.h"
+#include "mappedAudioFile.h"
+#include "sampleFormat.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_BIG_ENDIAN (1)
+#else
+#define HOST_BIG_ENDIAN (0)
+#endif
+
+// WAVE_FORMAT tags
+#define WAV_FORMAT_PCM (0x0001)
+#define WAV_FORMAT_FLOAT (0x0003)
+#define WAV_FORMAT_EXTENSIBLE (0xFFFE)
+
+// read little/big endian integers from the file header
+static uint32_t getLE32(const unsigned char *p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 |
+        (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint16_t getLE16(const unsigned char *p) {
+    return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t getBE32(const unsigned char *p) {
+    return (uint32_t) p[3] | (uint32_t) p[2] << 8 |
+        (uint32_t) p[1] << 16 | (uint32_t) p[0] << 24;
+}
+
+static uint16_t getBE16(const unsigned char *p) {
+    return (uint16_t) (p[1] | p[0] << 8);
+}
+
+// convert an 80-bit IEEE extended float (AIFF sample rate) to double
+static double getExtended(const unsigned char *p) {
+    int exponent = ((p[0] & 0x7F) << 8) | p[1];
+    uint64_t mantissa = 0;
+    for (int i = 0; i < 8; i++)
+        mantissa = (mantissa << 8) | p[2 + i];
+    double value = ldexp((double) mantissa, exponent - 16383 - 63);
+    return (p[0] & 0x80) ? -value : value;
+}
+
+// Find the sample data in a RIFF/WAVE file
+static int parseWav(struct mappedAudioFile *file) {
+    
+    const unsigned char *p = file->map + 12;
+    const unsigned char *end = file->map + file->mapSize;
+    int haveFormat = 0;
+    
+    while (p + 8 <= end) {
+        uint32_t size = getLE32(p + 4);
+        const unsigned char *body = p + 8;
+        
+        if (memcmp(p, "fmt ", 4) == 0 && size >= 16 && body + 16 <= end) {
+            unsigned int tag = getLE16(body);
+            if (tag == WAV_FORMAT_EXTENSIBLE && size >= 40 && body + 40 <= end)
+                tag = getLE16(body + 24); // first two bytes of the sub-format
+            file->channels = getLE16(body + 2);
+            file->sRate = (int) getLE32(body + 4);
+            file->bytesPerSample = getLE16(body + 14) / 8;
+            if (tag == WAV_FORMAT_PCM)
+                file->sampleType = MAPPED_PCM;
+            else if (tag == WAV_FORMAT_FLOAT)
+                file->sampleType = MAPPED_FLOAT;
+            else
+                return ERR_OPENING_FILE; // compressed
+            haveFormat = 1;
+        }
+        else if (memcmp(p, "data", 4) == 0 && haveFormat) {
+            if (file->channels == 0 || file->bytesPerSample == 0)
+                return ERR_OPENING_FILE;
+            file->data = body;
+            // the size may be wrong in files that were not closed properly
+            size_t available = (size_t) (end - body);
+            size_t dataSize = size < available ? size : available;
+            file->frames = (sf_count_t) (dataSize /
+                (file->channels * file->bytesPerSample));
+            file->bigEndian = 0;
+            return NO_ERROR;
+        }
+        
+        // chunks are padded to an even size
+        if ((size_t) (end - body) < size + (size & 1))
+            break;
+        p = body + size + (size & 1);
+    }
+    
+    return ERR_OPENING_FILE;
+}
+
+// Find the sample data in an AIFF/AIFC file
+static int parseAiff(struct mappedAudioFile *file) {
+    
+    const unsigned char *p = file->map + 12;
+    const unsigned char *end = file->map + file->mapSize;
+    int isAifc = memcmp(file->map + 8, "AIFC", 4) == 0;
+    int haveFormat = 0;
+    
+    file->bigEndian = 1;
+    
+    while (p + 8 <= end) {
+        uint32_t size = getBE32(p + 4);
+        const unsigned char *body = p + 8;
+        
+        if (memcmp(p, "COMM", 4) == 0 && size >= 18 && body + 18 <= end) {
+            file->channels = getBE16(body);
+            file->bytesPerSample = (getBE16(body + 6) + 7) / 8;
+            file->sRate = (int) getExtended(body + 8);
+            file->sampleType = MAPPED_PCM;
+            if (isAifc) {
+                if (size < 22 || body + 22 > end)
+                    return ERR_OPENING_FILE;
+                if (memcmp(body + 18, "sowt", 4) == 0)
+                    file->bigEndian = 0; // byte-swapped PCM
+                else if (memcmp(body + 18, "fl32", 4) == 0 ||
+                         memcmp(body + 18, "FL32", 4) == 0)
+                    file->sampleType = MAPPED_FLOAT;
+                else if (memcmp(body + 18, "NONE", 4) != 0)
+                    return ERR_OPENING_FILE; // compressed
+            }
+            haveFormat = 1;
+        }
+        else if (memcmp(p, "SSND", 4) == 0 && haveFormat && size >= 8) {
+            uint32_t offset = getBE32(body);
+            if (file->channels == 0 || file->bytesPerSample == 0 ||
+                offset > size - 8 || (size_t) (end - body) < 8 + (size_t) offset)
+                return ERR_OPENING_FILE;
+            file->data = body + 8 + offset;
+            size_t available = (size_t) (end - file->data);
+            size_t dataSize = size - 8 - offset;
+            if (dataSize > available)
+                dataSize = available;
+            file->frames = (sf_count_t) (dataSize /
+                (file->channels * file->bytesPerSample));
+            return NO_ERROR;
+        }
+        
+        if ((size_t) (end - body) < size + (size & 1))
+            break;
+        p = body + size + (size & 1);
+    }
+    
+    return ERR_OPENING_FILE;
+}
+
+// Ask the kernel to read ahead of the given data offset
+static void prefetch(struct mappedAudioFile *file, size_t offset) {
+    
+#if !defined(_WIN32)
+    size_t dataSize = (size_t) file->frames *
+        file->channels * file->bytesPerSample;
+    
+    // only issue advice once we are half way through the previous window
+    if (file->prefetchedTo >= dataSize ||
+        offset + file->prefetchBytes / 2 < file->prefetchedTo)
+        return;
+    
+    size_t start = offset > file->prefetchedTo ? offset : file->prefetchedTo;
+    size_t stop = offset + file->prefetchBytes;
+    if (stop > dataSize)
+        stop = dataSize;
+    
+    // madvise() wants a page-aligned address
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    uintptr_t from = (uintptr_t) (file->data + start) & ~(pageSize - 1);
+    uintptr_t to = (uintptr_t) (file->data + stop);
+    madvise((void *) from, to - from, MADV_WILLNEED);
+    
+    file->prefetchedTo = stop;
+#else
+    (void) file;
+    (void) offset;
+#endif
+}
+
+// Map a file
+int openMappedAudioFile(
+    const char fileName[],
+    struct mappedAudioFile *file,
+    double prefetchSeconds
+) {
+    
+    memset(file, 0, sizeof(*file));
+    
+#if defined(_WIN32)
+    (void) fileName;
+    (void) prefetchSeconds;
+    return ERR_OPENING_FILE;
+#else
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return ERR_OPENING_FILE;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 12) {
+        close(fd);
+        return ERR_OPENING_FILE;
+    }
+    
+    // the mapping stays valid after the descriptor is closed
+    file->mapSize = (size_t) st.st_size;
+    void *map = mmap(NULL, file->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        file->mapSize = 0;
+        return ERR_OPENING_FILE;
+    }
+    file->map = map;
+    
+    // find the sample data
+    int err = ERR_OPENING_FILE;
+    if (memcmp(file->map, "RIFF", 4) == 0 && memcmp(file->map + 8, "WAVE", 4) == 0)
+        err = parseWav(file);
+    else if (memcmp(file->map, "FORM", 4) == 0 &&
+             (memcmp(file->map + 8, "AIFF", 4) == 0 ||
+              memcmp(file->map + 8, "AIFC", 4) == 0))
+        err = parseAiff(file);
+    
+    // check we know how to convert the samples
+    if (!err) {
+        int supported = file->sampleType == MAPPED_FLOAT ?
+            file->bytesPerSample == 4 :
+            file->bytesPerSample >= 2 && file->bytesPerSample <= 4;
+        if (!supported || file->sRate <= 0)
+            err = ERR_OPENING_FILE;
+    }
+    
+    if (err) {
+        closeMappedAudioFile(file);
+        return err;
+    }
+    
+    // we will read the data from start to finish
+    madvise(file->map, file->mapSize, MADV_SEQUENTIAL);
+    file->prefetchBytes = (size_t) (prefetchSeconds * file->sRate) *
+        file->channels * file->bytesPerSample;
+    prefetch(file, 0);
+    
+    return NO_ERROR;
+#endif
+}
+
+// Get a PCM sample as a 32-bit integer (data in the top bits)
+static int32_t getPcm(const struct mappedAudioFile *file, const unsigned char *p) {
+    
+    switch (file->bytesPerSample) {
+        case 2:
+            return (int32_t) ((uint32_t) (file->bigEndian ?
+                getBE16(p) : getLE16(p)) << 16);
+        case 3:
+            // assemble in the top 24 bits so the sign comes for free
+            return (int32_t) (file->bigEndian ?
+                (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 :
+                (uint32_t) p[2] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[0] << 8);
+        default:
+            return (int32_t) (file->bigEndian ? getBE32(p) : getLE32(p));
+    }
+}
+
+// Get a float sample
+static float getFloat(const struct mappedAudioFile *file, const unsigned char *p) {
+    
+    uint32_t bits = file->bigEndian ? getBE32(p) : getLE32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    
+    return value;
+}
+
+// Convert samples in the file's encoding to an interleaved format
+void convertMappedSamples(
+    const struct mappedAudioFile *file,
+    void *buffer,
+    const unsigned char *p,
+    size_t n,
+    PaSampleFormat format
+) {
+    
+    size_t step = file->bytesPerSample;
+    
+    if (file->sampleType == MAPPED_PCM && file->bigEndian == HOST_BIG_ENDIAN &&
+        getSampleSize(format) == file->bytesPerSample && format != paFloat32) {
+        // the file already holds the samples as they are wanted
+        memcpy(buffer, p, n * step);
+    }
+    else if (format == paFloat32) {
+        // convert with the same scaling as sf_read_float()
+        float *out = (float *) buffer;
+        if (file->sampleType == MAPPED_FLOAT) {
+            for (size_t i = 0; i < n; i++, p += step)
+                out[i] = getFloat(file, p);
+        }
+        else {
+            for (size_t i = 0; i < n; i++, p += step)
+                out[i] = getPcm(file, p) * (1.0f / 0x80000000);
+        }
+    }
+    else {
+        // integer output: convert via 32-bit samples
+        unsigned char *out = (unsigned char *) buffer;
+        size_t outStep = getSampleSize(format);
+        for (size_t i = 0; i < n; i++, p += step, out += outStep) {
+            int32_t v;
+            if (file->sampleType == MAPPED_FLOAT) {
+                double f = getFloat(file, p) * 2147483648.0;
+                v = f >= 2147483647.0 ? INT32_MAX :
+                    f <= -2147483648.0 ? INT32_MIN : (int32_t) f;
+            }
+            else
+                v = getPcm(file, p);
+            
+            if (format == paInt16) {
+                int16_t s = (int16_t) (v >> 16);
+                memcpy(out, &s, sizeof(s));
+            }
+            else if (format == paInt24)
+                packInt24(out, &v, 1);
+            else
+                memcpy(out, &v, sizeof(v));
+        }
+    }
+}
+
+// Convert frames to the requested interleaved format
+sf_count_t readMappedAudioFile(
+    struct mappedAudioFile *file,
+    void *buffer,
+    sf_count_t frames,
+    PaSampleFormat format
+) {
+    
+    if (frames > file->frames - file->position)
+        frames = file->frames - file->position;
+    if (frames <= 0)
+        return 0;
+    
+    size_t bytesPerFrame = file->channels * file->bytesPerSample;
+    size_t offset = (size_t) file->position * bytesPerFrame;
+    size_t n = (size_t) frames * file->channels;
+    
+    prefetch(file, offset + n * file->bytesPerSample);
+    convertMappedSamples(file, buffer, file->data + offset, n, format);
+    
+    file->position += frames;
+    
+    return frames;
+}
+
+// Move the read position
+sf_count_t seekMappedAudioFile(struct mappedAudioFile *file, sf_count_t frame) {
+    
+    if (frame < 0 || frame > file->frames)
+        return -1;
+    
+    file->position = frame;
+    
+    // start prefetching again from the new position
+    file->prefetchedTo = (size_t) frame * file->channels * file->bytesPerSample;
+    prefetch(file, file->prefetchedTo);
+    
+    return frame;
+}
+
+// Unmap a file
+void closeMappedAudioFile(struct mappedAudioFile *file) {
+    
+#if !defined(_WIN32)
+    if (file->map != NULL)
+        munmap(file->map, file->mapSize);
+#endif
+    file->map = NULL;
+    file->mapSize = 0;
+    file->data = NULL;
+}
@@ -0,0 +1,85 @@
+//
+//  mappedAudioFile.h
+//
+//  Zero-copy reader for uncompressed WAV and AIFF files. The file is mapped
+//  into memory once, the sample data are located by walking the chunks, and
+//  frames are converted to float in a single pass straight from the mapping
+//  into the caller's buffer (typically a ring buffer write region), rather
+//  than being copied through libsndfile's internal buffers first. The kernel
+//  is asked to read ahead of the read position with madvise().
+//
+
+#ifndef mappedAudioFile_h
+#define mappedAudioFile_h
+
+#include <stddef.h>
+#include <portaudio.h>
+#include <sndfile.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Type to identify how samples are encoded in the file
+typedef enum {
+    MAPPED_PCM,     // signed integer
+    MAPPED_FLOAT    // IEEE float
+} MappedSampleType;
+
+// struct type for a mapped audio file
+struct mappedAudioFile {
+    unsigned char       *map;           // mapping of the whole file
+    size_t              mapSize;        // size of the mapping
+    const unsigned char *data;          // first byte of sample data
+    sf_count_t          frames;         // number of frames
+    unsigned int        channels;       // number of channels
+    int                 sRate;          // sample rate
+    unsigned int        bytesPerSample; // 2, 3 or 4
+    MappedSampleType    sampleType;     // integer or float
+    int                 bigEndian;      // byte order of the samples
+    sf_count_t          position;       // next frame to read
+    size_t              prefetchBytes;  // how far ahead to prefetch
+    size_t              prefetchedTo;   // data offset prefetched so far
+};
+
+// Map a file. Returns NO_ERROR, or ERR_OPENING_FILE if the file cannot be
+// mapped or is not an uncompressed WAV/AIFF file that can be read directly.
+int openMappedAudioFile(
+    const char fileName[],
+    struct mappedAudioFile *file,
+    double prefetchSeconds
+);
+
+// Convert up to the requested number of frames to the given interleaved
+// sample format (paFloat32, paInt16, paInt24 or paInt32). Integer samples
+// of the same width and byte order as the file are copied straight out of
+// the mapping. Returns the number of frames read (0 at the end of the file).
+sf_count_t readMappedAudioFile(
+    struct mappedAudioFile *file,
+    void *buffer,
+    sf_count_t frames,
+    PaSampleFormat format
+);
+
+// Convert n samples in the file's encoding, starting at p, to the given
+// interleaved sample format. Also used for samples read some other way than
+// through the mapping (only the encoding fields of file are used).
+void convertMappedSamples(
+    const struct mappedAudioFile *file,
+    void *buffer,
+    const unsigned char *p,
+    size_t n,
+    PaSampleFormat format
+);
+
+// Move the read position. Returns the new position, or -1 if out of range.
+sf_count_t seekMappedAudioFile(struct mappedAudioFile *file, sf_count_t frame);
+
+// Unmap a file
+void closeMappedAudioFile(struct mappedAudioFile *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* mappedAudioFile_h */
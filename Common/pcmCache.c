@@ -0,0 +1,336 @@
+//
+//  pcmCache.c
+//
+//  On-disk cache of decoded PCM for compressed files.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sndfile.h>
+#include "audioPlayerUtil.h"
+#include "pcmCache.h"
+#include "playerConfig.h"
+
+// Default size cap (MB)
+#define DEFAULT_CACHE_MB (2048.0)
+
+// Frames decoded at a time
+#define FILL_FRAMES (8192)
+
+// Temporary files older than this (s) were left by a crash and are deleted
+#define STALE_TEMP_SECONDS (3600)
+
+// Names in the cache directory
+#define TEMP_PREFIX "tmp-"
+#define ENTRY_SUFFIX ".wav"
+#define COUNTERS_NAME "counters"
+
+// struct type for a decode under way
+struct pcmCacheFill {
+    char            source[PATH_MAX];   // file being decoded
+    char            entry[PATH_MAX];    // where the result goes
+    char            temp[PATH_MAX];     // where it is written first
+    PaSampleFormat  format;
+    atomic_int      abandon;            // set to stop early
+    pthread_t       thread;
+};
+
+// struct type for an entry, when evicting
+struct cacheEntry {
+    char    name[NAME_MAX + 1];
+    time_t  lastUsed;
+    off_t   size;
+};
+
+// The cache directory, or NULL if caching is off
+static const char* getCacheDirectory(void) {
+    
+    return getConfigString("BAP_PCM_CACHE", NULL);
+}
+
+// Whether files in this format are worth caching
+int isPcmCacheable(int sfFormat) {
+    
+    return getCacheDirectory() != NULL &&
+        ((sfFormat & SF_FORMAT_TYPEMASK) == SF_FORMAT_FLAC ||
+         (sfFormat & SF_FORMAT_SUBMASK) == SF_FORMAT_VORBIS);
+}
+
+// Path of the cache entry for a file; returns 0 if the file can't be found
+static int getEntryPath(const char fileName[], char *path, size_t size) {
+    
+    char realName[PATH_MAX];
+    struct stat st;
+    
+    if (realpath(fileName, realName) == NULL || stat(realName, &st) != 0)
+        return 0;
+    
+    // FNV-1a hash of the path, size and modification time
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *c = realName; *c; c++)
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+    uint64_t keys[] = {
+        (uint64_t) st.st_size,
+        (uint64_t) st.st_mtime,
+#if defined(__APPLE__)
+        (uint64_t) st.st_mtimespec.tv_nsec
+#else
+        (uint64_t) st.st_mtim.tv_nsec
+#endif
+    };
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        for (int b = 0; b < 8; b++)
+            hash = (hash ^ ((keys[k] >> (8 * b)) & 0xFF)) * 1099511628211ULL;
+    }
+    
+    return snprintf(path, size, "%s/%016llx" ENTRY_SUFFIX, getCacheDirectory(),
+        (unsigned long long) hash) < (int) size;
+}
+
+// Add to the hit and miss counters shared by everything using the cache;
+// returns the new totals
+static void countLookup(int hit, unsigned long long *hits,
+    unsigned long long *misses) {
+    
+    char path[PATH_MAX];
+    *hits = *misses = 0;
+    
+    snprintf(path, sizeof(path), "%s/" COUNTERS_NAME, getCacheDirectory());
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+    
+    // players may be sharing the cache, so update under a lock
+    if (flock(fd, LOCK_EX) == 0) {
+        char text[64] = {0};
+        if (read(fd, text, sizeof(text) - 1) > 0)
+            sscanf(text, "hits %llu misses %llu", hits, misses);
+        if (hit)
+            (*hits)++;
+        else
+            (*misses)++;
+        // the counts only go up, so the new text is never shorter
+        int len = snprintf(text, sizeof(text), "hits %llu misses %llu\n",
+            *hits, *misses);
+        if (pwrite(fd, text, (size_t) len, 0) != len)
+            printf("PCM cache: unable to update %s\n", path);
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+}
+
+// Map the cached copy of a file
+int openCachedAudioFile(
+    const char fileName[],
+    struct mappedAudioFile *mapped,
+    double prefetchSeconds
+) {
+    
+    char path[PATH_MAX];
+    unsigned long long hits, misses;
+    
+    // the first lookup creates the cache directory
+    mkdir(getCacheDirectory(), 0755);
+    
+    int hit = getEntryPath(fileName, path, sizeof(path)) &&
+        openMappedAudioFile(path, mapped, prefetchSeconds) == NO_ERROR;
+    
+    // the entry's modification time is when it was last used
+    if (hit)
+        utimes(path, NULL);
+    
+    countLookup(hit, &hits, &misses);
+    printf("PCM cache %s (%llu hits, %llu misses in all)\n",
+        hit ? "hit" : "miss", hits, misses);
+    
+    return hit ? NO_ERROR : ERR_OPENING_FILE;
+}
+
+// Order entries oldest first
+static int compareLastUsed(const void *a, const void *b) {
+    
+    time_t ta = ((const struct cacheEntry *) a)->lastUsed;
+    time_t tb = ((const struct cacheEntry *) b)->lastUsed;
+    
+    return (ta > tb) - (ta < tb);
+}
+
+// Delete least recently used entries until the cache is under its cap, and
+// any temporary files left behind by a crash
+static void evictEntries(void) {
+    
+    const char *dirName = getCacheDirectory();
+    off_t cap = (off_t) (1e6 *
+        getConfigDouble("BAP_PCM_CACHE_MB", DEFAULT_CACHE_MB));
+    struct cacheEntry *entries = NULL;
+    size_t numEntries = 0, capacity = 0;
+    off_t total = 0;
+    char path[PATH_MAX];
+    struct stat st;
+    struct dirent *de;
+    
+    DIR *dir = opendir(dirName);
+    if (dir == NULL)
+        return;
+    
+    while ((de = readdir(dir)) != NULL) {
+        size_t len = strlen(de->d_name);
+        snprintf(path, sizeof(path), "%s/%s", dirName, de->d_name);
+        if (stat(path, &st) != 0)
+            continue;
+        
+        if (strncmp(de->d_name, TEMP_PREFIX, strlen(TEMP_PREFIX)) == 0) {
+            if (time(NULL) - st.st_mtime > STALE_TEMP_SECONDS)
+                unlink(path);
+        }
+        else if (len > strlen(ENTRY_SUFFIX) &&
+                 strcmp(de->d_name + len - strlen(ENTRY_SUFFIX), ENTRY_SUFFIX) == 0) {
+            if (numEntries == capacity) {
+                capacity = capacity ? 2 * capacity : 256;
+                struct cacheEntry *grown =
+                    realloc(entries, capacity * sizeof(*entries));
+                if (grown == NULL)
+                    break;
+                entries = grown;
+            }
+            snprintf(entries[numEntries].name, sizeof(entries[numEntries].name),
+                "%s", de->d_name);
+            entries[numEntries].lastUsed = st.st_mtime;
+            entries[numEntries].size = st.st_size;
+            total += st.st_size;
+            numEntries++;
+        }
+    }
+    closedir(dir);
+    
+    // players that still have an evicted entry mapped keep reading it; the
+    // space is freed when they unmap it
+    qsort(entries, numEntries, sizeof(*entries), compareLastUsed);
+    for (size_t i = 0; i < numEntries && total > cap; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dirName, entries[i].name);
+        if (unlink(path) == 0) {
+            printf("PCM cache: evicted %s\n", entries[i].name);
+            total -= entries[i].size;
+        }
+    }
+    
+    free(entries);
+}
+
+// Decode into the cache (background thread)
+static void* fillThread(void *data) {
+    
+    struct pcmCacheFill *fill = (struct pcmCacheFill *) data;
+    SF_INFO inInfo = {0};
+    SNDFILE *in = NULL, *out = NULL;
+    void *buffer = NULL;
+    int ok = 0;
+    
+    // a handle of our own: the player's is in use
+    in = sf_open(fill->source, SFM_READ, &inInfo);
+    int fd = mkstemp(fill->temp);
+    if (in == NULL || fd < 0)
+        goto cleanup;
+    fchmod(fd, 0644); // mkstemp() makes it private
+    
+    // a plain WAV in the native format, which the mapped reader can read
+    SF_INFO outInfo = {
+        .samplerate = inInfo.samplerate,
+        .channels = inInfo.channels,
+        .format = SF_FORMAT_WAV |
+            (fill->format == paInt16 ? SF_FORMAT_PCM_16 :
+             fill->format == paInt24 ? SF_FORMAT_PCM_24 :
+             fill->format == paInt32 ? SF_FORMAT_PCM_32 : SF_FORMAT_FLOAT)
+    };
+    out = sf_open_fd(fd, SFM_WRITE, &outInfo, SF_FALSE);
+    buffer = malloc(sizeof(int) * FILL_FRAMES * inInfo.channels);
+    if (out == NULL || buffer == NULL)
+        goto cleanup;
+    
+    // integers go through as 32-bit ints, so they are copied exactly
+    sf_count_t framesRead, framesDecoded = 0;
+    do {
+        if (fill->format == paFloat32) {
+            framesRead = sf_readf_float(in, buffer, FILL_FRAMES);
+            if (framesRead > 0 && sf_writef_float(out, buffer, framesRead) != framesRead)
+                goto cleanup;
+        }
+        else {
+            framesRead = sf_readf_int(in, buffer, FILL_FRAMES);
+            if (framesRead > 0 && sf_writef_int(out, buffer, framesRead) != framesRead)
+                goto cleanup;
+        }
+        framesDecoded += framesRead > 0 ? framesRead : 0;
+    } while (framesRead > 0 && !atomic_load(&fill->abandon));
+    
+    ok = !atomic_load(&fill->abandon) && framesDecoded == inInfo.frames;
+    
+cleanup:
+    if (out != NULL)
+        sf_close(out);
+    if (in != NULL)
+        sf_close(in);
+    free(buffer);
+    
+    if (fd >= 0) {
+        // the entry must be complete on disk before it appears under its
+        // name, or a crash could leave a truncated entry behind
+        ok = ok && fsync(fd) == 0;
+        close(fd);
+        if (ok && rename(fill->temp, fill->entry) == 0) {
+            printf("PCM cache: stored %s\n", fill->source);
+            evictEntries();
+        }
+        else
+            unlink(fill->temp);
+    }
+    
+    return NULL;
+}
+
+// Start decoding a file into the cache
+struct pcmCacheFill* startPcmCacheFill(
+    const char fileName[],
+    PaSampleFormat format
+) {
+    
+    struct pcmCacheFill *fill = calloc(1, sizeof(*fill));
+    if (fill == NULL)
+        return NULL;
+    
+    snprintf(fill->source, sizeof(fill->source), "%s", fileName);
+    snprintf(fill->temp, sizeof(fill->temp), "%s/" TEMP_PREFIX "XXXXXX",
+        getCacheDirectory());
+    fill->format = format;
+    atomic_init(&fill->abandon, 0);
+    
+    if (!getEntryPath(fileName, fill->entry, sizeof(fill->entry)) ||
+        pthread_create(&fill->thread, NULL, fillThread, fill) != 0) {
+        free(fill);
+        return NULL;
+    }
+    
+    return fill;
+}
+
+// Wait for a decode to finish, and free it
+void finishPcmCacheFill(struct pcmCacheFill *fill) {
+    
+    if (fill == NULL)
+        return;
+    
+    atomic_store(&fill->abandon, 1);
+    pthread_join(fill->thread, NULL);
+    free(fill);
+}
@@ -0,0 +1,64 @@
+//
+//  pcmCache.h
+//
+//  On-disk cache of decoded PCM for compressed (FLAC and Ogg Vorbis)
+//  files, so that files played over and over are only decoded once. The
+//  first time a compressed file is opened, a background thread decodes it
+//  into a WAV file (in the file's native sample format) in the cache
+//  directory, writing to a temporary file and renaming it into place once it
+//  is complete, so a partial entry is never seen. Later opens map the cached
+//  WAV with the memory-mapped reader instead of decoding.
+//
+//  Entries are named by a hash of the file's real path, size and
+//  modification time, so editing or replacing a file invalidates its entry.
+//  Each hit sets the entry's modification time, and when the cache grows past
+//  its cap the least recently used entries are deleted. Hits and misses are
+//  counted in a file in the cache directory, shared by all the players using
+//  it.
+//
+//  BAP_PCM_CACHE:      cache directory (no caching if unset)
+//  BAP_PCM_CACHE_MB:   size cap (2048 MB)
+//
+
+#ifndef pcmCache_h
+#define pcmCache_h
+
+#include <portaudio.h>
+#include "mappedAudioFile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// A decode into the cache that is under way
+struct pcmCacheFill;
+
+// Whether files in this format (SF_INFO.format) are worth caching: true for
+// compressed formats if BAP_PCM_CACHE is set
+int isPcmCacheable(int sfFormat);
+
+// Map the cached copy of a file. Counts a hit or a miss. Returns NO_ERROR
+// on a hit, or ERR_OPENING_FILE if the file has not been cached.
+int openCachedAudioFile(
+    const char fileName[],
+    struct mappedAudioFile *mapped,
+    double prefetchSeconds
+);
+
+// Start decoding a file into the cache in the background, in the given
+// sample format. Returns NULL if the file cannot be cached (the cache is
+// then just not filled).
+struct pcmCacheFill* startPcmCacheFill(
+    const char fileName[],
+    PaSampleFormat format
+);
+
+// Wait for a decode to finish (abandoning it if the file is closed before it
+// has been decoded) and free it. Accepts NULL.
+void finishPcmCacheFill(struct pcmCacheFill *fill);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* pcmCache_h */
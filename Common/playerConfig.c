@@ -0,0 +1,56 @@
+//
+//  playerConfig.c
+//
+//  Run-time settings for the players.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "playerConfig.h"
+
+// Default settings
+#define DEFAULT_LOW_WATERMARK (0.5)
+#define DEFAULT_HIGH_WATERMARK (1.0)
+
+// Read a number from an environment variable
+double getConfigDouble(const char *name, double defaultValue) {
+    
+    const char *value = getenv(name);
+    char *end;
+    
+    if (value == NULL || *value == '\0')
+        return defaultValue;
+    
+    double result = strtod(value, &end);
+    if (*end != '\0') {
+        printf("Ignoring invalid value for %s: %s\n", name, value);
+        return defaultValue;
+    }
+    
+    return result;
+}
+
+// Read a string from an environment variable
+const char* getConfigString(const char *name, const char *defaultValue) {
+    
+    const char *value = getenv(name);
+    
+    return (value == NULL || *value == '\0') ? defaultValue : value;
+}
+
+// Fill in the settings from the environment
+void getPlayerConfig(struct playerConfig *config) {
+    
+    // ring buffer watermarks
+    config->lowWatermark =
+        getConfigDouble("BAP_LOW_WATERMARK", DEFAULT_LOW_WATERMARK);
+    config->highWatermark =
+        getConfigDouble("BAP_HIGH_WATERMARK", DEFAULT_HIGH_WATERMARK);
+    if (config->lowWatermark <= 0.0 ||
+        config->highWatermark > 1.0 ||
+        config->lowWatermark >= config->highWatermark) {
+        printf("Watermarks must satisfy 0 < low < high <= 1; using defaults.\n");
+        config->lowWatermark = DEFAULT_LOW_WATERMARK;
+        config->highWatermark = DEFAULT_HIGH_WATERMARK;
+    }
+}
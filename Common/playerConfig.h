@@ -0,0 +1,37 @@
+//
+//  playerConfig.h
+//
+//  Run-time settings for the players. Settings are read from environment
+//  variables (prefixed BAP_) so that the command line of each player stays
+//  the same; anything that is not set takes a default value.
+//
+
+#ifndef playerConfig_h
+#define playerConfig_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for storing player settings
+struct playerConfig {
+    double  lowWatermark;   // ring fill (fraction) that wakes the reader
+    double  highWatermark;  // ring fill (fraction) the reader tops up to
+};
+
+// Fill in the settings from the environment
+void getPlayerConfig(struct playerConfig *config);
+
+// Read a number from an environment variable, or return the default if the
+// variable is not set or cannot be parsed
+double getConfigDouble(const char *name, double defaultValue);
+
+// Read a string from an environment variable, or return the default if the
+// variable is not set
+const char* getConfigString(const char *name, const char *defaultValue);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerConfig_h */
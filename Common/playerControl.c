@@ -0,0 +1,99 @@
+//
+//  playerControl.c
+//
+//  Commands read from stdin while a player plays.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audioPlayerUtil.h"
+#include "playerControl.h"
+
+// Split a line into a command, value and time. Returns 0 if it is blank or
+// cannot be parsed.
+static int parseCommandLine(char *text, struct playerCommandLine *line) {
+    
+    char *save = NULL;
+    char *word = strtok_r(text, " \t\r\n", &save);
+    
+    memset(line, 0, sizeof(*line));
+    if (word == NULL)
+        return 0;
+    snprintf(line->command, sizeof(line->command), "%s", word);
+    
+    while ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        const char *number = word;
+        double *field;
+    
+        // a number, then a time, each at most once
+        if ((word[0] == '@' || word[0] == '+') && !line->hasTime) {
+            line->hasTime = 1;
+            line->relative = word[0] == '+';
+            field = &line->time;
+            number++;
+        }
+        else if (!line->hasValue && !line->hasTime) {
+            line->hasValue = 1;
+            field = &line->value;
+        }
+        else
+            return 0;
+    
+        char *end;
+        *field = strtod(number, &end);
+        if (end == number || *end != '\0')
+            return 0;
+    }
+    
+    return 1;
+}
+
+// Read and dispatch commands until the end of stdin
+static void* controlThread(void *data) {
+    
+    struct playerControl *c = (struct playerControl *) data;
+    char *line = NULL;
+    size_t size = 0;
+    
+    while (getline(&line, &size, stdin) > 0) {
+        struct playerCommandLine command;
+        if (!parseCommandLine(line, &command)) {
+            if (command.command[0] != '\0')
+                printf("Cannot parse command: %s\n", command.command);
+            continue;
+        }
+    
+        if (!c->handler(c->userData, &command))
+            printf("Unknown command: %s\n", command.command);
+    }
+    free(line);
+    
+    return NULL;
+}
+
+// Start reading commands
+int startPlayerControl(
+    struct playerControl *c,
+    playerCommandHandler *handler,
+    void *userData
+) {
+    
+    c->handler = handler;
+    c->userData = userData;
+    c->started = pthread_create(&c->thread, NULL, controlThread, c) == 0;
+    
+    return c->started ? NO_ERROR : ERR_BAD_ALLOC;
+}
+
+// Stop reading commands
+void stopPlayerControl(struct playerControl *c) {
+    
+    if (!c->started)
+        return;
+    
+    // the thread spends its life blocked in getline(), a cancellation point
+    pthread_cancel(c->thread);
+    pthread_join(c->thread, NULL);
+    c->started = 0;
+}
@@ -0,0 +1,68 @@
+//
+//  playerControl.h
+//
+//  Commands typed (or piped) to a player while it plays. A thread reads
+//  lines from stdin, each a command word optionally followed by a number
+//  and a time, and passes them to the player's handler, so that the main
+//  thread and the callback never block on input. The time is "@<seconds>"
+//  for a point in the stream (counting from when it started) or
+//  "+<seconds>" for a time from now, e.g.
+//
+//      seek 12.5
+//      gain 0.5 @10
+//      pause +2
+//
+//  The thread finishes at the end of stdin.
+//
+
+#ifndef playerControl_h
+#define playerControl_h
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Longest command word
+#define MAX_COMMAND (32)
+
+// struct type for a command line
+struct playerCommandLine {
+    char    command[MAX_COMMAND];
+    int     hasValue;
+    double  value;
+    int     hasTime;
+    int     relative;   // time is from now rather than from the start
+    double  time;       // seconds
+};
+
+// Handler for one command. Returns 0 if the command is not recognised.
+typedef int playerCommandHandler(
+    void *userData,
+    const struct playerCommandLine *line
+);
+
+// struct type for the command thread
+struct playerControl {
+    pthread_t               thread;
+    int                     started;
+    playerCommandHandler    *handler;
+    void                    *userData;
+};
+
+// Start reading commands. Returns NO_ERROR or ERR_BAD_ALLOC.
+int startPlayerControl(
+    struct playerControl *c,
+    playerCommandHandler *handler,
+    void *userData
+);
+
+// Stop reading commands
+void stopPlayerControl(struct playerControl *c);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerControl_h */
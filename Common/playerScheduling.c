@@ -0,0 +1,228 @@
+//
+//  playerScheduling.c
+//
+//  Priorities, CPU affinity and memory locking for the players' threads.
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // SCHED_BATCH, CPU sets and pthread_setaffinity_np()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "playerConfig.h"
+#include "playerScheduling.h"
+
+// Stack each thread touches when memory is locked
+#define PREFAULT_STACK_BYTES (64 * 1024)
+
+// Stride of the touches (the smallest page size)
+#define PREFAULT_STRIDE (4096)
+
+// Note what became of a setting; one failure, of any of the threads
+// applying it, marks it failed
+static void recordResult(struct schedulingResult *r, int error) {
+    
+    int expected = SCHEDULING_NOT_ASKED;
+    
+    if (error) {
+        atomic_store(&r->error, error);
+        atomic_store(&r->state, SCHEDULING_FAILED);
+    }
+    else
+        atomic_compare_exchange_strong(&r->state, &expected,
+            SCHEDULING_APPLIED);
+}
+
+// Touch the next PREFAULT_STACK_BYTES of the calling thread's stack, so
+// that it is mapped (and locked) before it is needed
+static void prefaultStack(void) {
+    
+    volatile unsigned char stack[PREFAULT_STACK_BYTES];
+    
+    for (size_t i = 0; i < sizeof(stack); i += PREFAULT_STRIDE)
+        stack[i] = 0;
+}
+
+#if defined(__linux__)
+// Parse a CPU list such as "2-3,6"; returns 0 if it can't be parsed
+static int parseCpuList(const char *list, cpu_set_t *set) {
+    
+    CPU_ZERO(set);
+    for (const char *c = list; *c; ) {
+        char *end;
+        long first = strtol(c, &end, 10), last = first;
+        if (end == c || first < 0)
+            return 0;
+        if (*end == '-') {
+            c = end + 1;
+            last = strtol(c, &end, 10);
+            if (end == c || last < first)
+                return 0;
+        }
+        if (last >= CPU_SETSIZE || (*end != ',' && *end != '\0'))
+            return 0;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET((int) cpu, set);
+        c = *end == ',' ? end + 1 : end;
+    }
+    
+    return CPU_COUNT(set) > 0;
+}
+#endif
+
+// Read a CPU list setting (NULL if unset or invalid)
+static const char* getCpuList(const char *name) {
+    
+    const char *list = getConfigString(name, NULL);
+#if defined(__linux__)
+    cpu_set_t set;
+    if (list != NULL && !parseCpuList(list, &set)) {
+        printf("Ignoring invalid value for %s: %s\n", name, list);
+        list = NULL;
+    }
+#endif
+    
+    return list;
+}
+
+// Pin the calling thread to a list of CPUs; returns 0 or an errno value
+static int setAffinity(const char *list) {
+    
+#if defined(__linux__)
+    cpu_set_t set;
+    parseCpuList(list, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    // thread affinity tags on OS X are only hints
+    (void) list;
+    return ENOTSUP;
+#endif
+}
+
+// Read the settings, and lock memory
+void initPlayerScheduling(struct playerScheduling *s) {
+    
+    memset(s, 0, sizeof(*s));
+    
+    s->readerBatch =
+        strcmp(getConfigString("BAP_READER_PRIORITY", "normal"), "batch") == 0;
+    const char *priority = getConfigString("BAP_CALLBACK_PRIORITY", "host");
+    if (strcmp(priority, "host") != 0) {
+        // anything but a priority in SCHED_FIFO's range leaves the callback
+        // as the host set it
+        int lowest = sched_get_priority_min(SCHED_FIFO);
+        int highest = sched_get_priority_max(SCHED_FIFO);
+        char *end;
+        long value = strtol(priority, &end, 10);
+        if (end == priority || *end != '\0' || value < lowest ||
+            value > highest) {
+            printf("Ignoring invalid value for BAP_CALLBACK_PRIORITY: %s "
+                "(SCHED_FIFO priorities run from %d to %d)\n", priority,
+                lowest, highest);
+        }
+        else
+            s->callbackPriority = (int) value;
+    }
+    s->readerCpus = getCpuList("BAP_READER_CPUS");
+    s->callbackCpus = getCpuList("BAP_CALLBACK_CPUS");
+    s->lockMemory =
+        strcmp(getConfigString("BAP_LOCK_MEMORY", "off"), "on") == 0;
+    
+    // everything mapped so far, and everything mapped from now on, stays in
+    // memory, starting with this thread's stack
+    if (s->lockMemory) {
+        recordResult(&s->memoryLock,
+            mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? 0 : errno);
+        prefaultStack();
+    }
+}
+
+// Apply the reader's settings to the calling thread
+void scheduleReaderThread(struct playerScheduling *s) {
+    
+    // explicitly, since a thread inherits its creator's policy
+#if defined(__linux__)
+    struct sched_param param = {.sched_priority = 0};
+    recordResult(&s->readerPolicy, pthread_setschedparam(pthread_self(),
+        s->readerBatch ? SCHED_BATCH : SCHED_OTHER, &param));
+#else
+    // no batch policy; normal is the middle of SCHED_OTHER's range
+    struct sched_param param = {
+        .sched_priority = (sched_get_priority_min(SCHED_OTHER) +
+            sched_get_priority_max(SCHED_OTHER)) / 2
+    };
+    recordResult(&s->readerPolicy, s->readerBatch ? ENOTSUP :
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param));
+#endif
+    
+    if (s->readerCpus != NULL)
+        recordResult(&s->readerAffinity, setAffinity(s->readerCpus));
+    
+    if (s->lockMemory)
+        prefaultStack();
+}
+
+// Apply the callback's settings to the calling thread, once
+void scheduleCallbackThread(struct playerScheduling *s) {
+    
+    if (atomic_load_explicit(&s->callbackScheduled, memory_order_relaxed))
+        return;
+    atomic_store_explicit(&s->callbackScheduled, 1, memory_order_relaxed);
+    
+    if (s->callbackPriority > 0) {
+        struct sched_param param = {.sched_priority = s->callbackPriority};
+        recordResult(&s->callbackPolicy,
+            pthread_setschedparam(pthread_self(), SCHED_FIFO, &param));
+    }
+    
+    if (s->callbackCpus != NULL)
+        recordResult(&s->callbackAffinity, setAffinity(s->callbackCpus));
+    
+    if (s->lockMemory)
+        prefaultStack();
+}
+
+// Describe what became of a setting
+static const char* describeResult(const struct schedulingResult *r) {
+    
+    switch (atomic_load(&r->state)) {
+        case SCHEDULING_APPLIED:
+            return "took effect";
+        case SCHEDULING_FAILED:
+            return strerror(atomic_load(&r->error));
+        default:
+            return "not applied";
+    }
+}
+
+// Print the settings and whether they took effect
+void printPlayerScheduling(const struct playerScheduling *s) {
+    
+    // a player that reads the file in its callback has no reader thread
+    printf("Scheduling: ");
+    if (atomic_load(&s->readerPolicy.state) != SCHEDULING_NOT_ASKED) {
+        printf("reader %s (%s)", s->readerBatch ? "SCHED_BATCH" : "normal",
+            describeResult(&s->readerPolicy));
+        if (s->readerCpus != NULL)
+            printf(", CPUs %s (%s)", s->readerCpus,
+                describeResult(&s->readerAffinity));
+        printf("; ");
+    }
+    if (s->callbackPriority > 0)
+        printf("callback SCHED_FIFO %d (%s)", s->callbackPriority,
+            describeResult(&s->callbackPolicy));
+    else
+        printf("callback as the host set it");
+    if (s->callbackCpus != NULL)
+        printf(", CPUs %s (%s)", s->callbackCpus,
+            describeResult(&s->callbackAffinity));
+    if (s->lockMemory)
+        printf("; memory locked (%s)", describeResult(&s->memoryLock));
+    printf("\n");
+}
@@ -0,0 +1,85 @@
+//
+//  playerScheduling.h
+//
+//  Where and at what priority the players' threads run. The reader is the
+//  side that can wait, so it runs at normal priority, or as a batch thread
+//  (Linux SCHED_BATCH) so that it never competes with anything interactive;
+//  the callback is the side that can't, so its priority can be raised to
+//  SCHED_FIFO where the host allows it (by default it is left as the host
+//  API set it). Either can be pinned to a list of CPUs (Linux), so that a
+//  player can be placed on isolated audio cores. Memory can be locked
+//  (mlockall()) and the threads' stacks prefaulted, so that neither side
+//  page-faults once playing.
+//
+//  The reader applies its settings to itself when it starts, and the
+//  callback applies its own the first time it is called, which costs it a
+//  few system calls once. Whether each setting took effect, or why not, is
+//  recorded and printed with the other statistics.
+//
+//  BAP_READER_PRIORITY:    `normal` or `batch` (normal)
+//  BAP_CALLBACK_PRIORITY:  SCHED_FIFO priority for the callback thread, or
+//                          `host` to leave it (host); a value outside
+//                          SCHED_FIFO's range is reported and ignored
+//  BAP_READER_CPUS:        CPUs for the reader, e.g. `2` or `2-3,6` (any)
+//  BAP_CALLBACK_CPUS:      CPUs for the callback (any)
+//  BAP_LOCK_MEMORY:        `on` to lock memory and prefault stacks (off)
+//
+
+#ifndef playerScheduling_h
+#define playerScheduling_h
+
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// What became of a setting
+typedef enum {
+    SCHEDULING_NOT_ASKED,
+    SCHEDULING_APPLIED,
+    SCHEDULING_FAILED
+} schedulingState;
+
+// struct type for what became of a setting; error is the errno of the
+// first failure
+struct schedulingResult {
+    atomic_int      state;
+    atomic_int      error;
+};
+
+// struct type for the settings and what became of them
+struct playerScheduling {
+    int             readerBatch;        // SCHED_BATCH rather than normal
+    int             callbackPriority;   // SCHED_FIFO priority (0 = host's)
+    const char      *readerCpus;        // CPU lists (NULL = any)
+    const char      *callbackCpus;
+    int             lockMemory;
+
+    struct schedulingResult readerPolicy;
+    struct schedulingResult readerAffinity;
+    struct schedulingResult callbackPolicy;
+    struct schedulingResult callbackAffinity;
+    struct schedulingResult memoryLock;
+    atomic_int      callbackScheduled;  // the callback has applied its own
+};
+
+// Read the settings, and lock memory if asked to (call on the main thread,
+// before starting any other)
+void initPlayerScheduling(struct playerScheduling *s);
+
+// Apply the reader's settings to the calling thread
+void scheduleReaderThread(struct playerScheduling *s);
+
+// Apply the callback's settings to the calling thread, the first time it
+// is called; call at the top of the callback
+void scheduleCallbackThread(struct playerScheduling *s);
+
+// Print the settings and whether they took effect
+void printPlayerScheduling(const struct playerScheduling *s);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerScheduling_h */
@@ -0,0 +1,403 @@
+//
+//  playerSeek.c
+//
+//  Sample-accurate seeking for the ring-buffer players.
+//
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pa_util.h>
+#include "playerSeek.h"
+#include "playerConfig.h"
+
+// Default crossfade length (ms)
+#define DEFAULT_SEEK_FADE_MS (5.0)
+
+// Pre-roll this many buffers, so that the reader has time to refill the
+// ring (which the switch has just emptied) before the pre-roll runs out
+#define PREROLL_BUFFERS (2)
+
+// Set up seeking
+int initPlayerSeek(
+    struct playerSeek *s,
+    const struct audioFileInfo *audioFile,
+    unsigned long framesPerBuffer,
+    struct refillEvent *refillEvent
+) {
+    
+    PaUtil_InitializeClock();
+    
+    memset(s, 0, sizeof(*s));
+    atomic_init(&s->target, 0);
+    atomic_init(&s->requestTime, 0.0);
+    atomic_init(&s->requested, 0);
+    atomic_init(&s->handled, 0);
+    atomic_init(&s->ready, 0);
+    atomic_init(&s->prerollTime, 0.0);
+    atomic_init(&s->done, 0);
+    atomic_init(&s->seeks, 0);
+    atomic_init(&s->switchLatency, 0.0);
+    atomic_init(&s->audibleLatency, 0.0);
+    atomic_init(&s->latencyTotal, 0.0);
+    atomic_init(&s->latencyMax, 0.0);
+    atomic_init(&s->switchMax, 0.0);
+    
+    s->refillEvent = refillEvent;
+    s->sRate = audioFile->sRate;
+    s->channels = audioFile->channels;
+    s->sampleFormat = audioFile->sampleFormat;
+    s->bytesPerFrame = audioFile->bytesPerFrame;
+    s->prerollCapacity = PREROLL_BUFFERS * framesPerBuffer;
+    
+    // the fade must be over before the pre-roll is, so that a second seek
+    // never interrupts it
+    double fadeMs = getConfigDouble("BAP_SEEK_FADE_MS", DEFAULT_SEEK_FADE_MS);
+    s->fadeFrames = fadeMs > 0.0 ? (size_t) (fadeMs * audioFile->sRate / 1e3) : 0;
+    if (s->fadeFrames > s->prerollCapacity)
+        s->fadeFrames = s->prerollCapacity;
+    s->fadeRead = s->fadeFrames; // not fading
+    s->switchOffset = SIZE_MAX;
+    s->switchAt = SIZE_MAX;
+    
+    s->preroll = malloc(s->prerollCapacity * s->bytesPerFrame);
+    s->fade = malloc((s->fadeFrames + 1) * s->bytesPerFrame);
+    s->fadeGains = malloc((s->fadeFrames + 1) * sizeof(float));
+    if (s->preroll == NULL || s->fade == NULL || s->fadeGains == NULL) {
+        freePlayerSeek(s);
+        return ERR_BAD_ALLOC;
+    }
+    
+    // raised cosine, so that the fade starts and ends smoothly; the gains of
+    // the two signals always add up to 1
+    for (size_t i = 0; i < s->fadeFrames; i++) {
+        s->fadeGains[i] =
+            (float) (0.5 - 0.5 * cos(M_PI * (i + 0.5) / s->fadeFrames));
+    }
+    
+    return NO_ERROR;
+}
+
+// Free the buffers
+void freePlayerSeek(struct playerSeek *s) {
+    
+    free(s->preroll);
+    free(s->fade);
+    free(s->fadeGains);
+    s->preroll = s->fade = NULL;
+    s->fadeGains = NULL;
+}
+
+// Ask the reader to move (any thread)
+void requestSeek(struct playerSeek *s, sf_count_t frame, double requestTime) {
+    
+    if (frame < 0)
+        frame = 0;
+    
+    atomic_store_explicit(&s->target, frame, memory_order_relaxed);
+    atomic_store_explicit(&s->requestTime, requestTime, memory_order_relaxed);
+    
+    // publishes the target; the reader takes the latest one it sees
+    atomic_fetch_add_explicit(&s->requested, 1, memory_order_release);
+    interruptRefillWait(s->refillEvent);
+}
+
+// Ask the reader to move ahead of the frame the seek is for (callback side)
+void requestHeldSeek(
+    struct playerSeek *s,
+    sf_count_t frame,
+    double requestTime
+) {
+    
+    s->held = 1;
+    requestSeek(s, frame, requestTime);
+}
+
+// Is a seek waiting for its frame? (callback side)
+int isSeekHeld(const struct playerSeek *s) {
+    
+    return s->held;
+}
+
+// Let the seek switch within this buffer (callback side)
+void releaseSeek(struct playerSeek *s, size_t offset, double dueTime) {
+    
+    s->held = 0;
+    s->switchOffset = offset;
+    s->dueTime = dueTime;
+}
+
+// Is there a seek for the reader to handle now? (reader side)
+int isSeekDue(struct playerSeek *s) {
+    
+    return atomic_load_explicit(&s->requested, memory_order_acquire) !=
+        atomic_load_explicit(&s->handled, memory_order_relaxed) &&
+        atomic_load_explicit(&s->done, memory_order_acquire) == s->published;
+}
+
+// Move the file and pre-roll it (reader side)
+sf_count_t prerollSeek(
+    struct playerSeek *s,
+    struct audioFileInfo *audioFile,
+    sf_count_t current
+) {
+    
+    unsigned int requested =
+        atomic_load_explicit(&s->requested, memory_order_acquire);
+    if (requested == atomic_load_explicit(&s->handled, memory_order_relaxed))
+        return -1;
+    
+    // the callback may still be playing the last pre-roll; it wakes us when
+    // it has finished
+    if (atomic_load_explicit(&s->done, memory_order_acquire) != s->published)
+        return -1;
+    
+    // clamped here, as the reader knows which file it is in
+    sf_count_t target = atomic_load_explicit(&s->target, memory_order_relaxed);
+    if (target > audioFile->frames)
+        target = audioFile->frames;
+    if (seekAudioFile(audioFile, target) != target) {
+        printf("Unable to seek to frame %lld\n", (long long) target);
+        seekAudioFile(audioFile, current);
+        atomic_store_explicit(&s->handled, requested, memory_order_release);
+        return -1;
+    }
+    
+    sf_count_t framesRead = readAudioFile(audioFile, s->preroll,
+        (sf_count_t) s->prerollCapacity);
+    
+    s->prerollFrames = framesRead > 0 ? (size_t) framesRead : 0;
+    s->position = target;
+    s->published = requested;
+    atomic_store_explicit(&s->prerollTime, PaUtil_GetTime() -
+        atomic_load_explicit(&s->requestTime, memory_order_relaxed),
+        memory_order_relaxed);
+    
+    return target + (sf_count_t) s->prerollFrames;
+}
+
+// Hand the pre-roll to the callback (reader side)
+void publishSeek(struct playerSeek *s, struct adaptiveRing *ar) {
+    
+    // everything written to the ring so far is from the old position
+    s->startFrame = ar->framesWritten;
+    atomic_store_explicit(&s->ready, s->published, memory_order_release);
+    atomic_store_explicit(&s->handled, s->published, memory_order_release);
+}
+
+// Note that the pre-roll has been played, and wake the reader if there is
+// another seek waiting for it (callback side)
+static void finishPreroll(struct playerSeek *s) {
+    
+    atomic_store_explicit(&s->done, s->playing, memory_order_release);
+    if (atomic_load_explicit(&s->requested, memory_order_relaxed) != s->playing)
+        interruptRefillWait(s->refillEvent);
+}
+
+// Frames of the pre-roll still to play (callback side). Once a new one is
+// published, prerollFrames is its length while the old one is still
+// playing out, so this goes by whether the old one has been finished.
+static size_t getPrerollLeft(const struct playerSeek *s) {
+    
+    if (atomic_load_explicit(&s->done, memory_order_relaxed) == s->playing)
+        return 0;
+    return s->prerollFrames - s->prerollRead;
+}
+
+// Keep the maximum of an atomic (single writer)
+static void storeMax(_Atomic double *max, double value) {
+    
+    if (value > atomic_load_explicit(max, memory_order_relaxed))
+        atomic_store_explicit(max, value, memory_order_relaxed);
+}
+
+// Switch to the new position (callback side)
+static void switchPosition(
+    struct playerSeek *s,
+    struct adaptiveRing *ar,
+    unsigned int ready,
+    double switchTime
+) {
+    
+    // keep the start of the stale frames to fade out (any shortfall fades
+    // from silence), and drop the rest
+    size_t stale = s->startFrame - ar->framesRead;
+    size_t fadeOut = readAdaptiveRing(ar, s->fade, min(stale, s->fadeFrames));
+    memset(s->fade + fadeOut * s->bytesPerFrame, 0,
+        (s->fadeFrames - fadeOut) * s->bytesPerFrame);
+    discardAdaptiveRing(ar, stale - fadeOut);
+    
+    s->playing = ready;
+    s->prerollRead = 0;
+    s->fadeRead = 0;
+    if (s->prerollFrames == 0)
+        finishPreroll(s);
+    
+    // a scheduled seek is late from when it was due, not from when it was
+    // handed to the reader
+    double requestTime = s->dueTime > 0.0 ? s->dueTime :
+        atomic_load_explicit(&s->requestTime, memory_order_relaxed);
+    s->dueTime = 0.0;
+    double switchLatency = switchTime - requestTime;
+    double audibleLatency = switchLatency + s->dacLead;
+    atomic_store_explicit(&s->switchLatency, switchLatency, memory_order_relaxed);
+    atomic_store_explicit(&s->audibleLatency, audibleLatency,
+        memory_order_relaxed);
+    atomic_store_explicit(&s->latencyTotal, audibleLatency +
+        atomic_load_explicit(&s->latencyTotal, memory_order_relaxed),
+        memory_order_relaxed);
+    storeMax(&s->latencyMax, audibleLatency);
+    storeMax(&s->switchMax, switchLatency);
+    atomic_fetch_add_explicit(&s->seeks, 1, memory_order_release);
+}
+
+// Is a seek on its way? (callback side)
+int isSeekPending(struct playerSeek *s) {
+    
+    return atomic_load_explicit(&s->requested, memory_order_relaxed) !=
+        atomic_load_explicit(&s->handled, memory_order_relaxed) ||
+        atomic_load_explicit(&s->ready, memory_order_relaxed) != s->playing;
+}
+
+// Switch if there is a new position, and count the frames (callback side)
+size_t getSeekReadAvailable(
+    struct playerSeek *s,
+    struct adaptiveRing *ar,
+    const struct callbackTiming *timing
+) {
+    
+    // count first: the reader publishes a seek before it writes any frames
+    // from the new position, so if any of them are counted here, the load
+    // below sees the seek, and otherwise reading no more than this many
+    // frames never strays past the old position
+    size_t available = getAdaptiveRingReadAvailable(ar);
+    size_t switchOffset = s->switchOffset;
+    s->switchOffset = SIZE_MAX;
+    s->dacLead = timing->dacLead > 0.0 ? timing->dacLead : 0.0;
+    
+    unsigned int ready = atomic_load_explicit(&s->ready, memory_order_acquire);
+    if (ready != s->playing) {
+        // the old audio left in the ring (the old pre-roll has been played,
+        // or the reader would not have published); a held seek plays it up
+        // to the seek's frame, and switches early only if it runs out
+        size_t stale = min(available, s->startFrame - ar->framesRead);
+        if (stale > 0 && s->held)
+            return stale;
+        if (stale > 0 && switchOffset != SIZE_MAX && switchOffset > 0) {
+            // switch on the seek's frame, in readSeek()
+            s->switchAt = min(stale, switchOffset);
+            s->switchReady = ready;
+            return s->switchAt + s->prerollFrames + available - stale;
+        }
+        switchPosition(s, ar, ready, timing->entryTime);
+        available = getAdaptiveRingReadAvailable(ar);
+    } else if (!isSeekPending(s)) {
+        s->dueTime = 0.0; // released after it switched early, or failed
+    }
+    
+    return getPrerollLeft(s) + available;
+}
+
+// Read the pre-roll, then the ring, and crossfade (callback side)
+static size_t readPlaying(
+    struct playerSeek *s,
+    struct adaptiveRing *ar,
+    unsigned char *out,
+    size_t frames
+) {
+    
+    size_t framesRead = 0;
+    
+    if (getPrerollLeft(s) > 0) {
+        framesRead = min(frames, s->prerollFrames - s->prerollRead);
+        memcpy(out, s->preroll + s->prerollRead * s->bytesPerFrame,
+            framesRead * s->bytesPerFrame);
+        s->prerollRead += framesRead;
+        if (s->prerollRead == s->prerollFrames)
+            finishPreroll(s);
+    }
+    framesRead += readAdaptiveRing(ar, out + framesRead * s->bytesPerFrame,
+        frames - framesRead);
+    
+    // the fade can run over several buffers
+    if (s->fadeRead < s->fadeFrames) {
+        size_t fadeFrames = min(framesRead, s->fadeFrames - s->fadeRead);
+        crossfadeFrames(out, s->fade + s->fadeRead * s->bytesPerFrame,
+            s->fadeGains + s->fadeRead, fadeFrames, s->channels,
+            s->sampleFormat);
+        s->fadeRead += fadeFrames;
+    }
+    
+    return framesRead;
+}
+
+// Read, switching on a scheduled seek's frame if it is in this buffer
+// (callback side)
+size_t readSeek(
+    struct playerSeek *s,
+    struct adaptiveRing *ar,
+    void *data,
+    size_t frames
+) {
+    
+    unsigned char *out = (unsigned char *) data;
+    size_t framesRead = 0;
+    
+    if (s->switchAt != SIZE_MAX) {
+        framesRead = readPlaying(s, ar, out, min(frames, s->switchAt));
+        if (framesRead == s->switchAt)
+            switchPosition(s, ar, s->switchReady, s->dueTime);
+        s->switchAt = SIZE_MAX;
+    }
+    
+    return framesRead + readPlaying(s, ar, out + framesRead * s->bytesPerFrame,
+        frames - framesRead);
+}
+
+// Print the latest seek (main thread)
+void reportSeeks(struct playerSeek *s) {
+    
+    unsigned long seeks = atomic_load_explicit(&s->seeks, memory_order_acquire);
+    if (seeks == s->reported)
+        return;
+    s->reported = seeks;
+    
+    printf("Seek to %.3f s: pre-rolled after %.2f ms, switched after %.2f ms, "
+        "audible after %.2f ms\n",
+        (double) s->position / s->sRate,
+        1e3 * atomic_load_explicit(&s->prerollTime, memory_order_relaxed),
+        1e3 * atomic_load_explicit(&s->switchLatency, memory_order_relaxed),
+        1e3 * atomic_load_explicit(&s->audibleLatency, memory_order_relaxed));
+}
+
+// Print the seek latency statistics
+void printSeekStats(const struct playerSeek *s) {
+    
+    unsigned long seeks = atomic_load_explicit(&s->seeks, memory_order_relaxed);
+    if (seeks == 0)
+        return;
+    
+    printf("Seeks: %lu, audible after %.2f ms mean, %.2f ms max "
+        "(switched after %.2f ms max)\n", seeks,
+        1e3 * atomic_load_explicit(&s->latencyTotal, memory_order_relaxed) / seeks,
+        1e3 * atomic_load_explicit(&s->latencyMax, memory_order_relaxed),
+        1e3 * atomic_load_explicit(&s->switchMax, memory_order_relaxed));
+}
+
+// Write the seek latency statistics as JSON members
+void writeSeekStatsJson(const void *seek, FILE *file) {
+    
+    const struct playerSeek *s = (const struct playerSeek *) seek;
+    
+    unsigned long seeks = atomic_load_explicit(&s->seeks, memory_order_relaxed);
+    
+    fprintf(file, "  \"seeks\": %lu,\n"
+        "  \"seekAudibleMeanMs\": %.3f,\n"
+        "  \"seekAudibleMaxMs\": %.3f,\n"
+        "  \"seekSwitchMaxMs\": %.3f", seeks,
+        seeks > 0 ? 1e3 * atomic_load_explicit(&s->latencyTotal,
+            memory_order_relaxed) / seeks : 0.0,
+        1e3 * atomic_load_explicit(&s->latencyMax, memory_order_relaxed),
+        1e3 * atomic_load_explicit(&s->switchMax, memory_order_relaxed));
+}
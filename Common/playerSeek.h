@@ -0,0 +1,184 @@
+//
+//  playerSeek.h
+//
+//  Sample-accurate seeking for the players that read the file on their own
+//  thread into an adaptive ring. Any thread can request a seek, which hands
+//  a target frame and a new generation number to the reader and wakes it.
+//  The reader moves the file to the target, reads the first couple of
+//  buffers there into a pre-roll buffer and publishes the generation along
+//  with the ring position it has written up to: everything before that
+//  position belongs to the old generation. Nothing is flushed behind the
+//  callback's back; the callback itself notices the new generation at the
+//  start of its next buffer, drops the stale frames it has not played yet
+//  (keeping a few milliseconds to fade out), and carries on from the
+//  pre-roll and then the ring, crossfading from the old audio to the new
+//  over BAP_SEEK_FADE_MS. So the first frame of the new position is played
+//  on a buffer boundary, at most one buffer after the pre-roll is ready.
+//
+//  A seek scheduled for a stream frame is requested ahead of that frame and
+//  held: the callback keeps playing the old audio until the seek is
+//  released, and then switches at the frame it names inside the buffer.
+//  If the old audio runs out first it switches early, and if the pre-roll
+//  is not ready yet it switches as soon as it is.
+//
+//  The time from the request to the switch, and to the DAC time of the
+//  first frame at the new position, is recorded for every seek.
+//
+//  BAP_SEEK_FADE_MS:   crossfade length (5 ms; 0 for a hard cut)
+//
+
+#ifndef playerSeek_h
+#define playerSeek_h
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include "audioPlayerUtil.h"
+#include "adaptiveRing.h"
+#include "refillEvent.h"
+#include "callbackTiming.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for the seek state shared by a player's threads
+struct playerSeek {
+    // written by whoever requests the seek
+    atomic_llong    target;         // frame to move to
+    _Atomic double  requestTime;    // when it was requested
+    atomic_uint     requested;      // generation requested (bumped per seek)
+
+    // written by the reader
+    atomic_uint     handled;        // last generation dealt with (or failed)
+    atomic_uint     ready;          // generation whose pre-roll is ready
+    size_t          startFrame;     // ring position where it starts
+    size_t          prerollFrames;  // frames in the pre-roll
+    sf_count_t      position;       // file position it starts at
+    _Atomic double  prerollTime;    // request to pre-roll ready (s)
+    unsigned int    published;      // last generation published
+
+    // written by the callback
+    atomic_uint     done;           // generation whose pre-roll has been played
+    unsigned int    playing;        // generation being played
+    size_t          prerollRead;    // frames of the pre-roll played so far
+    size_t          fadeRead;       // frames of the crossfade done so far
+    int             held;           // the seek requested waits for its frame
+    size_t          switchOffset;   // audio frames of this buffer before it
+    double          dueTime;        // when it is due (0: when requested)
+    size_t          switchAt;       // frames to read before the switch
+    unsigned int    switchReady;    // generation to switch to there
+    double          dacLead;        // DAC lead of this buffer
+    atomic_ulong    seeks;          // seeks completed
+    _Atomic double  switchLatency;  // request to switch, for the last seek (s)
+    _Atomic double  audibleLatency; // request to DAC time, for the last seek (s)
+    _Atomic double  latencyTotal;   // request to DAC time, summed (s)
+    _Atomic double  latencyMax;     // worst request to DAC time (s)
+    _Atomic double  switchMax;      // worst request to switch (s)
+
+    // constant after initialisation
+    struct refillEvent *refillEvent; // wakes the reader
+    int             sRate;
+    unsigned int    channels;
+    PaSampleFormat  sampleFormat;
+    size_t          bytesPerFrame;
+    size_t          prerollCapacity; // frames
+    size_t          fadeFrames;     // crossfade length
+    unsigned char   *preroll;       // audio at the new position
+    unsigned char   *fade;          // old audio to fade out
+    float           *fadeGains;     // fade-in gain per frame
+
+    // main thread only
+    unsigned long   reported;       // seeks reported so far
+};
+
+// Set up seeking in a file read in the given sample format, for a stream
+// with the given buffer size. Returns NO_ERROR or ERR_BAD_ALLOC.
+int initPlayerSeek(
+    struct playerSeek *s,
+    const struct audioFileInfo *audioFile,
+    unsigned long framesPerBuffer,
+    struct refillEvent *refillEvent
+);
+
+// Free the buffers
+void freePlayerSeek(struct playerSeek *s);
+
+// Any thread: ask the reader to move to a frame (clamped to the file it is
+// reading).
+// A newer request replaces one that has not been handled yet. requestTime
+// is when the seek was asked for (PaUtil_GetTime()), which the latencies
+// are measured from. Wait-free, so it may be called from the callback.
+void requestSeek(struct playerSeek *s, sf_count_t frame, double requestTime);
+
+// Callback side: request a seek ahead of the frame it is scheduled for, and
+// keep playing the old audio until releaseSeek()
+void requestHeldSeek(
+    struct playerSeek *s,
+    sf_count_t frame,
+    double requestTime
+);
+
+// Callback side: is a seek held back for its frame?
+int isSeekHeld(const struct playerSeek *s);
+
+// Callback side, before getSeekReadAvailable(): let the seek requested last
+// switch offset audio frames into this buffer, which is due at dueTime, or
+// as soon as it is ready if it is not ready by then
+void releaseSeek(struct playerSeek *s, size_t offset, double dueTime);
+
+// Reader side: if a seek has been requested (and the callback has finished
+// with the previous pre-roll), move the file to the target and pre-roll it.
+// Returns the file position after the pre-roll, or -1 if there was nothing
+// to do. current is the file position, restored if the seek fails.
+sf_count_t prerollSeek(
+    struct playerSeek *s,
+    struct audioFileInfo *audioFile,
+    sf_count_t current
+);
+
+// Reader side: will prerollSeek() move the file? True if a seek has been
+// requested and the callback has finished with the previous pre-roll.
+int isSeekDue(struct playerSeek *s);
+
+// Reader side: hand the pre-roll to the callback. Call after prerollSeek()
+// has returned a position, and before writing anything more to the ring.
+void publishSeek(struct playerSeek *s, struct adaptiveRing *ar);
+
+// Callback side, before reading: switch to a newly pre-rolled position if
+// there is one (or arrange to switch within this buffer), then return the
+// number of frames available (pre-roll and ring)
+size_t getSeekReadAvailable(
+    struct playerSeek *s,
+    struct adaptiveRing *ar,
+    const struct callbackTiming *timing
+);
+
+// Callback side: read frames from the pre-roll and then the ring, applying
+// the crossfade and switching where getSeekReadAvailable() arranged to.
+// Returns the number of frames read.
+size_t readSeek(
+    struct playerSeek *s,
+    struct adaptiveRing *ar,
+    void *data,
+    size_t frames
+);
+
+// Callback side: is a seek requested but not yet switched to? The stream
+// should not finish while one is.
+int isSeekPending(struct playerSeek *s);
+
+// Main thread: print the latency of any seeks completed since the last call
+void reportSeeks(struct playerSeek *s);
+
+// Print the seek latency statistics
+void printSeekStats(const struct playerSeek *s);
+
+// Write the same figures as members of a JSON object; a playerStatsWriter
+// for a struct playerSeek (see playerStats.h)
+void writeSeekStatsJson(const void *seek, FILE *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerSeek_h */
@@ -0,0 +1,150 @@
+//
+//  playerStats.c
+//
+//  Machine-readable statistics, for comparing the players.
+//
+
+#include <stdio.h>
+#include <pa_util.h>
+#include "playerConfig.h"
+#include "playerStats.h"
+#include "playerStream.h"
+
+// Start the clock
+void initPlayerStats(struct playerStats *stats) {
+    
+    PaUtil_InitializeClock();
+    
+    stats->startTime = PaUtil_GetTime();
+    atomic_init(&stats->firstSampleTime, 0.0);
+    atomic_init(&stats->firstSampleDelay, -1.0);
+    stats->writeExtra = NULL;
+    stats->extraData = NULL;
+}
+
+// Add the player's own members
+void addPlayerStats(
+    struct playerStats *stats,
+    playerStatsWriter *writer,
+    const void *data
+) {
+    
+    stats->writeExtra = writer;
+    stats->extraData = data;
+}
+
+// Note the first audio output (callback side)
+void markFirstSample(
+    struct playerStats *stats,
+    unsigned long frames,
+    const PaStreamCallbackTimeInfo *timeInfo
+) {
+    
+    // one writer, and only the first write matters
+    if (frames > 0 &&
+        atomic_load_explicit(&stats->firstSampleTime, memory_order_relaxed) == 0.0) {
+        // the buffer reaches the DAC this long after the callback (some host
+        // APIs don't give the times, leaving them 0)
+        if (timeInfo != NULL && timeInfo->outputBufferDacTime > 0.0 &&
+            timeInfo->outputBufferDacTime >= timeInfo->currentTime) {
+            atomic_store_explicit(&stats->firstSampleDelay,
+                timeInfo->outputBufferDacTime - timeInfo->currentTime,
+                memory_order_relaxed);
+        }
+        atomic_store_explicit(&stats->firstSampleTime, PaUtil_GetTime(),
+            memory_order_relaxed);
+    }
+}
+
+// Write a string as a JSON string
+static void writeJsonString(const char *str, FILE *file) {
+    
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// Write the statistics to BAP_STATS
+void writePlayerStats(
+    const struct playerStats *stats,
+    const char *player,
+    const char *fileName,
+    const struct audioFileInfo *audioFile,
+    unsigned long framesPerBuffer,
+    const struct xrunStats *xruns,
+    const struct callbackTiming *timing
+) {
+    
+    const char *statsName = getConfigString("BAP_STATS", NULL);
+    if (statsName == NULL)
+        return;
+    
+    FILE *file = fopen(statsName, "w");
+    if (file == NULL) {
+        printf("Unable to open %s for writing\n", statsName);
+        return;
+    }
+    
+    static const char *sinks[] = {"device", "null", "memory", "wav"};
+    double firstSample =
+        atomic_load_explicit(&stats->firstSampleTime, memory_order_relaxed);
+    double delay =
+        atomic_load_explicit(&stats->firstSampleDelay, memory_order_relaxed);
+    
+    fprintf(file, "{\n  \"player\": ");
+    writeJsonString(player, file);
+    fprintf(file, ",\n  \"file\": ");
+    writeJsonString(fileName, file);
+    fprintf(file, ",\n"
+        "  \"channels\": %u,\n"
+        "  \"sampleRate\": %d,\n"
+        "  \"frames\": %lld,\n"
+        "  \"fileFormat\": \"%s\",\n"
+        "  \"sampleFormat\": \"%s\",\n"
+        "  \"reader\": \"%s\",\n"
+        "  \"output\": \"%s\",\n"
+        "  \"framesPerBuffer\": %lu,\n"
+        "  \"timeToFirstSampleMs\": %.3f,\n"
+        "  \"timeToFirstAudibleSampleMs\": %.3f,\n"
+        "  \"readerCpuSeconds\": %.6f",
+        audioFile->channels,
+        audioFile->sRate,
+        (long long) audioFile->frames,
+        getSampleFormatName(audioFile->nativeFormat),
+        getSampleFormatName(audioFile->sampleFormat),
+        audioFile->mapped.map != NULL ? "mmap" :
+            audioFile->uringStream != NULL ? "uring" :
+            audioFile->readahead.active ? "readahead" : "sndfile",
+        sinks[getPlayerSink()],
+        framesPerBuffer,
+        firstSample > 0.0 ? 1e3 * (firstSample - stats->startTime) : -1.0,
+        firstSample > 0.0 && delay >= 0.0 ?
+            1e3 * (firstSample + delay - stats->startTime) : -1.0,
+        audioFile->readTime);
+    if (audioFile->readahead.requests > 0) {
+        fprintf(file, ",\n");
+        writeReadaheadStatsJson(&audioFile->readahead, file);
+    }
+    if (xruns != NULL) {
+        fprintf(file, ",\n");
+        writeXrunStatsJson(xruns, file);
+    }
+    if (timing != NULL) {
+        fprintf(file, ",\n");
+        writeCallbackTimingJson(timing, file);
+    }
+    if (stats->writeExtra != NULL) {
+        fprintf(file, ",\n");
+        stats->writeExtra(stats->extraData, file);
+    }
+    fprintf(file, "\n}\n");
+    
+    fclose(file);
+}
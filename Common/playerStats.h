@@ -0,0 +1,76 @@
+//
+//  playerStats.h
+//
+//  Machine-readable statistics, for comparing the players. When BAP_STATS
+//  names a file, each player writes a JSON object to it once it has finished
+//  playing: the file and stream it played, how long it took to hand its first
+//  audio to the stream (from the start of main()) and for that audio to be
+//  heard (adding the stream's output latency), the CPU time spent reading
+//  the file, and, where the player has them, its glitch counts and callback
+//  timing, plus anything a player adds for itself (e.g. seek latency). The
+//  arch benchmark in AudioPlayerBenchmarks runs the players with
+//  this set.
+//
+//  BAP_STATS:  file to write the statistics to (not written if unset)
+//
+
+#ifndef playerStats_h
+#define playerStats_h
+
+#include "audioPlayerUtil.h"
+#include "xrunStats.h"
+#include "callbackTiming.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Writes a player's own members of the JSON object (without a trailing comma)
+typedef void playerStatsWriter(const void *data, FILE *file);
+
+// struct type for the statistics not kept elsewhere
+struct playerStats {
+    double          startTime;          // PaUtil_GetTime() at start
+    _Atomic double  firstSampleTime;    // when audio was first output (0 = not yet)
+    _Atomic double  firstSampleDelay;   // from then until it was heard (-1 = unknown)
+    playerStatsWriter *writeExtra;      // player's own members (or NULL)
+    const void      *extraData;         // passed to writeExtra
+};
+
+// Start the clock; call first thing in main()
+void initPlayerStats(struct playerStats *stats);
+
+// Add members of the player's own to the statistics
+void addPlayerStats(
+    struct playerStats *stats,
+    playerStatsWriter *writer,
+    const void *data
+);
+
+// Called from the callback (or the blocking write loop) with the number of
+// frames of audio it has output, and the callback's timeInfo (NULL if
+// there is none), from which the time until it is heard is taken.
+// Wait-free.
+void markFirstSample(
+    struct playerStats *stats,
+    unsigned long frames,
+    const PaStreamCallbackTimeInfo *timeInfo
+);
+
+// Write the statistics to the file named by BAP_STATS, if set. xruns and
+// timing may be NULL.
+void writePlayerStats(
+    const struct playerStats *stats,
+    const char *player,
+    const char *fileName,
+    const struct audioFileInfo *audioFile,
+    unsigned long framesPerBuffer,
+    const struct xrunStats *xruns,
+    const struct callbackTiming *timing
+);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerStats_h */
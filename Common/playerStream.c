@@ -0,0 +1,438 @@
+//
+//  playerStream.c
+//
+//  Output streams for the players: PortAudio devices or offline sinks.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pa_util.h>
+#include "playerConfig.h"
+#include "playerStream.h"
+#include "sampleFormat.h"
+
+// Prefix of BAP_OUTPUT values that name a WAV file
+#define WAV_SINK_PREFIX "wav:"
+
+// Where output is going (from BAP_OUTPUT)
+PlayerSink getPlayerSink(void) {
+    
+    const char *output = getConfigString("BAP_OUTPUT", "device");
+    
+    if (strcmp(output, "null") == 0)
+        return SINK_NULL;
+    else if (strcmp(output, "memory") == 0)
+        return SINK_MEMORY;
+    else if (strncmp(output, WAV_SINK_PREFIX, strlen(WAV_SINK_PREFIX)) == 0)
+        return SINK_WAV;
+    else
+        return SINK_DEVICE;
+}
+
+// How fast to run the virtual clock (multiple of real time; 0 = unpaced)
+static double getRenderSpeed(void) {
+    
+    const char *speed = getConfigString("BAP_RENDER_SPEED", "fast");
+    
+    if (strcmp(speed, "fast") == 0)
+        return 0.0;
+    else if (strcmp(speed, "realtime") == 0)
+        return 1.0;
+    else
+        return getConfigDouble("BAP_RENDER_SPEED", 0.0);
+}
+
+// Wait until the wall clock reaches the given time (PaUtil_GetTime() base)
+static void sleepUntil(double when) {
+    
+    double delay = when - PaUtil_GetTime();
+    
+    if (delay > 0.0) {
+        struct timespec ts = {
+            .tv_sec = (time_t) delay,
+            .tv_nsec = (long) ((delay - (time_t) delay) * 1e9)
+        };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// Pass a block of output to the sink; returns paNoError or an error code
+static PaError writeToSink(
+    struct offlineStream *s,
+    const void *buffer,
+    unsigned long frames
+) {
+    
+    size_t bytes = frames * s->bytesPerFrame;
+    sf_count_t written = (sf_count_t) frames;
+    
+    switch (s->sink) {
+        case SINK_MEMORY:
+            if (s->memoryUsed + bytes > s->memoryCapacity) {
+                // grow geometrically
+                size_t capacity = s->memoryCapacity ? s->memoryCapacity : bytes;
+                while (capacity < s->memoryUsed + bytes)
+                    capacity *= 2;
+                unsigned char *memory = realloc(s->memory, capacity);
+                if (memory == NULL)
+                    return paInsufficientMemory;
+                s->memory = memory;
+                s->memoryCapacity = capacity;
+            }
+            memcpy(s->memory + s->memoryUsed, buffer, bytes);
+            s->memoryUsed += bytes;
+            break;
+        case SINK_WAV:
+            switch (s->sampleFormat) {
+                case paFloat32:
+                    written = sf_writef_float(s->wavFile, buffer, frames);
+                    break;
+                case paInt16:
+                    written = sf_writef_short(s->wavFile, buffer, frames);
+                    break;
+                case paInt32:
+                    written = sf_writef_int(s->wavFile, buffer, frames);
+                    break;
+                case paInt24:
+                    // packed 24-bit samples are already in WAV's layout
+                    // (on little-endian hosts)
+                    written = sf_write_raw(s->wavFile, buffer, (sf_count_t)
+                        bytes) / (sf_count_t) s->bytesPerFrame;
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+    
+    return written == (sf_count_t) frames ? paNoError : paInternalError;
+}
+
+// Interleave frames of a paNonInterleaved stream's output, from offset
+// frames into each channel's buffer, into the stream's buffer
+static void interleavePlanes(
+    struct offlineStream *s,
+    const void *const *planes,
+    unsigned long offset,
+    unsigned long frames
+) {
+    
+    size_t sampleSize = getSampleSize(s->sampleFormat);
+    
+    for (int c = 0; c < s->channels; c++) {
+        const unsigned char *in =
+            (const unsigned char *) planes[c] + offset * sampleSize;
+        unsigned char *out = s->buffer + c * sampleSize;
+        for (unsigned long f = 0; f < frames; f++) {
+            memcpy(out, in, sampleSize);
+            in += sampleSize;
+            out += s->bytesPerFrame;
+        }
+    }
+}
+
+// Drive the stream callback from the virtual clock
+static void* renderThread(void *data) {
+    
+    struct offlineStream *s = (struct offlineStream *) data;
+    PaStreamCallbackTimeInfo timeInfo = {0};
+    int result = paContinue;
+    
+    while (result == paContinue && !atomic_load(&s->stopRequested)) {
+        double now = s->framesRendered / s->sampleRate;
+    
+        // pace the clock, or if unpaced, let a woken reader run first
+        if (s->speed > 0.0)
+            sleepUntil(s->startTime + now / s->speed);
+        else
+            sched_yield();
+    
+        // virtual time: the block is "played" one buffer after it is made
+        timeInfo.currentTime = now;
+        timeInfo.outputBufferDacTime = now + s->framesPerBuffer / s->sampleRate;
+        timeInfo.inputBufferAdcTime = 0.0;
+    
+        // PortAudio doesn't clear the buffer, but clearing it here keeps the
+        // rendered output deterministic
+        memset(s->planar ? s->planes[0] : (void *) s->buffer, 0,
+            s->framesPerBuffer * s->bytesPerFrame);
+        double callbackStart = PaUtil_GetTime();
+        result = s->callback(
+            NULL,
+            s->planar ? (void *) s->planes : (void *) s->buffer,
+            s->framesPerBuffer,
+            &timeInfo,
+            0,
+            s->userData
+        );
+        s->callbackTime += PaUtil_GetTime() - callbackStart;
+    
+        // like PortAudio, output from the final (paComplete) callback is
+        // played, whereas paAbort discards it
+        if (result != paAbort) {
+            if (s->planar)
+                interleavePlanes(s, (const void *const *) s->planes, 0,
+                    s->framesPerBuffer);
+            if (writeToSink(s, s->buffer, s->framesPerBuffer) != paNoError)
+                break;
+            s->framesRendered += s->framesPerBuffer;
+        }
+    
+        // like Pa_GetStreamCpuLoad(): the fraction of the audio's duration
+        // spent in the callback
+        if (s->framesRendered > 0) {
+            atomic_store_explicit(&s->cpuLoad, s->callbackTime /
+                (s->framesRendered / s->sampleRate), memory_order_relaxed);
+        }
+    }
+    
+    s->renderTime = PaUtil_GetTime() - s->startTime;
+    atomic_store(&s->active, 0);
+    
+    return NULL;
+}
+
+// Open a stream
+PaError openPlayerStream(
+    PaStream **stream,
+    const PaStreamParameters *inputParameters,
+    const PaStreamParameters *outputParameters,
+    double sampleRate,
+    unsigned long framesPerBuffer,
+    PaStreamFlags streamFlags,
+    PaStreamCallback *streamCallback,
+    void *userData
+) {
+    
+    PlayerSink sink = getPlayerSink();
+    
+    if (sink == SINK_DEVICE) {
+        return Pa_OpenStream(stream, inputParameters, outputParameters,
+            sampleRate, framesPerBuffer, streamFlags, streamCallback, userData);
+    }
+    
+    // offline streams only produce output
+    if (inputParameters != NULL || outputParameters == NULL)
+        return paInvalidDevice;
+    if (outputParameters->channelCount < 1 ||
+        outputParameters->channelCount > OFFLINE_MAX_CHANNELS)
+        return paInvalidChannelCount;
+    PaSampleFormat format = outputParameters->sampleFormat & ~paNonInterleaved;
+    if (getSampleSize(format) == 0)
+        return paSampleFormatNotSupported;
+    if (sampleRate <= 0.0)
+        return paInvalidSampleRate;
+    
+    struct offlineStream *s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return paInsufficientMemory;
+    
+    PaUtil_InitializeClock();
+    
+    s->callback = streamCallback;
+    s->userData = userData;
+    s->channels = outputParameters->channelCount;
+    s->sampleFormat = format;
+    s->planar = (outputParameters->sampleFormat & paNonInterleaved) != 0;
+    s->bytesPerFrame = s->channels * getSampleSize(s->sampleFormat);
+    s->sampleRate = sampleRate;
+    s->framesPerBuffer = framesPerBuffer != paFramesPerBufferUnspecified ?
+        framesPerBuffer : OFFLINE_FRAMES_PER_BUFFER;
+    s->speed = getRenderSpeed();
+    s->sink = sink;
+    atomic_init(&s->active, 0);
+    atomic_init(&s->stopRequested, 0);
+    atomic_init(&s->cpuLoad, 0.0);
+    
+    s->buffer = malloc(s->framesPerBuffer * s->bytesPerFrame);
+    if (s->buffer == NULL) {
+        free(s);
+        return paInsufficientMemory;
+    }
+    
+    // a callback given one buffer per channel: the channels of a callback's
+    // worth, one after the other
+    if (s->planar && streamCallback != NULL) {
+        s->planes = malloc(sizeof(void *) * s->channels);
+        unsigned char *planeData =
+            malloc(s->framesPerBuffer * s->bytesPerFrame);
+        if (s->planes == NULL || planeData == NULL) {
+            free(planeData);
+            free(s->planes);
+            free(s->buffer);
+            free(s);
+            return paInsufficientMemory;
+        }
+        for (int c = 0; c < s->channels; c++)
+            s->planes[c] = planeData + c * s->framesPerBuffer *
+                getSampleSize(format);
+    }
+    
+    if (sink == SINK_WAV) {
+        // write the file in the stream's own sample format
+        SF_INFO sfinfo = {
+            .samplerate = (int) sampleRate,
+            .channels = s->channels,
+            .format = SF_FORMAT_WAV |
+                (s->sampleFormat == paFloat32 ? SF_FORMAT_FLOAT :
+                 s->sampleFormat == paInt16 ? SF_FORMAT_PCM_16 :
+                 s->sampleFormat == paInt24 ? SF_FORMAT_PCM_24 :
+                 SF_FORMAT_PCM_32)
+        };
+        const char *fileName = getConfigString("BAP_OUTPUT", "") +
+            strlen(WAV_SINK_PREFIX);
+        s->wavFile = sf_open(fileName, SFM_WRITE, &sfinfo);
+        if (s->wavFile == NULL) {
+            printf("Unable to open %s for writing\n", fileName);
+            if (s->planes != NULL)
+                free(s->planes[0]);
+            free(s->planes);
+            free(s->buffer);
+            free(s);
+            return paInvalidDevice;
+        }
+    }
+    
+    *stream = (PaStream *) s;
+    
+    return paNoError;
+}
+
+// Start a stream
+PaError startPlayerStream(PaStream *stream) {
+    
+    if (getPlayerSink() == SINK_DEVICE)
+        return Pa_StartStream(stream);
+    
+    struct offlineStream *s = (struct offlineStream *) stream;
+    
+    s->startTime = PaUtil_GetTime();
+    atomic_store(&s->active, 1);
+    
+    // blocking streams are driven by writePlayerStream()
+    if (s->callback == NULL)
+        return paNoError;
+    
+    if (pthread_create(&s->thread, NULL, renderThread, s) != 0) {
+        atomic_store(&s->active, 0);
+        return paUnanticipatedHostError;
+    }
+    s->threadStarted = 1;
+    
+    return paNoError;
+}
+
+// Check whether a stream is still playing
+PaError isPlayerStreamActive(PaStream *stream) {
+    
+    if (getPlayerSink() == SINK_DEVICE)
+        return Pa_IsStreamActive(stream);
+    
+    return atomic_load(&((struct offlineStream *) stream)->active);
+}
+
+// Write to a blocking stream
+PaError writePlayerStream(
+    PaStream *stream,
+    const void *buffer,
+    unsigned long frames
+) {
+    
+    if (getPlayerSink() == SINK_DEVICE)
+        return Pa_WriteStream(stream, buffer, frames);
+    
+    struct offlineStream *s = (struct offlineStream *) stream;
+    
+    if (s->callback != NULL)
+        return paCanNotWriteToACallbackStream;
+    if (!atomic_load(&s->active))
+        return paStreamIsStopped;
+    
+    // a real device would block until the previous block had been played
+    if (s->speed > 0.0)
+        sleepUntil(s->startTime + s->framesRendered / s->sampleRate / s->speed);
+    
+    PaError err = paNoError;
+    if (s->planar) {
+        // a buffer per channel: interleave a block at a time
+        for (unsigned long done = 0; done < frames && !err;
+            done += s->framesPerBuffer) {
+            unsigned long n = frames - done < s->framesPerBuffer ?
+                frames - done : s->framesPerBuffer;
+            interleavePlanes(s, (const void *const *) buffer, done, n);
+            err = writeToSink(s, s->buffer, n);
+        }
+    }
+    else
+        err = writeToSink(s, buffer, frames);
+    s->framesRendered += frames;
+    s->renderTime = PaUtil_GetTime() - s->startTime;
+    
+    return err;
+}
+
+// Get the fraction of the available time spent in the callback
+double getPlayerStreamCpuLoad(PaStream *stream) {
+    
+    if (getPlayerSink() == SINK_DEVICE)
+        return Pa_GetStreamCpuLoad(stream);
+    
+    return atomic_load_explicit(&((struct offlineStream *) stream)->cpuLoad,
+        memory_order_relaxed);
+}
+
+// For offline streams rendered to memory: get the rendered audio
+size_t getOfflineRender(PaStream *stream, const void **data) {
+    
+    if (getPlayerSink() != SINK_MEMORY) {
+        *data = NULL;
+        return 0;
+    }
+    
+    struct offlineStream *s = (struct offlineStream *) stream;
+    *data = s->memory;
+    
+    return s->memoryUsed / s->bytesPerFrame;
+}
+
+// Close a stream
+PaError closePlayerStream(PaStream *stream) {
+    
+    if (getPlayerSink() == SINK_DEVICE)
+        return Pa_CloseStream(stream);
+    
+    struct offlineStream *s = (struct offlineStream *) stream;
+    
+    // stop rendering
+    atomic_store(&s->stopRequested, 1);
+    if (s->threadStarted)
+        pthread_join(s->thread, NULL);
+    
+    // report what was rendered
+    double seconds = s->framesRendered / s->sampleRate;
+    printf("Rendered %llu frames (%.3f s of audio) in %.3f s (%.1fx real time)\n",
+        s->framesRendered, seconds, s->renderTime,
+        s->renderTime > 0.0 ? seconds / s->renderTime : 0.0);
+    if (s->sink == SINK_MEMORY) {
+        // FNV-1a hash of the output, for comparing renders
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < s->memoryUsed; i++)
+            hash = (hash ^ s->memory[i]) * 1099511628211ULL;
+        printf("Output checksum: %016llx\n", hash);
+    }
+    
+    // put the toys away
+    if (s->wavFile != NULL)
+        sf_close(s->wavFile);
+    free(s->memory);
+    free(s->buffer);
+    if (s->planes != NULL)
+        free(s->planes[0]);
+    free(s->planes);
+    free(s);
+    
+    return paNoError;
+}
@@ -0,0 +1,108 @@
+//
+//  playerStream.h
+//
+//  Output streams for the players. By default these are thin wrappers around
+//  the PortAudio stream functions. When BAP_OUTPUT names an offline sink, no
+//  audio device is used: the stream callback is driven from a virtual clock
+//  (in real time, or as fast as possible) and the output is written to
+//  memory, to a WAV file, or nowhere. This allows the players to be profiled
+//  and regression-tested on machines without audio hardware.
+//
+//  BAP_OUTPUT:         device (default), null, memory or wav:<file name>
+//  BAP_RENDER_SPEED:   fast (default), realtime, or a multiple of real time
+//                      (offline sinks only)
+//
+
+#ifndef playerStream_h
+#define playerStream_h
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <portaudio.h>
+#include <sndfile.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Most channels an offline sink will accept
+#define OFFLINE_MAX_CHANNELS (256)
+
+// Block size used when the caller leaves it to the stream
+#define OFFLINE_FRAMES_PER_BUFFER (512)
+
+// Type to identify where the output goes
+typedef enum {
+    SINK_DEVICE,    // a PortAudio device
+    SINK_NULL,      // discarded
+    SINK_MEMORY,    // kept in memory
+    SINK_WAV        // written to a WAV file
+} PlayerSink;
+
+// struct type for an offline (device-less) stream
+struct offlineStream {
+    PaStreamCallback    *callback;          // NULL for blocking streams
+    void                *userData;
+    int                 channels;
+    PaSampleFormat      sampleFormat;       // without paNonInterleaved
+    int                 planar;             // paNonInterleaved?
+    size_t              bytesPerFrame;
+    double              sampleRate;
+    unsigned long       framesPerBuffer;
+    double              speed;              // multiple of real time (0 = unpaced)
+
+    PlayerSink          sink;
+    SNDFILE             *wavFile;           // SINK_WAV
+    unsigned char       *memory;            // SINK_MEMORY
+    size_t              memoryCapacity;     // bytes allocated
+    size_t              memoryUsed;         // bytes written
+
+    unsigned char       *buffer;            // one callback's worth of output
+    void                **planes;           // planar callback's buffers
+    unsigned long long  framesRendered;     // virtual clock, in frames
+    double              startTime;          // wall clock at start (s)
+    double              renderTime;         // wall clock time spent (s)
+    double              callbackTime;       // time spent in the callback (s)
+    _Atomic double      cpuLoad;            // callbackTime / audio rendered
+
+    pthread_t           thread;
+    int                 threadStarted;
+    atomic_int          active;
+    atomic_int          stopRequested;
+};
+
+// Where output is going (from BAP_OUTPUT)
+PlayerSink getPlayerSink(void);
+
+// Open a stream; takes the same arguments as Pa_OpenStream()
+PaError openPlayerStream(
+    PaStream **stream,
+    const PaStreamParameters *inputParameters,
+    const PaStreamParameters *outputParameters,
+    double sampleRate,
+    unsigned long framesPerBuffer,
+    PaStreamFlags streamFlags,
+    PaStreamCallback *streamCallback,
+    void *userData
+);
+
+// Counterparts of Pa_StartStream(), Pa_IsStreamActive(), Pa_WriteStream(),
+// Pa_GetStreamCpuLoad() and Pa_CloseStream()
+PaError startPlayerStream(PaStream *stream);
+PaError isPlayerStreamActive(PaStream *stream);
+PaError writePlayerStream(
+    PaStream *stream,
+    const void *buffer,
+    unsigned long frames
+);
+double getPlayerStreamCpuLoad(PaStream *stream);
+PaError closePlayerStream(PaStream *stream);
+
+// For offline streams rendered to memory: get the rendered audio
+size_t getOfflineRender(PaStream *stream, const void **data);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerStream_h */
@@ -0,0 +1,480 @@
+//
+//  playerTransport.c
+//
+//  Play, pause, stop, gain and seek while the stream runs.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "playerTransport.h"
+#include "playerConfig.h"
+#include "audioKernels.h"
+
+// Default ramp length (ms)
+#define DEFAULT_RAMP_MS (2.0)
+
+// Request a scheduled seek this long before the buffer it falls in, so that
+// the reader has pre-rolled it by then (ms)
+#define SEEK_LEAD_MS (20.0)
+
+// Set up the transport
+int initPlayerTransport(
+    struct playerTransport *t,
+    const struct audioFileInfo *audioFile,
+    unsigned long framesPerBuffer,
+    struct playerSeek *seek
+) {
+    
+    memset(t, 0, sizeof(*t));
+    initCommandQueue(&t->queue);
+    atomic_init(&t->framesOutput, 0);
+    atomic_init(&t->applied, 0);
+    atomic_init(&t->measured, 0);
+    atomic_init(&t->lastType, CMD_PLAY);
+    atomic_init(&t->lastLatency, 0.0);
+    atomic_init(&t->latencyTotal, 0.0);
+    atomic_init(&t->latencyMax, 0.0);
+    
+    t->state.userGain = t->state.gain = t->state.target = 1.0;
+    t->state.fading = -1;
+    
+    t->seek = seek;
+    t->sRate = audioFile->sRate;
+    t->channels = audioFile->channels;
+    t->sampleFormat = audioFile->sampleFormat;
+    t->bytesPerFrame = audioFile->bytesPerFrame;
+    t->maxFrames = framesPerBuffer;
+    double rampMs = getConfigDouble("BAP_RAMP_MS", DEFAULT_RAMP_MS);
+    t->rampFrames = rampMs > 0.0 ? (size_t) (rampMs * audioFile->sRate / 1e3) : 0;
+    t->seekLead = (size_t) (SEEK_LEAD_MS * audioFile->sRate / 1e3);
+    
+    t->scratch = malloc(t->maxFrames * t->bytesPerFrame);
+    
+    // choose the kernels for the gain ramps now, not in the callback
+    getAudioKernels();
+    
+    return t->scratch == NULL ? ERR_BAD_ALLOC : NO_ERROR;
+}
+
+// Free the scratch buffer
+void freePlayerTransport(struct playerTransport *t) {
+    
+    free(t->scratch);
+    t->scratch = NULL;
+}
+
+// Name of a command
+const char* getCommandName(playerCommandType type) {
+    
+    switch (type) {
+        case CMD_PLAY:
+            return "play";
+        case CMD_PAUSE:
+            return "pause";
+        case CMD_STOP:
+            return "stop";
+        case CMD_GAIN:
+            return "gain";
+        case CMD_SEEK:
+            return "seek";
+        default:
+            return "unknown";
+    }
+}
+
+// Post a command (producer side)
+int postTransportCommand(
+    struct playerTransport *t,
+    playerCommandType type,
+    double value,
+    unsigned long long frame
+) {
+    
+    struct playerCommand command = {
+        .type = type,
+        .value = value,
+        .frame = frame
+    };
+    
+    return postCommand(&t->queue, &command);
+}
+
+// Frames output so far (any thread)
+unsigned long long getTransportFrame(struct playerTransport *t) {
+    
+    return atomic_load_explicit(&t->framesOutput, memory_order_relaxed);
+}
+
+// Finish a ramp
+static void endRamp(struct transportState *st) {
+    
+    st->gain = st->target;
+    st->rampLeft = 0;
+    if (st->fading == CMD_PAUSE)
+        st->paused = 1;
+    else if (st->fading == CMD_STOP)
+        st->stopped = 1;
+    st->fading = -1;
+}
+
+// Start ramping to a gain; fading is what the ramp ends in (or -1)
+static void startRamp(
+    const struct playerTransport *t,
+    struct transportState *st,
+    double target,
+    int fading
+) {
+    
+    st->target = target;
+    st->fading = fading;
+    st->rampLeft = t->rampFrames;
+    if (st->rampLeft == 0)
+        endRamp(st);
+    else
+        st->step = (target - st->gain) / st->rampLeft;
+}
+
+// Apply a command to the state
+static void applyEvent(
+    const struct playerTransport *t,
+    struct transportState *st,
+    const struct transportEvent *ev
+) {
+    
+    if (st->stopped || st->fading == CMD_STOP)
+        return; // nothing undoes a stop
+    
+    switch (ev->type) {
+        case CMD_GAIN:
+            // a pause keeps the new gain until it is resumed
+            st->userGain = ev->value;
+            if (!st->paused && st->fading != CMD_PAUSE)
+                startRamp(t, st, ev->value, -1);
+            break;
+        case CMD_PAUSE:
+            if (!st->paused && st->fading != CMD_PAUSE)
+                startRamp(t, st, 0.0, CMD_PAUSE);
+            break;
+        case CMD_PLAY:
+            if (st->paused || st->fading == CMD_PAUSE) {
+                st->paused = 0;
+                startRamp(t, st, st->userGain, -1);
+            }
+            break;
+        case CMD_STOP:
+            if (st->paused)
+                st->stopped = 1;
+            else
+                startRamp(t, st, 0.0, CMD_STOP);
+            break;
+        default:
+            break;
+    }
+}
+
+// Run the state through the current buffer and its events, putting the
+// audio (from in, which holds up to available frames) in the output (out)
+// with the gain applied. With out NULL, only counts the frames of audio
+// consumed. Returns that number.
+static size_t runBuffer(
+    const struct playerTransport *t,
+    struct transportState *st,
+    void *out,
+    const void *in,
+    size_t available,
+    size_t frames
+) {
+    
+    unsigned char *o = (unsigned char *) out;
+    const unsigned char *i = (const unsigned char *) in;
+    size_t bytesPerFrame = t->bytesPerFrame;
+    size_t f = 0, consumed = 0, e = 0;
+    
+    while (f < frames) {
+        // apply the events due on this frame
+        while (e < t->numEvents && t->events[e].offset <= f)
+            applyEvent(t, st, &t->events[e++]);
+    
+        // run on to the next event or the end of the ramp
+        size_t end = e < t->numEvents ? t->events[e].offset : frames;
+        if (st->rampLeft > 0 && f + st->rampLeft < end)
+            end = f + st->rampLeft;
+        size_t n = end - f;
+    
+        if (st->paused || st->stopped) {
+            if (o != NULL)
+                memset(o + f * bytesPerFrame, 0, n * bytesPerFrame);
+        }
+        else {
+            if (o != NULL) {
+                // anything beyond the audio provided is silent
+                size_t m = consumed < available ? min(n, available - consumed) : 0;
+                if (st->rampLeft == 0 && st->gain == 1.0) {
+                    if (o + f * bytesPerFrame != i + consumed * bytesPerFrame)
+                        memmove(o + f * bytesPerFrame,
+                            i + consumed * bytesPerFrame, m * bytesPerFrame);
+                }
+                else {
+                    scaleFrames(o + f * bytesPerFrame,
+                        i + consumed * bytesPerFrame, m, t->channels,
+                        t->sampleFormat, st->gain,
+                        st->rampLeft > 0 ? st->step : 0.0);
+                }
+                memset(o + (f + m) * bytesPerFrame, 0, (n - m) * bytesPerFrame);
+            }
+            consumed += n;
+            if (st->rampLeft > 0) {
+                st->gain += st->step * n;
+                st->rampLeft -= n;
+                if (st->rampLeft == 0)
+                    endRamp(st);
+            }
+        }
+        f = end;
+    }
+    
+    return consumed;
+}
+
+// Does the whole buffer play? Then the audio can go straight into the output
+// buffer, and any gain is applied in place.
+static int isDirect(const struct playerTransport *t) {
+    
+    return t->numEvents == 0 && !t->state.paused && !t->state.stopped &&
+        t->state.fading == -1;
+}
+
+// Keep the maximum of an atomic (single writer)
+static void storeMax(_Atomic double *max, double value) {
+    
+    if (value > atomic_load_explicit(max, memory_order_relaxed))
+        atomic_store_explicit(max, value, memory_order_relaxed);
+}
+
+// Move the posted commands into the pending list, keeping it ordered by
+// frame (and in posting order for the same frame)
+static void takeCommands(struct playerTransport *t) {
+    
+    const struct playerCommand *command;
+    
+    while (t->numPending < COMMAND_QUEUE_SIZE &&
+        (command = peekCommand(&t->queue)) != NULL) {
+        size_t p = t->numPending;
+        while (p > 0 && t->pending[p - 1].frame > command->frame) {
+            t->pending[p] = t->pending[p - 1];
+            p--;
+        }
+        t->pending[p] = *command;
+        t->pending[p].held = 0;
+        t->numPending++;
+        popCommand(&t->queue);
+    }
+}
+
+// Record the latency of a command applied (callback side)
+static void recordCommand(
+    struct playerTransport *t,
+    playerCommandType type,
+    double latency,
+    int scheduled
+) {
+    
+    atomic_store_explicit(&t->lastType, type, memory_order_relaxed);
+    atomic_store_explicit(&t->lastLatency, scheduled ? -1.0 : latency,
+        memory_order_relaxed);
+    if (!scheduled) {
+        atomic_store_explicit(&t->latencyTotal, latency +
+            atomic_load_explicit(&t->latencyTotal, memory_order_relaxed),
+            memory_order_relaxed);
+        storeMax(&t->latencyMax, latency);
+        atomic_fetch_add_explicit(&t->measured, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&t->applied, 1, memory_order_release);
+}
+
+// Request the next scheduled seek ahead of the buffer it falls in, and hold
+// it until its frame (callback side). One is held at a time.
+static void requestSeekAhead(
+    struct playerTransport *t,
+    size_t frames,
+    const struct callbackTiming *timing
+) {
+    
+    if (t->seek == NULL)
+        return;
+    for (size_t p = 0; p < t->numPending; p++) {
+        if (t->pending[p].held)
+            return;
+    }
+    
+    for (size_t p = 0; p < t->numPending &&
+        t->pending[p].frame < t->streamFrame + frames + t->seekLead; p++) {
+        struct playerCommand *command = &t->pending[p];
+        if (command->type == CMD_SEEK && !command->held &&
+            command->frame >= t->streamFrame + frames) {
+            requestHeldSeek(t->seek,
+                (sf_count_t) (command->value * t->sRate + 0.5),
+                timing->entryTime);
+            command->held = 1;
+            return;
+        }
+    }
+}
+
+// Take the commands due in this buffer (callback side)
+size_t beginTransport(
+    struct playerTransport *t,
+    size_t frames,
+    const struct callbackTiming *timing
+) {
+    
+    double dacTime = timing->entryTime +
+        (timing->dacLead > 0.0 ? timing->dacLead : 0.0);
+    size_t taken = 0;
+    
+    takeCommands(t);
+    requestSeekAhead(t, frames, timing);
+    
+    t->numEvents = 0;
+    while (taken < t->numPending && t->numEvents < MAX_TRANSPORT_EVENTS &&
+        t->pending[taken].frame < t->streamFrame + frames) {
+        const struct playerCommand *command = &t->pending[taken++];
+        int scheduled = command->frame > t->streamFrame;
+        size_t offset = scheduled ?
+            (size_t) (command->frame - t->streamFrame) : 0;
+    
+        if (command->type == CMD_SEEK) {
+            // the reader does the work, and the seek records its own
+            // latency: from when it was posted, or from when it fell due.
+            // It switches after the audio the buffer consumes before its
+            // frame (with the events so far), or when it is ready if later.
+            if (t->seek != NULL) {
+                double dueTime = scheduled ?
+                    timing->entryTime + (double) offset / t->sRate :
+                    command->postTime;
+                struct transportState st = t->state;
+                size_t audioOffset = runBuffer(t, &st, NULL, NULL, 0, offset);
+                // requested again if a later seek has released the hold
+                if (!command->held || !isSeekHeld(t->seek)) {
+                    requestSeek(t->seek,
+                        (sf_count_t) (command->value * t->sRate + 0.5),
+                        dueTime);
+                }
+                releaseSeek(t->seek, audioOffset, dueTime);
+            }
+            continue;
+        }
+    
+        struct transportEvent *ev = &t->events[t->numEvents++];
+        ev->offset = offset;
+        ev->type = command->type;
+        ev->value = command->value;
+    
+        // the command is heard when its frame reaches the DAC
+        recordCommand(t, command->type, dacTime - command->postTime, scheduled);
+    }
+    
+    // drop the commands taken from the pending list
+    t->numPending -= taken;
+    memmove(t->pending, t->pending + taken,
+        t->numPending * sizeof(t->pending[0]));
+    
+    if (isDirect(t)) {
+        t->audioFrames = frames;
+        return frames;
+    }
+    
+    // otherwise run a copy of the state through the buffer to count the
+    // frames it will consume (no more than the scratch buffer holds)
+    struct transportState st = t->state;
+    size_t wanted = runBuffer(t, &st, NULL, NULL, 0, frames);
+    t->audioFrames = min(wanted, t->maxFrames);
+    
+    return t->audioFrames;
+}
+
+// Where to read the audio (callback side)
+void* getTransportAudio(struct playerTransport *t, void *outputBuffer) {
+    
+    if (isDirect(t))
+        return outputBuffer;
+    
+    return t->scratch;
+}
+
+// Put the audio in the output (callback side)
+void endTransport(
+    struct playerTransport *t,
+    void *outputBuffer,
+    const void *audio,
+    size_t frames
+) {
+    
+    runBuffer(t, &t->state, outputBuffer, audio, t->audioFrames, frames);
+    
+    t->streamFrame += frames;
+    atomic_store_explicit(&t->framesOutput, t->streamFrame,
+        memory_order_relaxed);
+}
+
+// Has a stop finished? (callback side)
+int isTransportStopped(struct playerTransport *t) {
+    
+    return t->state.stopped;
+}
+
+// Print the latest command (main thread)
+void reportTransport(struct playerTransport *t) {
+    
+    unsigned long applied =
+        atomic_load_explicit(&t->applied, memory_order_acquire);
+    if (applied == t->reported)
+        return;
+    t->reported = applied;
+    
+    const char *name =
+        getCommandName(atomic_load_explicit(&t->lastType, memory_order_relaxed));
+    double latency = atomic_load_explicit(&t->lastLatency, memory_order_relaxed);
+    if (latency < 0.0)
+        printf("Command %s: applied on its frame\n", name);
+    else
+        printf("Command %s: audible after %.2f ms\n", name, 1e3 * latency);
+}
+
+// Print the command latency statistics
+void printTransportStats(const struct playerTransport *t) {
+    
+    unsigned long applied =
+        atomic_load_explicit(&t->applied, memory_order_relaxed);
+    unsigned long measured =
+        atomic_load_explicit(&t->measured, memory_order_relaxed);
+    if (applied == 0)
+        return;
+    
+    printf("Commands: %lu (%lu scheduled)", applied, applied - measured);
+    if (measured > 0) {
+        printf(", audible after %.2f ms mean, %.2f ms max",
+            1e3 * atomic_load_explicit(&t->latencyTotal, memory_order_relaxed) /
+                measured,
+            1e3 * atomic_load_explicit(&t->latencyMax, memory_order_relaxed));
+    }
+    printf("\n");
+}
+
+// Write the command latency statistics as JSON members
+void writeTransportStatsJson(const void *transport, FILE *file) {
+    
+    const struct playerTransport *t = (const struct playerTransport *) transport;
+    unsigned long applied =
+        atomic_load_explicit(&t->applied, memory_order_relaxed);
+    unsigned long measured =
+        atomic_load_explicit(&t->measured, memory_order_relaxed);
+    
+    fprintf(file, "  \"commands\": %lu,\n"
+        "  \"scheduledCommands\": %lu,\n"
+        "  \"commandAudibleMeanMs\": %.3f,\n"
+        "  \"commandAudibleMaxMs\": %.3f", applied, applied - measured,
+        measured > 0 ? 1e3 * atomic_load_explicit(&t->latencyTotal,
+            memory_order_relaxed) / measured : 0.0,
+        1e3 * atomic_load_explicit(&t->latencyMax, memory_order_relaxed));
+}
@@ -0,0 +1,167 @@
+//
+//  playerTransport.h
+//
+//  Play, pause, stop, gain and seek while the stream runs. Commands are
+//  posted to a wait-free queue (commandQueue.h) and the callback takes
+//  those that are due at the top of each buffer. Each command carries the
+//  stream frame it applies at (frames output since the stream started), so
+//  it takes effect on that exact frame, wherever it falls in the buffer;
+//  a command without one applies at the start of the next buffer. Gain
+//  changes, pauses and stops start a short linear ramp on their frame, so
+//  they never click. While paused the callback outputs silence without
+//  reading the ring, and the stream itself is left running, so resuming
+//  is immediate. A seek is handed on to the reader (playerSeek.h); one
+//  scheduled for a frame is requested a little ahead of its buffer and
+//  held, so that the switch to the new position lands on that frame too.
+//
+//  The callback moves everything posted into a list of pending commands,
+//  ordered by frame, so a command scheduled well ahead does not hold up
+//  the ones posted after it. For each command that applies at once the
+//  latency from posting it to the DAC time of its first frame is recorded
+//  (a scheduled command applies on its frame by construction).
+//
+//  BAP_RAMP_MS:    length of the gain, pause and stop ramps (2 ms)
+//
+
+#ifndef playerTransport_h
+#define playerTransport_h
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include "commandQueue.h"
+#include "playerSeek.h"
+#include "callbackTiming.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Commands taken in one buffer at most; any more wait for the next buffer
+#define MAX_TRANSPORT_EVENTS (16)
+
+// struct type for a command due in the current buffer
+struct transportEvent {
+    size_t              offset;     // frame within the buffer
+    playerCommandType   type;
+    double              value;
+};
+
+// struct type for the state the commands change
+struct transportState {
+    double  userGain;   // gain set by the last gain command
+    double  gain;       // gain being applied (including any fade)
+    double  target;     // gain being ramped to
+    double  step;       // change in gain per frame while ramping
+    size_t  rampLeft;   // frames until the ramp ends
+    int     fading;     // what the ramp ends in: CMD_PAUSE, CMD_STOP or -1
+    int     paused;     // silent, consuming no audio
+    int     stopped;    // silent for good
+};
+
+// struct type for the transport of one stream
+struct playerTransport {
+    struct commandQueue     queue;          // commands to the callback
+
+    // callback only
+    struct transportState   state;
+    struct transportEvent   events[MAX_TRANSPORT_EVENTS];
+    size_t                  numEvents;      // events in the current buffer
+    struct playerCommand    pending[COMMAND_QUEUE_SIZE]; // taken, by frame
+    size_t                  numPending;
+    size_t                  audioFrames;    // frames of audio it needs
+    unsigned long long      streamFrame;    // frames output before it
+    unsigned char           *scratch;       // audio, when it has to be spread out
+
+    // written by the callback
+    atomic_ullong           framesOutput;   // for commands relative to now
+    atomic_ulong            applied;        // commands applied
+    atomic_ulong            measured;       // of those, ones applied at once
+    atomic_int              lastType;       // the last one applied
+    _Atomic double          lastLatency;    // post to DAC time for it (s, or
+                                            // -1 if it was scheduled)
+    _Atomic double          latencyTotal;   // post to DAC time, summed (s)
+    _Atomic double          latencyMax;     // worst post to DAC time (s)
+
+    // constant after initialisation
+    struct playerSeek       *seek;          // takes seeks (NULL if none)
+    int                     sRate;
+    unsigned int            channels;
+    PaSampleFormat          sampleFormat;
+    size_t                  bytesPerFrame;
+    size_t                  maxFrames;      // largest buffer
+    size_t                  rampFrames;
+    size_t                  seekLead;       // frames to request a seek early
+
+    // main thread only
+    unsigned long           reported;       // commands reported so far
+};
+
+// Set up the transport for a stream of the given buffer size. seek may be
+// NULL if the player cannot seek. Returns NO_ERROR or ERR_BAD_ALLOC.
+int initPlayerTransport(
+    struct playerTransport *t,
+    const struct audioFileInfo *audioFile,
+    unsigned long framesPerBuffer,
+    struct playerSeek *seek
+);
+
+// Free the scratch buffer
+void freePlayerTransport(struct playerTransport *t);
+
+// Name of a command (for messages)
+const char* getCommandName(playerCommandType type);
+
+// Producer side: post a command to apply at a stream frame (0 = at once).
+// Returns 1, or 0 if the queue is full.
+int postTransportCommand(
+    struct playerTransport *t,
+    playerCommandType type,
+    double value,
+    unsigned long long frame
+);
+
+// Any thread: the number of frames the stream has output, as of the last
+// buffer
+unsigned long long getTransportFrame(struct playerTransport *t);
+
+// Callback side, first: take the commands due in this buffer. Returns the
+// number of frames of audio the buffer needs (fewer than frames if it is
+// paused or stopped for part or all of it).
+size_t beginTransport(
+    struct playerTransport *t,
+    size_t frames,
+    const struct callbackTiming *timing
+);
+
+// Callback side: where to read the frames beginTransport() asked for: the
+// output buffer itself, or a scratch buffer if they have to be spread out
+void* getTransportAudio(struct playerTransport *t, void *outputBuffer);
+
+// Callback side, last: spread the audio from getTransportAudio() over the
+// output buffer, with silence where paused, and apply the gain
+void endTransport(
+    struct playerTransport *t,
+    void *outputBuffer,
+    const void *audio,
+    size_t frames
+);
+
+// Callback side: has a stop command finished?
+int isTransportStopped(struct playerTransport *t);
+
+// Main thread: print the latency of the latest command applied since the
+// last call
+void reportTransport(struct playerTransport *t);
+
+// Print the command latency statistics
+void printTransportStats(const struct playerTransport *t);
+
+// Write the same figures as members of a JSON object; a playerStatsWriter
+// for a struct playerTransport (see playerStats.h)
+void writeTransportStatsJson(const void *transport, FILE *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playerTransport_h */
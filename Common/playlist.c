@@ -0,0 +1,389 @@
+//
+//  playlist.c
+//
+//  Gapless playback of several files in a row through one stream.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <pa_util.h>
+#include "playlist.h"
+#include "playerConfig.h"
+
+// Default length of the head decoded ahead (ms)
+#define DEFAULT_HEAD_MS (300.0)
+
+// Open a track in the format the stream uses. Returns 1, or 0 if it cannot
+// be played in this stream.
+static int openTrack(
+    struct playlist *pl,
+    int track,
+    struct audioFileInfo *audioFile
+) {
+    
+    memset(audioFile, 0, sizeof(*audioFile));
+    int err = openAudioFile(pl->paths[track], audioFile, pl->maxChannels);
+    // the stream's channels and rate cannot change, so convert the track
+    if (!err)
+        err = setOutputChannels(audioFile, pl->channels);
+    if (!err && audioFile->sRate != pl->sRate) {
+        printf("Resampling %s from %d Hz to %d Hz\n", pl->paths[track],
+            audioFile->sRate, pl->sRate);
+        err = setOutputRate(audioFile, pl->sRate);
+    }
+    if (!err)
+        err = setSampleFormat(audioFile, pl->sampleFormat);
+    if (err) {
+        closeAudioFile(audioFile);
+        memset(audioFile, 0, sizeof(*audioFile));
+        return 0;
+    }
+    
+    return 1;
+}
+
+// Open a track into the standby file and decode its head (worker). Returns
+// 1, or 0 if it cannot be played in this stream.
+static int prepareTrack(struct playlist *pl, int track) {
+    
+    struct audioFileInfo *next = &pl->standby;
+    double start = PaUtil_GetTime();
+    
+    if (!openTrack(pl, track, next))
+        return 0;
+    
+    sf_count_t framesRead = readAudioFile(next, pl->standbyHead,
+        (sf_count_t) pl->headCapacity);
+    pl->standbyHeadFrames = framesRead > 0 ? (size_t) framesRead : 0;
+    pl->prepareTime = PaUtil_GetTime() - start;
+    
+    return 1;
+}
+
+// Prepare each track as the reader asks for it (worker)
+static void* prepareThread(void *data) {
+    
+    struct playlist *pl = (struct playlist *) data;
+    
+    pthread_mutex_lock(&pl->lock);
+    while (!pl->quit) {
+        if (pl->standbyState != STANDBY_WANTED) {
+            pthread_cond_wait(&pl->wake, &pl->lock);
+            continue;
+        }
+    
+        // open the file without holding the lock; the reader leaves the
+        // standby alone until it is ready
+        int track = pl->nextTrack;
+        pthread_mutex_unlock(&pl->lock);
+        int prepared = prepareTrack(pl, track);
+        pthread_mutex_lock(&pl->lock);
+    
+        if (prepared)
+            pl->standbyState = STANDBY_READY;
+        else if (track + 1 < pl->numTracks)
+            pl->nextTrack = track + 1;
+        else
+            pl->standbyState = STANDBY_NONE;
+        pthread_cond_broadcast(&pl->wake);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    
+    return NULL;
+}
+
+// Set up the playlist
+int initPlaylist(
+    struct playlist *pl,
+    char *paths[],
+    int numTracks,
+    const struct audioFileInfo *audioFile,
+    int maxChannels
+) {
+    
+    memset(pl, 0, sizeof(*pl));
+    pl->paths = paths;
+    pl->numTracks = numTracks;
+    pl->sRate = audioFile->sRate;
+    pl->channels = audioFile->channels;
+    pl->sampleFormat = audioFile->sampleFormat;
+    pl->maxChannels = maxChannels;
+    double headMs = getConfigDouble("BAP_PLAYLIST_HEAD_MS", DEFAULT_HEAD_MS);
+    pl->headCapacity = headMs > 0.0 ? (size_t) (headMs * pl->sRate / 1e3) : 0;
+    pl->standbyState = numTracks > 1 ? STANDBY_WANTED : STANDBY_NONE;
+    pl->nextTrack = 1;
+    atomic_init(&pl->tracksStarted, 1);
+    atomic_init(&pl->crossed, 0);
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->wake, NULL);
+    
+    // the first track starts at the start of the ring
+    pl->trackStart = calloc(numTracks, sizeof(size_t));
+    pl->trackIndex = calloc(numTracks, sizeof(int));
+    pl->gaps = calloc(numTracks, sizeof(size_t));
+    size_t headBytes = (pl->headCapacity > 0 ? pl->headCapacity : 1) *
+        audioFile->bytesPerFrame;
+    pl->head = malloc(headBytes);
+    pl->standbyHead = malloc(headBytes);
+    if (pl->trackStart == NULL || pl->trackIndex == NULL || pl->gaps == NULL ||
+        pl->head == NULL || pl->standbyHead == NULL)
+        return ERR_BAD_ALLOC;
+    
+    if (numTracks > 1) {
+        pl->started =
+            pthread_create(&pl->thread, NULL, prepareThread, pl) == 0;
+        if (!pl->started)
+            return ERR_BAD_ALLOC;
+    }
+    
+    return NO_ERROR;
+}
+
+// Stop the worker and free everything
+void freePlaylist(struct playlist *pl) {
+    
+    if (pl->started) {
+        pthread_mutex_lock(&pl->lock);
+        pl->quit = 1;
+        pthread_cond_broadcast(&pl->wake);
+        pthread_mutex_unlock(&pl->lock);
+        pthread_join(pl->thread, NULL);
+        pl->started = 0;
+    }
+    if (pl->standbyState == STANDBY_READY) {
+        closeAudioFile(&pl->standby);
+        pl->standbyState = STANDBY_NONE;
+    }
+    
+    pthread_cond_destroy(&pl->wake);
+    pthread_mutex_destroy(&pl->lock);
+    free(pl->trackStart);
+    free(pl->trackIndex);
+    free(pl->gaps);
+    free(pl->head);
+    free(pl->standbyHead);
+    pl->trackStart = NULL;
+    pl->trackIndex = NULL;
+    pl->gaps = NULL;
+    pl->head = pl->standbyHead = NULL;
+}
+
+// Move on to the next track (reader side)
+int advancePlaylist(
+    struct playlist *pl,
+    struct audioFileInfo *audioFile,
+    size_t ringFrame
+) {
+    
+    struct audioFileInfo finished = *audioFile;
+    int track;
+    
+    pthread_mutex_lock(&pl->lock);
+    while (pl->standbyState == STANDBY_WANTED)
+        pthread_cond_wait(&pl->wake, &pl->lock);
+    
+    track = pl->standbyState == STANDBY_READY ? pl->nextTrack : -1;
+    if (track >= 0) {
+        // take the standby file and its head, and ask for the one after
+        *audioFile = pl->standby;
+        memset(&pl->standby, 0, sizeof(pl->standby));
+        unsigned char *head = pl->head;
+        pl->head = pl->standbyHead;
+        pl->standbyHead = head;
+        pl->headFrames = pl->standbyHeadFrames;
+        pl->headRead = 0;
+        pl->prepareTotal += pl->prepareTime;
+        if (pl->prepareTime > pl->prepareMax)
+            pl->prepareMax = pl->prepareTime;
+    
+        pl->nextTrack = track + 1;
+        pl->standbyState =
+            pl->nextTrack < pl->numTracks ? STANDBY_WANTED : STANDBY_NONE;
+        pthread_cond_broadcast(&pl->wake);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    
+    if (track >= 0) {
+        // the reader's CPU time carries on from one file to the next
+        audioFile->readTime += finished.readTime;
+        closeAudioFile(&finished);
+    
+        // the callback may look at the new track once it is counted
+        int started =
+            atomic_load_explicit(&pl->tracksStarted, memory_order_relaxed);
+        pl->trackStart[started] = ringFrame;
+        pl->trackIndex[started] = track;
+        atomic_store_explicit(&pl->tracksStarted, started + 1,
+            memory_order_release);
+    }
+    
+    return track >= 0;
+}
+
+// Go back to the track being played, if the reader has moved on from it
+int rewindPlaylist(struct playlist *pl, struct audioFileInfo *audioFile) {
+    
+    if (pl->paths == NULL)
+        return 0;
+    
+    int playing = atomic_load_explicit(&pl->crossed, memory_order_acquire);
+    int started =
+        atomic_load_explicit(&pl->tracksStarted, memory_order_relaxed);
+    if (playing >= started - 1)
+        return 0;
+    
+    // reopen it first, so that a failure leaves the reader where it was
+    int track = pl->trackIndex[playing];
+    struct audioFileInfo reopened;
+    if (!openTrack(pl, track, &reopened)) {
+        printf("Unable to reopen %s to seek in it\n", pl->paths[track]);
+        return 0;
+    }
+    
+    pthread_mutex_lock(&pl->lock);
+    while (pl->standbyState == STANDBY_WANTED)
+        pthread_cond_wait(&pl->wake, &pl->lock);
+    
+    // the tracks after it are prepared again, in turn, from the one after it
+    if (pl->standbyState == STANDBY_READY)
+        closeAudioFile(&pl->standby);
+    memset(&pl->standby, 0, sizeof(pl->standby));
+    pl->nextTrack = track + 1;
+    pl->standbyState =
+        pl->nextTrack < pl->numTracks ? STANDBY_WANTED : STANDBY_NONE;
+    pthread_cond_broadcast(&pl->wake);
+    pthread_mutex_unlock(&pl->lock);
+    
+    reopened.readTime += audioFile->readTime;
+    closeAudioFile(audioFile);
+    *audioFile = reopened;
+    
+    // forget the starts of the tracks read ahead; the callback drops their
+    // frames when it switches to the seek
+    atomic_store_explicit(&pl->tracksStarted, playing + 1,
+        memory_order_release);
+    
+    return 1;
+}
+
+// Read the current track, head first (reader side)
+sf_count_t readPlaylist(
+    struct playlist *pl,
+    struct audioFileInfo *audioFile,
+    void *buffer,
+    sf_count_t frames
+) {
+    
+    unsigned char *out = (unsigned char *) buffer;
+    sf_count_t framesRead = 0;
+    
+    if (pl->headRead < pl->headFrames) {
+        size_t n = min((size_t) frames, pl->headFrames - pl->headRead);
+        memcpy(out, pl->head + pl->headRead * audioFile->bytesPerFrame,
+            n * audioFile->bytesPerFrame);
+        pl->headRead += n;
+        framesRead = (sf_count_t) n;
+    }
+    if (framesRead < frames) {
+        sf_count_t n = readAudioFile(audioFile,
+            out + (size_t) framesRead * audioFile->bytesPerFrame,
+            frames - framesRead);
+        if (n > 0)
+            framesRead += n;
+    }
+    
+    return framesRead;
+}
+
+// Forget the rest of the head (reader side)
+void dropPlaylistHead(struct playlist *pl) {
+    
+    pl->headRead = pl->headFrames;
+}
+
+// Note any track started being played (callback side)
+void notePlaylistPosition(
+    struct playlist *pl,
+    size_t before,
+    size_t after,
+    size_t silent
+) {
+    
+    int started =
+        atomic_load_explicit(&pl->tracksStarted, memory_order_acquire);
+    
+    // a seek took the reader back while this crossed into the next track
+    if (pl->playing >= started) {
+        pl->playing = started - 1;
+        atomic_store_explicit(&pl->crossed, pl->playing, memory_order_release);
+    }
+    
+    while (pl->playing + 1 < started &&
+        after > pl->trackStart[pl->playing + 1]) {
+        // the first frame of the next track was played in this buffer: if it
+        // was the first frame read, any silence before it was a gap
+        pl->playing++;
+        pl->gaps[pl->playing] =
+            before == pl->trackStart[pl->playing] ? pl->silent : 0;
+        atomic_store_explicit(&pl->crossed, pl->playing, memory_order_release);
+    }
+    
+    if (after != before)
+        pl->silent = silent;
+    else
+        pl->silent += silent;
+}
+
+// Print each track started (main thread)
+void reportPlaylist(struct playlist *pl) {
+    
+    int crossed = atomic_load_explicit(&pl->crossed, memory_order_acquire);
+    
+    if (pl->reported > crossed)
+        pl->reported = crossed;
+    while (pl->reported < crossed) {
+        pl->reported++;
+        printf("Track %d of %d: %s (gap %zu frames)\n",
+            pl->trackIndex[pl->reported] + 1, pl->numTracks,
+            pl->paths[pl->trackIndex[pl->reported]], pl->gaps[pl->reported]);
+    }
+}
+
+// Total frames of silence between tracks
+static size_t getTotalGap(const struct playlist *pl, int crossed) {
+    
+    size_t total = 0;
+    for (int t = 1; t <= crossed; t++)
+        total += pl->gaps[t];
+    
+    return total;
+}
+
+// Print the playlist statistics
+void printPlaylistStats(const struct playlist *pl) {
+    
+    int crossed = atomic_load_explicit(&pl->crossed, memory_order_acquire);
+    if (pl->numTracks < 2)
+        return;
+    
+    printf("Playlist: %d of %d tracks played, %zu frames of gap between them",
+        crossed + 1, pl->numTracks, getTotalGap(pl, crossed));
+    if (crossed > 0) {
+        printf("; next track ready after %.2f ms mean, %.2f ms max",
+            1e3 * pl->prepareTotal / crossed, 1e3 * pl->prepareMax);
+    }
+    printf("\n");
+}
+
+// Write the playlist statistics as JSON members
+void writePlaylistStatsJson(const void *playlist, FILE *file) {
+    
+    const struct playlist *pl = (const struct playlist *) playlist;
+    int crossed = atomic_load_explicit(&pl->crossed, memory_order_acquire);
+    
+    fprintf(file, "  \"tracks\": %d,\n"
+        "  \"tracksPlayed\": %d,\n"
+        "  \"trackGapFrames\": %zu,\n"
+        "  \"trackPrepareMaxMs\": %.3f", pl->numTracks, crossed + 1,
+        getTotalGap(pl, crossed), 1e3 * pl->prepareMax);
+}
@@ -0,0 +1,152 @@
+//
+//  playlist.h
+//
+//  Gapless playback of several files in a row through one stream. While a
+//  track plays, a worker thread opens the next one with openAudioFile(),
+//  mixes it to the stream's channels (setOutputChannels()), resamples it if
+//  its rate is not the stream's (setOutputRate()), and decodes its first
+//  BAP_PLAYLIST_HEAD_MS into a standby buffer. When the reader reaches the
+//  end of the current track it swaps the standby file in and carries on
+//  writing to the ring, head first, so the last frame of one track is
+//  followed in the ring by the first frame of the next. The stream is never
+//  closed between tracks.
+//
+//  The reader records the ring position where each track starts. The
+//  callback notes when it plays the first frame of each track, and how many
+//  frames of silence it had to output since the last frame of the track
+//  before: that is the gap, which should always be zero.
+//
+//  BAP_PLAYLIST_HEAD_MS:   audio decoded ahead for the next track (300 ms)
+//
+
+#ifndef playlist_h
+#define playlist_h
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "audioPlayerUtil.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// What the standby file is
+typedef enum {
+    STANDBY_WANTED,     // being prepared, or about to be
+    STANDBY_READY,      // open and its head decoded
+    STANDBY_NONE        // no more tracks
+} playlistStandby;
+
+// struct type for a playlist and its worker
+struct playlist {
+    // constant after initialisation
+    char            **paths;
+    int             numTracks;
+    int             sRate;          // of the stream
+    unsigned int    channels;
+    PaSampleFormat  sampleFormat;
+    int             maxChannels;
+    size_t          headCapacity;   // frames
+
+    // shared by the reader and the worker, under lock
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    int             started;        // worker running
+    int             quit;
+    playlistStandby standbyState;
+    int             nextTrack;      // track to prepare (or prepared)
+    struct audioFileInfo standby;
+    unsigned char   *standbyHead;
+    size_t          standbyHeadFrames;
+    double          prepareTime;    // time to open it and decode its head (s)
+
+    // reader only
+    unsigned char   *head;          // start of the track being read
+    size_t          headFrames;
+    size_t          headRead;
+    double          prepareTotal;   // s
+    double          prepareMax;     // s
+
+    // written by the reader: where each track starts in the ring
+    size_t          *trackStart;
+    int             *trackIndex;    // which path it is
+    atomic_int      tracksStarted;
+
+    // written by the callback
+    int             playing;        // track started being played
+    size_t          silent;         // frames of silence since the last read
+    size_t          *gaps;          // frames of silence before each track
+    atomic_int      crossed;        // tracks started being played
+
+    // main thread only
+    int             reported;
+};
+
+// Set up a playlist of paths, of which the first is already open as
+// audioFile, in the format the stream uses, and start preparing the next
+// track. Returns NO_ERROR or ERR_BAD_ALLOC.
+int initPlaylist(
+    struct playlist *pl,
+    char *paths[],
+    int numTracks,
+    const struct audioFileInfo *audioFile,
+    int maxChannels
+);
+
+// Stop the worker and free everything, closing the standby file
+void freePlaylist(struct playlist *pl);
+
+// Reader side: at the end of audioFile, replace it with the next track
+// (waiting for the worker if it is not ready), which starts at the given
+// ring position. Returns 1, or 0 if there are no more tracks.
+int advancePlaylist(
+    struct playlist *pl,
+    struct audioFileInfo *audioFile,
+    size_t ringFrame
+);
+
+// Reader side: before moving the file for a seek, go back to the track the
+// callback is playing if the reader has already moved on to a later one.
+// That track is opened again in place of audioFile, and the tracks after
+// it are prepared again. Call only with the seek about to be published, so
+// that the frames of the later tracks are dropped. Returns 1 if audioFile
+// was replaced.
+int rewindPlaylist(struct playlist *pl, struct audioFileInfo *audioFile);
+
+// Reader side: read frames of the current track, from its head first
+sf_count_t readPlaylist(
+    struct playlist *pl,
+    struct audioFileInfo *audioFile,
+    void *buffer,
+    sf_count_t frames
+);
+
+// Reader side: forget the rest of the head, after moving the file
+void dropPlaylistHead(struct playlist *pl);
+
+// Callback side: after reading the ring from position before to after,
+// with silent frames of silence output after that, note any track started
+void notePlaylistPosition(
+    struct playlist *pl,
+    size_t before,
+    size_t after,
+    size_t silent
+);
+
+// Main thread: print each track started being played since the last call
+void reportPlaylist(struct playlist *pl);
+
+// Print the playlist statistics
+void printPlaylistStats(const struct playlist *pl);
+
+// Write the same figures as members of a JSON object; a playerStatsWriter
+// for a struct playlist (see playerStats.h)
+void writePlaylistStatsJson(const void *playlist, FILE *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* playlist_h */
@@ -0,0 +1,111 @@
+//
+//  preloadedAudio.c
+//
+//  Whole-file preloading for players that read inside the callback.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "preloadedAudio.h"
+#include "playerConfig.h"
+
+// Largest decoded size preloaded in auto mode (MB)
+#define DEFAULT_PRELOAD_MAX_MB (128.0)
+
+// Decide whether to preload
+int shouldPreloadAudioFile(const struct audioFileInfo *audioFile) {
+    
+    const char *mode = getConfigString("BAP_PRELOAD", "auto");
+    
+    if (strcmp(mode, "always") == 0)
+        return 1;
+    else if (strcmp(mode, "never") == 0)
+        return 0;
+    
+    double megabytes = (double) audioFile->frames * audioFile->bytesPerFrame / 1e6;
+    
+    return megabytes <=
+        getConfigDouble("BAP_PRELOAD_MAX_MB", DEFAULT_PRELOAD_MAX_MB);
+}
+
+// Decode the whole file into a locked, prefaulted arena
+int preloadAudioFile(
+    struct preloadedAudio *p,
+    struct audioFileInfo *audioFile
+) {
+    
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t bytes = (size_t) audioFile->frames * audioFile->bytesPerFrame;
+    
+    memset(p, 0, sizeof(*p));
+    p->bytesPerFrame = audioFile->bytesPerFrame;
+    
+    // whole pages from mmap(), so the arena is page-aligned and can be
+    // locked without locking anything else
+    p->arenaSize = (bytes + pageSize - 1) / pageSize * pageSize;
+    if (p->arenaSize == 0)
+        p->arenaSize = pageSize;
+    void *arena = mmap(NULL, p->arenaSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        printf("Unable to allocate %.1f MB to preload the audio file\n",
+            p->arenaSize / 1e6);
+        return ERR_BAD_ALLOC;
+    }
+    p->data = arena;
+    
+    // lock first: this also faults every page in, so decoding doesn't take
+    // a page fault per page
+    p->locked = mlock(p->data, p->arenaSize) == 0;
+    if (!p->locked) {
+        // over RLIMIT_MEMLOCK, probably: prefault by hand instead (the pages
+        // can still be paged out under memory pressure)
+        for (size_t i = 0; i < p->arenaSize; i += pageSize)
+            p->data[i] = 0;
+    }
+    
+    // decode the lot, in the stream's sample format
+    sf_count_t framesRead;
+    while (p->frames < audioFile->frames &&
+           (framesRead = readAudioFile(audioFile,
+                p->data + (size_t) p->frames * p->bytesPerFrame,
+                audioFile->frames - p->frames)) > 0) {
+        p->frames += framesRead;
+    }
+    
+    printf("Preloaded %lld frames (%.1f MB, %s)\n", (long long) p->frames,
+        bytes / 1e6, p->locked ? "locked in RAM" : "could not be locked");
+    
+    return NO_ERROR;
+}
+
+// Copy frames out and advance the cursor (callback side)
+sf_count_t readPreloadedAudio(
+    struct preloadedAudio *p,
+    void *buffer,
+    sf_count_t frames
+) {
+    
+    sf_count_t framesLeft = p->frames - p->cursor;
+    if (frames > framesLeft)
+        frames = framesLeft;
+    
+    memcpy(buffer, p->data + (size_t) p->cursor * p->bytesPerFrame,
+        (size_t) frames * p->bytesPerFrame);
+    p->cursor += frames;
+    
+    return frames;
+}
+
+// Unlock and free the arena
+void freePreloadedAudio(struct preloadedAudio *p) {
+    
+    if (p->data != NULL) {
+        if (p->locked)
+            munlock(p->data, p->arenaSize);
+        munmap(p->data, p->arenaSize);
+        p->data = NULL;
+    }
+}
@@ -0,0 +1,63 @@
+//
+//  preloadedAudio.h
+//
+//  Whole-file preloading for players that read inside the callback. Before
+//  the stream starts, the file is decoded (in the stream's sample format)
+//  into one page-aligned arena, which is locked into RAM with mlock() and
+//  prefaulted, so that the callback only has to copy frames out and advance
+//  a cursor: no file I/O, no system calls and no page faults on the
+//  real-time thread. Files whose decoded size is over a threshold are
+//  streamed as before.
+//
+//  BAP_PRELOAD:        auto (default), always or never
+//  BAP_PRELOAD_MAX_MB: largest decoded size preloaded in auto mode (128 MB)
+//
+
+#ifndef preloadedAudio_h
+#define preloadedAudio_h
+
+#include <stddef.h>
+#include <sndfile.h>
+#include "audioPlayerUtil.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for a preloaded file
+struct preloadedAudio {
+    unsigned char   *data;          // the arena (NULL if not preloaded)
+    size_t          arenaSize;      // bytes mapped (a whole number of pages)
+    size_t          bytesPerFrame;
+    sf_count_t      frames;         // frames decoded
+    sf_count_t      cursor;         // next frame to play (callback only)
+    int             locked;         // mlock() succeeded
+};
+
+// Decide from BAP_PRELOAD and the file's decoded size whether to preload
+int shouldPreloadAudioFile(const struct audioFileInfo *audioFile);
+
+// Decode the whole file into a locked, prefaulted arena. Call after the
+// sample format has been negotiated. Returns NO_ERROR, or ERR_BAD_ALLOC if
+// the arena cannot be allocated.
+int preloadAudioFile(
+    struct preloadedAudio *p,
+    struct audioFileInfo *audioFile
+);
+
+// Copy up to frames frames to the output and advance the cursor. Returns the
+// number of frames copied. Wait-free; makes no system calls.
+sf_count_t readPreloadedAudio(
+    struct preloadedAudio *p,
+    void *buffer,
+    sf_count_t frames
+);
+
+// Unlock and free the arena
+void freePreloadedAudio(struct preloadedAudio *p);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* preloadedAudio_h */
@@ -0,0 +1,257 @@
+//
+//  readaheadFile.c
+//
+//  Read-ahead for files read through libsndfile.
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE     // readahead()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "readaheadFile.h"
+
+// Size and alignment of the read-ahead requests
+#define READAHEAD_CHUNK_BYTES ((off_t) 256 * 1024)
+
+// Most chunks asked for at a time: the kernel starts the reads before
+// returning, which is time the reader is not decoding
+#define READAHEAD_MAX_CHUNKS (4)
+
+#if !defined(_WIN32)
+// Ask the kernel to read part of the file into the page cache
+static void requestReadahead(struct readaheadFile *r, off_t from, off_t to) {
+    
+    // whole chunks, from a chunk boundary
+    from -= from % READAHEAD_CHUNK_BYTES;
+    to += (READAHEAD_CHUNK_BYTES - to % READAHEAD_CHUNK_BYTES) %
+        READAHEAD_CHUNK_BYTES;
+    if (to > from + READAHEAD_MAX_CHUNKS * READAHEAD_CHUNK_BYTES)
+        to = from + READAHEAD_MAX_CHUNKS * READAHEAD_CHUNK_BYTES;
+    if (to > r->fileSize)
+        to = r->fileSize;
+    if (to <= from)
+        return;
+    
+#if defined(__linux__)
+    readahead(r->fd, from, (size_t) (to - from));
+#elif defined(__APPLE__)
+    struct radvisory advice = {
+        .ra_offset = from,
+        .ra_count = (int) (to - from)
+    };
+    fcntl(r->fd, F_RDADVISE, &advice);
+#else
+    posix_fadvise(r->fd, from, to - from, POSIX_FADV_WILLNEED);
+#endif
+    r->readaheadTo = to;
+    r->requests++;
+}
+
+// How much of the window from the decoder's offset is in the page cache, in
+// bytes: mincore() on a mapping of it, which reads nothing. -1 if it can't
+// be told.
+static off_t getResidentBytes(struct readaheadFile *r, off_t position) {
+    
+    off_t from = position - position % r->pageBytes;
+    off_t to = position + (off_t) r->windowBytes;
+    if (to > r->fileSize)
+        to = r->fileSize;
+    if (to <= position)
+        return 0;
+    
+    size_t length = (size_t) (to - from);
+    void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, r->fd, from);
+    if (map == MAP_FAILED)
+        return -1;
+    // (char * on macOS)
+    int err = mincore(map, length, (void *) r->residency);
+    munmap(map, length);
+    if (err != 0)
+        return -1;
+    
+    // up to the first page that isn't there
+    size_t pages = (length + r->pageBytes - 1) / r->pageBytes;
+    size_t resident = 0;
+    while (resident < pages && (r->residency[resident] & 1))
+        resident++;
+    off_t end = from + (off_t) resident * r->pageBytes;
+    
+    return (end < to ? end : to) - position;
+}
+#endif
+
+// Open a file for libsndfile, and start reading ahead of it
+SNDFILE* openReadaheadFile(
+    const char fileName[],
+    struct readaheadFile *r,
+    SF_INFO *sfinfo,
+    double prefetchSeconds
+) {
+    
+    *r = (struct readaheadFile) {.fd = -1};
+    
+#if defined(_WIN32)
+    (void) prefetchSeconds;
+    return sf_open(fileName, SFM_READ, sfinfo);
+#else
+    r->fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if (r->fd < 0 || fstat(r->fd, &st) != 0) {
+        if (r->fd >= 0)
+            close(r->fd);
+        return NULL;
+    }
+    r->fileSize = st.st_size;
+    
+    // from start to finish, starting now
+#if defined(__APPLE__)
+    fcntl(r->fd, F_RDAHEAD, 1);
+#else
+    posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    
+    // the descriptor is closed here, after sf_close()
+    SNDFILE *sndfile = sf_open_fd(r->fd, SFM_READ, sfinfo, SF_FALSE);
+    if (sndfile == NULL) {
+        close(r->fd);
+        return NULL;
+    }
+    
+    // the file's average rate, which is exact for uncompressed files
+    double seconds = sfinfo->samplerate > 0 ?
+        (double) sfinfo->frames / sfinfo->samplerate : 0.0;
+    r->bytesPerSecond = seconds > 0.0 ? r->fileSize / seconds :
+        (double) sfinfo->samplerate * sfinfo->channels * sizeof(float);
+    r->windowBytes = (size_t) (prefetchSeconds * r->bytesPerSecond);
+    r->active = 1;
+    
+    // one byte per page of the window, and one more for a window that
+    // doesn't start on a page boundary
+    r->pageBytes = sysconf(_SC_PAGESIZE);
+    if (r->pageBytes <= 0)
+        r->pageBytes = 4096;
+    r->residency = malloc(r->windowBytes / r->pageBytes + 2);
+    
+    // the start of the window, from wherever the header left the decoder;
+    // the first reads ask for the rest
+    off_t position = lseek(r->fd, 0, SEEK_CUR);
+    r->position = position > 0 ? position : 0;
+    requestReadahead(r, r->position, r->position + (off_t) r->windowBytes);
+    
+    return sndfile;
+#endif
+}
+
+// Start the window again from the decoder's offset
+void restartReadahead(struct readaheadFile *r) {
+    
+#if !defined(_WIN32)
+    if (!r->active)
+        return;
+    
+    off_t position = lseek(r->fd, 0, SEEK_CUR);
+    if (position < 0)
+        return;
+    
+    r->position = position;
+    r->readaheadTo = position;
+    requestReadahead(r, position, position + (off_t) r->windowBytes);
+#else
+    (void) r;
+#endif
+}
+
+// Record how much is cached ahead, and ask for more of the file if need be
+void advanceReadahead(struct readaheadFile *r) {
+    
+#if !defined(_WIN32)
+    if (!r->active)
+        return;
+    
+    off_t position = lseek(r->fd, 0, SEEK_CUR);
+    if (position < 0)
+        return;
+    
+    // a seek that restartReadahead() wasn't told about
+    if (position < r->position) {
+        restartReadahead(r);
+        return;
+    }
+    
+    // near the end of the file, the window is cut short by it rather than
+    // by the disk
+    if (r->residency != NULL &&
+        position + (off_t) r->windowBytes < r->fileSize) {
+        off_t bytes = getResidentBytes(r, position);
+        if (bytes >= 0) {
+            double cached = bytes / r->bytesPerSecond;
+            if (bytes == 0)
+                r->uncached++;
+            if (r->reads == 0 || cached < r->minCached)
+                r->minCached = cached;
+            r->cachedSum += cached;
+            r->reads++;
+        }
+    }
+    r->position = position;
+    
+    // ask for the rest of the window once half way through it
+    if (r->readaheadTo < position)
+        r->readaheadTo = position;
+    if (r->readaheadTo < r->fileSize &&
+        r->readaheadTo - position < (off_t) r->windowBytes / 2)
+        requestReadahead(r, r->readaheadTo, position + (off_t) r->windowBytes);
+#else
+    (void) r;
+#endif
+}
+
+// Close the descriptor, if the file was opened here
+void closeReadaheadFile(struct readaheadFile *r) {
+    
+#if !defined(_WIN32)
+    if (r->active)
+        close(r->fd);
+#endif
+    free(r->residency);
+    r->residency = NULL;
+    r->active = 0;
+}
+
+// Print the requests and how much was cached ahead of the decoder
+void printReadaheadStats(const struct readaheadFile *r) {
+    
+    if (r->requests == 0)
+        return;
+    
+    printf("Read-ahead: %.2f s window (%zu KB), %lu requests; cached ahead "
+        "of the decoder after a read %.2f s at least, %.2f s on average; "
+        "%lu reads found nothing cached\n",
+        r->windowBytes / r->bytesPerSecond, r->windowBytes / 1024,
+        r->requests, r->minCached,
+        r->reads > 0 ? r->cachedSum / r->reads : 0.0, r->uncached);
+}
+
+// Write the statistics as JSON members
+void writeReadaheadStatsJson(const struct readaheadFile *r, FILE *file) {
+    
+    fprintf(file,
+        "  \"readaheadWindowBytes\": %zu,\n"
+        "  \"readaheadRequests\": %lu,\n"
+        "  \"readaheadMinCachedMs\": %.3f,\n"
+        "  \"readaheadMeanCachedMs\": %.3f,\n"
+        "  \"readaheadReadsUncached\": %lu",
+        r->windowBytes,
+        r->requests,
+        1e3 * r->minCached,
+        r->reads > 0 ? 1e3 * r->cachedSum / r->reads : 0.0,
+        r->uncached);
+}
@@ -0,0 +1,84 @@
+//
+//  readaheadFile.h
+//
+//  Read-ahead for files read through libsndfile. The file is opened here
+//  and its descriptor handed to sf_open_fd(), so that the kernel can be
+//  told how it will be read: sequentially (posix_fadvise() on Linux,
+//  F_RDAHEAD on macOS), with a window of BAP_PREFETCH_SECONDS ahead of the
+//  decoder. The start of the window is asked for on opening. After each
+//  read the decoder's offset in the file is checked, and once it is half
+//  way through the window the rest is asked for, in aligned chunks of at
+//  most 1 MB at a time (readahead() on Linux, F_RDADVISE on macOS,
+//  POSIX_FADV_WILLNEED elsewhere), so that a cold file on a slow disk is
+//  in the page cache before the decoder gets to it. Seconds of audio are
+//  converted to bytes at the file's average rate, so that compressed files
+//  are read ahead too.
+//
+//  After each read, how much of the file from the decoder's offset is in
+//  the page cache is recorded (mincore() on a mapping of the window), which
+//  is what the decoder can read next without waiting for the disk. That is
+//  ahead of the decoder, not of playback, which is further behind by
+//  however much the ring holds.
+//
+
+#ifndef readaheadFile_h
+#define readaheadFile_h
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sndfile.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for a file being read ahead of
+struct readaheadFile {
+    int             active;         // the file is open here
+    int             fd;             // the descriptor libsndfile reads
+    off_t           fileSize;
+    size_t          windowBytes;    // how far ahead to read
+    double          bytesPerSecond; // of audio, on average
+    off_t           position;       // decoder's offset after the last read
+    off_t           readaheadTo;    // end of what has been asked for
+    long            pageBytes;
+    unsigned char  *residency;      // mincore() of the window, per page
+    unsigned long   requests;       // read-ahead requests issued
+    unsigned long   reads;          // reads checked
+    unsigned long   uncached;       // reads with nothing cached after them
+    double          minCached;      // least cached ahead after a read (s)
+    double          cachedSum;      // for the mean (s)
+};
+
+// Open a file for libsndfile through a descriptor opened here, and start
+// reading ahead of it. Returns the SNDFILE (NULL if it can't be opened),
+// with sfinfo filled in as sf_open() would.
+SNDFILE* openReadaheadFile(
+    const char fileName[],
+    struct readaheadFile *r,
+    SF_INFO *sfinfo,
+    double prefetchSeconds
+);
+
+// Call after each read: record how much is cached ahead of the decoder,
+// and ask for more of the file if it is half way through the window
+void advanceReadahead(struct readaheadFile *r);
+
+// Call after a seek: the window starts again from the new offset, whichever
+// way the decoder moved
+void restartReadahead(struct readaheadFile *r);
+
+// Close the descriptor, if the file was opened here (after sf_close())
+void closeReadaheadFile(struct readaheadFile *r);
+
+// Print the requests and how much was cached, if the file was read ahead
+void printReadaheadStats(const struct readaheadFile *r);
+
+// Write the statistics as JSON members (no braces)
+void writeReadaheadStatsJson(const struct readaheadFile *r, FILE *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* readaheadFile_h */
@@ -0,0 +1,214 @@
+//
+//  refillEvent.c
+//
+//  Low-watermark notification from the PortAudio callback to the reader.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pa_util.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+#include "audioPlayerUtil.h"
+#include "refillEvent.h"
+
+// Set up the notification
+int initRefillEvent(
+    struct refillEvent *ev,
+    size_t ringFrames,
+    double lowWatermark,
+    double highWatermark
+) {
+    
+    PaUtil_InitializeClock();
+    
+    atomic_init(&ev->waiting, 0);
+    atomic_init(&ev->interrupted, 0);
+    atomic_init(&ev->postTime, 0.0);
+    atomic_init(&ev->lowWatermark, 0);
+    atomic_init(&ev->highWatermark, 0);
+    ev->lowFraction = lowWatermark;
+    ev->highFraction = highWatermark;
+    setRefillWatermarks(ev, ringFrames);
+    ev->startTime = PaUtil_GetTime();
+    ev->wakeups = 0;
+    ev->notifications = 0;
+    ev->latencyTotal = 0.0;
+    ev->latencyMax = 0.0;
+    ev->notified = 0;
+    
+#if defined(__linux__)
+    ev->fd = eventfd(0, EFD_NONBLOCK);
+    if (ev->fd < 0)
+        return ERR_BAD_ALLOC;
+#elif defined(__APPLE__)
+    ev->semaphore = dispatch_semaphore_create(0);
+    if (ev->semaphore == NULL)
+        return ERR_BAD_ALLOC;
+#endif
+    
+    return NO_ERROR;
+}
+
+// Recalculate the watermarks for a new ring size (reader side)
+void setRefillWatermarks(struct refillEvent *ev, size_t ringFrames) {
+    
+    atomic_store_explicit(&ev->lowWatermark,
+        (size_t) (ev->lowFraction * ringFrames), memory_order_relaxed);
+    atomic_store_explicit(&ev->highWatermark,
+        (size_t) (ev->highFraction * ringFrames), memory_order_relaxed);
+}
+
+// Release the notification
+void closeRefillEvent(struct refillEvent *ev) {
+    
+#if defined(__linux__)
+    if (ev->fd >= 0)
+        close(ev->fd);
+    ev->fd = -1;
+#elif defined(__APPLE__)
+    if (ev->semaphore != NULL)
+        dispatch_release(ev->semaphore);
+    ev->semaphore = NULL;
+#endif
+}
+
+// Signal the reader's event
+static void signalReader(struct refillEvent *ev) {
+    
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t written = write(ev->fd, &one, sizeof(one));
+    (void) written; // can only fail if the counter overflows
+#elif defined(__APPLE__)
+    dispatch_semaphore_signal(ev->semaphore);
+#else
+    (void) ev;
+#endif
+}
+
+// Wake the reader if the ring is below the low watermark (callback side)
+void notifyRefill(struct refillEvent *ev, size_t framesBuffered) {
+    
+    if (framesBuffered >=
+        atomic_load_explicit(&ev->lowWatermark, memory_order_relaxed))
+        return;
+    
+    // pairs with the fence in waitForEvent(): either the reader sees the
+    // frames we just consumed, or we see that it is waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    
+    // only signal once per wait, so that the event never accumulates, and
+    // not at all if the reader is only waiting to be interrupted
+    int expected = 1;
+    if (atomic_compare_exchange_strong(&ev->waiting, &expected, 0)) {
+        atomic_store_explicit(&ev->postTime, PaUtil_GetTime(),
+            memory_order_relaxed);
+        signalReader(ev);
+    }
+}
+
+// Wake the reader whatever the fill level
+void interruptRefillWait(struct refillEvent *ev) {
+    
+    // as in notifyRefill(): either the reader sees the flag before it blocks,
+    // or we see that it is waiting
+    atomic_store(&ev->interrupted, 1);
+    if (atomic_exchange(&ev->waiting, 0))
+        signalReader(ev);
+}
+
+// Record the refill latency (reader side)
+double refillDone(struct refillEvent *ev) {
+    
+    double latency = 0.0;
+    
+    if (ev->notified) {
+        latency = PaUtil_GetTime() -
+            atomic_load_explicit(&ev->postTime, memory_order_relaxed);
+        ev->latencyTotal += latency;
+        if (latency > ev->latencyMax)
+            ev->latencyMax = latency;
+        ev->notified = 0;
+    }
+    
+    return latency;
+}
+
+// Block until signalled; if ar is NULL, only an interrupt will do
+static void waitForEvent(struct refillEvent *ev, struct adaptiveRing *ar) {
+    
+    // announce that we are about to wait, then check the fill level again so
+    // that a notification posted in between is not lost
+    atomic_store(&ev->waiting, ar != NULL ? 1 : 2);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&ev->interrupted) || (ar != NULL &&
+        getAdaptiveRingFramesBuffered(ar) <
+        atomic_load_explicit(&ev->lowWatermark, memory_order_relaxed))) {
+        if (atomic_exchange(&ev->waiting, 0)) {
+            atomic_store(&ev->interrupted, 0);
+            return; // nobody signalled us; just carry on
+        }
+        // otherwise we have been signalled; consume that below
+    }
+    
+    int signalled = 0;
+#if defined(__linux__)
+    struct pollfd pfd = {.fd = ev->fd, .events = POLLIN};
+    if (poll(&pfd, 1, REFILL_WAIT_TIMEOUT) > 0) {
+        uint64_t count;
+        signalled = read(ev->fd, &count, sizeof(count)) == sizeof(count);
+    }
+#elif defined(__APPLE__)
+    signalled = dispatch_semaphore_wait(ev->semaphore, dispatch_time(
+        DISPATCH_TIME_NOW, REFILL_WAIT_TIMEOUT * NSEC_PER_MSEC)) == 0;
+#else
+    // no event available; fall back to polling
+    Pa_Sleep(REFILL_WAIT_TIMEOUT / 5);
+#endif
+    
+    // timed out: withdraw the request, unless the callback has just taken it
+    // (in which case its signal will be consumed by the next wait)
+    if (!signalled)
+        atomic_store(&ev->waiting, 0);
+    
+    // interruptions are not refill requests
+    if (atomic_exchange(&ev->interrupted, 0))
+        signalled = 0;
+    
+    ev->wakeups++;
+    if (signalled) {
+        ev->notifications++;
+        ev->notified = 1;
+    }
+}
+
+// Block until the ring drains below the low watermark (reader side)
+void waitForRefill(struct refillEvent *ev, struct adaptiveRing *ar) {
+    
+    waitForEvent(ev, ar);
+}
+
+// Block until interrupted (reader side)
+void waitForInterrupt(struct refillEvent *ev) {
+    
+    waitForEvent(ev, NULL);
+}
+
+// Print wakeup and refill latency statistics
+void printRefillStats(const struct refillEvent *ev) {
+    
+    double elapsed = PaUtil_GetTime() - ev->startTime;
+    
+    printf("Reader woke %lu times (%.1f per second), %lu by the callback\n",
+        ev->wakeups, elapsed > 0.0 ? ev->wakeups / elapsed : 0.0,
+        ev->notifications);
+    if (ev->notifications > 0) {
+        printf("Refill latency: %.3f ms mean, %.3f ms max\n",
+            1e3 * ev->latencyTotal / ev->notifications,
+            1e3 * ev->latencyMax);
+    }
+}
@@ -0,0 +1,98 @@
+//
+//  refillEvent.h
+//
+//  Low-watermark notification from the PortAudio callback to the thread that
+//  refills the ring buffer. The reader blocks until the callback reports that
+//  the ring has drained below the low watermark (or a timeout expires), rather
+//  than polling. Posting never blocks: the callback only signals when the
+//  reader has announced that it is waiting, using an eventfd on Linux and a
+//  dispatch semaphore on OS X. Other threads can also interrupt the wait,
+//  e.g. to hand the reader a seek.
+//
+
+#ifndef refillEvent_h
+#define refillEvent_h
+
+#include <stdatomic.h>
+#include <stddef.h>
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#endif
+#include "adaptiveRing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// How long the reader waits for a notification before checking anyway (ms)
+#define REFILL_WAIT_TIMEOUT (500)
+
+// struct type for the notification and its statistics
+struct refillEvent {
+    atomic_int      waiting;        // set by the reader before it blocks
+    atomic_int      interrupted;    // set by interruptRefillWait()
+    _Atomic double  postTime;       // when the callback last woke the reader
+    atomic_size_t   lowWatermark;   // fill (frames) that wakes the reader
+    atomic_size_t   highWatermark;  // fill (frames) the reader tops up to
+    double          lowFraction;    // watermarks as fractions of the ring
+    double          highFraction;
+    
+    // statistics, only touched by the reader
+    double          startTime;      // when the event was initialised
+    unsigned long   wakeups;        // times the reader woke up (any reason)
+    unsigned long   notifications;  // wakeups caused by the callback
+    double          latencyTotal;   // post-to-refilled time, summed (s)
+    double          latencyMax;     // worst post-to-refilled time (s)
+    int             notified;       // last wakeup was caused by the callback
+    
+#if defined(__linux__)
+    int                     fd;
+#elif defined(__APPLE__)
+    dispatch_semaphore_t    semaphore;
+#endif
+};
+
+// Set up the notification. The watermarks are fractions of the ring size.
+// Returns NO_ERROR or ERR_BAD_ALLOC.
+int initRefillEvent(
+    struct refillEvent *ev,
+    size_t ringFrames,
+    double lowWatermark,
+    double highWatermark
+);
+
+// Recalculate the watermarks after the ring has been resized (reader side)
+void setRefillWatermarks(struct refillEvent *ev, size_t ringFrames);
+
+// Release the notification
+void closeRefillEvent(struct refillEvent *ev);
+
+// Called from the callback after it has read from the ring; wakes the reader
+// if the ring holds fewer than lowWatermark frames. Wait-free.
+void notifyRefill(struct refillEvent *ev, size_t framesBuffered);
+
+// Called by the reader once it has topped up the ring; records and returns
+// the refill latency (s) if the refill was triggered by the callback, or
+// returns 0
+double refillDone(struct refillEvent *ev);
+
+// Called by the reader: block until the ring drains below the low watermark
+// (or the wait is interrupted)
+void waitForRefill(struct refillEvent *ev, struct adaptiveRing *ar);
+
+// Called by the reader once it has nothing left to read: block until the
+// wait is interrupted (or times out), whatever the fill level
+void waitForInterrupt(struct refillEvent *ev);
+
+// Wake the reader whatever the fill level; the wakeup is not counted as a
+// notification. Wait-free, so it may be called from the callback.
+void interruptRefillWait(struct refillEvent *ev);
+
+// Print wakeup and refill latency statistics
+void printRefillStats(const struct refillEvent *ev);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* refillEvent_h */
@@ -0,0 +1,303 @@
+//
+//  resampler.c
+//
+//  Polyphase windowed-sinc sample-rate conversion.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resampler.h"
+#include "audioPlayerUtil.h"
+
+// Rows of filter table at most; ratios that need more interpolate
+#define MAX_PHASES (4096)
+
+// Longest filter (taps), however far the rate comes down
+#define MAX_TAPS (2048)
+
+// Input frames read from the source at a time
+#define BLOCK_FRAMES (1024)
+
+// Quality presets: each doubles the taps of the one before, which halves
+// the transition band, so the cutoff can move closer to Nyquist
+static const struct resamplerPreset presets[] = {
+    {"fast", 16, 0.78, 5.0},
+    {"medium", 32, 0.85, 7.0},
+    {"high", 64, 0.90, 9.0},
+    {"best", 128, 0.94, 11.0},
+};
+    
+#define NUM_PRESETS (sizeof(presets) / sizeof(presets[0]))
+    
+// The preset called name
+const struct resamplerPreset* getResamplerPreset(const char *name) {
+    
+    for (size_t i = 0; i < NUM_PRESETS; i++) {
+        if (strcmp(presets[i].name, name) == 0)
+            return &presets[i];
+    }
+    
+    return NULL;
+}
+
+// Greatest common divisor
+static unsigned long long gcd(unsigned long long a, unsigned long long b) {
+    
+    while (b != 0) {
+        unsigned long long t = a % b;
+        a = b;
+        b = t;
+    }
+    
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind
+static double besselI0(double x) {
+    
+    double sum = 1.0, term = 1.0;
+    
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    
+    return sum;
+}
+
+// Stopband attenuation (dB) of a Kaiser window, from its beta
+static double getKaiserAttenuation(double beta) {
+    
+    return beta / 0.1102 + 8.7;
+}
+
+// Cutoff of the filter, as a fraction of the input's Nyquist frequency
+static double getCutoff(const struct resampler *r) {
+    
+    double ratio = (double) r->up / r->down;
+    
+    return r->preset->cutoff * (ratio < 1.0 ? ratio : 1.0);
+}
+
+// Fill in the table: row p holds the taps for an output p / phases of an
+// input frame after the frame under the middle of the filter
+static void designFilter(struct resampler *r) {
+    
+    double fc = getCutoff(r);
+    double half = r->taps / 2;
+    double i0Beta = besselI0(r->preset->beta);
+    
+    for (unsigned int p = 0; p <= r->phases; p++) {
+        float *row = r->coefs + (size_t) p * r->taps;
+        double sum = 0.0;
+        for (unsigned int k = 0; k < r->taps; k++) {
+            // distance from the output to input frame k, in input frames
+            double x = (double) p / r->phases + half - 1.0 - k;
+            double sinc = x == 0.0 ? 1.0 : sin(M_PI * fc * x) / (M_PI * fc * x);
+            double u = x / half;
+            double window = u * u < 1.0 ?
+                besselI0(r->preset->beta * sqrt(1.0 - u * u)) / i0Beta : 0.0;
+            double h = fc * sinc * window;
+            row[k] = (float) h;
+            sum += h;
+        }
+    
+        // unity gain at DC in every phase, so that there is no ripple
+        // from one output frame to the next
+        for (unsigned int k = 0; k < r->taps; k++)
+            row[k] = (float) (row[k] / sum);
+    }
+}
+
+// Set up a conversion
+int initResampler(
+    struct resampler *r,
+    int inRate,
+    int outRate,
+    unsigned int channels,
+    const struct resamplerPreset *preset
+) {
+    
+    memset(r, 0, sizeof(*r));
+    r->inRate = inRate;
+    r->outRate = outRate;
+    r->channels = channels;
+    r->preset = preset;
+    r->kernels = getAudioKernels();
+    
+    unsigned long long g = gcd((unsigned long long) inRate,
+        (unsigned long long) outRate);
+    r->up = (unsigned long long) outRate / g;
+    r->down = (unsigned long long) inRate / g;
+    r->phases = r->up <= MAX_PHASES ? (unsigned int) r->up : MAX_PHASES;
+    
+    // a longer filter when downsampling, for the same transition band
+    // relative to the new Nyquist frequency
+    double ratio = (double) r->up / r->down;
+    double taps = preset->taps / (ratio < 1.0 ? ratio : 1.0);
+    r->taps = taps < MAX_TAPS ? 2 * (unsigned int) ceil(taps / 2.0) : MAX_TAPS;
+    
+    r->coefs = malloc(sizeof(float) * (r->phases + 1) * r->taps);
+    r->capacity = r->taps + BLOCK_FRAMES;
+    r->planes = calloc(channels, sizeof(float *));
+    float *planeData = malloc(sizeof(float) * r->capacity * channels);
+    r->staging = malloc(sizeof(float) * BLOCK_FRAMES * channels);
+    if (r->coefs == NULL || r->planes == NULL || planeData == NULL ||
+        r->staging == NULL) {
+        free(planeData);
+        freeResampler(r);
+        return ERR_BAD_ALLOC;
+    }
+    for (unsigned int c = 0; c < channels; c++)
+        r->planes[c] = planeData + c * r->capacity;
+    
+    designFilter(r);
+    seekResampler(r, 0);
+    
+    return NO_ERROR;
+}
+
+// Free the filter and buffers
+void freeResampler(struct resampler *r) {
+    
+    free(r->coefs);
+    if (r->planes != NULL)
+        free(r->planes[0]);
+    free(r->planes);
+    free(r->staging);
+    r->coefs = NULL;
+    r->planes = NULL;
+    r->staging = NULL;
+}
+
+// Output frames for a number of input frames
+long long getResampledFrames(const struct resampler *r, long long inFrames) {
+    
+    return (long long) (((unsigned long long) inFrames * r->up + r->down - 1) /
+        r->down);
+}
+
+// Highest frequency passed within the ripple
+double getResamplerPassband(const struct resampler *r) {
+    
+    // Kaiser: taps = (A - 8) / (2.285 * transition), transition in rad/frame
+    double transition = (getKaiserAttenuation(r->preset->beta) - 8.0) /
+        (2.285 * r->taps) / M_PI;
+    
+    return (getCutoff(r) - transition / 2.0) * r->inRate / 2.0;
+}
+
+// Move to an output frame
+long long seekResampler(struct resampler *r, long long outFrame) {
+    
+    unsigned long long t = (unsigned long long) outFrame * r->down;
+    
+    r->outFrame = outFrame;
+    r->position = (long long) (t / r->up);
+    r->phase = t % r->up;
+    r->ended = 0;
+    
+    // hold nothing from before; silence before the start of the input
+    long long first = r->position - r->taps / 2 + 1;
+    r->planeStart = first;
+    r->planeFrames = first < 0 ? (size_t) -first : 0;
+    for (unsigned int c = 0; c < r->channels; c++)
+        memset(r->planes[c], 0, r->planeFrames * sizeof(float));
+    
+    return first > 0 ? first : 0;
+}
+
+// Make sure the planes hold input frames first to last, dropping any
+// before first and reading from the source
+static void fillPlanes(
+    struct resampler *r,
+    long long first,
+    long long last,
+    resamplerSource *source,
+    void *data
+) {
+    
+    // the filter always spans more input frames than one output advances,
+    // so first is never beyond the frames held
+    size_t drop = (size_t) (first - r->planeStart);
+    if (drop > r->planeFrames)
+        drop = r->planeFrames;
+    if (drop > 0) {
+        for (unsigned int c = 0; c < r->channels; c++)
+            memmove(r->planes[c], r->planes[c] + drop,
+                (r->planeFrames - drop) * sizeof(float));
+        r->planeFrames -= drop;
+        r->planeStart += drop;
+    }
+    
+    while (r->planeStart + (long long) r->planeFrames <= last) {
+        size_t room = r->capacity - r->planeFrames;
+        size_t frames = room < BLOCK_FRAMES ? room : BLOCK_FRAMES;
+    
+        size_t framesRead = r->ended ? 0 : source(data, r->staging, frames);
+        if (framesRead == 0) {
+            // silence after the end
+            r->ended = 1;
+            size_t need = (size_t) (last + 1 - r->planeStart) - r->planeFrames;
+            framesRead = need < room ? need : room;
+            for (unsigned int c = 0; c < r->channels; c++)
+                memset(r->planes[c] + r->planeFrames, 0,
+                    framesRead * sizeof(float));
+        }
+        else {
+            float *dst[r->channels];
+            for (unsigned int c = 0; c < r->channels; c++)
+                dst[c] = r->planes[c] + r->planeFrames;
+            r->kernels->deinterleave(dst, r->staging, framesRead, r->channels);
+        }
+        r->planeFrames += framesRead;
+    }
+}
+
+// Write output frames
+void readResampler(
+    struct resampler *r,
+    float *out,
+    size_t frames,
+    resamplerSource *source,
+    void *data
+) {
+    
+    long long half = r->taps / 2;
+    float (*dot)(const float *, const float *, size_t) = r->kernels->dotProduct;
+    
+    for (size_t f = 0; f < frames; f++) {
+        // input frames under the filter
+        long long first = r->position - half + 1;
+        long long last = r->position + half;
+        if (last >= r->planeStart + (long long) r->planeFrames)
+            fillPlanes(r, first, last, source, data);
+        size_t offset = (size_t) (first - r->planeStart);
+    
+        if (r->phases == r->up) {
+            // every phase has its own row
+            const float *row = r->coefs + r->phase * r->taps;
+            for (unsigned int c = 0; c < r->channels; c++)
+                *out++ = dot(row, r->planes[c] + offset, r->taps);
+        }
+        else {
+            // between two rows
+            double x = (double) r->phase * r->phases / r->up;
+            unsigned int p = (unsigned int) x;
+            float a = (float) (x - p);
+            const float *row = r->coefs + (size_t) p * r->taps;
+            for (unsigned int c = 0; c < r->channels; c++) {
+                float y0 = dot(row, r->planes[c] + offset, r->taps);
+                float y1 = dot(row + r->taps, r->planes[c] + offset, r->taps);
+                *out++ = y0 + a * (y1 - y0);
+            }
+        }
+    
+        // next output frame
+        r->phase += r->down;
+        r->position += (long long) (r->phase / r->up);
+        r->phase %= r->up;
+        r->outFrame++;
+    }
+}
@@ -0,0 +1,108 @@
+//
+//  resampler.h
+//
+//  Sample-rate conversion by a polyphase windowed-sinc filter, so that the
+//  stream can run at one rate whatever the rate of the file. The ratio is
+//  kept exactly as two integers (out/in in lowest terms), so output frame
+//  n is always input time n * in / out: a conversion never drifts, and
+//  seeking to an output frame is sample-accurate. The filter is a Kaiser-
+//  windowed sinc, cut off below the lower of the two Nyquist frequencies,
+//  tabulated once per phase; ratios with more phases than fit in the table
+//  interpolate between neighbouring phases. The output is aligned with the
+//  input (no delay), with silence before the start and after the end.
+//
+//  The taps run through the dotProduct kernel (audioKernels.h), on one
+//  buffer of input per channel.
+//
+
+#ifndef resampler_h
+#define resampler_h
+
+#include <stddef.h>
+#include "audioKernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for a quality preset
+struct resamplerPreset {
+    const char      *name;
+    unsigned int    taps;       // per output sample, when not downsampling
+    double          cutoff;     // -6 dB point, fraction of the lower Nyquist
+    double          beta;       // Kaiser window shape (stopband depth)
+};
+
+// Reads up to frames interleaved float frames into buffer; returns how
+// many (0 at the end)
+typedef size_t resamplerSource(void *data, float *buffer, size_t frames);
+
+// struct type for one conversion
+struct resampler {
+    int             inRate;
+    int             outRate;
+    unsigned int    channels;
+    const struct resamplerPreset *preset;
+    unsigned int    taps;       // filter length, even
+    unsigned long long up;      // out / in = up / down, in lowest terms
+    unsigned long long down;
+    unsigned int    phases;     // rows in the table (up, if it fits)
+    float           *coefs;     // (phases + 1) rows of taps
+    const struct audioKernels *kernels;
+
+    // input, one plane per channel
+    float           **planes;
+    size_t          capacity;   // frames per plane
+    size_t          planeFrames; // frames held
+    long long       planeStart; // input frame of the first one held
+    float           *staging;   // interleaved, from the source
+    int             ended;      // the source has run out
+
+    // the next output frame is at input time position + phase / up
+    long long       outFrame;
+    long long       position;
+    unsigned long long phase;
+};
+
+// The preset called name (fast, medium, high or best), or NULL
+const struct resamplerPreset* getResamplerPreset(const char *name);
+
+// Set up a conversion and design its filter. Returns NO_ERROR, or
+// ERR_BAD_ALLOC.
+int initResampler(
+    struct resampler *r,
+    int inRate,
+    int outRate,
+    unsigned int channels,
+    const struct resamplerPreset *preset
+);
+
+// Free the filter and buffers
+void freeResampler(struct resampler *r);
+
+// Output frames for a number of input frames
+long long getResampledFrames(const struct resampler *r, long long inFrames);
+
+// Highest frequency (Hz) passed within the filter's ripple, by the usual
+// estimate of a Kaiser window's transition band
+double getResamplerPassband(const struct resampler *r);
+
+// Move to an output frame. Returns the input frame the source must read
+// from next (the frames before input frame 0 are silence).
+long long seekResampler(struct resampler *r, long long outFrame);
+
+// Write frames output frames (interleaved float) to out, reading input
+// from source as needed. Past the end of the source, the input is silent.
+void readResampler(
+    struct resampler *r,
+    float *out,
+    size_t frames,
+    resamplerSource *source,
+    void *data
+);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* resampler_h */
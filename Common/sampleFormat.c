@@ -0,0 +1,208 @@
+//
+//  sampleFormat.c
+//
+//  Helpers for the sample formats the players can pass through.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <sndfile.h>
+#include "sampleFormat.h"
+#include "audioKernels.h"
+
+// Size of a sample in bytes, or 0 if the format is not supported
+size_t getSampleSize(PaSampleFormat format) {
+    
+    switch (format) {
+        case paFloat32:
+        case paInt32:
+            return 4;
+        case paInt24:
+            return 3;
+        case paInt16:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+// Name of a sample format (for messages)
+const char* getSampleFormatName(PaSampleFormat format) {
+    
+    switch (format) {
+        case paFloat32:
+            return "float32";
+        case paInt32:
+            return "int32";
+        case paInt24:
+            return "int24";
+        case paInt16:
+            return "int16";
+        default:
+            return "unsupported";
+    }
+}
+
+// The format that holds a file's samples without conversion
+PaSampleFormat getNativeSampleFormat(int sfFormat) {
+    
+    // the subtype is the encoding, whatever the container
+    switch (sfFormat & SF_FORMAT_SUBMASK) {
+        case SF_FORMAT_PCM_16:
+            return paInt16;
+        case SF_FORMAT_PCM_24:
+            return paInt24;
+        case SF_FORMAT_PCM_32:
+            return paInt32;
+        default:
+            return paFloat32;
+    }
+}
+
+// Pack 32-bit samples (with the data in the top 24 bits) into paInt24
+void packInt24(void *dst, const int *src, size_t samples) {
+    
+    unsigned char *p = (unsigned char *) dst;
+    
+    for (size_t i = 0; i < samples; i++, p += 3) {
+        unsigned int v = (unsigned int) src[i];
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        p[0] = (unsigned char) (v >> 24);
+        p[1] = (unsigned char) (v >> 16);
+        p[2] = (unsigned char) (v >> 8);
+#else
+        p[0] = (unsigned char) (v >> 8);
+        p[1] = (unsigned char) (v >> 16);
+        p[2] = (unsigned char) (v >> 24);
+#endif
+    }
+}
+
+// Sample as a double in [-1, 1)
+static double loadSample(const unsigned char *p, PaSampleFormat format) {
+    
+    switch (format) {
+        case paInt16: {
+            int16_t v;
+            memcpy(&v, p, sizeof(v));
+            return v / 32768.0;
+        }
+        case paInt24: {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            uint32_t u = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+                (uint32_t) p[2] << 8;
+#else
+            uint32_t u = (uint32_t) p[2] << 24 | (uint32_t) p[1] << 16 |
+                (uint32_t) p[0] << 8;
+#endif
+            return (int32_t) u / 2147483648.0;
+        }
+        case paInt32: {
+            int32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v / 2147483648.0;
+        }
+        default: {
+            float v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+    }
+}
+
+// Round and clip a scaled sample to the range of an integer format
+static int32_t roundSample(double scaled, int32_t largest) {
+    
+    scaled += scaled < 0.0 ? -0.5 : 0.5;
+    if (scaled >= largest)
+        return largest;
+    if (scaled <= -(double) largest - 1.0)
+        return -largest - 1;
+    
+    return (int32_t) scaled;
+}
+
+// Store a sample given as a double in [-1, 1)
+static void storeSample(unsigned char *p, double value, PaSampleFormat format) {
+    
+    switch (format) {
+        case paInt16: {
+            int16_t v = (int16_t) roundSample(value * 32768.0, INT16_MAX);
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case paInt24: {
+            // packInt24() takes the top 24 bits of a 32-bit sample
+            int v = (int) ((uint32_t) roundSample(value * 8388608.0, 0x7fffff) << 8);
+            packInt24(p, &v, 1);
+            break;
+        }
+        case paInt32: {
+            int32_t v = roundSample(value * 2147483648.0, INT32_MAX);
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+        default: {
+            float v = (float) value;
+            memcpy(p, &v, sizeof(v));
+            break;
+        }
+    }
+}
+
+// Crossfade from src into dst, in place
+void crossfadeFrames(
+    void *dst,
+    const void *src,
+    const float *gains,
+    size_t frames,
+    unsigned int channels,
+    PaSampleFormat format
+) {
+    
+    size_t sampleSize = getSampleSize(format);
+    unsigned char *out = (unsigned char *) dst;
+    const unsigned char *in = (const unsigned char *) src;
+    
+    for (size_t f = 0; f < frames; f++) {
+        double gain = gains[f];
+        for (unsigned int c = 0; c < channels; c++) {
+            double mixed = loadSample(in, format) * (1.0 - gain) +
+                loadSample(out, format) * gain;
+            storeSample(out, mixed, format);
+            in += sampleSize;
+            out += sampleSize;
+        }
+    }
+}
+
+// Copy frames with a (ramped) gain
+void scaleFrames(
+    void *dst,
+    const void *src,
+    size_t frames,
+    unsigned int channels,
+    PaSampleFormat format,
+    double gain,
+    double step
+) {
+    
+    size_t sampleSize = getSampleSize(format);
+    unsigned char *out = (unsigned char *) dst;
+    const unsigned char *in = (const unsigned char *) src;
+    
+    // float is the common case, and needs no rounding or clipping
+    if (format == paFloat32) {
+        getAudioKernels()->gainRamp((float *) dst, (const float *) src, frames,
+            channels, (float) gain, (float) step);
+        return;
+    }
+    
+    for (size_t f = 0; f < frames; f++, gain += step) {
+        for (unsigned int c = 0; c < channels; c++) {
+            storeSample(out, loadSample(in, format) * gain, format);
+            in += sampleSize;
+            out += sampleSize;
+        }
+    }
+}
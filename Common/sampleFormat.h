@@ -0,0 +1,62 @@
+//
+//  sampleFormat.h
+//
+//  Helpers for the PortAudio sample formats the players can pass through
+//  from file to device without converting to float: paFloat32, paInt16,
+//  paInt24 (packed, native byte order) and paInt32, all interleaved.
+//
+
+#ifndef sampleFormat_h
+#define sampleFormat_h
+
+#include <stddef.h>
+#include <portaudio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Size of a sample in bytes, or 0 if the format is not supported
+size_t getSampleSize(PaSampleFormat format);
+
+// Name of a sample format (for messages)
+const char* getSampleFormatName(PaSampleFormat format);
+
+// The format that holds a file's samples without conversion, from the
+// subtype of a libsndfile format (paFloat32 if there is no integer match)
+PaSampleFormat getNativeSampleFormat(int sfFormat);
+
+// Pack 32-bit samples (with the data in the top 24 bits) into paInt24
+void packInt24(void *dst, const int *src, size_t samples);
+
+// Crossfade from the frames in src into those in dst, in place: each sample
+// of dst becomes src * (1 - gain) + dst * gain, with one gain per frame.
+// Integer samples are rounded and clipped.
+void crossfadeFrames(
+    void *dst,
+    const void *src,
+    const float *gains,
+    size_t frames,
+    unsigned int channels,
+    PaSampleFormat format
+);
+
+// Copy frames from src to dst (which may be the same), multiplying them by
+// a gain that starts at gain and changes by step each frame. Integer
+// samples are rounded and clipped; float samples go through the gainRamp
+// kernel (audioKernels.h).
+void scaleFrames(
+    void *dst,
+    const void *src,
+    size_t frames,
+    unsigned int channels,
+    PaSampleFormat format,
+    double gain,
+    double step
+);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* sampleFormat_h */
@@ -0,0 +1,156 @@
+//
+//  startPolicy.c
+//
+//  How much audio the ring-buffer players read before starting the stream.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pa_util.h>
+#include "audioPlayerUtil.h"
+#include "playerConfig.h"
+#include "playerStream.h"
+#include "startPolicy.h"
+
+// Device buffers the prime covers if BAP_START_BUFFERS is not set
+#define DEFAULT_START_BUFFERS (2.0)
+
+// Set up the policy
+void initStartPolicy(
+    struct startPolicy *s,
+    double sampleRate,
+    unsigned long framesPerBuffer,
+    size_t maxFrames
+) {
+    
+    const char *policy = getConfigString("BAP_START",
+        getPlayerSink() == SINK_DEVICE ? "fast" : "full");
+    int fast = strcmp(policy, "full") != 0;
+    double startBuffers =
+        getConfigDouble("BAP_START_BUFFERS", DEFAULT_START_BUFFERS);
+    
+    *s = (struct startPolicy) {
+        .fast = fast,
+        .phase = fast ? START_MEASURE : START_DONE,
+        .framesPerBuffer = framesPerBuffer,
+        .sampleRate = sampleRate,
+        .startBuffers = startBuffers >= 0.0 ?
+            startBuffers : DEFAULT_START_BUFFERS,
+        .maxFrames = maxFrames,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .readyCond = PTHREAD_COND_INITIALIZER
+    };
+}
+
+// How many frames of a refill to read
+size_t beginStartRefill(
+    struct startPolicy *s,
+    size_t framesWanted,
+    size_t framesBuffered
+) {
+    
+    size_t limit = framesWanted;
+    
+    switch (s->phase) {
+        case START_MEASURE:
+            // one device buffer, to time
+            limit = s->framesPerBuffer;
+            s->primeStart = PaUtil_GetTime();
+            break;
+        case START_PRIME:
+            limit = s->startFrames - framesBuffered;
+            break;
+        case START_GROW:
+            // no more than the ring holds, so that the callback can't drain
+            // it before the read is done (unless reading is slower than
+            // real time, when nothing would help)
+            limit = framesBuffered > s->framesPerBuffer ?
+                framesBuffered : s->framesPerBuffer;
+            if (framesWanted <= limit)
+                s->phase = START_DONE;
+            break;
+        case START_DONE:
+            break;
+    }
+    s->refillStart = PaUtil_GetTime();
+    
+    return min(limit, framesWanted);
+}
+
+// Let the stream start
+void releaseStart(struct startPolicy *s) {
+    
+    pthread_mutex_lock(&s->lock);
+    if (!s->ready) {
+        if (s->fast)
+            s->primeTime = PaUtil_GetTime() - s->primeStart;
+        s->ready = 1;
+        pthread_cond_broadcast(&s->readyCond);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Note a finished refill
+void endStartRefill(struct startPolicy *s, size_t framesBuffered) {
+    
+    if (s->phase == START_MEASURE) {
+        // enough for a couple of device buffers, plus enough to last while
+        // the reader takes as long again as the first block took
+        s->readLatency = PaUtil_GetTime() - s->refillStart;
+        double frames = s->startBuffers * s->framesPerBuffer +
+            s->readLatency * s->sampleRate;
+        s->startFrames = (size_t) ceil(frames);
+        if (s->startFrames > s->maxFrames)
+            s->startFrames = s->maxFrames;
+        if (s->startFrames < framesBuffered)
+            s->startFrames = framesBuffered;
+        s->phase = START_PRIME;
+    }
+    if (s->phase == START_PRIME && framesBuffered >= s->startFrames)
+        s->phase = START_GROW;
+    
+    if (s->phase != START_MEASURE && s->phase != START_PRIME && !s->ready)
+        releaseStart(s);
+}
+
+// Whether to refill again straight away
+int isStartGrowing(
+    struct startPolicy *s,
+    size_t framesBuffered,
+    size_t highWatermark
+) {
+    
+    // the ring can be full before the fill has caught up with the
+    // watermarks (e.g. after a seek), and then there's nothing to grow
+    if (s->phase == START_GROW && framesBuffered >= highWatermark)
+        s->phase = START_DONE;
+    
+    return s->phase != START_DONE;
+}
+
+// Whether the stream can start
+int isStartReady(const struct startPolicy *s) {
+    
+    return s->ready;
+}
+
+// Block until the stream can start
+void waitForStart(struct startPolicy *s) {
+    
+    pthread_mutex_lock(&s->lock);
+    while (!s->ready)
+        pthread_cond_wait(&s->readyCond, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Print the policy and what it primed
+void printStartPolicy(const struct startPolicy *s) {
+    
+    if (s->fast)
+        printf("Start: fast, primed %zu frames (%g buffers plus %.2f ms "
+            "measured reader latency) in %.2f ms\n", s->startFrames,
+            s->startBuffers, 1e3 * s->readLatency, 1e3 * s->primeTime);
+    else
+        printf("Start: full (ring filled before the stream started)\n");
+}
@@ -0,0 +1,107 @@
+//
+//  startPolicy.h
+//
+//  How much audio the ring-buffer players read before they start the
+//  stream. With the `full` policy the ring is filled to its high watermark
+//  first, so the first sample waits for a large read. With the `fast`
+//  policy the reader times a first block of one device buffer, primes just
+//  enough frames to cover BAP_START_BUFFERS device buffers plus the time
+//  that block took (the reader's measured latency), and lets the stream
+//  start; it then grows the fill in the background, reading no more at a
+//  time than the ring already holds, so that each read is done before the
+//  callback can drain what was there, until the ring reaches its high
+//  watermark and the usual refills take over.
+//
+//  Offline sinks usually render faster than real time, and would drain a
+//  primed prefix before the reader could add to it, so they start `full`
+//  unless BAP_START says otherwise.
+//
+//  BAP_START:          `fast` or `full` (fast for devices, full offline)
+//  BAP_START_BUFFERS:  device buffers the prime covers, besides the reader's
+//                      latency (2)
+//
+
+#ifndef startPolicy_h
+#define startPolicy_h
+
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Where the reader is in starting
+typedef enum {
+    START_MEASURE,      // timing the first block
+    START_PRIME,        // reading up to startFrames
+    START_GROW,         // stream started; growing the fill
+    START_DONE          // refilling as usual
+} startPhase;
+
+// struct type for the start policy, shared by the reader and the thread
+// that starts the stream
+struct startPolicy {
+    int             fast;           // prime a prefix, rather than fill
+    startPhase      phase;          // reader side
+    unsigned long   framesPerBuffer;
+    double          sampleRate;
+    double          startBuffers;   // device buffers the prime covers
+    size_t          maxFrames;      // most the prime can be (high watermark)
+    size_t          startFrames;    // frames primed before the start
+    double          readLatency;    // time the first block took (s)
+    double          refillStart;    // when the current refill began
+    double          primeStart;     // when the first block began
+    double          primeTime;      // time taken to prime (s)
+    int             ready;          // the stream can start
+    pthread_mutex_t lock;
+    pthread_cond_t  readyCond;
+};
+
+// Set up the policy from BAP_START and BAP_START_BUFFERS. maxFrames is the
+// ring's high watermark.
+void initStartPolicy(
+    struct startPolicy *s,
+    double sampleRate,
+    unsigned long framesPerBuffer,
+    size_t maxFrames
+);
+
+// Called by the reader as it begins a refill of framesWanted frames, with
+// framesBuffered in the ring; returns how many it should read
+size_t beginStartRefill(
+    struct startPolicy *s,
+    size_t framesWanted,
+    size_t framesBuffered
+);
+
+// Called by the reader once the refill is in the ring, with the fill it
+// left; lets the stream start once enough is primed
+void endStartRefill(struct startPolicy *s, size_t framesBuffered);
+
+// Let the stream start whatever the fill (e.g. the file has been read)
+void releaseStart(struct startPolicy *s);
+
+// Whether the reader should refill again straight away rather than wait
+// for the callback to drain the ring, which holds framesBuffered frames of
+// highWatermark
+int isStartGrowing(
+    struct startPolicy *s,
+    size_t framesBuffered,
+    size_t highWatermark
+);
+
+// Whether the stream can start (reader side, or once waited for)
+int isStartReady(const struct startPolicy *s);
+
+// Block until the stream can start
+void waitForStart(struct startPolicy *s);
+
+// Print the policy and what it primed
+void printStartPolicy(const struct startPolicy *s);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* startPolicy_h */
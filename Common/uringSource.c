@@ -0,0 +1,527 @@
+//
+//  uringSource.c
+//
+//  Asynchronous reads of uncompressed audio files through Linux io_uring.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "audioPlayerUtil.h"
+#include "sampleFormat.h"
+#include "uringSource.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING (1)
+#endif
+#endif
+
+#if defined(HAVE_IO_URING)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Alignment of the read buffers (a page)
+#define URING_BUFFER_ALIGNMENT (4096)
+
+// The ring's indices are shared with the kernel
+static unsigned int loadAcquire(const unsigned int *p) {
+    
+    return atomic_load_explicit((const _Atomic unsigned int *) p,
+        memory_order_acquire);
+}
+
+static void storeRelease(unsigned int *p, unsigned int value) {
+    
+    atomic_store_explicit((_Atomic unsigned int *) p, value,
+        memory_order_release);
+}
+
+// Submit the queued entries, waiting for minComplete completions; returns
+// 0 or an errno value
+static int enterUring(struct uringQueue *q, unsigned int minComplete) {
+    
+    unsigned int flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    
+    while (1) {
+        long submitted = syscall(__NR_io_uring_enter, q->ringFd, q->pending,
+            minComplete, flags, NULL, 0);
+        if (submitted >= 0) {
+            q->pending -= (unsigned int) submitted;
+            return 0;
+        }
+        if (errno != EINTR)
+            return errno;
+    }
+}
+
+// Queue a read of the rest of a slot's block
+static void queueRead(struct uringQueue *q, struct uringSlot *slot) {
+    
+    unsigned int tail = *q->sqTail;
+    unsigned int index = tail & q->sqMask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) q->sqes + index;
+    
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = q->registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = slot->stream->fd;
+    sqe->off = (uint64_t) (slot->offset + (off_t) slot->filled);
+    sqe->addr = (uint64_t) (uintptr_t) (slot->buffer + slot->filled);
+    sqe->len = (uint32_t) (slot->length - slot->filled);
+    sqe->buf_index = 0;
+    sqe->user_data = (uint64_t) (slot - q->slots);
+    
+    q->sqArray[index] = index;
+    storeRelease(q->sqTail, tail + 1);
+    q->pending++;
+    q->reads++;
+}
+
+// Take the completions there are, asking again for what came back short
+static void reapCompletions(struct uringQueue *q) {
+    
+    unsigned int head = *q->cqHead;
+    unsigned int tail = loadAcquire(q->cqTail);
+    
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe =
+            (const struct io_uring_cqe *) q->cqes + (head & q->cqMask);
+        struct uringSlot *slot = &q->slots[cqe->user_data];
+        int result = cqe->res;
+    
+        if (result > 0) {
+            slot->filled += (size_t) result;
+            if (slot->filled < slot->length) {
+                queueRead(q, slot);
+                continue;
+            }
+        }
+        else if (result == -EAGAIN || result == -EINTR) {
+            queueRead(q, slot);
+            continue;
+        }
+        else if (result < 0)
+            slot->error = -result;
+    
+        // done, or short at the end of a truncated file
+        slot->state = URING_SLOT_DONE;
+        q->inFlight--;
+    }
+    storeRelease(q->cqHead, head);
+}
+
+// Whether the kernel's io_uring has an operation (io_uring itself may be
+// older than the reads used here)
+static int isOpSupported(struct uringQueue *q, unsigned int op) {
+    
+    size_t size = sizeof(struct io_uring_probe) +
+        IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe == NULL)
+        return 0;
+    
+    int supported = syscall(__NR_io_uring_register, q->ringFd,
+        IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0 &&
+        op <= probe->last_op && op < probe->ops_len &&
+        (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    
+    return supported;
+}
+
+// Read the rest of a block whose read failed with pread(), so that an
+// error is not taken for the end of the file. Returns 1 if it was read (up
+// to the end of the file), or 0 with slot->error still set.
+static int retrySlot(struct uringStream *s, struct uringSlot *slot) {
+    
+    while (slot->filled < slot->length) {
+        ssize_t n = pread(s->fd, slot->buffer + slot->filled,
+            slot->length - slot->filled, slot->offset + (off_t) slot->filled);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            slot->error = errno;
+            return 0;
+        }
+        if (n == 0)
+            break;
+        slot->filled += (size_t) n;
+    }
+    slot->error = 0;
+    
+    return 1;
+}
+
+// Keep every free slot of a stream reading the next block of the file
+static void fillStream(struct uringStream *s) {
+    
+    struct uringQueue *q = s->queue;
+    unsigned int depth = q->depth;
+    
+    while (s->count < depth && s->nextOffset < s->dataEnd && !s->ended) {
+        struct uringSlot *slot = &s->slots[(s->head + s->count) % depth];
+        size_t remaining = (size_t) (s->dataEnd - s->nextOffset);
+    
+        slot->state = URING_SLOT_READING;
+        slot->offset = s->nextOffset;
+        slot->length = remaining < s->blockBytes ? remaining : s->blockBytes;
+        slot->filled = 0;
+        slot->consumed = 0;
+        slot->error = 0;
+        queueRead(q, slot);
+    
+        s->nextOffset += (off_t) slot->length;
+        s->count++;
+        q->inFlight++;
+        if (q->inFlight > q->maxInFlight)
+            q->maxInFlight = q->inFlight;
+    }
+}
+
+// Wait until none of a stream's slots are being read; returns 0 or the
+// errno of io_uring_enter(), with reads possibly still in flight
+static int drainStream(struct uringStream *s) {
+    
+    struct uringQueue *q = s->queue;
+    
+    for (unsigned int i = 0; i < q->depth; i++) {
+        while (s->slots[i].state == URING_SLOT_READING) {
+            int err = enterUring(q, 1);
+            if (err != 0)
+                return err;
+            reapCompletions(q);
+        }
+    }
+    
+    return 0;
+}
+#endif
+
+// Set up an io_uring
+struct uringQueue* createUringQueue(
+    unsigned int maxStreams,
+    unsigned int depth,
+    size_t blockBytes
+) {
+    
+#if defined(HAVE_IO_URING)
+    if (maxStreams == 0 || depth == 0 || blockBytes == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    
+    struct uringQueue *q = calloc(1, sizeof(struct uringQueue));
+    if (q == NULL)
+        return NULL;
+    q->ringFd = -1;
+    q->depth = depth;
+    q->maxStreams = maxStreams;
+    blockBytes = (blockBytes + URING_BUFFER_ALIGNMENT - 1) &
+        ~(size_t) (URING_BUFFER_ALIGNMENT - 1);
+    q->blockBytes = blockBytes;
+    
+    // one submission entry for every slot, so the ring never fills
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    unsigned int entries = maxStreams * depth;
+    q->ringFd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (q->ringFd < 0) {
+        int err = errno;
+        freeUringQueue(q);
+        errno = err;
+        return NULL;
+    }
+    
+    // map the rings and the submission entries
+    q->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    q->cqMapSize = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (q->cqMapSize > q->sqMapSize)
+            q->sqMapSize = q->cqMapSize;
+        q->cqMapSize = 0;
+    }
+    q->sqMap = mmap(NULL, q->sqMapSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, q->ringFd, IORING_OFF_SQ_RING);
+    q->cqMap = q->cqMapSize == 0 ? q->sqMap :
+        mmap(NULL, q->cqMapSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, q->ringFd, IORING_OFF_CQ_RING);
+    q->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    q->sqes = mmap(NULL, q->sqesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, q->ringFd, IORING_OFF_SQES);
+    if (q->sqMap == MAP_FAILED || q->cqMap == MAP_FAILED ||
+        q->sqes == MAP_FAILED) {
+        int err = errno;
+        freeUringQueue(q);
+        errno = err;
+        return NULL;
+    }
+    
+    unsigned char *sq = (unsigned char *) q->sqMap;
+    unsigned char *cq = (unsigned char *) q->cqMap;
+    q->sqHead = (unsigned int *) (sq + params.sq_off.head);
+    q->sqTail = (unsigned int *) (sq + params.sq_off.tail);
+    q->sqMask = *(unsigned int *) (sq + params.sq_off.ring_mask);
+    q->sqArray = (unsigned int *) (sq + params.sq_off.array);
+    q->cqHead = (unsigned int *) (cq + params.cq_off.head);
+    q->cqTail = (unsigned int *) (cq + params.cq_off.tail);
+    q->cqMask = *(unsigned int *) (cq + params.cq_off.ring_mask);
+    q->cqes = cq + params.cq_off.cqes;
+    
+    // plain reads need Linux 5.6; without them there is nothing to do here
+    if (!isOpSupported(q, IORING_OP_READ)) {
+        freeUringQueue(q);
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+    
+    // the buffers, registered so that reads go straight into them; if the
+    // kernel won't pin them, plain reads into them still work
+    q->arenaBytes = (size_t) entries * blockBytes;
+    q->arena = aligned_alloc(URING_BUFFER_ALIGNMENT, q->arenaBytes);
+    q->slots = calloc(entries, sizeof(struct uringSlot));
+    q->streams = calloc(maxStreams, sizeof(struct uringStream));
+    if (q->arena == NULL || q->slots == NULL || q->streams == NULL) {
+        freeUringQueue(q);
+        errno = ENOMEM;
+        return NULL;
+    }
+    struct iovec arena = {.iov_base = q->arena, .iov_len = q->arenaBytes};
+    q->registered = syscall(__NR_io_uring_register, q->ringFd,
+        IORING_REGISTER_BUFFERS, &arena, 1) == 0;
+    if (q->registered && !isOpSupported(q, IORING_OP_READ_FIXED)) {
+        freeUringQueue(q);
+        errno = EOPNOTSUPP;
+        return NULL;
+    }
+    for (unsigned int i = 0; i < entries; i++)
+        q->slots[i].buffer = q->arena + (size_t) i * blockBytes;
+    
+    return q;
+#else
+    (void) maxStreams;
+    (void) depth;
+    (void) blockBytes;
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+// Open a file on a queue
+struct uringStream* openUringStream(
+    struct uringQueue *q,
+    const char fileName[]
+) {
+    
+#if defined(HAVE_IO_URING)
+    if (q->numStreams == q->maxStreams)
+        return NULL;
+    
+    // the memory-mapped reader finds the sample data and its encoding
+    struct mappedAudioFile layout;
+    if (openMappedAudioFile(fileName, &layout, 0.0) != NO_ERROR) {
+        closeMappedAudioFile(&layout);
+        return NULL;
+    }
+    off_t dataOffset = (off_t) (layout.data - layout.map);
+    closeMappedAudioFile(&layout);
+    
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    struct uringStream *s = &q->streams[q->numStreams];
+    *s = (struct uringStream) {
+        .queue = q,
+        .fd = fd,
+        .layout = layout,
+        .frames = layout.frames,
+        .bytesPerFrame = layout.channels * layout.bytesPerSample,
+        .slots = &q->slots[q->numStreams * q->depth]
+    };
+    s->blockBytes = q->blockBytes - q->blockBytes % s->bytesPerFrame;
+    if (s->blockBytes == 0) {
+        close(fd);
+        return NULL;
+    }
+    s->dataEnd = dataOffset + (off_t) (s->frames * s->bytesPerFrame);
+    s->nextOffset = dataOffset;
+    for (unsigned int i = 0; i < q->depth; i++)
+        s->slots[i] = (struct uringSlot) {
+            .stream = s,
+            .buffer = s->slots[i].buffer
+        };
+    q->numStreams++;
+    
+    // start reading straight away
+    fillStream(s);
+    pollUringQueue(q);
+    
+    return s;
+#else
+    (void) q;
+    (void) fileName;
+    return NULL;
+#endif
+}
+
+// Convert frames from the stream's position
+sf_count_t readUringStream(
+    struct uringStream *s,
+    void *buffer,
+    sf_count_t frames,
+    PaSampleFormat format
+) {
+    
+#if defined(HAVE_IO_URING)
+    struct uringQueue *q = s->queue;
+    unsigned char *out = (unsigned char *) buffer;
+    size_t outBytesPerFrame = getSampleSize(format) * s->layout.channels;
+    sf_count_t framesRead = 0;
+    
+    while (framesRead < frames) {
+        fillStream(s);
+        if (s->count == 0)
+            break;
+    
+        // wait for the next block in the file, if it has not arrived
+        struct uringSlot *slot = &s->slots[s->head];
+        if (slot->state == URING_SLOT_READING)
+            s->waits++;
+        while (slot->state == URING_SLOT_READING) {
+            if (enterUring(q, 1) != 0) {
+                s->position += framesRead;
+                return framesRead;
+            }
+            reapCompletions(q);
+        }
+    
+        if (slot->error && !retrySlot(s, slot) && s->error == 0) {
+            s->error = slot->error;
+            printf("Unable to read the audio file: %s\n", strerror(s->error));
+        }
+    
+        size_t available = (slot->filled - slot->consumed) / s->bytesPerFrame;
+        if (available == 0) {
+            // a short block is the end of what can be read; a failed one
+            // stops the stream with the error kept
+            if (slot->filled < slot->length || slot->error)
+                s->ended = 1;
+            slot->state = URING_SLOT_FREE;
+            s->head = (s->head + 1) % q->depth;
+            s->count--;
+            continue;
+        }
+    
+        size_t n = (size_t) (frames - framesRead);
+        if (n > available)
+            n = available;
+        convertMappedSamples(&s->layout, out, slot->buffer + slot->consumed,
+            n * s->layout.channels, format);
+        slot->consumed += n * s->bytesPerFrame;
+        out += n * outBytesPerFrame;
+        framesRead += (sf_count_t) n;
+    }
+    s->position += framesRead;
+    
+    // send the emptied slots for the next blocks
+    fillStream(s);
+    pollUringQueue(q);
+    
+    return framesRead;
+#else
+    (void) s;
+    (void) buffer;
+    (void) frames;
+    (void) format;
+    return 0;
+#endif
+}
+
+// Move the position
+sf_count_t seekUringStream(struct uringStream *s, sf_count_t frame) {
+    
+#if defined(HAVE_IO_URING)
+    if (frame < 0 || frame > s->frames)
+        return -1;
+    
+    // the slots can't be reused while the kernel may still write to them
+    if (drainStream(s) != 0)
+        return -1;
+    for (unsigned int i = 0; i < s->queue->depth; i++)
+        s->slots[i].state = URING_SLOT_FREE;
+    s->head = 0;
+    s->count = 0;
+    s->ended = 0;
+    s->error = 0;
+    s->nextOffset = s->dataEnd - (off_t) ((s->frames - frame) * s->bytesPerFrame);
+    s->position = frame;
+    fillStream(s);
+    pollUringQueue(s->queue);
+    
+    return frame;
+#else
+    (void) s;
+    (void) frame;
+    return -1;
+#endif
+}
+
+// Submit queued reads and take completions, without waiting
+void pollUringQueue(struct uringQueue *q) {
+    
+#if defined(HAVE_IO_URING)
+    if (q->pending > 0)
+        enterUring(q, 0);
+    reapCompletions(q);
+#else
+    (void) q;
+#endif
+}
+
+// Close a stream
+void closeUringStream(struct uringStream *s) {
+    
+#if defined(HAVE_IO_URING)
+    if (s == NULL || s->fd < 0)
+        return;
+    drainStream(s);
+    close(s->fd);
+    s->fd = -1;
+    s->count = 0;
+#else
+    (void) s;
+#endif
+}
+
+// Close the io_uring and free the queue
+void freeUringQueue(struct uringQueue *q) {
+    
+    if (q == NULL)
+        return;
+    
+#if defined(HAVE_IO_URING)
+    for (unsigned int i = 0; i < q->numStreams; i++)
+        closeUringStream(&q->streams[i]);
+    if (q->sqes != NULL && q->sqes != MAP_FAILED)
+        munmap(q->sqes, q->sqesSize);
+    if (q->cqMap != NULL && q->cqMap != MAP_FAILED && q->cqMap != q->sqMap)
+        munmap(q->cqMap, q->cqMapSize);
+    if (q->sqMap != NULL && q->sqMap != MAP_FAILED)
+        munmap(q->sqMap, q->sqMapSize);
+    if (q->ringFd >= 0)
+        close(q->ringFd);
+#endif
+    free(q->arena);
+    free(q->slots);
+    free(q->streams);
+    free(q);
+}
@@ -0,0 +1,158 @@
+//
+//  uringSource.h
+//
+//  Asynchronous reads of uncompressed WAV and AIFF files through Linux
+//  io_uring. A queue owns one io_uring and an arena of read buffers,
+//  registered with the kernel once so that reads go straight into them
+//  (IORING_OP_READ_FIXED). Each stream opened on the queue gets `depth` of
+//  those buffers and keeps every one of them in flight, reading ahead of
+//  the position it is consumed from, so a queue serving many streams keeps
+//  many reads in flight at once, and the device's queue depth is used
+//  rather than one blocking read at a time. Consuming a stream converts
+//  completed buffers, in file order, straight into the caller's buffer
+//  (typically a ring's write region) and sends each emptied buffer back
+//  for the next block of the file. Only the reader that consumes a stream
+//  waits, and only if its next block has not arrived yet.
+//
+//  The headers are parsed by the memory-mapped reader, which also does the
+//  sample conversion. Compressed files, or systems without io_uring, are
+//  left to libsndfile: createUringQueue() and openUringStream() return
+//  NULL, and the caller uses the blocking path.
+//
+//  A queue is used by one thread at a time.
+//
+
+#ifndef uringSource_h
+#define uringSource_h
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <portaudio.h>
+#include <sndfile.h>
+#include "mappedAudioFile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// Reads each stream keeps in flight if BAP_URING_DEPTH is not set
+#define DEFAULT_URING_DEPTH (4.0)
+
+// Size of each of those reads if BAP_URING_BLOCK_KB is not set
+#define DEFAULT_URING_BLOCK_KB (64.0)
+
+struct uringQueue;
+struct uringStream;
+
+// Where a read buffer is
+typedef enum {
+    URING_SLOT_FREE,
+    URING_SLOT_READING,
+    URING_SLOT_DONE
+} uringSlotState;
+
+// struct type for a read buffer and the block of the file it holds
+struct uringSlot {
+    struct uringStream  *stream;
+    unsigned char       *buffer;    // in the registered arena
+    uringSlotState      state;
+    off_t               offset;     // of the block in the file
+    size_t              length;     // bytes asked for
+    size_t              filled;     // bytes read so far
+    size_t              consumed;   // bytes taken by readUringStream()
+    int                 error;      // errno, if the read failed
+};
+
+// struct type for a file read through a queue
+struct uringStream {
+    struct uringQueue   *queue;
+    int                 fd;
+    struct mappedAudioFile layout;  // channels, rate and sample encoding
+    sf_count_t          frames;
+    size_t              bytesPerFrame;
+    size_t              blockBytes; // whole frames
+    off_t               dataEnd;    // end of the sample data in the file
+    struct uringSlot    *slots;     // depth of them, used in turn
+    unsigned int        head;       // next slot to consume
+    unsigned int        count;      // slots reading or holding data
+    off_t               nextOffset; // of the next block to ask for
+    sf_count_t          position;   // next frame readUringStream() returns
+    int                 ended;      // a read came back short or failed
+    int                 error;      // errno, if a read failed even retried
+    unsigned long       waits;      // reads that had to wait for a block
+};
+
+// struct type for an io_uring and the streams it serves
+struct uringQueue {
+    int                 ringFd;
+    void                *sqMap;     // submission ring
+    size_t              sqMapSize;
+    void                *cqMap;     // completion ring (may be sqMap)
+    size_t              cqMapSize;
+    void                *sqes;      // submission entries
+    size_t              sqesSize;
+    unsigned int        *sqHead, *sqTail, *sqArray, sqMask;
+    unsigned int        *cqHead, *cqTail, cqMask;
+    void                *cqes;
+    unsigned int        pending;    // entries queued but not submitted
+    unsigned int        inFlight;   // slots being read
+    unsigned int        maxInFlight;
+    unsigned char       *arena;     // the read buffers
+    size_t              arenaBytes;
+    int                 registered; // the arena is registered (READ_FIXED)
+    unsigned int        depth;      // slots per stream
+    size_t              blockBytes; // size of a slot
+    struct uringSlot    *slots;     // depth per stream
+    struct uringStream  *streams;
+    unsigned int        maxStreams;
+    unsigned int        numStreams; // opened so far
+    unsigned long long  reads;      // reads submitted
+};
+
+// Set up an io_uring for up to maxStreams streams, each with depth reads
+// of blockBytes in flight. Returns NULL if io_uring, or the reads it needs,
+// are not available (or there is no memory); errno says why.
+struct uringQueue* createUringQueue(
+    unsigned int maxStreams,
+    unsigned int depth,
+    size_t blockBytes
+);
+
+// Open an uncompressed WAV or AIFF file on a queue and start reading it.
+// Returns NULL if the file can't be read this way or the queue is full.
+struct uringStream* openUringStream(
+    struct uringQueue *q,
+    const char fileName[]
+);
+
+// Convert up to frames frames, from the stream's position, to the given
+// interleaved sample format, waiting for blocks that are still being read.
+// A block whose read fails is read again with pread(); if that fails too,
+// the stream stops there with error set. Returns the number of frames read
+// (0 at the end of the file, or after an error).
+sf_count_t readUringStream(
+    struct uringStream *s,
+    void *buffer,
+    sf_count_t frames,
+    PaSampleFormat format
+);
+
+// Move the position (blocks in flight are waited for and dropped). Returns
+// the new position, or -1 if out of range or the blocks in flight could not
+// be waited for, in which case the stream is left as it was.
+sf_count_t seekUringStream(struct uringStream *s, sf_count_t frame);
+
+// Submit any reads queued, and take any completions, without waiting
+void pollUringQueue(struct uringQueue *q);
+
+// Close a stream (its slots are not reused)
+void closeUringStream(struct uringStream *s);
+
+// Close the io_uring and free the queue
+void freeUringQueue(struct uringQueue *q);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* uringSource_h */
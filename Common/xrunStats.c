@@ -0,0 +1,137 @@
+//
+//  xrunStats.c
+//
+//  Glitch accounting for the stream callbacks.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <pa_util.h>
+#include "xrunStats.h"
+
+// Reset the counters
+void initXrunStats(struct xrunStats *stats) {
+    
+    PaUtil_InitializeClock();
+    
+    atomic_init(&stats->callbacks, 0);
+    atomic_init(&stats->starvedCallbacks, 0);
+    atomic_init(&stats->shortFrames, 0);
+    atomic_init(&stats->outputUnderflows, 0);
+    atomic_init(&stats->outputOverflows, 0);
+    stats->publishedStarved = 0;
+    stats->publishedUnderflows = 0;
+    stats->publishedOverflows = 0;
+    stats->startTime = PaUtil_GetTime();
+}
+
+// Zero-fill the shortfall and count it (callback side)
+void countCallback(
+    struct xrunStats *stats,
+    void *outputBuffer,
+    size_t bytesPerFrame,
+    unsigned long framesWritten,
+    unsigned long framesPerBuffer,
+    PaStreamCallbackFlags statusFlags,
+    int finishing
+) {
+    
+    // only the callback writes the counters, and nothing orders other memory
+    // by them, so relaxed increments are enough
+    atomic_fetch_add_explicit(&stats->callbacks, 1, memory_order_relaxed);
+    
+    if (framesWritten < framesPerBuffer) {
+        // PortAudio doesn't clear the buffer; libc's memset is vectorised
+        memset((unsigned char *) outputBuffer + framesWritten * bytesPerFrame,
+            0, (framesPerBuffer - framesWritten) * bytesPerFrame);
+        
+        if (!finishing) {
+            atomic_fetch_add_explicit(&stats->starvedCallbacks, 1,
+                memory_order_relaxed);
+            atomic_fetch_add_explicit(&stats->shortFrames,
+                framesPerBuffer - framesWritten, memory_order_relaxed);
+        }
+    }
+    
+    if (statusFlags & paOutputUnderflow)
+        atomic_fetch_add_explicit(&stats->outputUnderflows, 1,
+            memory_order_relaxed);
+    if (statusFlags & paOutputOverflow)
+        atomic_fetch_add_explicit(&stats->outputOverflows, 1,
+            memory_order_relaxed);
+}
+
+// Zero-fill the shortfall in each channel and count it (callback side)
+void countPlanarCallback(
+    struct xrunStats *stats,
+    void *const *outputBuffers,
+    unsigned int channels,
+    size_t bytesPerSample,
+    unsigned long framesWritten,
+    unsigned long framesPerBuffer,
+    PaStreamCallbackFlags statusFlags,
+    int finishing
+) {
+    
+    // the first channel is filled, and the callback counted, as usual
+    for (unsigned int c = 1; c < channels && framesWritten < framesPerBuffer;
+        c++) {
+        memset((unsigned char *) outputBuffers[c] +
+            framesWritten * bytesPerSample, 0,
+            (framesPerBuffer - framesWritten) * bytesPerSample);
+    }
+    countCallback(stats, outputBuffers[0], bytesPerSample, framesWritten,
+        framesPerBuffer, statusFlags, finishing);
+}
+
+// Print any glitches since the last call (non-real-time side)
+void publishXrunStats(struct xrunStats *stats) {
+    
+    unsigned long starved = atomic_load_explicit(&stats->starvedCallbacks,
+        memory_order_relaxed);
+    unsigned long underflows = atomic_load_explicit(&stats->outputUnderflows,
+        memory_order_relaxed);
+    unsigned long overflows = atomic_load_explicit(&stats->outputOverflows,
+        memory_order_relaxed);
+    
+    if (starved != stats->publishedStarved ||
+        underflows != stats->publishedUnderflows ||
+        overflows != stats->publishedOverflows) {
+        printf("Glitches by %.1f s: %lu starved callbacks, %lu output underflows, "
+            "%lu output overflows\n",
+            PaUtil_GetTime() - stats->startTime,
+            starved - stats->publishedStarved,
+            underflows - stats->publishedUnderflows,
+            overflows - stats->publishedOverflows);
+        stats->publishedStarved = starved;
+        stats->publishedUnderflows = underflows;
+        stats->publishedOverflows = overflows;
+    }
+}
+
+// Print a summary of the glitches
+void printXrunStats(const struct xrunStats *stats) {
+    
+    printf("Callbacks: %lu, starved: %lu (%lu frames of silence), "
+        "output underflows: %lu, output overflows: %lu\n",
+        atomic_load(&stats->callbacks),
+        atomic_load(&stats->starvedCallbacks),
+        atomic_load(&stats->shortFrames),
+        atomic_load(&stats->outputUnderflows),
+        atomic_load(&stats->outputOverflows));
+}
+
+// Write the counters as JSON members
+void writeXrunStatsJson(const struct xrunStats *stats, FILE *file) {
+    
+    fprintf(file, "  \"callbacks\": %lu,\n"
+        "  \"starvedCallbacks\": %lu,\n"
+        "  \"shortFrames\": %lu,\n"
+        "  \"outputUnderflows\": %lu,\n"
+        "  \"outputOverflows\": %lu",
+        atomic_load(&stats->callbacks),
+        atomic_load(&stats->starvedCallbacks),
+        atomic_load(&stats->shortFrames),
+        atomic_load(&stats->outputUnderflows),
+        atomic_load(&stats->outputOverflows));
+}
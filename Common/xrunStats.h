@@ -0,0 +1,83 @@
+//
+//  xrunStats.h
+//
+//  Glitch accounting for the stream callbacks. The callback counts the
+//  callbacks it could not fill (zero-filling the shortfall rather than
+//  leaving stale data in the output buffer) and the underflow/overflow flags
+//  PortAudio passes it, using wait-free atomic counters. A non-real-time
+//  thread (the players' main loop) publishes the counters while playing and
+//  prints a summary at the end.
+//
+
+#ifndef xrunStats_h
+#define xrunStats_h
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <portaudio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+// struct type for the counters; written by the callback only
+struct xrunStats {
+    atomic_ulong    callbacks;          // callbacks made
+    atomic_ulong    starvedCallbacks;   // callbacks short of frames
+    atomic_ulong    shortFrames;        // frames of silence filled in
+    atomic_ulong    outputUnderflows;   // paOutputUnderflow flags
+    atomic_ulong    outputOverflows;    // paOutputOverflow flags
+    
+    // last values published, only touched by the publishing thread
+    unsigned long   publishedStarved;
+    unsigned long   publishedUnderflows;
+    unsigned long   publishedOverflows;
+    double          startTime;
+};
+
+// Reset the counters
+void initXrunStats(struct xrunStats *stats);
+
+// Called from the callback once it has written framesWritten of the
+// framesPerBuffer frames: zero-fills the rest of the output and counts the
+// shortfall (unless the stream is finishing, when a short final buffer is
+// expected) and the status flags. Wait-free.
+void countCallback(
+    struct xrunStats *stats,
+    void *outputBuffer,
+    size_t bytesPerFrame,
+    unsigned long framesWritten,
+    unsigned long framesPerBuffer,
+    PaStreamCallbackFlags statusFlags,
+    int finishing
+);
+
+// As countCallback(), for a paNonInterleaved stream: the output is one
+// buffer per channel, of bytesPerSample samples
+void countPlanarCallback(
+    struct xrunStats *stats,
+    void *const *outputBuffers,
+    unsigned int channels,
+    size_t bytesPerSample,
+    unsigned long framesWritten,
+    unsigned long framesPerBuffer,
+    PaStreamCallbackFlags statusFlags,
+    int finishing
+);
+
+// Called periodically from a non-real-time thread: prints any glitches
+// since the last call
+void publishXrunStats(struct xrunStats *stats);
+
+// Print a summary of the glitches
+void printXrunStats(const struct xrunStats *stats);
+
+// Write the counters as members of a JSON object (see playerStats.h)
+void writeXrunStatsJson(const struct xrunStats *stats, FILE *file);
+
+#ifdef __cplusplus
+}		/* extern "C" */
+#endif	/* __cplusplus */
+
+#endif /* xrunStats_h */